@@ -1,6 +1,27 @@
 // This is the main DLL file.
 #include "stdafx.h"
 #include "Advanced Samples2.h"
+#include "Array Span.h"
+#include "Result Array.h"
+#include "Result Cache.h"
+#include "Signal Array.h"
+#include "Kernels/Averages.h"
+#include "Kernels/EquityAnalytics.h"
+#include "Kernels/Incremental.h"
+#include "Kernels/Optimizer.h"
+#include "Kernels/Positions.h"
+#include "Kernels/Price.h"
+#include "Kernels/Profiler.h"
+#include "Kernels/RecursiveFilter.h"
+#include "Kernels/RollingWindow.h"
+#include "Kernels/ScratchArena.h"
+#include "Kernels/Signals.h"
+#include "Kernels/TimeFrame.h"
+#include "Kernels/WalkForward.h"
+
+#include <algorithm>
+#include <vector>
+#include <msclr/marshal_cppstd.h>
 
 namespace AmiBroker
 {
@@ -36,16 +57,20 @@ namespace AmiBroker
 			ATArray^ high = ABHost::GetStockArray(StockField::High);
 			ATArray^ low = ABHost::GetStockArray(StockField::Low);
 
+			Kernels::ProfileScope profile("AdvancedSampleVC2", close->Length);
+
 			// calculate typical price from bar price data
-			ATArray^ myTypicalPrice = (high + low + 2 * close) / 4;
+			ATArray^ myTypicalPrice = NewResultArray();
+			Kernels::TypicalPrice(high->Array, low->Array, close->Array, myTypicalPrice->Array, myTypicalPrice->Length);
 
 			ATArray^ mySlowMa;
 
 			// calculate slow average of typical price
 			//mySlowMa = AFAvg::Ma(myTypicalPrice, period);              // the easy way using AFAvg
-			ATVar result = ABHost::CallFunction("MA"                     // the hard way using ABHost
-				, ATVar(myTypicalPrice)
-				, ATVar(period));
+			cli::array<ATVar>^ arguments = maFunction->CreateArguments();  // the hard way using ABHost
+			arguments[0] = ATVar(myTypicalPrice);                          // through a cached function handle
+			arguments[1] = ATVar(period);                                  // (see "Function Handle.h")
+			ATVar result = maFunction->Invoke(arguments);
 			mySlowMa = result.GetArray();
 
 			// set MySlowMa AFL variable
@@ -82,8 +107,12 @@ namespace AmiBroker
 		/// NOTE: If you use ABParameterType::FloatOrArray type for any of the parameters, 
 		/// all ABParameterType::Float parameters may receive ATArray^ parameters as well! 
 		/// In such case you should check parameter types in you code!
+		/// 
+		/// The slow average of typical price is shared with BasicSampleVC2 and BasicSampleVC9 through the result cache
+		/// (see [CachedResult] and "Result Cache.h").
 		/// </summary>
 		[ABMethod]
+		[CachedResult]
 		[ABParameter(0, Type = ABParameterType::Array, Description = "Array to calc Ema")]
 		[ABParameter(1, Type = ABParameterType::Float, Description = "Ema period")]
 		[ABParameter(2, Type = ABParameterType::Float, Description = "Ma period")]
@@ -101,35 +130,60 @@ namespace AmiBroker
 				ATArray^ high = ABHost::GetStockArray(StockField::High);
 				ATArray^ low = ABHost::GetStockArray(StockField::Low);
 
-				// calculate typical price from bar price data
-				ATArray^ myTypicalPrice = (high + low + 2 * close) / 4;
+				Kernels::ProfileScope profile("AdvancedSampleVC3", close->Length);
 
-				// calculate slow average of typical price
-				ATArray^ mySlowMa = AFAvg::Ma(myTypicalPrice, myMaPeriod);
+				Kernels::ResultKey key("TypicalPriceMa");
+				key.AddInput(high->Array, high->Length);
+				key.AddInput(low->Array, low->Length);
+				key.AddInput(close->Array, close->Length);
+				key.AddParameter((float)(int)myMaPeriod);
+
+				ATArray^ mySlowMa = NewResultArray();
+				if (!ResultCache::Get(MethodBase::GetCurrentMethod(), key, mySlowMa))
+				{
+					// calculate typical price from bar price data into scratch memory (see BasicSampleVC2)
+					Kernels::ScratchScope scratch;
+					Kernels::Span<float> myTypicalPrice = scratch.Allocate<float>(mySlowMa->Length);
+					Kernels::TypicalPrice(high->Array, low->Array, close->Array, myTypicalPrice.Data(), myTypicalPrice.Length());
+
+					// calculate slow average of typical price
+					Kernels::Ma(myTypicalPrice.Data(), mySlowMa->Array, mySlowMa->Length, (int)myMaPeriod);
+					ResultCache::Put(MethodBase::GetCurrentMethod(), key, mySlowMa);
+				}
 
 				// plotting average typical price
 				AFGraph::Plot(mySlowMa, "SlowMa", Color::Red, Style::Thick);
 
 				// calculate fast average of close price
-				ATArray^ myFastEma = AFAvg::Ema(myEmaArray, myEmaPeriod);
+				ATArray^ myFastEma = NewResultArray();
+				Kernels::Ema(myEmaArray->Array, myFastEma->Array, myFastEma->Length, (int)myEmaPeriod);
+
+				// the condition and the signals are packed bit vectors (Kernels\Signals.h, see BasicSampleVC9),
+				// expanded to arrays only for AmiBroker
+				Kernels::ScratchScope signalScratch;
+				int words = Kernels::SignalWords(close->Length);
+				Kernels::Span<std::uint64_t> emaAbove = signalScratch.Allocate<std::uint64_t>(words);
+				Kernels::Span<std::uint64_t> buySignal = signalScratch.Allocate<std::uint64_t>(words);
+				Kernels::Span<std::uint64_t> shortSignal = signalScratch.Allocate<std::uint64_t>(words);
 
 				// plotting fast average close price with alternating color
+				Kernels::Compare(mySlowMa->Array, myFastEma->Array, Kernels::Comparison::Less, emaAbove.Data(), close->Length);
 				AFGraph::Plot(myFastEma, "FastEma",
-					AFTools::Iif(mySlowMa < myFastEma, Color::DarkGreen, Color::Brown),
+					SignalArray(emaAbove.Data(), (float)Color::DarkGreen, (float)Color::Brown),
 					Style::Line);
 
 				// generate signals and set trade prices
-				ATArray^ buy = AFTools::Cross(mySlowMa, myFastEma);
-				ABVars::Buy.Set(buy);
-				ABVars::BuyPrice.Set(gcnew ATArray(close));
+				Kernels::Cross(mySlowMa->Array, myFastEma->Array, buySignal.Data(), close->Length);
+				ABVars::Buy.Set(SignalArray(buySignal.Data()));
+				ABVars::BuyPrice.Set(NewResultArray(close));
 
-				ATArray^ shrt = AFTools::Cross(myFastEma, mySlowMa);
-				ABVars::Short.Set(shrt);
+				Kernels::Cross(myFastEma->Array, mySlowMa->Array, shortSignal.Data(), close->Length);
+				ABVars::Short.Set(SignalArray(shortSignal.Data()));
 				//ABVars::ShortPrice.Set(gcnew ATArray(close)); // same as the next line
-				ATAfl::SaveTo("ShortPrice", gcnew ATArray(close));
+				ATAfl::SaveTo("ShortPrice", NewResultArray(close));
 
-				AFGraph::PlotShapes(buy * (float)Shape::UpArrow, Color::Green, 0, close);
-				AFGraph::PlotShapes(shrt * (float)Shape::DownArrow, Color::Red, 0, close);
+				AFGraph::PlotShapes(SignalArray(buySignal.Data(), Shape::UpArrow), Color::Green, 0, close);
+				AFGraph::PlotShapes(SignalArray(shortSignal.Data(), Shape::DownArrow), Color::Red, 0, close);
 
 				// indicate success
 				return ATVar::Ok;
@@ -147,10 +201,11 @@ namespace AmiBroker
 		/// AdvancedSampleVC4:
 		/// - how to use parameters with default/optional values
 		/// 
-		/// In this sample AB's MA function is called. It has two parameters:
+		/// In this sample a moving average is calculated. It has two parameters:
 		///     Array to calc with.
 		///     Period to calc the average.
 		/// In our DefAvgVC function the period parameter has a default value. So it is not required in AFL.
+		/// The average itself is calculated by the native MA kernel (Kernels\Averages.h).
 		/// </summary>
 		[ABMethod(Name = "DefAvgVC")]
 		[ABParameter(0, Type = ABParameterType::Array, Description = "Array to calculate DefAvg")]
@@ -163,8 +218,15 @@ namespace AmiBroker
 			// if period is not supplied in the AFL script, AB will pass the default value
 			float period = args[1].GetFloat();
 
-			// now we call AB's built-in MA function
-			ATArray^ result = AFAvg::Ma(array, period);
+			Kernels::ProfileScope profile("DefAvgVC", array->Length);
+
+			// checked before the cast, Null does not fit an int; a period longer than the history is Null everywhere
+			if (period == ATFloat::Null || !(period >= 1.0f))
+				throw gcnew ArgumentOutOfRangeException("Period", "Period must be positive.");
+
+			// now we call the native MA kernel
+			ATArray^ result = NewResultArray();
+			Kernels::Ma(array->Array, result->Array, result->Length, (int)std::min(period, (float)array->Length + 1));
 
 			// return result of the MA call
 			return ATVar(result);
@@ -181,6 +243,8 @@ namespace AmiBroker
 		/// DO NOT CALL built-in AmiBroker methods in this way! Use AFxxx static classes instead.
 		/// If you use AFxxx classes, your code can run on all future versions of AmiBroker!
 		///
+		/// The function is called through a FunctionHandle ("Function Handle.h") resolved once when the class is loaded,
+		/// so the name is not encoded again on every call.
 		/// </summary>
 		[ABMethod(Name = "CallMaVC")]
 		[ABParameter(0, Type = ABParameterType::Array, Description = "Array to calculate Ma")]
@@ -193,9 +257,13 @@ namespace AmiBroker
 			// if period is not supplied in the AFL script, AB will pass the default value
 			float period = args[1].GetFloat();
 
-			ATVar result = ABHost::CallFunction("MA", ATVar(array), ATVar(period));
+			Kernels::ProfileScope profile("CallMaVC", array->Length);
+
+			cli::array<ATVar>^ arguments = maFunction->CreateArguments();
+			arguments[0] = ATVar(array);
+			arguments[1] = ATVar(period);
 
-			return result;
+			return maFunction->Invoke(arguments);
 		}
 
 		[ABMethod(Name = "AdvancedLoopSampleVC")]
@@ -204,30 +272,891 @@ namespace AmiBroker
 		{
 			int maPeriod = (int)args[0].GetFloat();
 			ATArray^ close = ABHost::GetStockArray(StockField::Close);
+			ATDateTimeArray^ dates = ABHost::GetDatatimeArray();
+
+			Kernels::ProfileScope profile("AdvancedLoopSampleVC", close->Length);
 
 			// allocate memory for result array
-			ATArray^ myMa = gcnew ATArray();
+			ATArray^ myMa = NewResultArray();
+
+			// continue the running sum of the previous refresh of this symbol (see BasicSampleVC5)
+			Kernels::IncrementalKey key;
+			key.symbol = msclr::interop::marshal_as<std::string>(AFInfo::Name());
+			key.interval = (int)AFTimeFrame::Interval();
+			key.function = Kernels::IncrementalFunction::Ma;
+			key.period = maPeriod;
 
-			// set null values at the beginning of the array
-			for (int i = 0; i < maPeriod - 1 && i < myMa->Length; i++)
-				myMa[i] = ATFloat::Null;
+			// the spans keep close, dates and myMa alive while the kernel uses their buffers (see BasicSampleVC5)
+			Kernels::IncrementalUpdate(key, ArraySpan(close), DateTimeSpan(dates), ArraySpan(myMa));
 
-			// calculate the average for each bar
-			for (int i = maPeriod - 1; i < myMa->Length; i++)
+			// returning result to AFL  script
+			return ATVar(myMa);
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC7:
+		/// - how to use the rolling-window engine for other window functions
+		/// 
+		/// The same engine that calculates the moving average of LoopSampleVC calculates
+		/// Sum, HHV, LLV and StDev at O(BarCount) cost whatever the period.
+		/// HHV and LLV use a monotonic deque, StDev uses Kahan-compensated sums.
+		/// Leading Null values are skipped the same way AFL's built-in functions do.
+		/// 
+		/// Function: 0 = MA, 1 = Sum, 2 = HHV, 3 = LLV, 4 = StDev
+		/// </summary>
+		[ABMethod(Name = "RollingVC")]
+		[ABParameter(0, Type = ABParameterType::Array, Description = "Array to calculate with")]
+		[ABParameter(1, Type = ABParameterType::Float, Description = "Window size")]
+		[ABParameter(2, Type = ABParameterType::Default, Description = "Function (0 = MA, 1 = Sum, 2 = HHV, 3 = LLV, 4 = StDev)", Default = 0)]
+		ATVar AdvancedSamples2::AdvancedSampleVC7(ATArgList args)
+		{
+			try
 			{
-				// clear temporary result
-				float tempSum = 0.0f;
+				ATArray^ array = args[0].GetArray();
+				float window = args[1].GetFloat();
+				int function = (int)args[2].GetFloat();
 
-				// inner loop to sum bar data
-				for (int j = 0; j < maPeriod; j++)
-					tempSum = tempSum + close[i - j];
+				Kernels::ProfileScope profile("RollingVC", array->Length);
 
-				// save calculated value to result array element
-				myMa[i] = tempSum / maPeriod;
+				// checked before the cast, Null does not fit an int
+				if (window == ATFloat::Null || !(window >= 1.0f))
+					throw gcnew ArgumentOutOfRangeException("Window", "Window must be positive.");
+				if (function < 0 || function > (int)Kernels::WindowFunction::StDev)
+					throw gcnew ArgumentOutOfRangeException("Function", "Function must be between 0 and 4.");
+
+				// a window longer than the history is Null everywhere, whatever its length
+				int period = (int)std::min(window, (float)array->Length + 1);
+
+				ATArray^ result = NewResultArray();
+				Kernels::Rolling((Kernels::WindowFunction)function, array->Array, result->Array, result->Length, period);
+
+				return ATVar(result);
 			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing RollingVC indicator.", e);
 
-			// returning result to AFL  script
-			return ATVar(myMa);
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC8:
+		/// - how to return more than one array from a single fused kernel
+		/// 
+		/// Calculates the percentage bands of "HaGaSample 1.afl" (Close * 1.01 and Close * 0.99).
+		/// In AFL each band is a separate pass over the array. Here both bands are written
+		/// in one vectorized pass (SSE2, AVX2 or AVX-512 is selected by CPUID when the plug-in is loaded).
+		/// The results are returned in the UpperBand and LowerBand AFL variables.
+		/// </summary>
+		[ABMethod(Name = "PercentBandsVC")]
+		[ABParameter(0, Type = ABParameterType::Array, Description = "Array to calculate bands around")]
+		[ABParameter(1, Type = ABParameterType::Default, Description = "Band width %", Default = 1)]
+		ATVar AdvancedSamples2::AdvancedSampleVC8(ATArgList args)
+		{
+			try
+			{
+				ATArray^ array = args[0].GetArray();
+				float percent = args[1].GetFloat();
+
+				Kernels::ProfileScope profile("PercentBandsVC", array->Length);
+
+				ATArray^ upperBand = NewResultArray();
+				ATArray^ lowerBand = NewResultArray();
+				Kernels::PercentBands(array->Array, upperBand->Array, lowerBand->Array, upperBand->Length, percent);
+
+				ATAfl::SaveTo("UpperBand", upperBand);
+				ATAfl::SaveTo("LowerBand", lowerBand);
+
+				return ATVar::Ok;
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing PercentBandsVC indicator.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC9:
+		/// - how to use a string parameter
+		/// - how to return any number of arrays in AFL variables
+		/// 
+		/// Optimizations often calculate the average of the same array for dozens of periods.
+		/// Calling MA once per period streams the whole array through memory once per period.
+		/// This function takes the list of periods (e.g. "5,10,20,50") and calculates all averages
+		/// in one cache-blocked sweep (see Kernels::MaBatch). The results are saved to the
+		/// MA_<period> (or EMA_<period>) AFL variables, e.g. MA_20.
+		/// </summary>
+		[ABMethod(Name = "MaBatchVC")]
+		[ABParameter(0, Type = ABParameterType::Array, Description = "Array to calculate averages")]
+		[ABParameter(1, Type = ABParameterType::String, Description = "Comma separated list of periods")]
+		[ABParameter(2, Type = ABParameterType::Default, Description = "Average type (0 = MA, 1 = EMA)", Default = 0)]
+		ATVar AdvancedSamples2::AdvancedSampleVC9(ATArgList args)
+		{
+			try
+			{
+				// reading parameters
+				ATArray^ source = args[0].GetArray();
+				cli::array<int>^ items = ParsePeriods(args[1].GetString());
+				bool ema = ATFloat::IsTrue(args[2].GetFloat());
+
+				Kernels::ProfileScope profile("MaBatchVC", source->Length);
+
+				// allocate one result array per period and collect their native buffers for the kernel
+				cli::array<ATArray^>^ results = gcnew cli::array<ATArray^>(items->Length);
+				std::vector<int> periods;
+				std::vector<float*> buffers;
+
+				for (int k = 0; k < items->Length; k++)
+				{
+					results[k] = NewResultArray();
+					periods.push_back(items[k]);
+					buffers.push_back(results[k]->Array);
+				}
+
+				if (ema)
+					Kernels::EmaBatch(source->Array, source->Length, periods.data(), (int)periods.size(), buffers.data());
+				else
+					Kernels::MaBatch(source->Array, source->Length, periods.data(), (int)periods.size(), buffers.data());
+
+				// set MA_<period> AFL variables
+				String^ prefix = ema ? "EMA_" : "MA_";
+				for (int k = 0; k < results->Length; k++)
+					ATAfl::SaveTo(prefix + periods[k].ToString(), results[k]);
+
+				return ATVar::Ok;
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing MaBatchVC indicator.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC10:
+		/// - how to read and size the result cache
+		/// 
+		/// Returns a report of the result cache (see [CachedResult] and "Result Cache.h") and saves the counters
+		/// to the ResultCacheHits, ResultCacheMisses, ResultCacheEvictions, ResultCacheEntries and ResultCacheMB AFL variables.
+		/// If a capacity is given (in megabytes) the cache is resized first; least recently used results are evicted.
+		/// A low hit ratio with many evictions means the cache is too small for the working set.
+		/// </summary>
+		[ABMethod(Name = "ResultCacheVC")]
+		[ABParameter(0, Type = ABParameterType::Default, Description = "Capacity in MB (-1 = unchanged, 0 = disable)", Default = -1)]
+		ATVar AdvancedSamples2::AdvancedSampleVC10(ATArgList args)
+		{
+			try
+			{
+				Kernels::ProfileScope profile("ResultCacheVC", 0);
+
+				float capacity = args[0].GetFloat();
+				if (capacity >= 0)
+					Kernels::ResultCacheSetCapacity((std::size_t)(capacity * 1024 * 1024));
+
+				Kernels::ResultCacheStats stats = Kernels::ResultCacheStatistics();
+				double megabytes = stats.bytes / (1024.0 * 1024.0);
+
+				ATAfl::SaveTo("ResultCacheHits", (double)stats.hits);
+				ATAfl::SaveTo("ResultCacheMisses", (double)stats.misses);
+				ATAfl::SaveTo("ResultCacheEvictions", (double)stats.evictions);
+				ATAfl::SaveTo("ResultCacheEntries", (double)stats.entries);
+				ATAfl::SaveTo("ResultCacheMB", megabytes);
+
+				return ATVar(String::Format("Result cache: {0} hits, {1} misses, {2} evictions, {3} results, {4:F1} of {5:F1} MB",
+					stats.hits, stats.misses, stats.evictions, (UInt64)stats.entries, megabytes, stats.capacity / (1024.0 * 1024.0)));
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing ResultCacheVC function.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC11:
+		/// - how to call the same AFL function for many parameter sets
+		/// 
+		/// Calls any function taking (array, period) - a built-in one like MA, EMA or WMA, or a 3rd party plug-in function -
+		/// for each period of the list through one FunctionHandle::InvokeBatch call: the function is resolved once
+		/// and one argument pack is reused for all calls. The results are saved to the <FUNCTION>_<period> AFL variables, e.g. WMA_20.
+		/// (For MA and EMA themselves MaBatchVC is faster: it calculates all periods natively in one sweep.)
+		/// </summary>
+		[ABMethod(Name = "CallBatchVC")]
+		[ABParameter(0, Type = ABParameterType::Array, Description = "Array to pass to the function")]
+		[ABParameter(1, Type = ABParameterType::String, Description = "Name of an AFL function taking (array, period)")]
+		[ABParameter(2, Type = ABParameterType::String, Description = "Comma separated list of periods")]
+		ATVar AdvancedSamples2::AdvancedSampleVC11(ATArgList args)
+		{
+			try
+			{
+				// reading parameters
+				ATArray^ source = args[0].GetArray();
+				String^ function = args[1].GetString()->Trim()->ToUpperInvariant();
+				cli::array<int>^ periods = ParsePeriods(args[2].GetString());
+
+				Kernels::ProfileScope profile("CallBatchVC", source->Length);
+
+				FunctionHandle^ handle = FunctionHandle::Get(function, 2);
+
+				// the argument sets back to back: (source, period 1), (source, period 2), ...
+				cli::array<ATVar>^ argumentSets = gcnew cli::array<ATVar>(periods->Length * 2);
+				for (int k = 0; k < periods->Length; k++)
+				{
+					argumentSets[2 * k] = ATVar(source);
+					argumentSets[2 * k + 1] = ATVar((float)periods[k]);
+				}
+
+				cli::array<ATVar>^ results = handle->InvokeBatch(argumentSets);
+
+				// set <FUNCTION>_<period> AFL variables
+				for (int k = 0; k < results->Length; k++)
+					ATAfl::SaveTo(function + "_" + periods[k].ToString(), results[k].GetArray());
+
+				return ATVar::Ok;
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing CallBatchVC indicator.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC12:
+		/// - how to read the scratch arena counters
+		/// 
+		/// Returns a report of the per-thread scratch arenas that hold the intermediate arrays of the plug-in methods
+		/// (see Kernels\ScratchArena.h) and saves the counters to the ScratchThreads, ScratchReservedMB, ScratchHighWaterMB,
+		/// ScratchCalls and ScratchBlockAllocations AFL variables.
+		/// The high-water mark is the most scratch memory one call needed. Block allocations stop growing once every thread
+		/// has run its largest call; if they keep growing during an exploration, calls of increasing size are being made.
+		/// </summary>
+		[ABMethod(Name = "ScratchArenaVC")]
+		[ABParameter(0, Type = ABParameterType::Default, Description = "Reset the counters after reading them (0 = no, 1 = yes)", Default = 0)]
+		ATVar AdvancedSamples2::AdvancedSampleVC12(ATArgList args)
+		{
+			try
+			{
+				Kernels::ProfileScope profile("ScratchArenaVC", 0);
+
+				bool reset = ATFloat::IsTrue(args[0].GetFloat());
+
+				Kernels::ScratchArenaStats stats = Kernels::ScratchArenaStatistics();
+				double reserved = stats.reserved / (1024.0 * 1024.0);
+				double highWater = stats.highWater / (1024.0 * 1024.0);
+
+				ATAfl::SaveTo("ScratchThreads", (double)stats.threads);
+				ATAfl::SaveTo("ScratchReservedMB", reserved);
+				ATAfl::SaveTo("ScratchHighWaterMB", highWater);
+				ATAfl::SaveTo("ScratchCalls", (double)stats.calls);
+				ATAfl::SaveTo("ScratchBlockAllocations", (double)stats.blockAllocations);
+
+				if (reset)
+					Kernels::ScratchArenaResetStatistics();
+
+				return ATVar(String::Format("Scratch arenas: {0} threads, {1:F2} MB reserved, high-water {2:F2} MB per call, {3} calls, {4} block allocations",
+					(UInt64)stats.threads, reserved, highWater, stats.calls, stats.blockAllocations));
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing ScratchArenaVC function.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC13:
+		/// - how to measure the plug-in functions
+		/// 
+		/// Every plug-in function of the samples measures its calls with a Kernels::ProfileScope (Kernels\Profiler.h).
+		/// The counters are kept per thread, so parallel scans do not contend for them.
+		/// This function returns the report: calls, total, average, minimum, 99th percentile and maximum latency,
+		/// bars and allocated kilobytes per call (scratch memory and result arrays) for each function, the most expensive first.
+		/// Run a scan or exploration first, then call it (e.g. in the last symbol or from a commentary window).
+		/// 
+		/// Action: 0 = report, 1 = report and reset the counters, 2 = start tracing, 3 = stop tracing
+		/// </summary>
+		[ABMethod(Name = "ProfilerVC")]
+		[ABParameter(0, Type = ABParameterType::Default, Description = "Action (0 = report, 1 = report and reset, 2 = start tracing, 3 = stop tracing)", Default = 0)]
+		ATVar AdvancedSamples2::AdvancedSampleVC13(ATArgList args)
+		{
+			try
+			{
+				int action = (int)args[0].GetFloat();
+				if (action < 0 || action > 3)
+					throw gcnew ArgumentOutOfRangeException("Action", "Action must be between 0 and 3.");
+
+				if (action == 2 || action == 3)
+				{
+					Kernels::ProfilerSetTracing(action == 2);
+					return ATVar(gcnew String(action == 2 ? "Tracing started." : "Tracing stopped."));
+				}
+
+				String^ report = gcnew String(Kernels::ProfilerReport().c_str());
+				if (action == 1)
+					Kernels::ProfilerReset();
+
+				return ATVar(report);
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing ProfilerVC function.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC14:
+		/// - how to write a trace of the plug-in calls
+		/// 
+		/// While tracing is on (ProfilerVC(2)) every call of a plug-in function is recorded with its thread, start and duration.
+		/// This function writes the recorded calls to a Chrome trace file; open it in chrome://tracing, ui.perfetto.dev or speedscope
+		/// to see the calls of each scan thread on a timeline or as a flame graph. Returns the number of calls written.
+		/// </summary>
+		[ABMethod(Name = "ProfilerTraceVC")]
+		[ABParameter(0, Type = ABParameterType::String, Description = "Trace file (.json) to write")]
+		ATVar AdvancedSamples2::AdvancedSampleVC14(ATArgList args)
+		{
+			try
+			{
+				String^ path = args[0].GetString();
+
+				int events = Kernels::ProfilerWriteTrace(msclr::interop::marshal_as<std::string>(path));
+				if (events < 0)
+					throw gcnew IO::IOException(String::Format("Cannot create trace file {0}.", path));
+
+				return ATVar((float)events);
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing ProfilerTraceVC function.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC15:
+		/// - how to calculate recursive filters on all cores
+		/// 
+		/// EMA, DEMA, TEMA, Wilder's smoothing and the two pole Super Smoother (a second order IIR filter) of Kernels\RecursiveFilter.h.
+		/// A recursive filter depends on its previous output, so it looks sequential; but the recurrence is linear, so long arrays
+		/// are filtered chunk by chunk in parallel and the state is carried between the chunks afterwards (a prefix scan).
+		/// Leading Nulls are skipped and the averages are seeded like AFL's EMA; a Null in the middle restarts the seeding.
+		/// 
+		/// Filter: 0 = EMA, 1 = DEMA, 2 = TEMA, 3 = Wilders, 4 = Super Smoother
+		/// </summary>
+		[ABMethod(Name = "FilterVC")]
+		[ABParameter(0, Type = ABParameterType::Array, Description = "Array to filter")]
+		[ABParameter(1, Type = ABParameterType::Float, Description = "Period")]
+		[ABParameter(2, Type = ABParameterType::Default, Description = "Filter (0 = EMA, 1 = DEMA, 2 = TEMA, 3 = Wilders, 4 = Super Smoother)", Default = 0)]
+		ATVar AdvancedSamples2::AdvancedSampleVC15(ATArgList args)
+		{
+			try
+			{
+				ATArray^ array = args[0].GetArray();
+				int period = (int)args[1].GetFloat();
+				int filter = (int)args[2].GetFloat();
+
+				Kernels::ProfileScope profile("FilterVC", array->Length);
+
+				if (period < 1)
+					throw gcnew ArgumentOutOfRangeException("Period", "Period must be positive.");
+				if (filter < 0 || filter > 4)
+					throw gcnew ArgumentOutOfRangeException("Filter", "Filter must be between 0 and 4.");
+
+				ATArray^ result = NewResultArray();
+				switch (filter)
+				{
+				case 0:
+					Kernels::Ema(array->Array, result->Array, result->Length, period);
+					break;
+				case 1:
+					Kernels::Dema(array->Array, result->Array, result->Length, period);
+					break;
+				case 2:
+					Kernels::Tema(array->Array, result->Array, result->Length, period);
+					break;
+				case 3:
+					Kernels::Wilders(array->Array, result->Array, result->Length, period);
+					break;
+				default:
+					Kernels::Iir(array->Array, result->Array, result->Length, Kernels::SuperSmootherCoefficients(period), 1);
+					break;
+				}
+
+				return ATVar(result);
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing FilterVC indicator.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC16:
+		/// - how to remove redundant signals and follow the position in one pass
+		/// 
+		/// Reads Buy, Sell, Short and Cover and the trade prices (Close if not set) of the formula and runs them through the
+		/// position state machine of Kernels\Positions.h: flat, long or short, exits before entries, reversals by the opposite entry.
+		/// Buy, Sell, Short and Cover are replaced by the signals that were acted on (what ExRem and Flip do in AFL), and
+		/// InLong, InShort, EntryPrice and BarsInTrade are saved as AFL variables. Returns the number of trades.
+		/// </summary>
+		[ABMethod(Name = "PositionsVC")]
+		ATVar AdvancedSamples2::AdvancedSampleVC16(ATArgList args)
+		{
+			try
+			{
+				ATArray^ close = ABHost::GetStockArray(StockField::Close);
+				int length = close->Length;
+
+				Kernels::ProfileScope profile("PositionsVC", length);
+
+				cli::array<ATArray^>^ signals = gcnew cli::array<ATArray^> {
+					ABVars::Buy.GetArray(0.0f), ABVars::Sell.GetArray(0.0f), ABVars::Short.GetArray(0.0f), ABVars::Cover.GetArray(0.0f) };
+				ATArray^ buyPrice = ABVars::BuyPrice.GetArray(close);
+				ATArray^ sellPrice = ABVars::SellPrice.GetArray(close);
+				ATArray^ shortPrice = ABVars::ShortPrice.GetArray(close);
+				ATArray^ coverPrice = ABVars::CoverPrice.GetArray(close);
+
+				// raw signals in, deduplicated signals and position masks out: 10 bit vectors of scratch memory
+				Kernels::ScratchScope scratch;
+				int words = Kernels::SignalWords(length);
+				Kernels::Span<std::uint64_t> bits = scratch.Allocate<std::uint64_t>(10 * words);
+				for (int k = 0; k < 4; k++)
+					Kernels::PackSignal(signals[k]->Array, bits.Data() + k * words, length);
+
+				Kernels::PositionSignals in = { bits.Data(), bits.Data() + words, bits.Data() + 2 * words, bits.Data() + 3 * words,
+					buyPrice->Array, sellPrice->Array, shortPrice->Array, coverPrice->Array };
+
+				ATArray^ entryPrice = NewResultArray();
+				ATArray^ barsInTrade = NewResultArray();
+				std::uint64_t* acted = bits.Data() + 4 * words;
+				Kernels::PositionOutputs out = { acted, acted + words, acted + 2 * words, acted + 3 * words,
+					acted + 4 * words, acted + 5 * words, entryPrice->Array, barsInTrade->Array, nullptr };
+				int trades = Kernels::TrackPositions(in, length, out);
+
+				ABVars::Buy.Set(SignalArray(out.buy));
+				ABVars::Sell.Set(SignalArray(out.sell));
+				ABVars::Short.Set(SignalArray(out.shrt));
+				ABVars::Cover.Set(SignalArray(out.cover));
+				ATAfl::SaveTo("InLong", SignalArray(out.inLong));
+				ATAfl::SaveTo("InShort", SignalArray(out.inShort));
+				ATAfl::SaveTo("EntryPrice", entryPrice);
+				ATAfl::SaveTo("BarsInTrade", barsInTrade);
+
+				return ATVar((float)trades);
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing PositionsVC function.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC17:
+		/// - how to work with several time frames without TimeFrameSet
+		/// 
+		/// Each TimeFrameSet compresses the whole base series through AmiBroker again, so a formula that checks 1 minute, 5 minutes,
+		/// hourly and daily bars pays for it once per time frame. This function compresses the quotes of the symbol to all listed
+		/// intervals in a single pass (Kernels\TimeFrame.h) and keeps the compressed bars per symbol: the other panes, the scan
+		/// and the exploration of the same symbol reuse them until the quotes change.
+		/// For each interval the compressed Open, High, Low, Close and Volume are expanded back to the base bars and saved as
+		/// Open_<interval>, High_<interval>, ... AFL variables. If a period is given, MA_<interval> is the moving average of the
+		/// compressed close (MA(Close, period) of the time frame, not of the base bars). Returns the number of intervals.
+		/// 
+		/// Intervals are in seconds or the TFInterval values of daily (86400), weekly (432001), monthly (2160001), quarterly (6480001)
+		/// and yearly (25920001) bars. Expand: 0 = last (no lookahead), 1 = first, 2 = point, as in TimeFrameExpand.
+		/// </summary>
+		[ABMethod(Name = "TimeFrameVC")]
+		[ABParameter(0, Type = ABParameterType::String, Description = "Comma separated list of intervals")]
+		[ABParameter(1, Type = ABParameterType::Default, Description = "MA period on the compressed close (0 = none)", Default = 0)]
+		[ABParameter(2, Type = ABParameterType::Default, Description = "Expand (0 = last, 1 = first, 2 = point)", Default = 0)]
+		ATVar AdvancedSamples2::AdvancedSampleVC17(ATArgList args)
+		{
+			try
+			{
+				cli::array<int>^ intervals = ParsePeriods(args[0].GetString());
+				int period = (int)args[1].GetFloat();
+				int mode = (int)args[2].GetFloat();
+
+				if (period < 0)
+					throw gcnew ArgumentOutOfRangeException("Period", "Period must not be negative.");
+				if (mode < 0 || mode > 2)
+					throw gcnew ArgumentOutOfRangeException("Expand", "Expand must be between 0 and 2.");
+
+				ATArray^ open = ABHost::GetStockArray(StockField::Open);
+				ATArray^ high = ABHost::GetStockArray(StockField::High);
+				ATArray^ low = ABHost::GetStockArray(StockField::Low);
+				ATArray^ close = ABHost::GetStockArray(StockField::Close);
+				ATArray^ volume = ABHost::GetStockArray(StockField::Volume);
+				DateTimeSpan dates(ABHost::GetDatatimeArray());
+				int length = close->Length;
+
+				Kernels::ProfileScope profile("TimeFrameVC", length);
+
+				std::vector<int> list;
+				for (int k = 0; k < intervals->Length; k++)
+					list.push_back(intervals[k]);
+
+				Kernels::TimeFrameInput input = { dates.Data(), open->Array, high->Array, low->Array, close->Array, volume->Array, length };
+				std::vector<std::shared_ptr<const Kernels::CompressedBars>> compressed = Kernels::TimeFrameCompress(
+					msclr::interop::marshal_as<std::string>(AFInfo::Name()), (int)AFTimeFrame::Interval(), input, list.data(), (int)list.size());
+
+				Kernels::ExpandMode expand = (Kernels::ExpandMode)mode;
+				for (int k = 0; k < intervals->Length; k++)
+				{
+					const Kernels::CompressedBars& bars = *compressed[k];
+					String^ suffix = "_" + intervals[k].ToString();
+
+					const float* fields[5] = { bars.open.data(), bars.high.data(), bars.low.data(), bars.close.data(), bars.volume.data() };
+					cli::array<String^>^ names = gcnew cli::array<String^> { "Open", "High", "Low", "Close", "Volume" };
+					for (int f = 0; f < 5; f++)
+					{
+						ATArray^ result = NewResultArray();
+						Kernels::ExpandTimeFrame(fields[f], bars, result->Array, length, expand);
+						ATAfl::SaveTo(names[f] + suffix, result);
+					}
+
+					if (period > 0)
+					{
+						Kernels::ScratchScope scratch;
+						Kernels::Span<float> ma = scratch.Allocate<float>(bars.Length());
+						Kernels::Ma(bars.close.data(), ma.Data(), bars.Length(), period);
+
+						ATArray^ result = NewResultArray();
+						Kernels::ExpandTimeFrame(ma.Data(), bars, result->Array, length, expand);
+						ATAfl::SaveTo("MA" + suffix, result);
+					}
+				}
+
+				return ATVar((float)intervals->Length);
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing TimeFrameVC function.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC18:
+		/// - how to optimize a trading system natively on all cores
+		/// 
+		/// An optimization in AmiBroker runs the whole formula once per combination. This function optimizes the periods of the
+		/// crossover system of BasicSampleVC9 (Cross of EMA(Close, fast) and MA(TypicalPrice, slow)) on the current symbol in a single call:
+		/// the typical price and its prefix sums are calculated once, the combinations that share a fast period share its EMA,
+		/// and the combinations are evaluated on all cores with the scratch memory of each thread (Kernels\Optimizer.h).
+		/// The best periods are saved as the BestFast and BestSlow AFL variables; returns the ranked results as a text table.
+		/// 
+		/// Ranges: "min, max[, step]". Method: 0 = grid (every combination), 1 = random (Samples combinations of the grid),
+		/// 2 = successive halving (Samples random combinations, the best third of each rung tested on three times more bars).
+		/// Objective: 0 = net profit, 1 = profit factor, 2 = recovery factor (net profit / max drawdown).
+		/// </summary>
+		[ABMethod(Name = "OptimizeVC")]
+		[ABParameter(0, Type = ABParameterType::String, Description = "Fast EMA periods: min, max[, step]")]
+		[ABParameter(1, Type = ABParameterType::String, Description = "Slow MA periods: min, max[, step]")]
+		[ABParameter(2, Type = ABParameterType::Default, Description = "Method (0 = grid, 1 = random, 2 = successive halving)", Default = 0)]
+		[ABParameter(3, Type = ABParameterType::Default, Description = "Objective (0 = net profit, 1 = profit factor, 2 = recovery factor)", Default = 0)]
+		[ABParameter(4, Type = ABParameterType::Default, Description = "Samples of the random and successive halving methods", Default = 300)]
+		[ABParameter(5, Type = ABParameterType::Default, Description = "Rows of the table", Default = 10)]
+		ATVar AdvancedSamples2::AdvancedSampleVC18(ATArgList args)
+		{
+			try
+			{
+				cli::array<int>^ fast = ParsePeriods(args[0].GetString());
+				cli::array<int>^ slow = ParsePeriods(args[1].GetString());
+				int method = (int)args[2].GetFloat();
+				int objective = (int)args[3].GetFloat();
+				int samples = (int)args[4].GetFloat();
+				int rows = (int)args[5].GetFloat();
+
+				if (fast->Length < 2 || fast->Length > 3 || slow->Length < 2 || slow->Length > 3)
+					throw gcnew ArgumentException("A range must be given as min, max[, step].", "Periods");
+				if (method < 0 || method > 2)
+					throw gcnew ArgumentOutOfRangeException("Method", "Method must be between 0 and 2.");
+				if (objective < 0 || objective > 2)
+					throw gcnew ArgumentOutOfRangeException("Objective", "Objective must be between 0 and 2.");
+				if (samples < 1)
+					throw gcnew ArgumentOutOfRangeException("Samples", "Samples must be positive.");
+
+				ATArray^ open = ABHost::GetStockArray(StockField::Open);
+				ATArray^ high = ABHost::GetStockArray(StockField::High);
+				ATArray^ low = ABHost::GetStockArray(StockField::Low);
+				ATArray^ close = ABHost::GetStockArray(StockField::Close);
+				int length = close->Length;
+
+				Kernels::ProfileScope profile("OptimizeVC", length);
+
+				Kernels::OptimizationSettings settings;
+				settings.method = (Kernels::OptimizationMethod)method;
+				settings.objective = (Kernels::OptimizationObjective)objective;
+				settings.fastMin = fast[0];
+				settings.fastMax = fast[1];
+				settings.fastStep = fast->Length > 2 ? fast[2] : 1;
+				settings.slowMin = slow[0];
+				settings.slowMax = slow[1];
+				settings.slowStep = slow->Length > 2 ? slow[2] : 1;
+				settings.samples = samples;
+
+				Kernels::CrossoverInputs inputs = { open->Array, high->Array, low->Array, close->Array, length };
+				Kernels::CrossoverSystem system(inputs);
+				Kernels::OptimizationReport report = Kernels::Optimize(system, settings);
+				if (report.results.empty())
+					throw gcnew ArgumentException("The ranges have no combination with the fast period below the slow period.", "Periods");
+
+				ATArray^ bestFast = NewResultArray();
+				ATArray^ bestSlow = NewResultArray();
+				for (int i = 0; i < length; i++)
+				{
+					bestFast->Array[i] = (float)report.results[0].fast;
+					bestSlow->Array[i] = (float)report.results[0].slow;
+				}
+				ATAfl::SaveTo("BestFast", bestFast);
+				ATAfl::SaveTo("BestSlow", bestSlow);
+
+				return ATVar(String::Format("{0} combinations evaluated\n{1}", report.evaluations,
+					gcnew String(Kernels::OptimizationTable(report.results, rows).c_str())));
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing OptimizeVC function.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC19:
+		/// - how to run a walk-forward test natively
+		/// 
+		/// Optimizes the crossover system of OptimizeVC on each in-sample window of the current symbol and trades the best periods
+		/// on the following out-of-sample window (Kernels\WalkForward.h). All windows share the prefix sums of the typical price,
+		/// the EMA of each fast period is calculated once for the whole history, and the windows are optimized on all cores.
+		/// Returns the out-of-sample equity (1 at the start of the first out-of-sample window, the windows chained);
+		/// WFFast and WFSlow are the periods traded on each bar and WFWindow the number of the window (Null before the first one).
+		/// 
+		/// Step: bars between the windows (0 = the out-of-sample length). Anchored: the in-sample windows all start at the first bar.
+		/// Method and objective as in OptimizeVC.
+		/// </summary>
+		[ABMethod(Name = "WalkForwardVC")]
+		[ABParameter(0, Type = ABParameterType::String, Description = "Fast EMA periods: min, max[, step]")]
+		[ABParameter(1, Type = ABParameterType::String, Description = "Slow MA periods: min, max[, step]")]
+		[ABParameter(2, Type = ABParameterType::Float, Description = "In-sample bars")]
+		[ABParameter(3, Type = ABParameterType::Float, Description = "Out-of-sample bars")]
+		[ABParameter(4, Type = ABParameterType::Default, Description = "Step in bars (0 = out-of-sample bars)", Default = 0)]
+		[ABParameter(5, Type = ABParameterType::Default, Description = "Anchored (0 = rolling, 1 = anchored)", Default = 0)]
+		[ABParameter(6, Type = ABParameterType::Default, Description = "Method (0 = grid, 1 = random, 2 = successive halving)", Default = 0)]
+		[ABParameter(7, Type = ABParameterType::Default, Description = "Objective (0 = net profit, 1 = profit factor, 2 = recovery factor)", Default = 0)]
+		ATVar AdvancedSamples2::AdvancedSampleVC19(ATArgList args)
+		{
+			try
+			{
+				cli::array<int>^ fast = ParsePeriods(args[0].GetString());
+				cli::array<int>^ slow = ParsePeriods(args[1].GetString());
+				int inSample = (int)args[2].GetFloat();
+				int outOfSample = (int)args[3].GetFloat();
+				int step = (int)args[4].GetFloat();
+				bool anchored = args[5].GetFloat() != 0.0f;
+				int method = (int)args[6].GetFloat();
+				int objective = (int)args[7].GetFloat();
+
+				if (fast->Length < 2 || fast->Length > 3 || slow->Length < 2 || slow->Length > 3)
+					throw gcnew ArgumentException("A range must be given as min, max[, step].", "Periods");
+				if (inSample < 1 || outOfSample < 1)
+					throw gcnew ArgumentOutOfRangeException("Bars", "In-sample and out-of-sample bars must be positive.");
+				if (step < 0)
+					throw gcnew ArgumentOutOfRangeException("Step", "Step must not be negative.");
+				if (method < 0 || method > 2)
+					throw gcnew ArgumentOutOfRangeException("Method", "Method must be between 0 and 2.");
+				if (objective < 0 || objective > 2)
+					throw gcnew ArgumentOutOfRangeException("Objective", "Objective must be between 0 and 2.");
+
+				ATArray^ open = ABHost::GetStockArray(StockField::Open);
+				ATArray^ high = ABHost::GetStockArray(StockField::High);
+				ATArray^ low = ABHost::GetStockArray(StockField::Low);
+				ATArray^ close = ABHost::GetStockArray(StockField::Close);
+				int length = close->Length;
+
+				Kernels::ProfileScope profile("WalkForwardVC", length);
+
+				Kernels::WalkForwardSettings settings;
+				settings.inSample = inSample;
+				settings.outOfSample = outOfSample;
+				settings.step = step;
+				settings.anchored = anchored;
+				settings.optimization.method = (Kernels::OptimizationMethod)method;
+				settings.optimization.objective = (Kernels::OptimizationObjective)objective;
+				settings.optimization.fastMin = fast[0];
+				settings.optimization.fastMax = fast[1];
+				settings.optimization.fastStep = fast->Length > 2 ? fast[2] : 1;
+				settings.optimization.slowMin = slow[0];
+				settings.optimization.slowMax = slow[1];
+				settings.optimization.slowStep = slow->Length > 2 ? slow[2] : 1;
+
+				Kernels::CrossoverInputs inputs = { open->Array, high->Array, low->Array, close->Array, length };
+				Kernels::CrossoverSystem system(inputs);
+				Kernels::WalkForwardReport report = Kernels::WalkForward(system, settings);
+				if (report.windows.empty())
+					throw gcnew ArgumentException("There are not enough bars for one in-sample window.", "Bars");
+
+				// the periods of each window on the bars where its equity is used (see WalkForwardReport::equity)
+				ATArray^ equity = NewResultArray();
+				ATArray^ wfFast = NewResultArray();
+				ATArray^ wfSlow = NewResultArray();
+				ATArray^ wfWindow = NewResultArray();
+				for (int i = 0; i < length; i++)
+				{
+					equity->Array[i] = report.equity[i];
+					wfFast->Array[i] = wfSlow->Array[i] = wfWindow->Array[i] = Kernels::Null;
+				}
+				int windows = (int)report.windows.size();
+				for (int w = 0; w < windows; w++)
+				{
+					const Kernels::WalkForwardWindow& window = report.windows[w];
+					int end = w + 1 < windows ? std::min(window.outOfSampleEnd, report.windows[w + 1].outOfSampleBegin) : window.outOfSampleEnd;
+					for (int i = window.outOfSampleBegin; i < end; i++)
+					{
+						wfFast->Array[i] = (float)window.inSample.fast;
+						wfSlow->Array[i] = (float)window.inSample.slow;
+						wfWindow->Array[i] = (float)(w + 1);
+					}
+				}
+				ATAfl::SaveTo("WFFast", wfFast);
+				ATAfl::SaveTo("WFSlow", wfSlow);
+				ATAfl::SaveTo("WFWindow", wfWindow);
+
+				return ATVar(equity);
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing WalkForwardVC function.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		/// <summary>
+		/// AdvancedSampleVC20:
+		/// - how to analyze an equity curve natively
+		/// 
+		/// Compounds the bar returns of holding Position (1 = long, -1 = short, fractions for partial exposure, 0 or Null = flat)
+		/// from each close to the next one of Price, and returns the equity, starting at 1 (Kernels\EquityAnalytics.h).
+		/// The same passes over the bars save the drawdown from the highest equity so far in percent (Drawdown), the bars since
+		/// that high (DrawdownBars), and the rolling annualized Sharpe and Sortino ratios and ulcer index of the last Window bars
+		/// (RollingSharpe, RollingSortino, RollingUlcer; Null until the window is full). The metrics of the whole curve are saved
+		/// as EquityCAGR, EquityMaxDD, EquityMaxDDBars, EquitySharpe, EquitySortino, EquityUlcer and EquityMAR.
+		/// 
+		/// Periods per year annualize the ratios and the CAGR; 0 derives them from the dates of the bars.
+		/// </summary>
+		[ABMethod(Name = "EquityVC")]
+		[ABParameter(0, Type = ABParameterType::Array, Description = "Position (1 = long, -1 = short, 0 = flat)")]
+		[ABParameter(1, Type = ABParameterType::Array, Description = "Price")]
+		[ABParameter(2, Type = ABParameterType::Default, Description = "Window of the rolling ratios in bars", Default = 252)]
+		[ABParameter(3, Type = ABParameterType::Default, Description = "Periods per year (0 = from the dates)", Default = 0)]
+		ATVar AdvancedSamples2::AdvancedSampleVC20(ATArgList args)
+		{
+			try
+			{
+				ATArray^ position = args[0].GetArray();
+				ATArray^ price = args[1].GetArray();
+				int window = (int)args[2].GetFloat();
+				double periodsPerYear = args[3].GetFloat();
+
+				if (window < 2)
+					throw gcnew ArgumentOutOfRangeException("Window", "Window must be at least 2 bars.");
+				if (periodsPerYear < 0.0)
+					throw gcnew ArgumentOutOfRangeException("PeriodsPerYear", "Periods per year must not be negative.");
+
+				int length = price->Length;
+
+				Kernels::ProfileScope profile("EquityVC", length);
+
+				Kernels::EquitySettings settings;
+				settings.window = window;
+				if (periodsPerYear > 0.0)
+					settings.periodsPerYear = periodsPerYear;
+				else
+				{
+					DateTimeSpan dates(ABHost::GetDatatimeArray());
+					settings.periodsPerYear = Kernels::PeriodsPerYear(dates.Data(), length);
+				}
+
+				ATArray^ equity = NewResultArray();
+				ATArray^ drawdown = NewResultArray();
+				ATArray^ drawdownBars = NewResultArray();
+				ATArray^ sharpe = NewResultArray();
+				ATArray^ sortino = NewResultArray();
+				ATArray^ ulcer = NewResultArray();
+				Kernels::EquityOutputs outputs = { equity->Array, drawdown->Array, drawdownBars->Array, sharpe->Array, sortino->Array, ulcer->Array };
+				Kernels::EquityMetrics metrics = Kernels::PositionEquity(position->Array, price->Array, length, settings, outputs);
+
+				ATAfl::SaveTo("Drawdown", drawdown);
+				ATAfl::SaveTo("DrawdownBars", drawdownBars);
+				ATAfl::SaveTo("RollingSharpe", sharpe);
+				ATAfl::SaveTo("RollingSortino", sortino);
+				ATAfl::SaveTo("RollingUlcer", ulcer);
+				ATAfl::SaveTo("EquityCAGR", metrics.cagr);
+				ATAfl::SaveTo("EquityMaxDD", metrics.maxDrawdown);
+				ATAfl::SaveTo("EquityMaxDDBars", (double)metrics.maxDrawdownBars);
+				ATAfl::SaveTo("EquitySharpe", metrics.sharpe);
+				ATAfl::SaveTo("EquitySortino", metrics.sortino);
+				ATAfl::SaveTo("EquityUlcer", metrics.ulcerIndex);
+				ATAfl::SaveTo("EquityMAR", metrics.mar);
+
+				return ATVar(equity);
+			}
+			catch (Exception^ e)
+			{
+				YException::Show("Error while executing EquityVC function.", e);
+
+				// indicate failure
+				return ATVar::Fail;
+			}
+		}
+
+		cli::array<int>^ AdvancedSamples2::ParsePeriods(String^ list)
+		{
+			cli::array<String^>^ items = list->Split(gcnew cli::array<wchar_t> { ',', ';', ' ' }, StringSplitOptions::RemoveEmptyEntries);
+
+			if (items->Length == 0)
+				throw gcnew ArgumentException("At least one period must be given.", "Periods");
+
+			cli::array<int>^ periods = gcnew cli::array<int>(items->Length);
+			for (int k = 0; k < items->Length; k++)
+			{
+				periods[k] = Int32::Parse(items[k]);
+				if (periods[k] < 1)
+					throw gcnew ArgumentOutOfRangeException("Periods", "Periods must be positive.");
+			}
+
+			return periods;
 		}
 	}
 }
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include "Function Handle.h"
+
 using namespace System;
 using namespace AmiBroker;
 using namespace AmiBroker::PlugIn;
@@ -27,6 +29,26 @@ namespace AmiBroker
 			static ATVar AdvancedSampleVC4(ATArgList args);
 			static ATVar AdvancedSampleVC5(ATArgList args);
 			static ATVar AdvancedSampleVC6(ATArgList args);
+			static ATVar AdvancedSampleVC7(ATArgList args);
+			static ATVar AdvancedSampleVC8(ATArgList args);
+			static ATVar AdvancedSampleVC9(ATArgList args);
+			static ATVar AdvancedSampleVC10(ATArgList args);
+			static ATVar AdvancedSampleVC11(ATArgList args);
+			static ATVar AdvancedSampleVC12(ATArgList args);
+			static ATVar AdvancedSampleVC13(ATArgList args);
+			static ATVar AdvancedSampleVC14(ATArgList args);
+			static ATVar AdvancedSampleVC15(ATArgList args);
+			static ATVar AdvancedSampleVC16(ATArgList args);
+			static ATVar AdvancedSampleVC17(ATArgList args);
+			static ATVar AdvancedSampleVC18(ATArgList args);
+			static ATVar AdvancedSampleVC19(ATArgList args);
+			static ATVar AdvancedSampleVC20(ATArgList args);
+
+		private:
+			static cli::array<int>^ ParsePeriods(String^ list);
+
+			// AmiBroker's MA(array, period) resolved once for AdvancedSampleVC2 and AdvancedSampleVC5
+			static FunctionHandle^ maFunction = FunctionHandle::Get("MA", 2);
 		};
 	}
 }
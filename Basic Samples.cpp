@@ -1,6 +1,26 @@
 // This is the main DLL file.
 #include "stdafx.h"
 #include "Basic Samples.h"
+#include "Array Span.h"
+#include "Result Array.h"
+#include "Result Cache.h"
+#include "Signal Array.h"
+#include "Kernels/Averages.h"
+#include "Kernels/EquityAnalytics.h"
+#include "Kernels/Expression.h"
+#include "Kernels/Incremental.h"
+#include "Kernels/Positions.h"
+#include "Kernels/Price.h"
+#include "Kernels/Profiler.h"
+#include "Kernels/RollingWindow.h"
+#include "Kernels/ScratchArena.h"
+#include "Kernels/Signals.h"
+#include "Kernels/Slippage.h"
+#include "Kernels/TradeAnalytics.h"
+
+#include <algorithm>
+#include <vector>
+#include <msclr/marshal_cppstd.h>
 
 namespace AmiBroker
 {
@@ -53,6 +73,8 @@ namespace AmiBroker
 		[ABMethod]
 		void BasicSamples::BasicSampleVC1()
 		{
+			Kernels::ProfileScope profile("BasicSampleVC1", BarCount);
+
 			// calculate the moving average of close price by calling the built-in MA function
 			ATArray^ mySlowMa = AFAvg::Ma(Close, 20);
 
@@ -97,15 +119,51 @@ namespace AmiBroker
         /// 
         /// The item in ATArray at the selected index can be printed to strings easily using the ToString method;
         /// Title = "myTypicalPrice=" + myTypicalPrice;
+        /// 
+        /// Using native kernels
+        /// --------------------
+        /// Each operator of the above expression allocates a temporary array and makes a full pass over memory.
+        /// The numeric work of these samples is done by the native kernel library (Kernels folder) instead.
+        /// The kernels work on the native buffers of the arrays (ATArray::Array) and follow AFL's Null rules,
+        /// so the plug-in methods only allocate the result arrays and pass the buffers.
+        /// Intermediate arrays (like the typical price below) are not results, so they are not ATArray objects either:
+        /// they are taken from the scratch arena of the calling thread (Kernels\ScratchArena.h), which is reset when the method returns.
+        /// An exploration over thousands of symbols then reuses the same memory for every symbol.
+        /// The same kernels are built and benchmarked outside AmiBroker by CMakeLists.txt.
+        /// 
+        /// Caching results
+        /// ---------------
+        /// BasicSampleVC9 and AdvancedSampleVC3 calculate the same moving average of typical price.
+        /// Methods tagged with the [CachedResult] attribute share results through the result cache (see "Result Cache.h"):
+        /// the key is the function name, the content hash of the input arrays and the parameters,
+        /// so the method that runs first calculates the average and the others copy it.
         /// </summary>
 		[ABMethod]
+		[CachedResult]
 		ATArray^ BasicSamples::BasicSampleVC2()
 		{
-			// calculate bar avg price
-			ATArray^ myTypicalPrice = (High + Low + 2 * Close) / 4;
+			Kernels::ProfileScope profile("BasicSampleVC2", BarCount);
+
+			Kernels::ResultKey key("TypicalPriceMa");
+			key.AddInput(High->Array, High->Length);
+			key.AddInput(Low->Array, Low->Length);
+			key.AddInput(Close->Array, Close->Length);
+			key.AddParameter(20);
+
+			ATArray^ mySlowMa = NewResultArray();
+			if (!ResultCache::Get(MethodBase::GetCurrentMethod(), key, mySlowMa))
+			{
+				Kernels::ScratchScope scratch;
+
+				// calculate bar avg price: (High + Low + 2 * Close) / 4
+				Kernels::Span<float> myTypicalPrice = scratch.Allocate<float>(mySlowMa->Length);
+				Kernels::TypicalPrice(High->Array, Low->Array, Close->Array, myTypicalPrice.Data(), myTypicalPrice.Length());
 
-			// calculate the moving average of typical price by calling the built-in MA function
-			ATArray^ mySlowMa = AFAvg::Ma(myTypicalPrice, 20);
+				// calculate the moving average of typical price
+				Kernels::Ma(myTypicalPrice.Data(), mySlowMa->Array, mySlowMa->Length, 20);
+
+				ResultCache::Put(MethodBase::GetCurrentMethod(), key, mySlowMa);
+			}
 
 			// returning result to AFL  script
 			return mySlowMa;
@@ -129,7 +187,14 @@ namespace AmiBroker
 		[ABMethod]
 		ATArray^ BasicSamples::BasicSampleVC3(ATArray^ array, float period)
 		{
-			ATArray^ myEma = AFAvg::Ema(array, period);
+			Kernels::ProfileScope profile("BasicSampleVC3", array->Length);
+
+			// checked before the cast, Null does not fit an int; a period longer than the history is Null everywhere
+			if (period == ATFloat::Null || !(period >= 1.0f))
+				throw gcnew ArgumentOutOfRangeException("Period", "Period must be positive.");
+
+			ATArray^ myEma = NewResultArray();
+			Kernels::Ema(array->Array, myEma->Array, myEma->Length, (int)std::min(period, (float)array->Length + 1));
 			return myEma;
 		}
 	
@@ -150,10 +215,19 @@ namespace AmiBroker
         /// If more values are needed to be returned to the calling AFL script, 
         /// use ATAfl objects (AFL global variables) to pass all results to AFL and
         /// use the function return value to indicate the failure or the success.
+        /// 
+        /// Fusing array expressions
+        /// ------------------------
+        /// (myMa - myEma) * 100.0f written with ATArray operators allocates a temporary array for each operator.
+        /// Kernels::Series wraps the native buffers into an expression template (Kernels\Expression.h),
+        /// so the whole expression is evaluated by Kernels::Evaluate in one loop into the result array.
+        /// Null values propagate the same way as with the ATArray operators.
         /// </summary>
         [ABMethod]
 		float BasicSamples::BasicSampleVC4()
         {
+            Kernels::ProfileScope profile("BasicSampleVC4", BarCount);
+
             // reading the variant of the Period AFL variable intialized by the AFL script
 			ATVar^ emaPeriodVar = ATAfl::ReadFrom("EmaPeriod");
 
@@ -172,19 +246,22 @@ namespace AmiBroker
 				return ATFloat::False;
 
             // calculating the average close price
-			ATArray^ myEma = AFAvg::Ema(Close, emaPeriod);
+			ATArray^ myEma = NewResultArray();
+			Kernels::Ema(Close->Array, myEma->Array, myEma->Length, (int)emaPeriod);
 
             // saving result to MyEma AFL variable
 			ATAfl::SaveTo("MyEma", myEma);
 
             // calculating the average close price
-			ATArray^ myMa = AFAvg::Ma(Close, maPeriod);
+			ATArray^ myMa = NewResultArray();
+			Kernels::Ma(Close->Array, myMa->Array, myMa->Length, (int)maPeriod);
 
             // saving result to MyMa AFL variable
 			ATAfl::SaveTo("MyMa", myMa);
 
-            // calculate the % difference of the two averages
-            ATArray^ myDiff = (myMa - myEma) * 100.0f;
+            // calculate the % difference of the two averages in one fused loop
+            ATArray^ myDiff = NewResultArray();
+            Kernels::Evaluate((Kernels::Series(myMa->Array) - Kernels::Series(myEma->Array)) * 100.0f, myDiff->Array, myDiff->Length);
 
             // setting AFL variable value
 			ATAfl::SaveTo("MyDiff", myDiff);
@@ -203,6 +280,23 @@ namespace AmiBroker
         /// Because of compiled code and integer index arithmetric 
         /// .NET loops are much faster than AFL script loops (2-40 times faster)
         /// 
+        /// Performance advantage of a better algorithm
+        /// -------------------------------------------
+        /// Summing the whole window on every bar costs O(BarCount * period) additions.
+        /// The rolling-window engine (Kernels\RollingWindow.h) keeps a running sum instead:
+        /// the value entering the window is added and the value leaving it is subtracted,
+        /// so the cost is O(BarCount) whatever the period. It reads and writes the native
+        /// buffers of the arrays through ArraySpan ("Array Span.h") so no indexer calls are made per element.
+        /// 
+        /// Real-time refreshes
+        /// -------------------
+        /// In real-time AmiBroker re-runs the formula on every tick although only the last bar changed.
+        /// The incremental cache (Kernels\Incremental.h) keeps the running sum per symbol, interval and period
+        /// up to the last closed bar, so a refresh only adds the new bars and recalculates the last one.
+        /// If the history is backfilled or bars are inserted the cache notices it and calculates everything again; a closed bar
+        /// edited deep in the history is noticed within BarCount / 4096 refreshes (Kernels::IncrementalInvalidate rebuilds at once).
+        /// The cache is bounded in memory: an exploration over many symbols and periods drops the least recently used indicators.
+        /// 
         /// This indicator has 2 more optimized versions in Unsafe Samples. Those are for 
         /// the experienced C/C# programmers.
         /// 
@@ -225,28 +319,28 @@ namespace AmiBroker
         [ABMethod(Name = "LoopSampleVC")]
 		ATArray^ BasicSamples::BasicSampleVC5(float period)
         {
+            // measure every call: the report of ProfilerVC shows the calls, latencies and bars of each plug-in function
+            Kernels::ProfileScope profile("LoopSampleVC", BarCount);
+
             int maPeriod = (int)period;
 
             // allocate memory for result array
-            ATArray^ myMa = gcnew ATArray();
+            ATArray^ myMa = NewResultArray();
 
-            // set null values at the beginning of the array
-            for (int i = 0; i < maPeriod - 1 && i < myMa->Length; i++)
-				myMa[i] = ATFloat::Null;
+            // continue the running sum of the previous refresh of this symbol
+            // (Null values at the beginning of the array are set by the engine)
+            Kernels::IncrementalKey key;
+            key.symbol = msclr::interop::marshal_as<std::string>(AFInfo::Name());
+            key.interval = (int)AFTimeFrame::Interval();
+            key.function = Kernels::IncrementalFunction::Ma;
+            key.period = maPeriod;
 
-            // calculate the average for each bar
-            for (int i = maPeriod - 1; i < myMa->Length; i++)
-            {
-                // clear temporary result
-                float tempSum = 0.0f;
+            // native views of the AmiBroker buffers: no per-element managed calls and no copies
+            ArraySpan close(Close);
+            DateTimeSpan dates(DateAndTime);
+            ArraySpan ma(myMa);
 
-                // inner loop to sum bar data
-                for (int j = 0; j < maPeriod; j++)
-                    tempSum = tempSum + Close[i - j];
-
-                // save calculated value to result array element
-                myMa[i] = tempSum / maPeriod;
-            }
+            Kernels::IncrementalUpdate(key, close, dates, ma);
 
             // returning result to AFL  script
             return myMa;
@@ -271,6 +365,8 @@ namespace AmiBroker
 		[ABMethod]
 		float BasicSamples::BasicSampleVC6(float emaPeriod)
 		{
+			Kernels::ProfileScope profile("BasicSampleVC6", BarCount);
+
 			try
 			{
 				ATArray^ myEma = AFAvg::Ema(Close, emaPeriod);
@@ -309,41 +405,53 @@ namespace AmiBroker
 		/// - how to use AFL script objects
 		/// 
 		/// It is possible to use all AFL objects (Backtester, Signal, Stats, Trade) in .NET.
-		/// The following function calculates the expectency % of the system by using the
+		/// The following function calculates custom metrics of the system by using the
 		/// Backtester and the Trade objects.
+		/// 
+		/// Each Trade property read is a call into AmiBroker, so the trades are walked only once:
+		/// the closed trades and open positions are copied into columns (Kernels\TradeAnalytics.h).
+		/// The metrics (expectancy, profit factor, SQN, ulcer index, profit % percentiles, MAE/MFE, bars held)
+		/// are then calculated natively with parallel reductions for all, long and short trades,
+		/// and every metric is added to the report with its long and short values.
 		/// </summary>
 		[ABMethod]
 		void BasicSamples::BasicSampleVC7()
 		{
+			Kernels::ProfileScope profile("BasicSampleVC7", BarCount);
+
 			if (AFMisc::StatusAction() == Action::Portfolio)
 			{
 				Backtester^ bo = AFTools::GetBacktesterObject();
 				bo->Backtest();
 
-				double totalProfitPercent = 0;
-				int tradeNum = 0;
+				Kernels::TradeColumns trades;
 
-				// iterate through all closed trades
+				// copy all closed trades
 				for (Trade^ trade = bo->GetFirstTrade(); trade != nullptr; trade = bo->GetNextTrade())
 				{
-					// sum up profit % 
-					totalProfitPercent = totalProfitPercent + trade->GetPercentProfit();
-					tradeNum++;
+					trades.Add(trade->GetProfit(), trade->GetPercentProfit(), trade->BarsInTrade, trade->EntryPrice, trade->ExitPrice,
+						trade->GetMAE(), trade->GetMFE(), trade->IsLong, false);
 				}
 
-				// iterate through open positions
+				// copy open positions
 				for (Trade^ trade = bo->GetFirstOpenPos(); trade != nullptr; trade = bo->GetNextOpenPos())
 				{
-					// sum up profit % 
-					totalProfitPercent = totalProfitPercent + trade->GetPercentProfit();
-					tradeNum++;
+					trades.Add(trade->GetProfit(), trade->GetPercentProfit(), trade->BarsInTrade, trade->EntryPrice, trade->ExitPrice,
+						trade->GetMAE(), trade->GetMFE(), trade->IsLong, true);
 				}
 
-				// calc expectency %
-				float expectancy = (float)(totalProfitPercent / tradeNum);
+				// select the metrics to report
+				Kernels::TradeMetrics metrics = Kernels::TradeMetrics::Expectancy | Kernels::TradeMetrics::ProfitFactor |
+					Kernels::TradeMetrics::Sqn | Kernels::TradeMetrics::UlcerIndex | Kernels::TradeMetrics::Percentiles |
+					Kernels::TradeMetrics::Excursions | Kernels::TradeMetrics::BarsHeld;
+
+				std::vector<Kernels::TradeMetricValue> values = Kernels::CalculateTradeMetrics(trades, metrics, Kernels::DefaultTradePercentiles());
 
-				// Adding custom metric to the report
-				bo->AddCustomMetric("Expectancy %", expectancy, 0, 0, 4);
+				// Adding custom metrics to the report
+				for (const Kernels::TradeMetricValue& value : values)
+				{
+					bo->AddCustomMetric(gcnew String(value.name.c_str()), (float)value.all, (float)value.longOnly, (float)value.shortOnly, (float)value.decimals);
+				}
 			}
 		}
 
@@ -351,36 +459,104 @@ namespace AmiBroker
 		/// BasicSampleVC8:
 		/// - how to use advanced backtester interface
 		/// 
-		/// This function modifies the exit prices by the expected slippage (Slippage of Long and Short are usually different in size.)
-		/// The function uses the Backtester and the Signal object to modifiy the ExitPrices.
+		/// This function modifies the entry and exit prices by the expected slippage and commission
+		/// (Slippage of Long and Short are usually different in size.)
+		/// The function uses the Backtester and the Signal object to modifiy the prices.
+		/// 
+		/// Slippage models (Kernels\Slippage.h, SlippageModel AFL variable):
+		/// 0 = fixed number of ticks, 1 = percent of the price, 2 = multiple of ATR,
+		/// 3 = volume participation (square root of the order value / average traded value).
+		/// 
+		/// The ATR and traded value of a symbol are calculated natively in the first (per-symbol) phase of the backtest,
+		/// when its own quotes are available. Before PreProcess the custom backtest aligns them to the portfolio bars once,
+		/// so each signal costs an array lookup instead of host calls.
+		/// The inputs are kept in a store of this backtest, named by the optional SlippageRun AFL variable (default 0).
+		/// Analyses that backtest at the same time must set different SlippageRun values.
+		/// 
+		/// Unset (Null) variables take their defaults: fixed tick model, no slippage, period 14, no commission.
 		/// </summary>
 		[ABMethod]
 		void BasicSamples::BasicSampleVC8()
 		{
-			if (AFMisc::StatusAction() == Action::Portfolio)
+			Kernels::ProfileScope profile("BasicSampleVC8", BarCount);
+
+			Action action = AFMisc::StatusAction();
+			if (action != Action::Backtest && action != Action::Portfolio)
+				return;
+
+			// the model and the period are needed in both phases
+			float model = ReadSetting("SlippageModel", 0.0f);
+			if (model != 0.0f && model != 1.0f && model != 2.0f && model != 3.0f)
+				throw gcnew ArgumentOutOfRangeException("SlippageModel", "SlippageModel must be 0, 1, 2 or 3.");
+
+			float period = ReadSetting("SlippagePeriod", 14.0f);
+			if (!(period >= 1.0f && period <= 1000000.0f))
+				throw gcnew ArgumentOutOfRangeException("SlippagePeriod", "SlippagePeriod must be between 1 and 1000000.");
+
+			Kernels::SlippageSettings settings;
+			settings.model = (Kernels::SlippageModel)(int)model;
+			settings.period = (int)period;
+
+			bool usesInputs = settings.model == Kernels::SlippageModel::Atr || settings.model == Kernels::SlippageModel::VolumeParticipation;
+			std::string backtest = msclr::interop::marshal_as<std::string>(ReadSetting("SlippageRun", 0.0f).ToString());
+
+			if (action == Action::Backtest)
+			{
+				// first phase: store the model inputs of this symbol
+				if (usesInputs)
+				{
+					Kernels::NamedSlippageInputs(backtest)->Store(msclr::interop::marshal_as<std::string>(AFInfo::Name()), reinterpret_cast<const std::uint64_t*>(DateAndTime->Array),
+						High->Array, Low->Array, Close->Array, Volume->Array, BarCount, settings.period);
+				}
+			}
+			else
 			{
-				float slippageLong = ATAfl::ReadFrom("SlippageLong").GetFloat();
-				float slippageShort = ATAfl::ReadFrom("SlippageShort").GetFloat();
-				float tickSize = ATAfl::ReadFrom("SlippageTickSize").GetFloat();
+				settings.longAmount = ReadSetting("SlippageLong", 0.0f);
+				settings.shortAmount = ReadSetting("SlippageShort", 0.0f);
+				settings.tickSize = ReadSetting("SlippageTickSize", 0.0f);
+				settings.commissionPerShare = ReadSetting("CommissionPerShare", 0.0f);
 
-				if (tickSize == ATFloat::Null || tickSize == 0.0f)
+				if (settings.model == Kernels::SlippageModel::FixedTick && settings.tickSize == 0.0f)
 					throw gcnew Exception("TickSize must be set for the ticker!");
 
 				Backtester^ bo = AFTools::GetBacktesterObject();
 
+				// align the stored inputs of this backtest to the portfolio bars, then drop them
+				std::shared_ptr<Kernels::SlippageInputs> inputs = Kernels::NamedSlippageInputs(backtest);
+				Kernels::ReleaseSlippageInputs(backtest);
+				Kernels::SlippageEngine engine(settings, *inputs, reinterpret_cast<const std::uint64_t*>(DateAndTime->Array), BarCount);
+
 				bo->PreProcess();
 
 				for (int bar = 0; bar < BasicSamples::BarCount; bar++)
 				{
 					for (Signal^ sig = bo->GetFirstSignal(bar); sig != nullptr; sig = bo->GetNextSignal(bar))
 					{
-						if (!sig->IsEntry())     // if exit signal
+						if (sig->IsScale())
+							continue;
+
+						int symbol = -1;
+						double orderValue = 0;
+
+						if (usesInputs)
+							symbol = engine.SymbolIndex(msclr::interop::marshal_as<std::string>(sig->Symbol));
+
+						if (settings.model == Kernels::SlippageModel::VolumeParticipation)
 						{
-							if (sig->IsLong())
-								sig->Price = sig->Price - slippageLong * tickSize;
+							if (sig->IsEntry())
+							{
+								// positive position size is a value, -100..0 is a percent of the equity
+								float posSize = sig->PosSize;
+								orderValue = posSize > 0 ? posSize : (posSize >= -100 ? -posSize / 100 * bo->Equity : 0);
+							}
 							else
-								sig->Price = sig->Price + slippageShort * tickSize;
+							{
+								Trade^ position = bo->FindOpenPos(sig->Symbol);
+								orderValue = position != nullptr ? position->GetPositionValue() : 0;
+							}
 						}
+
+						sig->Price = engine.Adjust(symbol, bar, sig->Price, sig->IsLong(), sig->IsEntry(), orderValue);
 					}
 					bo->ProcessTradeSignals(bar);
 				}
@@ -394,30 +570,73 @@ namespace AmiBroker
 		/// - how to use AmiBroker's predefined variables
 		/// 
 		/// This function add expectency custom metrics to the report by using the Stats object.
+		/// The equity curve of the portfolio adds the CAGR, the longest drawdown, the Sharpe and Sortino ratios, the ulcer index
+		/// and the MAR ratio, calculated natively from the EquityArray of the backtester.
+		/// The moving average of typical price is shared with BasicSampleVC2 through the result cache.
 		/// </summary>
 		[ABMethod]
+		[CachedResult]
 		void BasicSamples::BasicSampleVC9()
 		{
-			float MaPeriod = 20;
-			ATArray^ myTypicalPrice = (High + Low + 2 * Close) / 4;
+			Kernels::ProfileScope profile("BasicSampleVC9", BarCount);
 
-			ATArray^ myMa = AFAvg::Ma(myTypicalPrice, MaPeriod);
+			int MaPeriod = 20;
+			Kernels::ResultKey key("TypicalPriceMa");
+			key.AddInput(High->Array, High->Length);
+			key.AddInput(Low->Array, Low->Length);
+			key.AddInput(Close->Array, Close->Length);
+			key.AddParameter((float)MaPeriod);
+
+			ATArray^ myMa = NewResultArray();
+			if (!ResultCache::Get(MethodBase::GetCurrentMethod(), key, myMa))
+			{
+				Kernels::ScratchScope scratch;
+				Kernels::Span<float> myTypicalPrice = scratch.Allocate<float>(myMa->Length);
+				Kernels::TypicalPrice(High->Array, Low->Array, Close->Array, myTypicalPrice.Data(), myTypicalPrice.Length());
+
+				Kernels::Ma(myTypicalPrice.Data(), myMa->Array, myMa->Length, MaPeriod);
+				ResultCache::Put(MethodBase::GetCurrentMethod(), key, myMa);
+			}
 			AFGraph::Plot(myMa, "MyMa", Color::Blue, Style::Thick);
 
-			ATArray^ myFastEma = AFAvg::Ema(Close, 5);
-			AFGraph::Plot(myFastEma, "Ema5", AFTools::Iif(myMa < myFastEma, Color::DarkGreen, Color::Brown), Style::Line);
+			ATArray^ myFastEma = NewResultArray();
+			Kernels::Ema(Close->Array, myFastEma->Array, myFastEma->Length, 5);
+
+			// conditions and signals are packed bit vectors (Kernels\Signals.h): one bit per bar instead of a float array per step.
+			// They are expanded to float arrays only where AmiBroker needs an array (trade signals, plot colors and shapes).
+			Kernels::ScratchScope signalScratch;
+			int words = Kernels::SignalWords(BarCount);
+			Kernels::Span<std::uint64_t> emaAbove = signalScratch.Allocate<std::uint64_t>(words);
+			Kernels::Span<std::uint64_t> buySignal = signalScratch.Allocate<std::uint64_t>(words);
+			Kernels::Span<std::uint64_t> shortSignal = signalScratch.Allocate<std::uint64_t>(words);
+			Kernels::Span<std::uint64_t> acted = signalScratch.Allocate<std::uint64_t>(4 * words);
+
+			Kernels::Compare(myMa->Array, myFastEma->Array, Kernels::Comparison::Less, emaAbove.Data(), BarCount);
+			AFGraph::Plot(myFastEma, "Ema5", SignalArray(emaAbove.Data(), (float)Color::DarkGreen, (float)Color::Brown), Style::Line);
 
 			AFGraph::PlotOHLC(Open, High, Low, Close, "Close", Color::Red, Style::Candle);
 
-			Buy = AFTools::Cross(myFastEma, myMa);
-			Cover = gcnew ATArray(Buy);               //makes a copy of the original array as it may change at backtest
-			Short = AFTools::Cross(myMa, myFastEma);
-			Sell = gcnew ATArray(Short);
+			Kernels::Cross(myFastEma->Array, myMa->Array, buySignal.Data(), BarCount);
+			Kernels::Cross(myMa->Array, myFastEma->Array, shortSignal.Data(), BarCount);
+
+			// the crossovers are the entries and also the exits of the opposite position (Cover = Buy, Sell = Short).
+			// The position state machine (Kernels\Positions.h) keeps the signals that are acted on in one pass, instead of
+			// copying the arrays and leaving the redundant signals to the backtester.
+			Kernels::PositionSignals raw = { buySignal.Data(), shortSignal.Data(), shortSignal.Data(), buySignal.Data(),
+				Open->Array, Close->Array, Open->Array, Close->Array };
+			Kernels::PositionOutputs positions = { acted.Data(), acted.Data() + words, acted.Data() + 2 * words, acted.Data() + 3 * words,
+				nullptr, nullptr, nullptr, nullptr, nullptr };
+			Kernels::TrackPositions(raw, BarCount, positions);
 
-			BuyPrice = gcnew ATArray(Open);
-			ShortPrice = gcnew ATArray(Open);
-			SellPrice = gcnew ATArray(Close);
-			CoverPrice = gcnew ATArray(Close);
+			Buy = SignalArray(positions.buy);         //each variable gets its own array as the backtester may change it
+			Sell = SignalArray(positions.sell);
+			Short = SignalArray(positions.shrt);
+			Cover = SignalArray(positions.cover);
+
+			BuyPrice = NewResultArray(Open);
+			ShortPrice = NewResultArray(Open);
+			SellPrice = NewResultArray(Close);
+			CoverPrice = NewResultArray(Close);
 
 			// Be carefull! The following line has correct syntax. It would probably even work in this sample in most cases.
 			// However, it does not copy the "Open" array to the BuyPrice and ShortPrice arrays. Instead it sets 
@@ -433,11 +652,11 @@ namespace AmiBroker
 			//           BuyPrice = gcnew ATArray(Open);
 			// Now BuyPrice has a copy of the Open array
 
-			AFGraph::PlotShapes(AFTools::Iif(Buy, Shape::UpArrow, Shape::None), Color::Green, 0, Open);
-			AFGraph::PlotShapes(AFTools::Iif(Sell, Shape::DownArrow, Shape::None), Color::Red, 0, Close);
+			AFGraph::PlotShapes(SignalArray(positions.buy, Shape::UpArrow), Color::Green, 0, Open);
+			AFGraph::PlotShapes(SignalArray(positions.sell, Shape::DownArrow), Color::Red, 0, Close);
 
-			AFGraph::PlotShapes(AFTools::Iif(Short, Shape::HollowDownArrow, Shape::None), Color::Red, 0, Open);
-			AFGraph::PlotShapes(AFTools::Iif(Cover, Shape::HollowUpArrow, Shape::None), Color::Green, 0, Close);
+			AFGraph::PlotShapes(SignalArray(positions.shrt, Shape::HollowDownArrow), Color::Red, 0, Open);
+			AFGraph::PlotShapes(SignalArray(positions.cover, Shape::HollowUpArrow), Color::Green, 0, Close);
 
 			AFTools::SetOption(AFTools::UseCustomBacktestProc, ATFloat::True);
 
@@ -453,6 +672,17 @@ namespace AmiBroker
 					st->GetValue(Stats::LosersAvgLoss) * st->GetValue(Stats::LosersPercent)) / 100;
 
 				bo->AddCustomMetric("Expectancy", expectancy, 0, 0, 2);
+
+				// CAGR, drawdown duration, Sharpe, Sortino, ulcer index and MAR of the portfolio equity (Kernels\EquityAnalytics.h),
+				// annualized by the bars per year of the backtest dates
+				ATArray^ equity = bo->EquityArray;
+				DateTimeSpan dates(ABHost::GetDatatimeArray());
+				Kernels::EquitySettings settings;
+				settings.periodsPerYear = Kernels::PeriodsPerYear(dates.Data(), dates.Length());
+				Kernels::EquityOutputs none = {};
+				Kernels::EquityMetrics metrics = Kernels::AnalyzeEquity(equity->Array, equity->Length, settings, none);
+				for (const Kernels::TradeMetricValue& value : Kernels::EquityMetricValues(metrics))
+					bo->AddCustomMetric(gcnew String(value.name.c_str()), (float)value.all, (float)value.longOnly, (float)value.shortOnly, (float)value.decimals);
 			}
 		}
 
@@ -491,6 +721,8 @@ namespace AmiBroker
 		[ABMethod]
 		float BasicSamples::BasicSampleVC10(float a, float b)
 		{
+			Kernels::ProfileScope profile("BasicSampleVC10", 0);
+
 			return (ATFloat)a & b;   // logical AND operator that respects Nulls
 		}
 
@@ -513,11 +745,19 @@ namespace AmiBroker
 		[ABMethod]
 		float BasicSamples::BasicSampleVC11(float a, float b)
 		{
+			Kernels::ProfileScope profile("BasicSampleVC11", 0);
+
 			// You can use ATFloat's static members to test any float's boolean value
 			if (ATFloat::IsTrue(a) & ATFloat::IsTrue(b))
 				return ATFloat::True;
 
 			return ATFloat::False;
 		}
+
+		float BasicSamples::ReadSetting(String^ name, float defaultValue)
+		{
+			float value = ATAfl::ReadFrom(name).GetFloat();
+			return value == ATFloat::Null ? defaultValue : value;
+		}
 	}
 }
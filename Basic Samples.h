@@ -23,6 +23,9 @@ namespace AmiBroker
 			void BasicSampleVC9();
 			float BasicSampleVC10(float a, float b);
 			float BasicSampleVC11(float a, float b);
+
+		private:
+			static float ReadSetting(String^ name, float defaultValue);
 		};
 	}
 }
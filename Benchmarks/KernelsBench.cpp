@@ -0,0 +1,1020 @@
+// KernelsBench.cpp : benchmarks of the native kernels on synthetic 500k-bar series
+//
+// Run: KernelsBench --benchmark_format=json --benchmark_out=kernels.json
+// and compare runs with Google Benchmark's tools/compare.py to gate regressions.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Kernels/Arithmetic.h"
+#include "Kernels/Averages.h"
+#include "Kernels/EquityAnalytics.h"
+#include "Kernels/Expression.h"
+#include "Kernels/Incremental.h"
+#include "Kernels/Null.h"
+#include "Kernels/Optimizer.h"
+#include "Kernels/Parallel.h"
+#include "Kernels/Positions.h"
+#include "Kernels/Price.h"
+#include "Kernels/Profiler.h"
+#include "Kernels/RecursiveFilter.h"
+#include "Kernels/ResultCache.h"
+#include "Kernels/RollingWindow.h"
+#include "Kernels/Signals.h"
+#include "Kernels/Simd.h"
+#include "Kernels/Span.h"
+#include "Kernels/TickStream.h"
+#include "Kernels/TimeFrame.h"
+#include "Kernels/TradeAnalytics.h"
+#include "Kernels/WalkForward.h"
+#include "Offline/Backtester.h"
+#include "Offline/SampleProcedures.h"
+#include "Offline/TickReplay.h"
+#include "SyntheticBars.h"
+
+using namespace AmiBroker;
+
+namespace
+{
+	const Benchmarks::Bars& SharedBars()
+	{
+		static const Benchmarks::Bars bars = Benchmarks::MakeBars(Benchmarks::DefaultBarCount);
+		return bars;
+	}
+
+	void SetCounters(benchmark::State& state, int length, int inputs)
+	{
+		state.SetItemsProcessed(state.iterations() * length);
+		state.SetBytesProcessed(state.iterations() * length * (int64_t)sizeof(float) * (inputs + 1));
+	}
+
+	// the original O(n * period) loop of LoopSampleVC, kept as the baseline
+	void MaNaive(const float* src, float* dst, int length, int period)
+	{
+		for (int i = 0; i < period - 1 && i < length; i++)
+			dst[i] = Kernels::Null;
+
+		for (int i = period - 1; i < length; i++)
+		{
+			float tempSum = 0.0f;
+			for (int j = 0; j < period; j++)
+				tempSum = tempSum + src[i - j];
+			dst[i] = tempSum / period;
+		}
+	}
+
+	// the same loop on spans, the way LoopSampleVC indexes the ATArray buffers: must match MaNaive in release builds
+	void MaNaiveSpan(Kernels::Span<const float> src, Kernels::Span<float> dst, int period)
+	{
+		for (int i = 0; i < period - 1 && i < dst.Length(); i++)
+			dst[i] = Kernels::Null;
+
+		for (int i = period - 1; i < dst.Length(); i++)
+		{
+			float tempSum = 0.0f;
+			for (int j = 0; j < period; j++)
+				tempSum = tempSum + src[i - j];
+			dst[i] = tempSum / period;
+		}
+	}
+
+	void BM_MaNaiveSpan(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		std::vector<float> result(bars.Length());
+
+		for (auto _ : state)
+		{
+			MaNaiveSpan(Kernels::Span<const float>(bars.close.data(), bars.Length()), Kernels::Span<float>(result.data(), bars.Length()), (int)state.range(0));
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, bars.Length(), 1);
+	}
+
+	void BM_MaNaive(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		std::vector<float> result(bars.Length());
+
+		for (auto _ : state)
+		{
+			MaNaive(bars.close.data(), result.data(), bars.Length(), (int)state.range(0));
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, bars.Length(), 1);
+	}
+
+	// a series long enough for the rolling engine to cut it into chunks; the argument is the thread count
+	void BM_RollingMaParallel(benchmark::State& state)
+	{
+		static const Benchmarks::Bars bars = Benchmarks::MakeBars(4 * Kernels::ParallelMinimumLength);
+		std::vector<float> result(bars.Length());
+		int previous = Kernels::Parallelism();
+		Kernels::SetParallelism((int)state.range(0));
+
+		for (auto _ : state)
+		{
+			Kernels::RollingMa(bars.close.data(), result.data(), bars.Length(), 200);
+			benchmark::DoNotOptimize(result.data());
+		}
+		Kernels::SetParallelism(previous);
+		SetCounters(state, bars.Length(), 1);
+	}
+
+	// EMA as a parallel prefix scan, checked against the sequential recurrence on the same bars
+	void BM_EmaScan(benchmark::State& state)
+	{
+		static const Benchmarks::Bars bars = Benchmarks::MakeBars(4 * Kernels::ParallelMinimumLength);
+		std::vector<float> result(bars.Length());
+		std::vector<float> reference(bars.Length());
+		Kernels::IirCoefficients coefficients = Kernels::EmaCoefficients(20);
+		int previous = Kernels::Parallelism();
+		Kernels::SetParallelism((int)state.range(0));
+
+		for (auto _ : state)
+		{
+			Kernels::Iir(bars.close.data(), result.data(), bars.Length(), coefficients, 20);
+			benchmark::DoNotOptimize(result.data());
+		}
+		Kernels::SetParallelism(previous);
+		SetCounters(state, bars.Length(), 1);
+
+		Kernels::IirSequential(bars.close.data(), reference.data(), bars.Length(), coefficients, 20);
+		double maxError = 0.0;
+		for (int i = 0; i < bars.Length(); i++)
+		{
+			if (Kernels::IsNull(result[i]) != Kernels::IsNull(reference[i]))
+			{
+				state.SkipWithError("Null bars differ from the sequential EMA");
+				return;
+			}
+			if (!Kernels::IsNull(reference[i]))
+				maxError = std::max(maxError, std::fabs((double)result[i] - reference[i]) / std::max(1.0, std::fabs((double)reference[i])));
+		}
+		state.counters["max_rel_error"] = maxError;
+		if (maxError > 1e-6)
+			state.SkipWithError("EMA scan differs from the sequential EMA");
+	}
+
+	// cost of measuring one plug-in call: two clock reads and the per-thread counters
+	void BM_ProfileScope(benchmark::State& state)
+	{
+		for (auto _ : state)
+		{
+			Kernels::ProfileScope profile("BM_ProfileScope", 1000);
+			benchmark::ClobberMemory();
+		}
+	}
+
+	void BM_Ma(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		std::vector<float> result(bars.Length());
+
+		for (auto _ : state)
+		{
+			Kernels::Ma(bars.close.data(), result.data(), bars.Length(), (int)state.range(0));
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, bars.Length(), 1);
+	}
+
+	void BM_Ema(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		std::vector<float> result(bars.Length());
+
+		for (auto _ : state)
+		{
+			Kernels::Ema(bars.close.data(), result.data(), bars.Length(), (int)state.range(0));
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, bars.Length(), 1);
+	}
+
+	// the periods of a typical MA optimization
+	std::vector<int> OptimizationPeriods()
+	{
+		std::vector<int> periods;
+		for (int period = 5; period <= 160; period += 5)
+			periods.push_back(period);
+		return periods;
+	}
+
+	void BM_MaPerPeriod(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		std::vector<int> periods = OptimizationPeriods();
+		std::vector<std::vector<float>> results(periods.size(), std::vector<float>(bars.Length()));
+
+		for (auto _ : state)
+		{
+			for (size_t k = 0; k < periods.size(); k++)
+				Kernels::Ma(bars.close.data(), results[k].data(), bars.Length(), periods[k]);
+			benchmark::ClobberMemory();
+		}
+		SetCounters(state, bars.Length() * (int)periods.size(), 1);
+	}
+
+	void BM_MaBatch(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		std::vector<int> periods = OptimizationPeriods();
+		std::vector<std::vector<float>> results(periods.size(), std::vector<float>(bars.Length()));
+		std::vector<float*> buffers;
+		for (std::vector<float>& result : results)
+			buffers.push_back(result.data());
+
+		for (auto _ : state)
+		{
+			Kernels::MaBatch(bars.close.data(), bars.Length(), periods.data(), (int)periods.size(), buffers.data());
+			benchmark::ClobberMemory();
+		}
+		SetCounters(state, bars.Length() * (int)periods.size(), 1);
+	}
+
+	// a real-time refresh: the last bar changes on every tick, the cached state is continued
+	void BM_IncrementalTick(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		std::vector<float> close(bars.close);
+		std::vector<std::uint64_t> dates(bars.Length());
+		for (int i = 0; i < bars.Length(); i++)
+			dates[i] = (std::uint64_t)i;
+		std::vector<float> result(bars.Length());
+
+		Kernels::IncrementalKey key;
+		key.symbol = "BENCH";
+		key.interval = 60;
+		key.function = Kernels::IncrementalFunction::Ma;
+		key.period = (int)state.range(0);
+
+		float tick = 0.0f;
+		for (auto _ : state)
+		{
+			close.back() = bars.close.back() + (tick += 0.01f);
+			Kernels::IncrementalUpdate(key, close.data(), dates.data(), bars.Length(), result.data());
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, bars.Length(), 1);
+	}
+
+	// typical price MA calculated on every call
+	void BM_TypicalPriceMa(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		std::vector<float> price(bars.Length());
+		std::vector<float> result(bars.Length());
+
+		for (auto _ : state)
+		{
+			Kernels::TypicalPrice(bars.high.data(), bars.low.data(), bars.close.data(), price.data(), bars.Length());
+			Kernels::Ma(price.data(), result.data(), bars.Length(), 20);
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, bars.Length(), 3);
+	}
+
+	// the same served by the result cache: hashing the inputs and copying the cached result
+	void BM_TypicalPriceMaCached(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		std::vector<float> result(bars.Length());
+
+		for (auto _ : state)
+		{
+			Kernels::ResultKey key("TypicalPriceMa");
+			key.AddInput(bars.high.data(), bars.Length());
+			key.AddInput(bars.low.data(), bars.Length());
+			key.AddInput(bars.close.data(), bars.Length());
+			key.AddParameter(20);
+
+			if (!Kernels::ResultCacheGet(key, result.data(), bars.Length()))
+			{
+				std::vector<float> price(bars.Length());
+				Kernels::TypicalPrice(bars.high.data(), bars.low.data(), bars.close.data(), price.data(), bars.Length());
+				Kernels::Ma(price.data(), result.data(), bars.Length(), 20);
+				Kernels::ResultCachePut(key, result.data(), bars.Length());
+			}
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, bars.Length(), 3);
+	}
+
+	// a portfolio backtest with 50k random trades
+	const Kernels::TradeColumns& SharedTrades()
+	{
+		static const Kernels::TradeColumns trades = []()
+		{
+			Kernels::TradeColumns columns;
+			std::mt19937 random(11);
+			std::normal_distribution<double> returns(0.3, 4.0);
+			std::uniform_int_distribution<int> bars(1, 60);
+			for (int i = 0; i < 50000; i++)
+			{
+				double percent = returns(random);
+				columns.Add(percent * 100.0, percent, bars(random), 100.0f, (float)(100.0 + percent), (float)std::fabs(percent) / 2, (float)std::fabs(percent), i % 3 != 0, false);
+			}
+			return columns;
+		}();
+		return trades;
+	}
+
+	void BM_TradeMetrics(benchmark::State& state)
+	{
+		const Kernels::TradeColumns& trades = SharedTrades();
+
+		for (auto _ : state)
+		{
+			std::vector<Kernels::TradeMetricValue> values = Kernels::CalculateTradeMetrics(trades, Kernels::TradeMetrics::All, Kernels::DefaultTradePercentiles());
+			benchmark::DoNotOptimize(values.data());
+		}
+		state.SetItemsProcessed(state.iterations() * trades.Count());
+	}
+
+	// portfolio backtest of the sample system on 50 symbols of 20k bars: the signal loop, mark to market and statistics
+	void BM_OfflineBacktest(benchmark::State& state)
+	{
+		const int symbolCount = 50, barCount = 20000;
+		static std::vector<Offline::SymbolQuotes> quotes;
+		if (quotes.empty())
+		{
+			quotes.resize(symbolCount);
+			for (int s = 0; s < symbolCount; s++)
+			{
+				Benchmarks::Bars bars = Benchmarks::MakeBars(barCount, 20100101u + s);
+				quotes[s].symbol = "SYM" + std::to_string(s);
+				quotes[s].Reserve(barCount);
+				for (int i = 0; i < barCount; i++)
+					quotes[s].Add(i, bars.open[i], bars.high[i], bars.low[i], bars.close[i], bars.volume[i]);
+			}
+		}
+
+		std::vector<Offline::SymbolData> symbols;
+		for (const Offline::SymbolQuotes& symbol : quotes)
+			symbols.push_back(symbol.View());
+		std::vector<Offline::SymbolSignals> signals = Offline::CrossoverSignals(symbols);
+
+		for (auto _ : state)
+		{
+			// the backtester keeps its own signals; the copy is not part of the backtest
+			state.PauseTiming();
+			std::vector<Offline::SymbolSignals> copy = signals;
+			state.ResumeTiming();
+
+			Offline::Backtester bo(symbols, std::move(copy));
+			bo.Backtest();
+			benchmark::DoNotOptimize(bo.Equity);
+		}
+		state.SetItemsProcessed(state.iterations() * symbolCount * (int64_t)barCount);
+	}
+
+	// restores the instruction set that was active when it was created, however the benchmark returns
+	class SimdLevelScope
+	{
+	public:
+		SimdLevelScope()
+			: previous(Kernels::ActiveSimdLevel())
+		{
+		}
+
+		~SimdLevelScope()
+		{
+			Kernels::SetSimdLevel(previous);
+		}
+
+		SimdLevelScope(const SimdLevelScope&) = delete;
+		SimdLevelScope& operator=(const SimdLevelScope&) = delete;
+
+	private:
+		Kernels::SimdLevel previous;
+	};
+
+	// runs the benchmark with the instruction set given by the first argument; the caller restores the previous one with a SimdLevelScope
+	bool UseSimdLevel(benchmark::State& state)
+	{
+		Kernels::SimdLevel level = (Kernels::SimdLevel)state.range(0);
+		if (level > Kernels::DetectSimdLevel())
+		{
+			state.SkipWithError("instruction set not supported by this CPU");
+			return false;
+		}
+		state.SetLabel(Kernels::SimdLevelName(level));
+		Kernels::SetSimdLevel(level);
+		return true;
+	}
+
+	// (High + Low + 2 * Close) / 4 the way chained ATArray operators evaluate it: one pass and one temporary per operator
+	void BM_TypicalPriceChained(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		int length = bars.Length();
+		std::vector<float> sum(length), doubled(length), total(length), result(length);
+
+		SimdLevelScope simd;
+		Kernels::SetSimdLevel(Kernels::SimdLevel::Scalar);
+		for (auto _ : state)
+		{
+			Kernels::Add(bars.high.data(), bars.low.data(), sum.data(), length);
+			Kernels::Scale(bars.close.data(), doubled.data(), length, 2.0f);
+			Kernels::Add(sum.data(), doubled.data(), total.data(), length);
+			Kernels::Scale(total.data(), result.data(), length, 0.25f);
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, length, 3);
+	}
+
+	void BM_TypicalPrice(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		std::vector<float> result(bars.Length());
+
+		SimdLevelScope simd;
+		if (!UseSimdLevel(state))
+			return;
+		for (auto _ : state)
+		{
+			Kernels::TypicalPrice(bars.high.data(), bars.low.data(), bars.close.data(), result.data(), bars.Length());
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, bars.Length(), 3);
+	}
+
+	// (myMa - myEma) * 100 of BasicSampleVC4 with one temporary per operator
+	void BM_DiffChained(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		int length = bars.Length();
+		std::vector<float> diff(length), result(length);
+
+		for (auto _ : state)
+		{
+			Kernels::Subtract(bars.high.data(), bars.low.data(), diff.data(), length);
+			Kernels::Scale(diff.data(), result.data(), length, 100.0f);
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, length, 2);
+	}
+
+	// the same expression fused by the expression templates
+	void BM_DiffExpression(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		int length = bars.Length();
+		std::vector<float> result(length);
+
+		for (auto _ : state)
+		{
+			Kernels::Evaluate((Kernels::Series(bars.high.data()) - Kernels::Series(bars.low.data())) * 100.0f, result.data(), length);
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, length, 2);
+	}
+
+	void BM_TypicalPriceExpression(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		int length = bars.Length();
+		std::vector<float> result(length);
+		Kernels::SeriesTerm high = Kernels::Series(bars.high.data());
+		Kernels::SeriesTerm low = Kernels::Series(bars.low.data());
+		Kernels::SeriesTerm close = Kernels::Series(bars.close.data());
+
+		for (auto _ : state)
+		{
+			Kernels::Evaluate((high + low + 2 * close) / 4, result.data(), length);
+			benchmark::DoNotOptimize(result.data());
+		}
+		SetCounters(state, length, 3);
+	}
+
+	void BM_PercentBands(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		std::vector<float> upper(bars.Length()), lower(bars.Length());
+
+		SimdLevelScope simd;
+		if (!UseSimdLevel(state))
+			return;
+		for (auto _ : state)
+		{
+			Kernels::PercentBands(bars.close.data(), upper.data(), lower.data(), bars.Length(), 1.0f);
+			benchmark::DoNotOptimize(upper.data());
+			benchmark::DoNotOptimize(lower.data());
+		}
+		SetCounters(state, bars.Length(), 2);
+	}
+
+	// averages of a multi-condition strategy: Buy = ExRem(Cross(fast, slow) AND Close > slow AND High > fast, Cross(slow, fast))
+	struct StrategyInputs
+	{
+		std::vector<float> fast;
+		std::vector<float> slow;
+	};
+
+	const StrategyInputs& SharedStrategyInputs()
+	{
+		static const StrategyInputs inputs = []()
+		{
+			const Benchmarks::Bars& bars = SharedBars();
+			StrategyInputs result;
+			result.fast.resize(bars.Length());
+			result.slow.resize(bars.Length());
+			Kernels::Ema(bars.close.data(), result.fast.data(), bars.Length(), 5);
+			Kernels::Ma(bars.close.data(), result.slow.data(), bars.Length(), 20);
+			return result;
+		}();
+		return inputs;
+	}
+
+	// the strategy with a float array per step, like ATArray operators and AFTools::Cross
+	void BM_SignalsFloat(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		const StrategyInputs& inputs = SharedStrategyInputs();
+		int length = bars.Length();
+		std::vector<float> cross(length), above(length), high(length), sell(length), buy(length);
+
+		for (auto _ : state)
+		{
+			auto crossArrays = [&](const float* a, const float* b, float* dst)
+			{
+				dst[0] = 0.0f;
+				for (int i = 1; i < length; i++)
+				{
+					bool valid = !Kernels::IsNull(a[i]) && !Kernels::IsNull(b[i]) && !Kernels::IsNull(a[i - 1]) && !Kernels::IsNull(b[i - 1]);
+					dst[i] = valid && a[i] > b[i] && a[i - 1] <= b[i - 1] ? 1.0f : 0.0f;
+				}
+			};
+			crossArrays(inputs.fast.data(), inputs.slow.data(), cross.data());
+			crossArrays(inputs.slow.data(), inputs.fast.data(), sell.data());
+			for (int i = 0; i < length; i++)
+				above[i] = bars.close[i] > inputs.slow[i] && !Kernels::IsNull(inputs.slow[i]) ? 1.0f : 0.0f;
+			for (int i = 0; i < length; i++)
+				high[i] = bars.high[i] > inputs.fast[i] && !Kernels::IsNull(inputs.fast[i]) ? 1.0f : 0.0f;
+			for (int i = 0; i < length; i++)
+				cross[i] = cross[i] * above[i];
+			for (int i = 0; i < length; i++)
+				cross[i] = cross[i] * high[i];
+			bool on = false;
+			for (int i = 0; i < length; i++)
+			{
+				buy[i] = 0.0f;
+				if (!on && cross[i] != 0.0f)
+				{
+					buy[i] = 1.0f;
+					on = true;
+				}
+				if (on && sell[i] != 0.0f)
+					on = false;
+			}
+			benchmark::DoNotOptimize(buy.data());
+		}
+		SetCounters(state, length, 4);
+	}
+
+	// the same strategy on packed bits, expanded to a float array once at the end
+	void BM_SignalsPacked(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		const StrategyInputs& inputs = SharedStrategyInputs();
+		int length = bars.Length();
+		int words = Kernels::SignalWords(length);
+		std::vector<std::uint64_t> cross(words), above(words), high(words), sell(words), signal(words);
+		std::vector<float> buy(length);
+
+		SimdLevelScope simd;
+		if (!UseSimdLevel(state))
+			return;
+		for (auto _ : state)
+		{
+			Kernels::Cross(inputs.fast.data(), inputs.slow.data(), cross.data(), length);
+			Kernels::Cross(inputs.slow.data(), inputs.fast.data(), sell.data(), length);
+			Kernels::Compare(bars.close.data(), inputs.slow.data(), Kernels::Comparison::Greater, above.data(), length);
+			Kernels::Compare(bars.high.data(), inputs.fast.data(), Kernels::Comparison::Greater, high.data(), length);
+			Kernels::SignalAnd(cross.data(), above.data(), cross.data(), length);
+			Kernels::SignalAnd(cross.data(), high.data(), cross.data(), length);
+			Kernels::ExRem(cross.data(), sell.data(), signal.data(), length);
+			Kernels::ExpandSignal(signal.data(), buy.data(), length);
+			benchmark::DoNotOptimize(buy.data());
+		}
+		SetCounters(state, length, 4);
+	}
+
+	// raw Buy = fast > slow, Sell = Short = fast < slow, Cover = Buy: a signal on every bar, reduced to the crossovers
+	void BM_TrackPositions(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		const StrategyInputs& inputs = SharedStrategyInputs();
+		int length = bars.Length();
+		int words = Kernels::SignalWords(length);
+		std::vector<std::uint64_t> above(words), below(words), acted(4 * words), inLong(words), inShort(words);
+		std::vector<float> entryPrice(length), barsInTrade(length);
+		Kernels::Compare(inputs.fast.data(), inputs.slow.data(), Kernels::Comparison::Greater, above.data(), length);
+		Kernels::Compare(inputs.fast.data(), inputs.slow.data(), Kernels::Comparison::Less, below.data(), length);
+
+		Kernels::PositionSignals signals = { above.data(), below.data(), below.data(), above.data(),
+			bars.open.data(), bars.close.data(), bars.open.data(), bars.close.data() };
+		Kernels::PositionOutputs outputs = { acted.data(), acted.data() + words, acted.data() + 2 * words, acted.data() + 3 * words,
+			inLong.data(), inShort.data(), entryPrice.data(), barsInTrade.data(), nullptr };
+		int trades = 0;
+		for (auto _ : state)
+		{
+			trades = Kernels::TrackPositions(signals, length, outputs);
+			benchmark::DoNotOptimize(entryPrice.data());
+		}
+		state.counters["trades"] = trades;
+		SetCounters(state, length, 4);
+	}
+
+	// time stamps of the shared bars as 1 minute bars of a 9:30 - 16:00 session on week days
+	const std::vector<std::uint64_t>& SharedMinuteDates()
+	{
+		static const std::vector<std::uint64_t> dates = []
+		{
+			const int daysInMonth[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+			std::vector<std::uint64_t> result;
+			int year = 2010, month = 1, day = 1, weekday = 4;
+			while ((int)result.size() < SharedBars().Length())
+			{
+				for (int minute = 0; weekday < 5 && minute < 390 && (int)result.size() < SharedBars().Length(); minute++)
+					result.push_back(Kernels::MakeDateTime(year, month, day, 9 + (30 + minute) / 60, (30 + minute) % 60));
+
+				weekday = (weekday + 1) % 7;
+				bool leap = month == 2 && year % 4 == 0;
+				if (++day > daysInMonth[month - 1] + (leap ? 1 : 0))
+				{
+					day = 1;
+					if (++month > 12)
+					{
+						month = 1;
+						year++;
+					}
+				}
+			}
+			return result;
+		}();
+		return dates;
+	}
+
+	// 5 minute, hourly, daily and weekly bars: 0 = one pass per interval (TimeFrameSet), 1 = all in one pass, 2 = cached
+	void BM_TimeFrames(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		int length = bars.Length();
+		Kernels::TimeFrameInput input = { SharedMinuteDates().data(), bars.open.data(), bars.high.data(), bars.low.data(),
+			bars.close.data(), bars.volume.data(), length };
+		const int intervals[] = { 300, 3600, Kernels::IntervalDaily, Kernels::IntervalWeekly };
+		Kernels::CompressedBars compressed[4];
+
+		Kernels::TimeFrameClear();
+		for (auto _ : state)
+		{
+			if (state.range(0) == 0)
+			{
+				for (int k = 0; k < 4; k++)
+					Kernels::CompressTimeFrames(input, &intervals[k], 1, &compressed[k]);
+			}
+			else if (state.range(0) == 1)
+				Kernels::CompressTimeFrames(input, intervals, 4, compressed);
+			else
+				benchmark::DoNotOptimize(Kernels::TimeFrameCompress("BENCH", 60, input, intervals, 4));
+			benchmark::DoNotOptimize(compressed);
+		}
+		Kernels::TimeFrameClear();
+		SetCounters(state, length, 6);
+	}
+
+	// the hourly close expanded to the minute bars without lookahead
+	void BM_ExpandTimeFrame(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		int length = bars.Length();
+		Kernels::TimeFrameInput input = { SharedMinuteDates().data(), bars.open.data(), bars.high.data(), bars.low.data(),
+			bars.close.data(), bars.volume.data(), length };
+		int interval = 3600;
+		Kernels::CompressedBars hourly;
+		Kernels::CompressTimeFrames(input, &interval, 1, &hourly);
+
+		std::vector<float> result(length);
+		for (auto _ : state)
+		{
+			Kernels::ExpandTimeFrame(hourly.close.data(), hourly, result.data(), length);
+			benchmark::DoNotOptimize(result.data());
+		}
+		state.counters["compressed"] = hourly.Length();
+		SetCounters(state, length, 1);
+	}
+
+	const std::vector<Kernels::Tick>& SharedTicks()
+	{
+		static const std::vector<Kernels::Tick> ticks = []
+		{
+			std::vector<Kernels::Tick> result(2000000);
+			std::unique_ptr<Offline::TickSource> source = Offline::MakeSyntheticTicks((std::int64_t)result.size());
+			source->Read(result.data(), (int)result.size());
+			return result;
+		}();
+		return ticks;
+	}
+
+	class CountingSink : public Kernels::BarSink
+	{
+	public:
+		void OnBar(const Kernels::StreamBar& bar) override { last = bar.ma; bars++; }
+		float last = 0.0f;
+		std::int64_t bars = 0;
+	};
+
+	// 1 minute bars and their MA 20 from 2M ticks on one thread, in batches of the ring
+	void BM_TickAggregator(benchmark::State& state)
+	{
+		const std::vector<Kernels::Tick>& ticks = SharedTicks();
+		int count = (int)ticks.size();
+		CountingSink sink;
+		for (auto _ : state)
+		{
+			Kernels::TickAggregator aggregator(60, 20);
+			for (int k = 0; k < count; k += 4096)
+				aggregator.Push(ticks.data() + k, std::min(4096, count - k), sink);
+			aggregator.Flush(sink);
+			benchmark::DoNotOptimize(sink.last);
+		}
+		state.SetItemsProcessed(state.iterations() * count);
+	}
+
+	// the same through the lock-free ring, with the feed on a second thread
+	void BM_TickStage(benchmark::State& state)
+	{
+		const std::vector<Kernels::Tick>& ticks = SharedTicks();
+		int count = (int)ticks.size();
+		CountingSink sink;
+		for (auto _ : state)
+		{
+			Kernels::TickRing ring((int)state.range(0));
+			Kernels::TickAggregator aggregator(60, 20);
+			std::thread feed([&]
+			{
+				for (int sent = 0; sent < count;)
+				{
+					int pushed = ring.Push(ticks.data() + sent, std::min(4096, count - sent));
+					if (pushed == 0)
+						std::this_thread::yield();
+					sent += pushed;
+				}
+				ring.Close();
+			});
+			Kernels::RunTickStage(ring, aggregator, sink);
+			feed.join();
+			benchmark::DoNotOptimize(sink.last);
+		}
+		state.SetItemsProcessed(state.iterations() * count);
+	}
+
+	// the grid of the optimization benchmarks: fast 2..40 step 2, slow 10..200 step 10
+	Kernels::OptimizationSettings BenchmarkGrid()
+	{
+		Kernels::OptimizationSettings settings;
+		settings.fastMin = 2;
+		settings.fastMax = 40;
+		settings.fastStep = 2;
+		settings.slowMin = 10;
+		settings.slowMax = 200;
+		settings.slowStep = 10;
+		return settings;
+	}
+
+	// the baseline: every combination from scratch, the way an AFL optimization runs the formula once per combination
+	void BM_OptimizePerCombination(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		int length = bars.Length();
+		Kernels::OptimizationSettings settings = BenchmarkGrid();
+		std::vector<float> typicalPrice(length), ma(length), ema(length);
+		std::vector<std::uint64_t> up(Kernels::SignalWords(length)), down(Kernels::SignalWords(length));
+		std::vector<Kernels::PositionTrade> trades;
+		int combinations = 0;
+
+		for (auto _ : state)
+		{
+			combinations = 0;
+			for (int fast = settings.fastMin; fast <= settings.fastMax; fast += settings.fastStep)
+			{
+				for (int slow = settings.slowMin; slow <= settings.slowMax; slow += settings.slowStep)
+				{
+					if (fast >= slow)
+						continue;
+					Kernels::TypicalPrice(bars.high.data(), bars.low.data(), bars.close.data(), typicalPrice.data(), length);
+					Kernels::Ma(typicalPrice.data(), ma.data(), length, slow);
+					Kernels::Ema(bars.close.data(), ema.data(), length, fast);
+					Kernels::Cross(ema.data(), ma.data(), up.data(), length);
+					Kernels::Cross(ma.data(), ema.data(), down.data(), length);
+
+					Kernels::PositionSignals signals = { up.data(), down.data(), down.data(), up.data(),
+						bars.open.data(), bars.close.data(), bars.open.data(), bars.close.data() };
+					Kernels::PositionOutputs outputs = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, &trades };
+					trades.clear();
+					Kernels::TrackPositions(signals, length, outputs);
+					benchmark::DoNotOptimize(trades.data());
+					combinations++;
+				}
+			}
+		}
+		state.counters["combinations"] = combinations;
+		state.SetItemsProcessed(state.iterations() * combinations);
+	}
+
+	// the same grid through the optimizer: 0 = grid, 1 = random (100 combinations), 2 = successive halving (100 combinations)
+	void BM_Optimize(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		int length = bars.Length();
+		Kernels::OptimizationSettings settings = BenchmarkGrid();
+		settings.method = (Kernels::OptimizationMethod)state.range(0);
+		settings.samples = 100;
+		Kernels::CrossoverInputs inputs = { bars.open.data(), bars.high.data(), bars.low.data(), bars.close.data(), length };
+		int evaluations = 0;
+
+		for (auto _ : state)
+		{
+			Kernels::CrossoverSystem system(inputs);
+			Kernels::OptimizationReport report = Kernels::Optimize(system, settings);
+			evaluations = report.evaluations;
+			benchmark::DoNotOptimize(report.results.data());
+		}
+		// the rungs of successive halving are shorter than the bars, so the items are combinations, not bars
+		state.counters["combinations"] = evaluations;
+		state.SetItemsProcessed(state.iterations() * evaluations);
+	}
+
+	// 100k bars in sample, 50k out of sample (8 windows) on fast 2..40 step 4, slow 10..200 step 20:
+	// 0 = each window from scratch, 1 = WalkForward with the shared prefix sums and EMA cache and the windows in parallel
+	void BM_WalkForward(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		int length = bars.Length();
+		Kernels::WalkForwardSettings settings;
+		settings.inSample = 100000;
+		settings.outOfSample = 50000;
+		settings.optimization = BenchmarkGrid();
+		settings.optimization.fastStep = 4;
+		settings.optimization.slowStep = 20;
+		Kernels::CrossoverInputs inputs = { bars.open.data(), bars.high.data(), bars.low.data(), bars.close.data(), length };
+		double netProfit = 0.0;
+
+		for (auto _ : state)
+		{
+			if (state.range(0) == 0)
+			{
+				double equity = 1.0;
+				for (int isEnd = settings.inSample; isEnd < length; isEnd += settings.outOfSample)
+				{
+					Kernels::CrossoverSystem system(inputs);
+					Kernels::OptimizationSettings optimization = settings.optimization;
+					optimization.begin = isEnd - settings.inSample;
+					optimization.end = isEnd;
+					Kernels::OptimizationReport report = Kernels::Optimize(system, optimization);
+					Kernels::CrossoverResult result = system.Evaluate(report.results[0].fast, report.results[0].slow,
+						isEnd, std::min(isEnd + settings.outOfSample, length));
+					equity *= 1.0 + result.netProfit / 100.0;
+				}
+				netProfit = (equity - 1.0) * 100.0;
+			}
+			else
+			{
+				Kernels::CrossoverSystem system(inputs);
+				netProfit = Kernels::WalkForward(system, settings).netProfit;
+			}
+			benchmark::DoNotOptimize(netProfit);
+		}
+		SetCounters(state, length, 4);
+	}
+
+	// equity, drawdown, duration and the rolling Sharpe, Sortino and ulcer index (252 bars) of an always-in-the-market position:
+	// with the metrics of the whole curve: 0 = one array per step as an AFL formula chains them (returns, equity, highs,
+	// squares, four moving averages, the totals), 1 = PositionEquity
+	void BM_EquityAnalytics(benchmark::State& state)
+	{
+		const Benchmarks::Bars& bars = SharedBars();
+		int length = bars.Length();
+		const int window = 252;
+		const float annual = std::sqrt(252.0f);
+		std::vector<float> position(length), average(length);
+		Kernels::Ma(bars.close.data(), average.data(), length, 50);
+		for (int i = 0; i < length; i++)
+			position[i] = Kernels::IsNull(average[i]) ? 0.0f : bars.close[i] > average[i] ? 1.0f : -1.0f;
+
+		std::vector<float> equity(length), drawdown(length), drawdownBars(length), sharpe(length), sortino(length), ulcer(length);
+		std::vector<float> returns(length), squares(length), downside(length), drawdownSquares(length);
+		std::vector<float> mean(length), meanSquare(length), meanDownside(length), meanDrawdown(length);
+		Kernels::EquitySettings settings;
+		settings.window = window;
+		Kernels::EquityOutputs outputs = { equity.data(), drawdown.data(), drawdownBars.data(), sharpe.data(), sortino.data(), ulcer.data() };
+		Kernels::EquityMetrics metrics = {};
+
+		for (auto _ : state)
+		{
+			if (state.range(0) == 0)
+			{
+				returns[0] = 0.0f;
+				for (int i = 1; i < length; i++)
+					returns[i] = position[i - 1] * (bars.close[i] / bars.close[i - 1] - 1.0f);
+				double value = 1.0;
+				for (int i = 0; i < length; i++)
+				{
+					value *= 1.0 + returns[i];
+					equity[i] = (float)value;
+				}
+				float high = equity[0];
+				int highBar = 0;
+				for (int i = 0; i < length; i++)
+				{
+					if (equity[i] >= high)
+					{
+						high = equity[i];
+						highBar = i;
+					}
+					drawdown[i] = 100.0f * (equity[i] / high - 1.0f);
+					drawdownBars[i] = (float)(i - highBar);
+				}
+				for (int i = 0; i < length; i++)
+				{
+					squares[i] = returns[i] * returns[i];
+					downside[i] = returns[i] < 0.0f ? squares[i] : 0.0f;
+					drawdownSquares[i] = drawdown[i] * drawdown[i];
+				}
+				Kernels::Ma(returns.data(), mean.data(), length, window);
+				Kernels::Ma(squares.data(), meanSquare.data(), length, window);
+				Kernels::Ma(downside.data(), meanDownside.data(), length, window);
+				Kernels::Ma(drawdownSquares.data(), meanDrawdown.data(), length, window);
+				for (int i = window - 1; i < length; i++)
+				{
+					float deviation = std::sqrt(std::max(meanSquare[i] - mean[i] * mean[i], 0.0f));
+					sharpe[i] = deviation > 0.0f ? mean[i] / deviation * annual : Kernels::Null;
+					sortino[i] = meanDownside[i] > 0.0f ? mean[i] / std::sqrt(meanDownside[i]) * annual : Kernels::Null;
+					ulcer[i] = std::sqrt(meanDrawdown[i]);
+				}
+				double sum = 0.0, squareSum = 0.0, downsideSum = 0.0, drawdownSum = 0.0;
+				for (int i = 0; i < length; i++)
+				{
+					sum += returns[i];
+					squareSum += squares[i];
+					downsideSum += downside[i];
+					drawdownSum += drawdownSquares[i];
+					metrics.maxDrawdown = std::min(metrics.maxDrawdown, (double)drawdown[i]);
+					metrics.maxDrawdownBars = std::max(metrics.maxDrawdownBars, (int)drawdownBars[i]);
+				}
+				double mean = sum / length;
+				metrics.sharpe = mean / std::sqrt(squareSum / length - mean * mean) * annual;
+				metrics.sortino = mean / std::sqrt(downsideSum / length) * annual;
+				metrics.ulcerIndex = std::sqrt(drawdownSum / length);
+			}
+			else
+				metrics = Kernels::PositionEquity(position.data(), bars.close.data(), length, settings, outputs);
+			benchmark::DoNotOptimize(metrics);
+			benchmark::DoNotOptimize(sharpe.data());
+			benchmark::DoNotOptimize(ulcer.data());
+		}
+		SetCounters(state, length, 2);
+	}
+}
+
+BENCHMARK(BM_MaNaive)->Arg(20)->Arg(200)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MaNaiveSpan)->Arg(20)->Arg(200)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Ma)->Arg(20)->Arg(200)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ProfileScope);
+BENCHMARK(BM_IncrementalTick)->Arg(20)->Arg(200);
+BENCHMARK(BM_TypicalPriceMa)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_TypicalPriceMaCached)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_TradeMetrics)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_OfflineBacktest)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MaPerPeriod)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MaBatch)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Ema)->Arg(5)->Arg(20)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TypicalPriceChained)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TypicalPrice)->DenseRange(0, 3)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TypicalPriceExpression)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_DiffChained)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_DiffExpression)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RollingMaParallel)->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_EmaScan)->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PercentBands)->DenseRange(0, 3)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SignalsFloat)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SignalsPacked)->DenseRange(0, 3)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TrackPositions)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TimeFrames)->DenseRange(0, 2)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ExpandTimeFrame)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TickAggregator)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TickStage)->Arg(8192)->Arg(65536)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_OptimizePerCombination)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Optimize)->DenseRange(0, 2)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_WalkForward)->DenseRange(0, 1)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_EquityAnalytics)->DenseRange(0, 1)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
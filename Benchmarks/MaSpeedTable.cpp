@@ -0,0 +1,477 @@
+// MaSpeedTable.cpp : generates the MA speed table of "Sample5 Loop PerformanceVC.afl" from native measurements
+//
+// Usage: MaSpeedTable [options]
+//   --bars <n,n,...>            bar counts of the synthetic series (default 50000,500000)
+//   --periods <n,n,...>         MA periods (default 20,200)
+//   --data <quotes.csv | quotes.bin | quotes.abcol> [--symbol <name>]
+//                               also measures the close of a recorded symbol (default: the longest one) at its full length
+//   --min-time <seconds>        measuring time of one variant on one dataset (default 0.5)
+//   --repetitions <n>           repetitions of the measurement; the median is reported (default 5)
+//   --json <file>               writes the results as JSON
+//   --baseline <file>           JSON of an earlier run on the same machine: exits with 1 if a variant got slower
+//   --threshold <percent>       allowed slowdown against the baseline (default 10)
+//   --afl                       prints the table as the comment block of the AFL sample
+//
+// Every variant runs on the same data and its results are checked against the baseline loop,
+// so a faster but wrong variant fails as well. Exit codes: 0 = ok, 1 = regression or wrong result, 2 = usage or input error.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Kernels/Averages.h"
+#include "Kernels/Incremental.h"
+#include "Kernels/Null.h"
+#include "Kernels/Parallel.h"
+#include "Kernels/RollingWindow.h"
+#include "Kernels/Simd.h"
+#include "Offline/ColumnStore.h"
+#include "Offline/Quotes.h"
+#include "MaVariants.h"
+#include "SyntheticBars.h"
+
+using namespace AmiBroker;
+
+namespace
+{
+	struct Dataset
+	{
+		std::string name;
+		std::vector<float> close;
+		std::vector<std::uint64_t> dates;
+	};
+
+	struct Variant
+	{
+		const char* name;
+		// the row of the AFL table it corresponds to
+		const char* aflRow;
+		std::function<void(const Dataset& data, float* dst, int period)> run;
+		// true if the results must be bit-identical to the baseline; otherwise within a relative tolerance
+		bool exact;
+	};
+
+	struct Result
+	{
+		std::string dataset;
+		int bars;
+		int period;
+		std::string variant;
+		double nsPerBar;
+		double gbPerSecond;
+		double speedup;
+		bool correct;
+	};
+
+	// relative difference allowed for the variants that sum in another order (running sums, prefix sums)
+	const double Tolerance = 1e-4;
+
+	std::vector<int> ParseList(const char* text)
+	{
+		std::vector<int> values;
+		std::stringstream stream(text);
+		std::string item;
+		while (std::getline(stream, item, ','))
+		{
+			int value = std::atoi(item.c_str());
+			if (value > 0)
+				values.push_back(value);
+		}
+		return values;
+	}
+
+	bool EndsWith(const std::string& text, const char* suffix)
+	{
+		size_t length = std::strlen(suffix);
+		return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+	}
+
+	std::string SymbolName(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+		size_t dot = name.find_last_of('.');
+		return dot == std::string::npos ? name : name.substr(0, dot);
+	}
+
+	Dataset Synthetic(int bars)
+	{
+		Dataset data;
+		data.name = "synthetic";
+		data.close = Benchmarks::MakeBars(bars).close;
+		data.dates.resize(bars);
+		for (int i = 0; i < bars; i++)
+			data.dates[i] = (std::uint64_t)i + 1;
+		return data;
+	}
+
+	// the close of one symbol of a quotes file: the named one, or the longest one
+	Dataset Recorded(const std::string& path, const std::string& symbol)
+	{
+		std::vector<Offline::SymbolQuotes> quotes;
+		std::unique_ptr<Offline::ColumnStore> store;
+		std::vector<Offline::SymbolData> symbols;
+
+		if (EndsWith(path, ".abcol"))
+		{
+			store.reset(new Offline::ColumnStore(path));
+			for (int s = 0; s < store->SymbolCount(); s++)
+				symbols.push_back(store->View(s));
+		}
+		else
+		{
+			if (EndsWith(path, ".bin"))
+				quotes = Offline::LoadBinary(path);
+			else
+				quotes.push_back(Offline::LoadCsv(path, SymbolName(path)));
+			for (const Offline::SymbolQuotes& quote : quotes)
+				symbols.push_back(quote.View());
+		}
+
+		const Offline::SymbolData* chosen = nullptr;
+		for (const Offline::SymbolData& data : symbols)
+		{
+			if (symbol.empty() ? chosen == nullptr || data.length > chosen->length : data.symbol == symbol)
+				chosen = &data;
+		}
+		if (chosen == nullptr || chosen->length == 0)
+			throw std::runtime_error(symbol.empty() ? "No quotes in " + path : "No symbol " + symbol + " in " + path);
+
+		Dataset data;
+		data.name = chosen->symbol;
+		data.close.assign(chosen->close, chosen->close + chosen->length);
+		data.dates.assign(chosen->dates, chosen->dates + chosen->length);
+		return data;
+	}
+
+	std::vector<Variant> Variants()
+	{
+		std::vector<Variant> variants;
+		variants.push_back(Variant{ "Naive loop (baseline)", "C++ (Native) loop w/ opt. pointer",
+			[](const Dataset& data, float* dst, int period) { Benchmarks::MaNaive(data.close.data(), dst, (int)data.close.size(), period); }, true });
+
+		if (Benchmarks::HasMaNaiveSimd())
+		{
+			variants.push_back(Variant{ "Naive loop, SSE2 4 bars/op", "Native (Vector SSE2) loop",
+				[](const Dataset& data, float* dst, int period) { Benchmarks::MaNaiveSse2(data.close.data(), dst, (int)data.close.size(), period); }, true });
+			if (Kernels::DetectSimdLevel() >= Kernels::SimdLevel::Avx2)
+			{
+				variants.push_back(Variant{ "Naive loop, AVX2 8 bars/op", "Native (Vector AVX2) loop",
+					[](const Dataset& data, float* dst, int period) { Benchmarks::MaNaiveAvx2(data.close.data(), dst, (int)data.close.size(), period); }, true });
+			}
+		}
+
+		variants.push_back(Variant{ "Rolling window, 1 thread", "LoopSampleVC (rolling window)",
+			[](const Dataset& data, float* dst, int period)
+			{
+				int previous = Kernels::Parallelism();
+				Kernels::SetParallelism(1);
+				Kernels::Ma(data.close.data(), dst, (int)data.close.size(), period);
+				Kernels::SetParallelism(previous);
+			}, false });
+
+		variants.push_back(Variant{ "Rolling window, all threads", "LoopSampleVC (rolling window, parallel)",
+			[](const Dataset& data, float* dst, int period) { Kernels::Ma(data.close.data(), dst, (int)data.close.size(), period); }, false });
+
+		variants.push_back(Variant{ "Prefix sums (MaBatch)", "MaBatchVC (prefix sums)",
+			[](const Dataset& data, float* dst, int period) { Kernels::MaBatch(data.close.data(), (int)data.close.size(), &period, 1, &dst); }, false });
+
+		// a real-time refresh: the state is cached up to the last closed bar, so only the forming bar is calculated.
+		// Every call is a new tick: the close of the forming bar moves between two prices a tiny step apart
+		// (well within the tolerance of the check), so the closed bars are verified and the forming bar is recalculated
+		variants.push_back(Variant{ "Incremental refresh (tick)", "LoopSampleVC (real-time refresh)",
+			[ticks = std::vector<float>(), source = (const float*)nullptr, up = false](const Dataset& data, float* dst, int period) mutable
+			{
+				if (source != data.close.data() || ticks.size() != data.close.size())
+				{
+					ticks = data.close;
+					source = data.close.data();
+				}
+				if (!ticks.empty() && !Kernels::IsNull(data.close.back()))
+				{
+					up = !up;
+					ticks.back() = up ? data.close.back() * (1.0f + 1e-5f) : data.close.back();
+				}
+
+				Kernels::IncrementalKey key;
+				key.symbol = "MaSpeedTable/" + data.name;
+				key.interval = 0;
+				key.function = Kernels::IncrementalFunction::Ma;
+				key.period = period;
+				Kernels::IncrementalUpdate(key, ticks.data(), data.dates.data(), (int)ticks.size(), dst);
+			}, false });
+
+		return variants;
+	}
+
+	// compares a result to the baseline result; leading Nulls may differ (the kernels skip leading Nulls of the input)
+	bool Matches(const std::vector<float>& expected, const std::vector<float>& actual, bool exact)
+	{
+		for (size_t i = 0; i < expected.size(); i++)
+		{
+			float a = expected[i], b = actual[i];
+			if (Kernels::IsNull(a) || Kernels::IsNull(b))
+			{
+				if (exact && Kernels::IsNull(a) != Kernels::IsNull(b))
+					return false;
+				continue;
+			}
+			if (exact ? std::memcmp(&a, &b, sizeof(float)) != 0 : std::fabs(a - b) > Tolerance * std::max(std::fabs(a), 1.0f))
+				return false;
+		}
+		return true;
+	}
+
+	// median of the per-repetition times, in ns per bar
+	double Measure(const Variant& variant, const Dataset& data, std::vector<float>& dst, int period, double minTime, int repetitions)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		// warm up (and calibrate) with one call
+		Clock::time_point start = Clock::now();
+		variant.run(data, dst.data(), period);
+		double once = std::chrono::duration<double>(Clock::now() - start).count();
+		int iterations = std::max(1, (int)(minTime / repetitions / std::max(once, 1e-9)));
+
+		std::vector<double> samples;
+		for (int r = 0; r < repetitions; r++)
+		{
+			start = Clock::now();
+			for (int k = 0; k < iterations; k++)
+				variant.run(data, dst.data(), period);
+			double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			samples.push_back(seconds * 1e9 / iterations / (double)data.close.size());
+		}
+
+		std::sort(samples.begin(), samples.end());
+		return samples[samples.size() / 2];
+	}
+
+	void WriteJson(const std::string& path, const std::vector<Result>& results)
+	{
+		std::ofstream file(path);
+		if (!file)
+			throw std::runtime_error("Cannot create " + path);
+
+		file << "{\n  \"context\": {\"simd\": \"" << Kernels::SimdLevelName(Kernels::DetectSimdLevel()) << "\", \"threads\": "
+			<< Kernels::Parallelism() << "},\n  \"results\": [";
+		char line[512];
+		for (size_t k = 0; k < results.size(); k++)
+		{
+			const Result& r = results[k];
+			std::snprintf(line, sizeof(line),
+				"%s\n    {\"dataset\": \"%s\", \"bars\": %d, \"period\": %d, \"variant\": \"%s\", \"ns_per_bar\": %.6g, \"gb_per_s\": %.6g, \"speedup\": %.6g, \"correct\": %s}",
+				k == 0 ? "" : ",", r.dataset.c_str(), r.bars, r.period, r.variant.c_str(), r.nsPerBar, r.gbPerSecond, r.speedup, r.correct ? "true" : "false");
+			file << line;
+		}
+		file << "\n  ]\n}\n";
+	}
+
+	std::string StringField(const std::string& line, const char* key)
+	{
+		std::string pattern = std::string("\"") + key + "\": \"";
+		size_t start = line.find(pattern);
+		if (start == std::string::npos)
+			return std::string();
+		start += pattern.size();
+		return line.substr(start, line.find('"', start) - start);
+	}
+
+	double NumberField(const std::string& line, const char* key)
+	{
+		std::string pattern = std::string("\"") + key + "\": ";
+		size_t start = line.find(pattern);
+		return start == std::string::npos ? 0.0 : std::atof(line.c_str() + start + pattern.size());
+	}
+
+	std::string ResultKey(const std::string& dataset, int bars, int period, const std::string& variant)
+	{
+		return dataset + "/" + std::to_string(bars) + "/" + std::to_string(period) + "/" + variant;
+	}
+
+	// reads the ns/bar of every result of a file written by WriteJson (one result per line)
+	std::map<std::string, double> ReadBaseline(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file)
+			throw std::runtime_error("Cannot open " + path);
+
+		std::map<std::string, double> baseline;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::string variant = StringField(line, "variant");
+			if (!variant.empty())
+			{
+				baseline[ResultKey(StringField(line, "dataset"), (int)NumberField(line, "bars"), (int)NumberField(line, "period"), variant)] =
+					NumberField(line, "ns_per_bar");
+			}
+		}
+		return baseline;
+	}
+
+	void PrintAflTable(const std::vector<Result>& results, const std::vector<Variant>& variants, int bars, int period)
+	{
+		std::printf("\n// MA calculation                                     Execution time  Speed\n");
+		std::printf("// --------------------------------------------------------------------------\n");
+		for (const Result& r : results)
+		{
+			if (r.bars != bars || r.period != period || r.dataset != "synthetic")
+				continue;
+			const char* row = r.variant.c_str();
+			for (const Variant& variant : variants)
+			{
+				if (r.variant == variant.name)
+					row = variant.aflRow;
+			}
+			std::printf("// %-48s %10.3f ms %8.1f\n", row, r.nsPerBar * bars / 1e6, r.speedup);
+		}
+		std::printf("// --------------------------------------------------------------------------\n");
+		std::printf("// (generated by Benchmarks\\MaSpeedTable, %s, %d threads, %d bars, MA period: %d)\n",
+			Kernels::SimdLevelName(Kernels::DetectSimdLevel()), Kernels::Parallelism(), bars, period);
+	}
+
+	int Usage()
+	{
+		std::fprintf(stderr, "Usage: MaSpeedTable [--bars <n,...>] [--periods <n,...>] [--data <quotes> [--symbol <name>]] [--min-time <s>]\n"
+			"                    [--repetitions <n>] [--json <file>] [--baseline <file>] [--threshold <percent>] [--afl]\n");
+		return 2;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<int> barCounts = { 50000, 500000 };
+	std::vector<int> periods = { 20, 200 };
+	std::string dataPath, symbol, jsonPath, baselinePath;
+	double minTime = 0.5, threshold = 10.0;
+	int repetitions = 5;
+	bool afl = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--bars" && i + 1 < argc)
+			barCounts = ParseList(argv[++i]);
+		else if (arg == "--periods" && i + 1 < argc)
+			periods = ParseList(argv[++i]);
+		else if (arg == "--data" && i + 1 < argc)
+			dataPath = argv[++i];
+		else if (arg == "--symbol" && i + 1 < argc)
+			symbol = argv[++i];
+		else if (arg == "--min-time" && i + 1 < argc)
+			minTime = std::atof(argv[++i]);
+		else if (arg == "--repetitions" && i + 1 < argc)
+			repetitions = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--json" && i + 1 < argc)
+			jsonPath = argv[++i];
+		else if (arg == "--baseline" && i + 1 < argc)
+			baselinePath = argv[++i];
+		else if (arg == "--threshold" && i + 1 < argc)
+			threshold = std::atof(argv[++i]);
+		else if (arg == "--afl")
+			afl = true;
+		else
+			return Usage();
+	}
+
+	if (barCounts.empty() || periods.empty())
+		return Usage();
+
+	try
+	{
+		std::vector<Dataset> datasets;
+		for (int bars : barCounts)
+			datasets.push_back(Synthetic(bars));
+		if (!dataPath.empty())
+			datasets.push_back(Recorded(dataPath, symbol));
+
+		std::map<std::string, double> baseline;
+		if (!baselinePath.empty())
+			baseline = ReadBaseline(baselinePath);
+
+		std::vector<Variant> variants = Variants();
+		std::vector<Result> results;
+		int failures = 0;
+
+		std::printf("%-12s %9s %6s  %-28s %10s %8s %9s\n", "Dataset", "Bars", "Period", "Variant", "ns/bar", "GB/s", "Speedup");
+		for (const Dataset& data : datasets)
+		{
+			int bars = (int)data.close.size();
+			std::vector<float> expected(bars), dst(bars);
+
+			for (int period : periods)
+			{
+				Benchmarks::MaNaive(data.close.data(), expected.data(), bars, period);
+				double baselineNs = 0.0;
+
+				for (const Variant& variant : variants)
+				{
+					std::fill(dst.begin(), dst.end(), 0.0f);
+					variant.run(data, dst.data(), period);
+					bool correct = Matches(expected, dst, variant.exact);
+
+					Result result;
+					result.dataset = data.name;
+					result.bars = bars;
+					result.period = period;
+					result.variant = variant.name;
+					result.nsPerBar = Measure(variant, data, dst, period, minTime, repetitions);
+					// one float read and one written per bar
+					result.gbPerSecond = 2.0 * sizeof(float) / result.nsPerBar;
+					if (baselineNs == 0.0)
+						baselineNs = result.nsPerBar;
+					result.speedup = baselineNs / result.nsPerBar;
+					result.correct = correct;
+					results.push_back(result);
+
+					std::string verdict = correct ? "" : "  WRONG RESULT";
+					auto previous = baseline.find(ResultKey(data.name, bars, period, variant.name));
+					if (previous != baseline.end() && result.nsPerBar > previous->second * (1.0 + threshold / 100.0))
+					{
+						char text[64];
+						std::snprintf(text, sizeof(text), "  REGRESSION (+%.1f%%)", (result.nsPerBar / previous->second - 1.0) * 100.0);
+						verdict += text;
+					}
+					if (!verdict.empty())
+						failures++;
+
+					std::printf("%-12s %9d %6d  %-28s %10.3f %8.2f %9.1f%s\n", data.name.c_str(), bars, period, variant.name,
+						result.nsPerBar, result.gbPerSecond, result.speedup, verdict.c_str());
+				}
+			}
+		}
+
+		if (!jsonPath.empty())
+			WriteJson(jsonPath, results);
+
+		if (afl)
+		{
+			int bars = *std::max_element(barCounts.begin(), barCounts.end());
+			PrintAflTable(results, variants, bars, periods.front());
+		}
+
+		if (failures > 0)
+		{
+			std::printf("\n%d result(s) wrong or slower than the baseline by more than %.1f%%\n", failures, threshold);
+			return 1;
+		}
+		return 0;
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, "%s\n", e.what());
+		return 2;
+	}
+}
@@ -0,0 +1,81 @@
+// MaVariants.cpp : the moving average loops of the Sample5 speed table, scalar and SSE2
+
+#include "MaVariants.h"
+#include "Kernels/Null.h"
+#include "Kernels/Simd.h"
+
+#if KERNELS_X86
+#include <emmintrin.h>
+#endif
+
+namespace AmiBroker
+{
+	namespace Benchmarks
+	{
+		void MaNaive(const float* src, float* dst, int length, int period)
+		{
+			for (int i = 0; i < period - 1 && i < length; i++)
+				dst[i] = Kernels::Null;
+
+			for (int i = period - 1; i < length; i++)
+			{
+				float tempSum = 0.0f;
+				for (int j = 0; j < period; j++)
+					tempSum = tempSum + src[i - j];
+				dst[i] = tempSum / period;
+			}
+		}
+
+#if KERNELS_X86
+		bool HasMaNaiveSimd()
+		{
+			return true;
+		}
+
+		void MaNaiveSse2(const float* src, float* dst, int length, int period)
+		{
+			for (int i = 0; i < period - 1 && i < length; i++)
+				dst[i] = Kernels::Null;
+
+			const __m128 divisor = _mm_set1_ps((float)period);
+			int i = period - 1;
+
+			// four vectors of independent bars per window step hide the latency of the additions
+			for (; i + 16 <= length; i += 16)
+			{
+				__m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps(), sum2 = _mm_setzero_ps(), sum3 = _mm_setzero_ps();
+				for (int j = 0; j < period; j++)
+				{
+					const float* p = src + i - j;
+					sum0 = _mm_add_ps(sum0, _mm_loadu_ps(p));
+					sum1 = _mm_add_ps(sum1, _mm_loadu_ps(p + 4));
+					sum2 = _mm_add_ps(sum2, _mm_loadu_ps(p + 8));
+					sum3 = _mm_add_ps(sum3, _mm_loadu_ps(p + 12));
+				}
+				_mm_storeu_ps(dst + i, _mm_div_ps(sum0, divisor));
+				_mm_storeu_ps(dst + i + 4, _mm_div_ps(sum1, divisor));
+				_mm_storeu_ps(dst + i + 8, _mm_div_ps(sum2, divisor));
+				_mm_storeu_ps(dst + i + 12, _mm_div_ps(sum3, divisor));
+			}
+
+			for (; i < length; i++)
+			{
+				float tempSum = 0.0f;
+				for (int j = 0; j < period; j++)
+					tempSum = tempSum + src[i - j];
+				dst[i] = tempSum / period;
+			}
+		}
+#else
+		bool HasMaNaiveSimd()
+		{
+			return false;
+		}
+
+		void MaNaiveSse2(const float* src, float* dst, int length, int period)
+		{
+			MaNaive(src, dst, length, period);
+		}
+#endif
+	}
+}
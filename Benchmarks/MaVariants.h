@@ -0,0 +1,25 @@
+// MaVariants.h : the moving average loops of the Sample5 speed table, as native functions
+
+#pragma once
+
+namespace AmiBroker
+{
+	namespace Benchmarks
+	{
+		/// <summary>
+		/// The O(BarCount * period) loop of "Sample5 Loop PerformanceVC.afl" and of the original LoopSampleVC:
+		/// each bar sums the whole window again. The first period - 1 bars are Null. It is the baseline of the speed table.
+		/// </summary>
+		void MaNaive(const float* src, float* dst, int length, int period);
+
+		/// <summary>
+		/// The same loop vectorized over bars, the native counterpart of the "ASM x64 (Scalar/Vector)" rows of the table:
+		/// 4 (SSE2) or 8 (AVX2) neighbouring bars are summed at once. Each lane adds the window in the order of MaNaive,
+		/// so the results are bit-identical to it. The AVX2 variant may only be called if Kernels::DetectSimdLevel() supports it;
+		/// both are unavailable (false) on other than x86 processors.
+		/// </summary>
+		void MaNaiveSse2(const float* src, float* dst, int length, int period);
+		void MaNaiveAvx2(const float* src, float* dst, int length, int period);
+		bool HasMaNaiveSimd();
+	}
+}
@@ -0,0 +1,58 @@
+// MaVariantsAvx2.cpp : the moving average loop of the Sample5 speed table for AVX2 (8 lanes)
+// Compiled with AVX2 code generation (-mavx2, /arch:AVX2); only called if the CPU supports it.
+
+#include "MaVariants.h"
+#include "Kernels/Null.h"
+#include "Kernels/Simd.h"
+
+#if KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace AmiBroker
+{
+	namespace Benchmarks
+	{
+#if KERNELS_X86
+		void MaNaiveAvx2(const float* src, float* dst, int length, int period)
+		{
+			for (int i = 0; i < period - 1 && i < length; i++)
+				dst[i] = Kernels::Null;
+
+			const __m256 divisor = _mm256_set1_ps((float)period);
+			int i = period - 1;
+
+			// four vectors of independent bars per window step hide the latency of the additions
+			for (; i + 32 <= length; i += 32)
+			{
+				__m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps(), sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+				for (int j = 0; j < period; j++)
+				{
+					const float* p = src + i - j;
+					sum0 = _mm256_add_ps(sum0, _mm256_loadu_ps(p));
+					sum1 = _mm256_add_ps(sum1, _mm256_loadu_ps(p + 8));
+					sum2 = _mm256_add_ps(sum2, _mm256_loadu_ps(p + 16));
+					sum3 = _mm256_add_ps(sum3, _mm256_loadu_ps(p + 24));
+				}
+				_mm256_storeu_ps(dst + i, _mm256_div_ps(sum0, divisor));
+				_mm256_storeu_ps(dst + i + 8, _mm256_div_ps(sum1, divisor));
+				_mm256_storeu_ps(dst + i + 16, _mm256_div_ps(sum2, divisor));
+				_mm256_storeu_ps(dst + i + 24, _mm256_div_ps(sum3, divisor));
+			}
+
+			for (; i < length; i++)
+			{
+				float tempSum = 0.0f;
+				for (int j = 0; j < period; j++)
+					tempSum = tempSum + src[i - j];
+				dst[i] = tempSum / period;
+			}
+		}
+#else
+		void MaNaiveAvx2(const float* src, float* dst, int length, int period)
+		{
+			MaNaive(src, dst, length, period);
+		}
+#endif
+	}
+}
@@ -0,0 +1,66 @@
+// SyntheticBars.h : reproducible OHLCV series for the benchmarks
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Benchmarks
+	{
+		/// <summary>
+		/// Bar count of the intraday databases the kernels are tuned for.
+		/// </summary>
+		const int DefaultBarCount = 500000;
+
+		/// <summary>
+		/// Column-per-field bar data, the same layout AmiBroker hands to plug-ins.
+		/// </summary>
+		struct Bars
+		{
+			std::vector<float> open;
+			std::vector<float> high;
+			std::vector<float> low;
+			std::vector<float> close;
+			std::vector<float> volume;
+
+			int Length() const { return (int)close.size(); }
+		};
+
+		/// <summary>
+		/// Generates a geometric random walk with a fixed seed so every run measures the same data.
+		/// </summary>
+		inline Bars MakeBars(int length, std::uint32_t seed = 20100101u)
+		{
+			std::mt19937 random(seed);
+			std::normal_distribution<float> change(0.0f, 0.01f);
+			std::uniform_real_distribution<float> range(0.0f, 0.005f);
+			std::uniform_real_distribution<float> volume(1000.0f, 100000.0f);
+
+			Bars bars;
+			bars.open.resize(length);
+			bars.high.resize(length);
+			bars.low.resize(length);
+			bars.close.resize(length);
+			bars.volume.resize(length);
+
+			float price = 100.0f;
+			for (int i = 0; i < length; i++)
+			{
+				float open = price;
+				price = std::max(0.01f, price * (1.0f + change(random)));
+
+				bars.open[i] = open;
+				bars.close[i] = price;
+				bars.high[i] = std::max(open, price) * (1.0f + range(random));
+				bars.low[i] = std::min(open, price) * (1.0f - range(random));
+				bars.volume[i] = volume(random);
+			}
+
+			return bars;
+		}
+	}
+}
@@ -0,0 +1,63 @@
+/*Function Handle.cpp*/
+#include "stdafx.h"
+#include "Function Handle.h"
+
+namespace AmiBroker
+{
+	namespace Samples
+	{
+		FunctionHandle::FunctionHandle(String^ name, int parameterCount)
+			: name(name), parameterCount(parameterCount)
+		{
+			// the zero terminated ANSI name AmiBroker's site interface expects, encoded once
+			encodedName = ABHost::StringToByteArray(name);
+		}
+
+		FunctionHandle^ FunctionHandle::Get(String^ name, int parameterCount)
+		{
+			if (String::IsNullOrEmpty(name))
+				throw gcnew ArgumentException("Function name must be given.", "name");
+			if (parameterCount < 0)
+				throw gcnew ArgumentOutOfRangeException("parameterCount");
+
+			String^ key = name + "/" + parameterCount;
+
+			FunctionHandle^ handle;
+			if (!handles->TryGetValue(key, handle))
+				handle = handles->GetOrAdd(key, gcnew FunctionHandle(name, parameterCount));
+
+			return handle;
+		}
+
+		cli::array<ATVar>^ FunctionHandle::CreateArguments()
+		{
+			return gcnew cli::array<ATVar>(parameterCount);
+		}
+
+		ATVar FunctionHandle::Invoke(cli::array<ATVar>^ arguments)
+		{
+			if (arguments == nullptr || arguments->Length != parameterCount)
+				throw gcnew ArgumentException(String::Format("{0} takes {1} arguments.", name, parameterCount), "arguments");
+
+			return ABHost::CallFunction(encodedName, arguments);
+		}
+
+		cli::array<ATVar>^ FunctionHandle::InvokeBatch(cli::array<ATVar>^ argumentSets)
+		{
+			if (argumentSets == nullptr || (parameterCount == 0 ? argumentSets->Length != 0 : argumentSets->Length % parameterCount != 0))
+				throw gcnew ArgumentException(String::Format("The argument sets of {0} must hold a multiple of {1} values.", name, parameterCount), "argumentSets");
+
+			int count = parameterCount == 0 ? 0 : argumentSets->Length / parameterCount;
+			cli::array<ATVar>^ results = gcnew cli::array<ATVar>(count);
+			cli::array<ATVar>^ arguments = CreateArguments();
+
+			for (int k = 0; k < count; k++)
+			{
+				Array::Copy(argumentSets, k * parameterCount, arguments, 0, parameterCount);
+				results[k] = ABHost::CallFunction(encodedName, arguments);
+			}
+
+			return results;
+		}
+	}
+}
@@ -0,0 +1,74 @@
+/*Function Handle.h*/
+#pragma once
+
+using namespace System;
+using namespace AmiBroker;
+using namespace AmiBroker::PlugIn;
+
+namespace AmiBroker
+{
+	namespace Samples
+	{
+		/// <summary>
+		/// An AFL function (built-in or 3rd party plug-in) resolved once for repeated calls through ABHost::CallFunction.
+		///
+		/// ABHost::CallFunction(String^, ...) encodes the function name to an ANSI buffer and packs the arguments
+		/// into a new ATVar array on every call. When another plug-in's function is chained inside a loop,
+		/// this per-call work costs more than many of the functions themselves.
+		/// A handle keeps the encoded name, so a call passes the name and a reused argument pack straight to AmiBroker:
+		///
+		///     static FunctionHandle^ ma = FunctionHandle::Get("MA", 2);
+		///     cli::array<ATVar>^ arguments = ma->CreateArguments();
+		///     arguments[0] = ATVar(close);
+		///     arguments[1] = ATVar(20.0f);
+		///     ATVar result = ma->Invoke(arguments);
+		///
+		/// Handles are immutable, so one handle can be used by all threads; an argument pack belongs to one caller.
+		/// </summary>
+		ref class FunctionHandle sealed
+		{
+		public:
+			/// <summary>
+			/// Returns the handle of the function 'name' called with 'parameterCount' arguments.
+			/// Handles are cached, so each function is resolved once per plug-in load. Thread safe.
+			/// </summary>
+			static FunctionHandle^ Get(String^ name, int parameterCount);
+
+			property String^ Name
+			{
+				String^ get() { return name; }
+			}
+
+			property int ParameterCount
+			{
+				int get() { return parameterCount; }
+			}
+
+			/// <summary>
+			/// Allocates an argument pack of ParameterCount values for Invoke. Reuse it across calls.
+			/// </summary>
+			cli::array<ATVar>^ CreateArguments();
+
+			/// <summary>
+			/// Calls the function with the argument pack. Throws ArgumentException if the pack size does not match the handle.
+			/// </summary>
+			ATVar Invoke(cli::array<ATVar>^ arguments);
+
+			/// <summary>
+			/// Calls the function once per argument set and returns the results in order.
+			/// argumentSets holds the sets back to back: set k is argumentSets[k * ParameterCount ... (k + 1) * ParameterCount - 1].
+			/// One argument pack is reused for all calls.
+			/// </summary>
+			cli::array<ATVar>^ InvokeBatch(cli::array<ATVar>^ argumentSets);
+
+		private:
+			FunctionHandle(String^ name, int parameterCount);
+
+			String^ name;
+			int parameterCount;
+			cli::array<Byte>^ encodedName;
+
+			static Collections::Concurrent::ConcurrentDictionary<String^, FunctionHandle^>^ handles = gcnew Collections::Concurrent::ConcurrentDictionary<String^, FunctionHandle^>();
+		};
+	}
+}
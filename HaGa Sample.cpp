@@ -1,6 +1,7 @@
 /*this is the main DLL file*/
 #include "stdafx.h"
 #include "HaGa Sample.h"
+#include "Kernels/Profiler.h"
 
 namespace AmiBroker
 {
@@ -9,6 +10,8 @@ namespace AmiBroker
         [ABMethod]
         void HaGaSampleClass::HaGaSample()
         {
+			Kernels::ProfileScope profile("HaGaSample", BarCount);
+
 			/*calculate the moving average of close price by calling the built-in MA function*/
             ATArray^ mySlowMa = AFAvg::Ma(Close, 20);
 
@@ -0,0 +1,35 @@
+// Arithmetic.cpp : Null-aware element-wise arithmetic on arrays
+
+#include "Arithmetic.h"
+#include "Elementwise.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		void Add(const float* a, const float* b, float* dst, int length)
+		{
+			ActiveElementwiseKernels().add(a, b, dst, length);
+		}
+
+		void Subtract(const float* a, const float* b, float* dst, int length)
+		{
+			ActiveElementwiseKernels().subtract(a, b, dst, length);
+		}
+
+		void Multiply(const float* a, const float* b, float* dst, int length)
+		{
+			ActiveElementwiseKernels().multiply(a, b, dst, length);
+		}
+
+		void Divide(const float* a, const float* b, float* dst, int length)
+		{
+			ActiveElementwiseKernels().divide(a, b, dst, length);
+		}
+
+		void Scale(const float* src, float* dst, int length, float factor)
+		{
+			ActiveElementwiseKernels().scale(src, dst, length, factor);
+		}
+	}
+}
@@ -0,0 +1,24 @@
+// Arithmetic.h : Null-aware element-wise arithmetic on arrays
+
+#pragma once
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Vectorized equivalents of the ATArray +, -, * and / operators.
+		/// A Null in either operand produces Null; division by zero follows IEEE rules.
+		/// dst may be the same buffer as one of the operands.
+		/// </summary>
+		void Add(const float* a, const float* b, float* dst, int length);
+		void Subtract(const float* a, const float* b, float* dst, int length);
+		void Multiply(const float* a, const float* b, float* dst, int length);
+		void Divide(const float* a, const float* b, float* dst, int length);
+
+		/// <summary>
+		/// Multiplies an array by a scalar (array * factor in AFL).
+		/// </summary>
+		void Scale(const float* src, float* dst, int length, float factor);
+	}
+}
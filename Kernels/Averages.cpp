@@ -0,0 +1,137 @@
+// Averages.cpp : moving average kernels
+
+#include "Averages.h"
+#include "Null.h"
+#include "Parallel.h"
+#include "RecursiveFilter.h"
+#include "RollingWindow.h"
+#include "ScratchArena.h"
+
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// bars processed for all periods before moving on, sized so the source block stays in L1/L2
+			const int BatchBlockSize = 4096;
+
+			// the prefix sums of src (with the Nulls counted as 0) and the number of Nulls up to each bar
+			void BuildPrefixSums(const float* src, int length, int first, double* sums, int* nulls)
+			{
+				sums[0] = 0.0;
+				nulls[0] = 0;
+				for (int i = 0; i < length; i++)
+				{
+					float value = src[i];
+					bool isNull = i >= first && IsNull(value);
+					sums[i + 1] = sums[i] + (isNull || i < first ? 0.0f : value);
+					nulls[i + 1] = nulls[i] + (isNull ? 1 : 0);
+				}
+			}
+
+			// each average is a difference of two prefix sums: no dependency between bars, so the loop vectorizes;
+			// bar i goes to out[i - offset]
+			void PrefixMa(const double* prefix, const int* nullCount, int first, int period, float* out, int offset, int start, int end)
+			{
+				period = period < 1 ? 1 : period;
+				int i = start;
+				for (; i < end && i < first + period - 1; i++)
+					out[i - offset] = Null;
+
+				for (; i < end; i++)
+				{
+					double sum = prefix[i + 1] - prefix[i + 1 - period];
+					out[i - offset] = NullIf(nullCount[i + 1] != nullCount[i + 1 - period], (float)(sum / period));
+				}
+			}
+		}
+
+		void Ma(const float* src, float* dst, int length, int period)
+		{
+			RollingMa(src, dst, length, period);
+		}
+
+		void Ema(const float* src, float* dst, int length, int period)
+		{
+			// long arrays are filtered as a parallel prefix scan of the recurrence
+			if (length >= ParallelMinimumLength)
+			{
+				Iir(src, dst, length, EmaCoefficients(period), period);
+				return;
+			}
+
+			EmaState state(period);
+			for (int i = 0; i < length; i++)
+				dst[i] = state.Push(src[i]);
+		}
+
+		void Wilders(const float* src, float* dst, int length, int period)
+		{
+			if (length >= ParallelMinimumLength)
+			{
+				Iir(src, dst, length, WildersCoefficients(period), period);
+				return;
+			}
+
+			EmaState state(period, 1.0 / (period < 1 ? 1 : period));
+			for (int i = 0; i < length; i++)
+				dst[i] = state.Push(src[i]);
+		}
+
+		void MaBatch(const float* src, int length, const int* periods, int count, float* const* dst)
+		{
+			int first = FirstValidIndex(src, length);
+
+			// one pass builds prefix sums shared by every period, after that each average is
+			// a difference of two prefix sums: no dependency between bars, so the loops vectorize
+			// the prefix sums are 12 bytes per bar, taken from the scratch arena instead of the heap on every call
+			ScratchScope scratch;
+			Span<double> sums = scratch.Allocate<double>(length + 1);
+			Span<int> nulls = scratch.Allocate<int>(length + 1);
+			BuildPrefixSums(src, length, first, sums.Data(), nulls.Data());
+
+			for (int start = 0; start < length; start += BatchBlockSize)
+			{
+				int end = start + BatchBlockSize < length ? start + BatchBlockSize : length;
+				for (int k = 0; k < count; k++)
+					PrefixMa(sums.Data(), nulls.Data(), first, periods[k], dst[k], 0, start, end);
+			}
+		}
+
+		PrefixSums::PrefixSums(const float* src, int length)
+			: first(FirstValidIndex(src, length)), sums(length + 1), nulls(length + 1)
+		{
+			BuildPrefixSums(src, length, first, sums.data(), nulls.data());
+		}
+
+		void PrefixSums::Ma(int period, float* dst, int begin, int end) const
+		{
+			PrefixMa(sums.data(), nulls.data(), first, period, dst, begin, begin, end);
+		}
+
+		void EmaBatch(const float* src, int length, const int* periods, int count, float* const* dst)
+		{
+			std::vector<EmaState> states;
+			states.reserve(count);
+			for (int k = 0; k < count; k++)
+				states.emplace_back(periods[k]);
+
+			// the recurrences of different periods are independent, so interleaving them per block
+			// overlaps their latency while the source block stays in cache
+			for (int start = 0; start < length; start += BatchBlockSize)
+			{
+				int end = start + BatchBlockSize < length ? start + BatchBlockSize : length;
+				for (int k = 0; k < count; k++)
+				{
+					EmaState& state = states[k];
+					float* out = dst[k];
+					for (int i = start; i < end; i++)
+						out[i] = state.Push(src[i]);
+				}
+			}
+		}
+	}
+}
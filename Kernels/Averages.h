@@ -0,0 +1,122 @@
+// Averages.h : moving average kernels
+
+#pragma once
+
+#include <vector>
+#include "Null.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// EMA recurrence of one period, shared by Ema, EmaBatch and the incremental cache so they give identical results.
+		/// The state is a few scalars, so copying it is cheap.
+		/// </summary>
+		class EmaState
+		{
+		public:
+			explicit EmaState(int period)
+				: period(period < 1 ? 1 : period), factor(2.0 / (this->period + 1.0)), ema(0.0), seeded(0)
+			{
+			}
+
+			// the same recurrence with another smoothing factor (e.g. 1 / period for Wilder's average)
+			EmaState(int period, double factor)
+				: period(period < 1 ? 1 : period), factor(factor), ema(0.0), seeded(0)
+			{
+			}
+
+			float Push(float value)
+			{
+				if (IsNull(value))
+				{
+					// restart seeding after a Null
+					seeded = 0;
+					ema = 0.0;
+					return Null;
+				}
+
+				if (seeded < period)
+				{
+					// accumulate the simple average used as seed
+					ema += value;
+					if (++seeded < period)
+						return Null;
+					ema /= period;
+				}
+				else
+				{
+					ema += factor * (value - ema);
+				}
+
+				return (float)ema;
+			}
+
+		private:
+			int period;
+			double factor;
+			double ema;
+			int seeded;
+		};
+
+		/// <summary>
+		/// Simple moving average (AFL's MA). Uses the running sum of the rolling-window engine,
+		/// so the cost is O(length) whatever the period.
+		/// </summary>
+		void Ma(const float* src, float* dst, int length, int period);
+
+		/// <summary>
+		/// Exponential moving average (AFL's EMA) with a smoothing factor of 2 / (period + 1).
+		///
+		/// Like AmiBroker, leading Nulls are skipped and the average is seeded with the simple average
+		/// of the first 'period' valid values, so the result is Null up to that bar.
+		/// A Null in the middle of the array produces Null and the average is seeded again after it.
+		/// Arrays of at least ParallelMinimumLength bars are computed by Iir() (RecursiveFilter.h) on all cores;
+		/// those results match EmaState within double rounding instead of bit for bit.
+		/// </summary>
+		void Ema(const float* src, float* dst, int length, int period);
+
+		/// <summary>
+		/// Wilder's smoothing (AFL's Wilders): the EMA recurrence with a smoothing factor of 1 / period,
+		/// seeded, Null handled and parallelized like Ema().
+		/// </summary>
+		void Wilders(const float* src, float* dst, int length, int period);
+
+		/// <summary>
+		/// Calculates the MA of src for 'count' periods in one sweep: the prefix sums of src are built once
+		/// and every average is the difference of two of them, computed block by block for all periods.
+		/// dst[k] receives the average of periods[k]; the results match Ma() within float rounding.
+		/// </summary>
+		void MaBatch(const float* src, int length, const int* periods, int count, float* const* dst);
+
+		/// <summary>
+		/// EMA counterpart of MaBatch. The periods are advanced block by block over the same cached bars;
+		/// the results are identical to Ema() below ParallelMinimumLength bars.
+		/// </summary>
+		void EmaBatch(const float* src, int length, const int* periods, int count, float* const* dst);
+
+		/// <summary>
+		/// The prefix sums of MaBatch kept as an object: built once, after that the MA of any period over any range of bars
+		/// costs O(range) and reads only the sums, so the threads of an optimization or the windows of a walk-forward test
+		/// share them. The results are those of MaBatch.
+		/// </summary>
+		class PrefixSums
+		{
+		public:
+			PrefixSums(const float* src, int length);
+
+			/// <summary>
+			/// MA(src, period) of the bars [begin, end) into dst[0] .. dst[end - begin - 1]. Thread safe.
+			/// </summary>
+			void Ma(int period, float* dst, int begin, int end) const;
+
+			int Length() const { return (int)sums.size() - 1; }
+
+		private:
+			int first;
+			std::vector<double> sums;
+			std::vector<int> nulls;
+		};
+	}
+}
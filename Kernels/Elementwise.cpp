@@ -0,0 +1,66 @@
+// Elementwise.cpp : scalar element-wise kernels and the dispatch by instruction set
+
+#include "Elementwise.h"
+#include "Null.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// one-lane "vector", so the scalar kernels are the same code as the vectorized ones
+			struct V
+			{
+				static const int Width = 1;
+
+				float v;
+
+				static V Load(const float* p) { return V{ *p }; }
+				static V LoadPartial(const float* p, int) { return V{ *p }; }
+				static V Set(float x) { return V{ x }; }
+				void Store(float* p) const { *p = v; }
+				void StorePartial(float* p, int) const { *p = v; }
+			};
+
+			inline V operator+(const V& a, const V& b) { return V{ a.v + b.v }; }
+			inline V operator-(const V& a, const V& b) { return V{ a.v - b.v }; }
+			inline V operator*(const V& a, const V& b) { return V{ a.v * b.v }; }
+			inline V operator/(const V& a, const V& b) { return V{ a.v / b.v }; }
+			inline V operator*(float a, const V& b) { return V{ a * b.v }; }
+			inline V operator*(const V& a, float b) { return V{ a.v * b }; }
+			inline V operator/(const V& a, float b) { return V{ a.v / b }; }
+
+			inline bool IsNull(const V& a) { return a.v == Null; }
+			inline V Select(bool mask, const V& ifTrue, const V& ifFalse) { return mask ? ifTrue : ifFalse; }
+
+			inline bool Greater(const V& a, const V& b) { return a.v > b.v; }
+			inline bool GreaterEqual(const V& a, const V& b) { return a.v >= b.v; }
+			inline bool Equal(const V& a, const V& b) { return a.v == b.v; }
+			inline unsigned Bits(bool mask) { return mask ? 1u : 0u; }
+			inline bool MaskFromBits(unsigned bits) { return (bits & 1) != 0; }
+		}
+
+#include "Elementwise.inl"
+
+		const ElementwiseKernels& ScalarElementwiseKernels()
+		{
+			return table;
+		}
+
+		const ElementwiseKernels& ElementwiseKernelsFor(SimdLevel level)
+		{
+			switch (level)
+			{
+			case SimdLevel::Avx512:
+				return Avx512ElementwiseKernels();
+			case SimdLevel::Avx2:
+				return Avx2ElementwiseKernels();
+			case SimdLevel::Sse2:
+				return Sse2ElementwiseKernels();
+			default:
+				return ScalarElementwiseKernels();
+			}
+		}
+	}
+}
@@ -0,0 +1,50 @@
+// Elementwise.h : dispatch table of the vectorized element-wise kernels (internal to the library)
+
+#pragma once
+
+#include "Signals.h"
+#include "Simd.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// One entry per fused element-wise kernel. There is a table for each instruction set;
+		/// the public functions (Price.h, Arithmetic.h, Signals.h) call the table of ActiveSimdLevel().
+		/// </summary>
+		struct ElementwiseKernels
+		{
+			void (*typicalPrice)(const float* high, const float* low, const float* close, float* dst, int length);
+			void (*medianPrice)(const float* high, const float* low, float* dst, int length);
+			void (*avgPrice)(const float* high, const float* low, const float* close, float* dst, int length);
+			void (*percentBands)(const float* src, float* upper, float* lower, int length, float percent);
+			void (*add)(const float* a, const float* b, float* dst, int length);
+			void (*subtract)(const float* a, const float* b, float* dst, int length);
+			void (*multiply)(const float* a, const float* b, float* dst, int length);
+			void (*divide)(const float* a, const float* b, float* dst, int length);
+			void (*scale)(const float* src, float* dst, int length, float factor);
+			void (*compare)(const float* a, const float* b, Comparison op, std::uint64_t* bits, int length);
+			void (*compareScalar)(const float* a, float b, Comparison op, std::uint64_t* bits, int length);
+			void (*cross)(const float* a, const float* b, std::uint64_t* bits, int length);
+			void (*packSignal)(const float* src, std::uint64_t* bits, int length);
+			void (*expandSignal)(const std::uint64_t* bits, float* dst, int length, float ifTrue, float ifFalse);
+			void (*selectSignal)(const std::uint64_t* bits, const float* ifTrue, const float* ifFalse, float* dst, int length);
+		};
+
+		const ElementwiseKernels& ScalarElementwiseKernels();
+		const ElementwiseKernels& Sse2ElementwiseKernels();
+		const ElementwiseKernels& Avx2ElementwiseKernels();
+		const ElementwiseKernels& Avx512ElementwiseKernels();
+
+		/// <summary>
+		/// Returns the table for an instruction set level.
+		/// </summary>
+		const ElementwiseKernels& ElementwiseKernelsFor(SimdLevel level);
+
+		inline const ElementwiseKernels& ActiveElementwiseKernels()
+		{
+			return ElementwiseKernelsFor(ActiveSimdLevel());
+		}
+	}
+}
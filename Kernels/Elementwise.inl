@@ -0,0 +1,288 @@
+// Elementwise.inl : element-wise kernels written once for every vector width
+//
+// Included by one translation unit per instruction set after it defines, in an anonymous namespace:
+//   V        vector of floats with static Width, Load, LoadPartial, Set, Store, StorePartial
+//            and the + - * / operators (vector and float operands)
+//   IsNull   returning a lane mask, combined with operator|
+//   Select   choosing lanes of two vectors by a mask
+//   Greater, GreaterEqual, Equal   comparing two vectors to a lane mask
+//   Bits         a lane mask as an integer, lane i in bit i (movemask)
+//   MaskFromBits the lane mask of the low Width bits of an integer
+// Everything here has internal linkage, so code compiled for one instruction set
+// is never merged by the linker into another translation unit.
+
+namespace
+{
+	// Null in any input lane produces Null in the result lane, like the ATArray operators
+	template <class A>
+	auto AnyNull(const A& a) -> decltype(IsNull(a))
+	{
+		return IsNull(a);
+	}
+
+	template <class A, class... Rest>
+	auto AnyNull(const A& a, const Rest&... rest) -> decltype(IsNull(a))
+	{
+		return IsNull(a) | AnyNull(rest...);
+	}
+
+	template <class Op, class... Args>
+	V Apply(const V& null, Op op, const Args&... args)
+	{
+		return Select(AnyNull(args...), null, op(args...));
+	}
+
+	// single fused pass: every source is read once and the result is written once
+	template <class Op, class... Src>
+	void Map(float* dst, int length, Op op, const Src*... src)
+	{
+		const V null = V::Set(Null);
+
+		int i = 0;
+		for (; i + V::Width <= length; i += V::Width)
+			Apply(null, op, V::Load(src + i)...).Store(dst + i);
+
+		if (i < length)
+		{
+			int rest = length - i;
+			Apply(null, op, V::LoadPartial(src + i, rest)...).StorePartial(dst + i, rest);
+		}
+	}
+
+	void TypicalPrice(const float* high, const float* low, const float* close, float* dst, int length)
+	{
+		Map(dst, length, [](const V& h, const V& l, const V& c) { return (h + l + 2.0f * c) / 4.0f; }, high, low, close);
+	}
+
+	void MedianPrice(const float* high, const float* low, float* dst, int length)
+	{
+		Map(dst, length, [](const V& h, const V& l) { return (h + l) / 2.0f; }, high, low);
+	}
+
+	void AvgPrice(const float* high, const float* low, const float* close, float* dst, int length)
+	{
+		Map(dst, length, [](const V& h, const V& l, const V& c) { return (h + l + c) / 3.0f; }, high, low, close);
+	}
+
+	void PercentBands(const float* src, float* upper, float* lower, int length, float percent)
+	{
+		const V null = V::Set(Null);
+		const float up = 1.0f + percent / 100.0f;
+		const float down = 1.0f - percent / 100.0f;
+
+		int i = 0;
+		for (; i + V::Width <= length; i += V::Width)
+		{
+			V x = V::Load(src + i);
+			Select(IsNull(x), null, x * up).Store(upper + i);
+			Select(IsNull(x), null, x * down).Store(lower + i);
+		}
+
+		if (i < length)
+		{
+			int rest = length - i;
+			V x = V::LoadPartial(src + i, rest);
+			Select(IsNull(x), null, x * up).StorePartial(upper + i, rest);
+			Select(IsNull(x), null, x * down).StorePartial(lower + i, rest);
+		}
+	}
+
+	void Add(const float* a, const float* b, float* dst, int length)
+	{
+		Map(dst, length, [](const V& x, const V& y) { return x + y; }, a, b);
+	}
+
+	void Subtract(const float* a, const float* b, float* dst, int length)
+	{
+		Map(dst, length, [](const V& x, const V& y) { return x - y; }, a, b);
+	}
+
+	void Multiply(const float* a, const float* b, float* dst, int length)
+	{
+		Map(dst, length, [](const V& x, const V& y) { return x * y; }, a, b);
+	}
+
+	void Divide(const float* a, const float* b, float* dst, int length)
+	{
+		Map(dst, length, [](const V& x, const V& y) { return x / y; }, a, b);
+	}
+
+	void Scale(const float* src, float* dst, int length, float factor)
+	{
+		Map(dst, length, [factor](const V& x) { return x * factor; }, src);
+	}
+
+	// n lanes starting at p: a full vector or the tail of the array
+	V LoadLanes(const float* p, int n)
+	{
+		return n == V::Width ? V::Load(p) : V::LoadPartial(p, n);
+	}
+
+	// lanes where neither input is Null
+	unsigned ValidBits(const V& a, const V& b)
+	{
+		return ~Bits(IsNull(a) | IsNull(b));
+	}
+
+	// 64 bars [start, start + count) of a condition as one word; condition(i, n) returns the lane bits of bars [i, i + n)
+	template <class Condition>
+	std::uint64_t PackWord(int start, int count, Condition condition)
+	{
+		std::uint64_t word = 0;
+		for (int lane = 0; lane < count; lane += V::Width)
+		{
+			int n = count - lane < V::Width ? count - lane : V::Width;
+			std::uint64_t laneBits = condition(start + lane, n) & ((n == 64 ? 0 : 1ull << n) - 1);
+			word |= laneBits << lane;
+		}
+		return word;
+	}
+
+	template <class Condition>
+	void Pack(std::uint64_t* bits, int length, Condition condition)
+	{
+		for (int start = 0, w = 0; start < length; start += 64, w++)
+			bits[w] = PackWord(start, length - start < 64 ? length - start : 64, condition);
+	}
+
+	template <class Op>
+	void CompareArrays(const float* a, const float* b, std::uint64_t* bits, int length, Op op)
+	{
+		Pack(bits, length, [&](int i, int n)
+		{
+			V x = LoadLanes(a + i, n);
+			V y = LoadLanes(b + i, n);
+			return op(x, y) & ValidBits(x, y);
+		});
+	}
+
+	template <class Op>
+	void CompareArrayScalar(const float* a, float b, std::uint64_t* bits, int length, Op op)
+	{
+		const V y = V::Set(b);
+		Pack(bits, length, [&](int i, int n)
+		{
+			V x = LoadLanes(a + i, n);
+			return op(x, y) & ValidBits(x, y);
+		});
+	}
+
+	// the comparison is chosen once per call, the loops are specialized for each operator
+	template <class Compare>
+	void DispatchComparison(Comparison op, Compare compare)
+	{
+		switch (op)
+		{
+		case Comparison::Less:
+			compare([](const V& x, const V& y) { return Bits(Greater(y, x)); });
+			break;
+		case Comparison::LessEqual:
+			compare([](const V& x, const V& y) { return Bits(GreaterEqual(y, x)); });
+			break;
+		case Comparison::Greater:
+			compare([](const V& x, const V& y) { return Bits(Greater(x, y)); });
+			break;
+		case Comparison::GreaterEqual:
+			compare([](const V& x, const V& y) { return Bits(GreaterEqual(x, y)); });
+			break;
+		case Comparison::Equal:
+			compare([](const V& x, const V& y) { return Bits(Equal(x, y)); });
+			break;
+		default:
+			compare([](const V& x, const V& y) { return ~Bits(Equal(x, y)); });
+			break;
+		}
+	}
+
+	void Compare(const float* a, const float* b, Comparison op, std::uint64_t* bits, int length)
+	{
+		DispatchComparison(op, [&](auto compare) { CompareArrays(a, b, bits, length, compare); });
+	}
+
+	void CompareScalar(const float* a, float b, Comparison op, std::uint64_t* bits, int length)
+	{
+		DispatchComparison(op, [&](auto compare) { CompareArrayScalar(a, b, bits, length, compare); });
+	}
+
+	// Cross = (a > b) AND previous bar of (a <= b): both conditions in one pass, the previous bar shifted in across the words
+	void Cross(const float* a, const float* b, std::uint64_t* bits, int length)
+	{
+		std::uint64_t carry = 0;
+		for (int start = 0, w = 0; start < length; start += 64, w++)
+		{
+			int count = length - start < 64 ? length - start : 64;
+			std::uint64_t above = 0;
+			std::uint64_t belowOrEqual = 0;
+			for (int lane = 0; lane < count; lane += V::Width)
+			{
+				int n = count - lane < V::Width ? count - lane : V::Width;
+				std::uint64_t used = (n == 64 ? 0 : 1ull << n) - 1;
+				V x = LoadLanes(a + start + lane, n);
+				V y = LoadLanes(b + start + lane, n);
+				std::uint64_t valid = ValidBits(x, y) & used;
+				above |= (Bits(Greater(x, y)) & valid) << lane;
+				belowOrEqual |= (Bits(GreaterEqual(y, x)) & valid) << lane;
+			}
+			bits[w] = above & ((belowOrEqual << 1) | carry);
+			carry = belowOrEqual >> 63;
+		}
+	}
+
+	void PackSignal(const float* src, std::uint64_t* bits, int length)
+	{
+		const V zero = V::Set(0.0f);
+		Pack(bits, length, [&](int i, int n)
+		{
+			V x = LoadLanes(src + i, n);
+			return ~Bits(Equal(x, zero) | IsNull(x));
+		});
+	}
+
+	void SelectSignal(const std::uint64_t* bits, const float* ifTrue, const float* ifFalse, float* dst, int length)
+	{
+		for (int i = 0; i < length; i += V::Width)
+		{
+			int n = length - i < V::Width ? length - i : V::Width;
+			// V::Width divides 64, so the lanes of a vector never straddle two words
+			V value = Select(MaskFromBits((unsigned)(bits[i / 64] >> (i % 64))), LoadLanes(ifTrue + i, n), LoadLanes(ifFalse + i, n));
+			if (n == V::Width)
+				value.Store(dst + i);
+			else
+				value.StorePartial(dst + i, n);
+		}
+	}
+
+	void ExpandSignal(const std::uint64_t* bits, float* dst, int length, float ifTrue, float ifFalse)
+	{
+		const V t = V::Set(ifTrue);
+		const V f = V::Set(ifFalse);
+		for (int i = 0; i < length; i += V::Width)
+		{
+			int n = length - i < V::Width ? length - i : V::Width;
+			V value = Select(MaskFromBits((unsigned)(bits[i / 64] >> (i % 64))), t, f);
+			if (n == V::Width)
+				value.Store(dst + i);
+			else
+				value.StorePartial(dst + i, n);
+		}
+	}
+
+	const AmiBroker::Kernels::ElementwiseKernels table =
+	{
+		TypicalPrice,
+		MedianPrice,
+		AvgPrice,
+		PercentBands,
+		Add,
+		Subtract,
+		Multiply,
+		Divide,
+		Scale,
+		Compare,
+		CompareScalar,
+		Cross,
+		PackSignal,
+		ExpandSignal,
+		SelectSignal
+	};
+}
@@ -0,0 +1,95 @@
+// ElementwiseAvx2.cpp : element-wise kernels for AVX2 (8 lanes)
+// Compiled with AVX2 code generation (-mavx2, /arch:AVX2); only called if the CPU supports it.
+
+#include "Elementwise.h"
+#include "Null.h"
+
+#if KERNELS_X86
+
+#include <immintrin.h>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			struct V
+			{
+				static const int Width = 8;
+
+				__m256 v;
+
+				static V Load(const float* p) { return V{ _mm256_loadu_ps(p) }; }
+				static V LoadPartial(const float* p, int count)
+				{
+					return V{ _mm256_maskload_ps(p, TailMask(count)) };
+				}
+				static V Set(float x) { return V{ _mm256_set1_ps(x) }; }
+				void Store(float* p) const { _mm256_storeu_ps(p, v); }
+				void StorePartial(float* p, int count) const
+				{
+					_mm256_maskstore_ps(p, TailMask(count), v);
+				}
+
+				// lanes below count are enabled
+				static __m256i TailMask(int count)
+				{
+					return _mm256_cmpgt_epi32(_mm256_set1_epi32(count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+				}
+			};
+
+			struct Mask
+			{
+				__m256 m;
+			};
+
+			inline V operator+(const V& a, const V& b) { return V{ _mm256_add_ps(a.v, b.v) }; }
+			inline V operator-(const V& a, const V& b) { return V{ _mm256_sub_ps(a.v, b.v) }; }
+			inline V operator*(const V& a, const V& b) { return V{ _mm256_mul_ps(a.v, b.v) }; }
+			inline V operator/(const V& a, const V& b) { return V{ _mm256_div_ps(a.v, b.v) }; }
+			inline V operator*(float a, const V& b) { return V::Set(a) * b; }
+			inline V operator*(const V& a, float b) { return a * V::Set(b); }
+			inline V operator/(const V& a, float b) { return a / V::Set(b); }
+
+			inline Mask IsNull(const V& a) { return Mask{ _mm256_cmp_ps(a.v, _mm256_set1_ps(Null), _CMP_EQ_OQ) }; }
+			inline Mask operator|(const Mask& a, const Mask& b) { return Mask{ _mm256_or_ps(a.m, b.m) }; }
+			inline V Select(const Mask& mask, const V& ifTrue, const V& ifFalse)
+			{
+				return V{ _mm256_blendv_ps(ifFalse.v, ifTrue.v, mask.m) };
+			}
+
+			inline Mask Greater(const V& a, const V& b) { return Mask{ _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+			inline Mask GreaterEqual(const V& a, const V& b) { return Mask{ _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+			inline Mask Equal(const V& a, const V& b) { return Mask{ _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+			inline unsigned Bits(const Mask& mask) { return (unsigned)_mm256_movemask_ps(mask.m); }
+			inline Mask MaskFromBits(unsigned bits)
+			{
+				const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+				return Mask{ _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)bits), lanes), lanes)) };
+			}
+		}
+
+#include "Elementwise.inl"
+
+		const ElementwiseKernels& Avx2ElementwiseKernels()
+		{
+			return table;
+		}
+	}
+}
+
+#else
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		const ElementwiseKernels& Avx2ElementwiseKernels()
+		{
+			return ScalarElementwiseKernels();
+		}
+	}
+}
+
+#endif
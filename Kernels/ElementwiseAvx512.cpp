@@ -0,0 +1,91 @@
+// ElementwiseAvx512.cpp : element-wise kernels for AVX-512F (16 lanes)
+// Compiled with AVX-512 code generation (-mavx512f, /arch:AVX512); only called if the CPU supports it.
+
+#include "Elementwise.h"
+#include "Null.h"
+
+#if KERNELS_X86
+
+#include <immintrin.h>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			struct V
+			{
+				static const int Width = 16;
+
+				__m512 v;
+
+				static V Load(const float* p) { return V{ _mm512_loadu_ps(p) }; }
+				static V LoadPartial(const float* p, int count)
+				{
+					return V{ _mm512_maskz_loadu_ps(TailMask(count), p) };
+				}
+				static V Set(float x) { return V{ _mm512_set1_ps(x) }; }
+				void Store(float* p) const { _mm512_storeu_ps(p, v); }
+				void StorePartial(float* p, int count) const
+				{
+					_mm512_mask_storeu_ps(p, TailMask(count), v);
+				}
+
+				static __mmask16 TailMask(int count)
+				{
+					return (__mmask16)((1u << count) - 1);
+				}
+			};
+
+			struct Mask
+			{
+				__mmask16 m;
+			};
+
+			inline V operator+(const V& a, const V& b) { return V{ _mm512_add_ps(a.v, b.v) }; }
+			inline V operator-(const V& a, const V& b) { return V{ _mm512_sub_ps(a.v, b.v) }; }
+			inline V operator*(const V& a, const V& b) { return V{ _mm512_mul_ps(a.v, b.v) }; }
+			inline V operator/(const V& a, const V& b) { return V{ _mm512_div_ps(a.v, b.v) }; }
+			inline V operator*(float a, const V& b) { return V::Set(a) * b; }
+			inline V operator*(const V& a, float b) { return a * V::Set(b); }
+			inline V operator/(const V& a, float b) { return a / V::Set(b); }
+
+			inline Mask IsNull(const V& a) { return Mask{ _mm512_cmp_ps_mask(a.v, _mm512_set1_ps(Null), _CMP_EQ_OQ) }; }
+			inline Mask operator|(const Mask& a, const Mask& b) { return Mask{ (__mmask16)(a.m | b.m) }; }
+			inline V Select(const Mask& mask, const V& ifTrue, const V& ifFalse)
+			{
+				return V{ _mm512_mask_blend_ps(mask.m, ifFalse.v, ifTrue.v) };
+			}
+
+			// AVX-512 compares write mask registers directly, no movemask needed
+			inline Mask Greater(const V& a, const V& b) { return Mask{ _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+			inline Mask GreaterEqual(const V& a, const V& b) { return Mask{ _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ) }; }
+			inline Mask Equal(const V& a, const V& b) { return Mask{ _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ) }; }
+			inline unsigned Bits(const Mask& mask) { return mask.m; }
+			inline Mask MaskFromBits(unsigned bits) { return Mask{ (__mmask16)bits }; }
+		}
+
+#include "Elementwise.inl"
+
+		const ElementwiseKernels& Avx512ElementwiseKernels()
+		{
+			return table;
+		}
+	}
+}
+
+#else
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		const ElementwiseKernels& Avx512ElementwiseKernels()
+		{
+			return ScalarElementwiseKernels();
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,94 @@
+// ElementwiseSse2.cpp : element-wise kernels for SSE2 (4 lanes)
+
+#include "Elementwise.h"
+#include "Null.h"
+
+#if KERNELS_X86
+
+#include <emmintrin.h>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			struct V
+			{
+				static const int Width = 4;
+
+				__m128 v;
+
+				static V Load(const float* p) { return V{ _mm_loadu_ps(p) }; }
+				static V LoadPartial(const float* p, int count)
+				{
+					float lanes[Width] = {};
+					for (int i = 0; i < count; i++)
+						lanes[i] = p[i];
+					return Load(lanes);
+				}
+				static V Set(float x) { return V{ _mm_set1_ps(x) }; }
+				void Store(float* p) const { _mm_storeu_ps(p, v); }
+				void StorePartial(float* p, int count) const
+				{
+					float lanes[Width];
+					Store(lanes);
+					for (int i = 0; i < count; i++)
+						p[i] = lanes[i];
+				}
+			};
+
+			struct Mask
+			{
+				__m128 m;
+			};
+
+			inline V operator+(const V& a, const V& b) { return V{ _mm_add_ps(a.v, b.v) }; }
+			inline V operator-(const V& a, const V& b) { return V{ _mm_sub_ps(a.v, b.v) }; }
+			inline V operator*(const V& a, const V& b) { return V{ _mm_mul_ps(a.v, b.v) }; }
+			inline V operator/(const V& a, const V& b) { return V{ _mm_div_ps(a.v, b.v) }; }
+			inline V operator*(float a, const V& b) { return V::Set(a) * b; }
+			inline V operator*(const V& a, float b) { return a * V::Set(b); }
+			inline V operator/(const V& a, float b) { return a / V::Set(b); }
+
+			inline Mask IsNull(const V& a) { return Mask{ _mm_cmpeq_ps(a.v, _mm_set1_ps(Null)) }; }
+			inline Mask operator|(const Mask& a, const Mask& b) { return Mask{ _mm_or_ps(a.m, b.m) }; }
+			inline V Select(const Mask& mask, const V& ifTrue, const V& ifFalse)
+			{
+				return V{ _mm_or_ps(_mm_and_ps(mask.m, ifTrue.v), _mm_andnot_ps(mask.m, ifFalse.v)) };
+			}
+
+			inline Mask Greater(const V& a, const V& b) { return Mask{ _mm_cmpgt_ps(a.v, b.v) }; }
+			inline Mask GreaterEqual(const V& a, const V& b) { return Mask{ _mm_cmpge_ps(a.v, b.v) }; }
+			inline Mask Equal(const V& a, const V& b) { return Mask{ _mm_cmpeq_ps(a.v, b.v) }; }
+			inline unsigned Bits(const Mask& mask) { return (unsigned)_mm_movemask_ps(mask.m); }
+			inline Mask MaskFromBits(unsigned bits)
+			{
+				const __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+				return Mask{ _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)bits), lanes), lanes)) };
+			}
+		}
+
+#include "Elementwise.inl"
+
+		const ElementwiseKernels& Sse2ElementwiseKernels()
+		{
+			return table;
+		}
+	}
+}
+
+#else
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		const ElementwiseKernels& Sse2ElementwiseKernels()
+		{
+			return ScalarElementwiseKernels();
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,391 @@
+// EquityAnalytics.cpp : bar by bar equity, drawdown and risk-adjusted return metrics
+
+#include "EquityAnalytics.h"
+#include "Null.h"
+#include "Parallel.h"
+#include "ScratchArena.h"
+#include "TimeFrame.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// chunks of the rolling windows, several windows long to bound the recalculated halo (as in RollingWindow.cpp)
+			const int WindowChunkLength = 1 << 16;
+			const int HalosPerChunk = 4;
+
+			// the chunks of the scans: one chunk below ParallelMinimumLength, so short arrays stay on the calling thread
+			int ChunkLength(int count)
+			{
+				return count < ParallelMinimumLength ? std::max(count, 1) : ParallelChunkLength;
+			}
+
+			int ChunkCount(int count)
+			{
+				int size = ChunkLength(count);
+				return (int)(((long long)count + size - 1) / size);
+			}
+
+			// body(chunk, begin, end) for the fixed chunks of [0, count)
+			template <class Body>
+			void ForChunks(int count, Body body)
+			{
+				int size = ChunkLength(count);
+				ParallelForWindowed(count, size, 0, [&](int begin, int end, int)
+				{
+					body(begin / size, begin, end);
+				});
+			}
+
+			// what a chunk adds to the metrics; folded in chunk order
+			struct ChunkSums
+			{
+				double returns = 0.0;
+				double squares = 0.0;
+				double downside = 0.0;
+				double drawdowns = 0.0;
+				double maxDrawdown = 0.0;
+				int maxDrawdownBars = 0;
+			};
+
+			// clamps a metric to the range of a float, NaN to 0
+			double FiniteFloat(double value)
+			{
+				const double Largest = std::numeric_limits<float>::max();
+				return value != value ? 0.0 : std::min(std::max(value, -Largest), Largest);
+			}
+
+			double Annualized(double mean, double deviation, double periodsPerYear)
+			{
+				return deviation > 0.0 ? mean / deviation * std::sqrt(periodsPerYear) : 0.0;
+			}
+
+			// equity and returns start at bar 'first' (returns[first] is Null); both are [first, length) shifted to 0
+			EquityMetrics Analyze(const float* returns, const float* equity, int count, const EquitySettings& settings,
+				float* drawdown, float* drawdownBars, float* sharpe, float* sortino, float* ulcer)
+			{
+				// the highest equity before each chunk and its (last) bar: a max scan over the chunk highs
+				int chunks = ChunkCount(count);
+				std::vector<float> highs(chunks);
+				std::vector<int> highBars(chunks);
+				if (chunks > 1)
+				{
+					ForChunks(count, [&](int chunk, int begin, int end)
+					{
+						float high = equity[begin];
+						int bar = begin;
+						for (int i = begin; i < end; i++)
+						{
+							if (equity[i] >= high)
+							{
+								high = equity[i];
+								bar = i;
+							}
+						}
+						highs[chunk] = high;
+						highBars[chunk] = bar;
+					});
+					for (int chunk = 1; chunk < chunks; chunk++)
+					{
+						if (highs[chunk - 1] > highs[chunk])
+						{
+							highs[chunk] = highs[chunk - 1];
+							highBars[chunk] = highBars[chunk - 1];
+						}
+					}
+				}
+
+				// drawdowns and the sums of the metrics
+				std::vector<ChunkSums> sums(chunks);
+				ForChunks(count, [&](int chunk, int begin, int end)
+				{
+					float high = chunk > 0 ? highs[chunk - 1] : equity[0];
+					int highBar = chunk > 0 ? highBars[chunk - 1] : 0;
+					double scale = high > 0.0f ? 100.0 / high : 0.0;
+					ChunkSums s;
+					for (int i = begin; i < end; i++)
+					{
+						if (equity[i] >= high)
+						{
+							high = equity[i];
+							highBar = i;
+							scale = high > 0.0f ? 100.0 / high : 0.0;
+						}
+						// exactly 0 on a high: equity * (100 / high) - 100 leaves a rounding error there
+						double dd = scale > 0.0 && equity[i] < high ? equity[i] * scale - 100.0 : 0.0;
+						drawdown[i] = (float)dd;
+						if (drawdownBars)
+							drawdownBars[i] = (float)(i - highBar);
+						s.drawdowns += dd * dd;
+						s.maxDrawdown = std::min(s.maxDrawdown, dd);
+						s.maxDrawdownBars = std::max(s.maxDrawdownBars, i - highBar);
+
+						if (i > 0)
+						{
+							double r = returns[i];
+							s.returns += r;
+							s.squares += r * r;
+							double down = 0.5 * (r - std::fabs(r));
+							s.downside += down * down;
+						}
+					}
+					sums[chunk] = s;
+				});
+
+				ChunkSums total;
+				for (const ChunkSums& s : sums)
+				{
+					total.returns += s.returns;
+					total.squares += s.squares;
+					total.downside += s.downside;
+					total.drawdowns += s.drawdowns;
+					total.maxDrawdown = std::min(total.maxDrawdown, s.maxDrawdown);
+					total.maxDrawdownBars = std::max(total.maxDrawdownBars, s.maxDrawdownBars);
+				}
+
+				EquityMetrics metrics = {};
+				int bars = count - 1;
+				double growth = equity[0] > 0.0f ? equity[count - 1] / (double)equity[0] : 0.0;
+				double years = bars / settings.periodsPerYear;
+				metrics.netProfit = (growth - 1.0) * 100.0;
+				metrics.cagr = growth <= 0.0 ? -100.0 : (years >= MinimumCagrYears ? (std::pow(growth, 1.0 / years) - 1.0) * 100.0 : 0.0);
+				metrics.maxDrawdown = 0.0 - total.maxDrawdown;
+				metrics.maxDrawdownBars = total.maxDrawdownBars;
+				if (bars > 0)
+				{
+					double mean = total.returns / bars;
+					double variance = total.squares / bars - mean * mean;
+					metrics.sharpe = Annualized(mean, variance > 0.0 ? std::sqrt(variance) : 0.0, settings.periodsPerYear);
+					metrics.sortino = Annualized(mean, std::sqrt(total.downside / bars), settings.periodsPerYear);
+				}
+				metrics.ulcerIndex = std::sqrt(total.drawdowns / count);
+				metrics.mar = metrics.maxDrawdown > 0.0 ? metrics.cagr / metrics.maxDrawdown : 0.0;
+
+				// a quarter of extreme growth still overflows a float when annualized
+				metrics.netProfit = FiniteFloat(metrics.netProfit);
+				metrics.mar = std::isfinite(metrics.cagr) ? FiniteFloat(metrics.mar) : 0.0;
+				metrics.cagr = FiniteFloat(metrics.cagr);
+
+				if (!sharpe && !sortino && !ulcer)
+					return metrics;
+
+				// the rolling windows; each chunk warms its windows up on the halo before its first result.
+				// Inside the curve the returns and drawdowns are never Null, so the windows are running sums over the arrays
+				// themselves, the value entering and the value leaving added as one difference. The count of nonzero values
+				// in the window is exact, so a flat window gives 0 instead of the rounding left in the sums.
+				// The sums are a sequential pass that stores the moments of each window; the square roots and divisions
+				// follow in an element-wise pass over the chunk
+				int period = std::max(settings.window, 1);
+				int chunkSize = count < ParallelMinimumLength ? count : std::max(WindowChunkLength, HalosPerChunk * period);
+				float annualize = (float)std::sqrt(settings.periodsPerYear);
+				double inverse = 1.0 / period;
+
+				ScratchScope scratch;
+				float* mean = scratch.Allocate<float>(count).Data();
+				float* variance = sharpe ? sharpe : scratch.Allocate<float>(count).Data();
+				float* downside = sortino ? sortino : scratch.Allocate<float>(count).Data();
+				float* drawdownSquare = ulcer ? ulcer : scratch.Allocate<float>(count).Data();
+				ParallelForWindowed(count, chunkSize, period - 1, [&](int begin, int end, int warmup)
+				{
+					// returns[0] is Null: the return windows start at bar 1
+					int returnStart = std::max(warmup, 1);
+					double returnSum = 0.0, squareSum = 0.0, downsideSum = 0.0, drawdownSum = 0.0;
+					int moving = 0, falling = 0, below = 0;
+					for (int i = warmup; i < end; i++)
+					{
+						double dd = drawdown[i];
+						double leaving = i - period >= warmup ? drawdown[i - period] : 0.0;
+						drawdownSum += dd * dd - leaving * leaving;
+						below += (dd != 0.0) - (leaving != 0.0);
+						if (i >= returnStart)
+						{
+							// min(r, 0) without a branch on the sign of the return
+							double r = returns[i];
+							double old = i - period >= returnStart ? returns[i - period] : 0.0;
+							double down = 0.5 * (r - std::fabs(r)), oldDown = 0.5 * (old - std::fabs(old));
+							returnSum += r - old;
+							squareSum += r * r - old * old;
+							downsideSum += down * down - oldDown * oldDown;
+							moving += (r != 0.0) - (old != 0.0);
+							falling += (r < 0.0) - (old < 0.0);
+						}
+						if (i < begin)
+							continue;
+
+						// 0: no ratio
+						bool returnsValid = i - period + 1 >= returnStart;
+						double m = returnSum * inverse;
+						mean[i] = (float)m;
+						variance[i] = returnsValid && moving > 0 ? (float)std::max(squareSum * inverse - m * m, 0.0) : 0.0f;
+						downside[i] = returnsValid && falling > 0 ? (float)std::max(downsideSum * inverse, 0.0) : 0.0f;
+						if (i - period + 1 < warmup)
+							drawdownSquare[i] = Null;
+						else
+							drawdownSquare[i] = below > 0 ? (float)std::max(drawdownSum * inverse, 0.0) : 0.0f;
+					}
+
+					if (sharpe)
+					{
+						for (int i = begin; i < end; i++)
+							sharpe[i] = variance[i] > 0.0f ? mean[i] / std::sqrt(variance[i]) * annualize : Null;
+					}
+					if (sortino)
+					{
+						for (int i = begin; i < end; i++)
+							sortino[i] = downside[i] > 0.0f ? mean[i] / std::sqrt(downside[i]) * annualize : Null;
+					}
+					if (ulcer)
+					{
+						for (int i = begin; i < end; i++)
+							ulcer[i] = IsNull(drawdownSquare[i]) ? Null : std::sqrt(drawdownSquare[i]);
+					}
+				});
+
+				return metrics;
+			}
+
+			// Null before the first bar of the curve
+			void FillLeading(const EquityOutputs& outputs, int first)
+			{
+				float* arrays[] = { outputs.equity, outputs.drawdown, outputs.drawdownBars, outputs.sharpe, outputs.sortino, outputs.ulcer };
+				for (float* array : arrays)
+				{
+					if (array)
+						std::fill(array, array + first, Null);
+				}
+			}
+
+			// the outputs shifted to the first bar of the curve
+			float* Shift(float* array, int first)
+			{
+				return array ? array + first : nullptr;
+			}
+		}
+
+		EquityMetrics PositionEquity(const float* position, const float* price, int length, const EquitySettings& settings, const EquityOutputs& outputs)
+		{
+			int first = FirstValidIndex(price, length);
+			FillLeading(outputs, first);
+			if (first >= length)
+				return EquityMetrics();
+
+			const float* p = price + first;
+			const float* held = position + first;
+			int count = length - first;
+
+			ScratchScope scratch;
+			float* returns = scratch.Allocate<float>(count).Data();
+			float* equity = outputs.equity ? outputs.equity + first : scratch.Allocate<float>(count).Data();
+			float* drawdown = outputs.drawdown ? outputs.drawdown + first : scratch.Allocate<float>(count).Data();
+
+			// the returns, element-wise, and the growth of each chunk
+			std::vector<double> growth(ChunkCount(count));
+			ForChunks(count, [&](int chunk, int begin, int end)
+			{
+				for (int i = std::max(begin, 1); i < end; i++)
+				{
+					float previous = p[i - 1], current = p[i], exposure = held[i - 1];
+					bool valid = !IsNull(previous) && !IsNull(current) && !IsNull(exposure) && previous > 0.0f;
+					returns[i] = valid ? exposure * (current / previous - 1.0f) : 0.0f;
+				}
+				if (begin == 0)
+					returns[0] = Null;
+
+				if (growth.size() > 1)
+				{
+					double product = 1.0;
+					for (int i = std::max(begin, 1); i < end; i++)
+						product *= 1.0 + returns[i];
+					growth[chunk] = product;
+				}
+			});
+
+			// the equity at the start of each chunk, then each chunk compounded from it
+			double start = settings.initialEquity;
+			for (double& g : growth)
+			{
+				double next = start * g;
+				g = start;
+				start = next;
+			}
+			ForChunks(count, [&](int chunk, int begin, int end)
+			{
+				double value = growth[chunk];
+				for (int i = begin; i < end; i++)
+				{
+					if (i > 0)
+						value *= 1.0 + returns[i];
+					equity[i] = (float)value;
+				}
+			});
+
+			return Analyze(returns, equity, count, settings, drawdown, Shift(outputs.drawdownBars, first),
+				Shift(outputs.sharpe, first), Shift(outputs.sortino, first), Shift(outputs.ulcer, first));
+		}
+
+		EquityMetrics AnalyzeEquity(const float* equity, int length, const EquitySettings& settings, const EquityOutputs& outputs)
+		{
+			EquityOutputs analyzed = outputs;
+			analyzed.equity = nullptr;
+
+			int first = FirstValidIndex(equity, length);
+			FillLeading(analyzed, first);
+			if (first >= length)
+				return EquityMetrics();
+
+			int count = length - first;
+			ScratchScope scratch;
+			float* returns = scratch.Allocate<float>(count).Data();
+			float* curve = scratch.Allocate<float>(count).Data();
+			float* drawdown = outputs.drawdown ? outputs.drawdown + first : scratch.Allocate<float>(count).Data();
+
+			// a Null inside the curve keeps the previous equity
+			float last = equity[first];
+			for (int i = 0; i < count; i++)
+			{
+				if (!IsNull(equity[first + i]))
+					last = equity[first + i];
+				curve[i] = last;
+			}
+
+			ForChunks(count, [&](int, int begin, int end)
+			{
+				for (int i = std::max(begin, 1); i < end; i++)
+					returns[i] = curve[i - 1] > 0.0f ? curve[i] / curve[i - 1] - 1.0f : 0.0f;
+				if (begin == 0)
+					returns[0] = Null;
+			});
+
+			return Analyze(returns, curve, count, settings, drawdown, Shift(outputs.drawdownBars, first),
+				Shift(outputs.sharpe, first), Shift(outputs.sortino, first), Shift(outputs.ulcer, first));
+		}
+
+		double PeriodsPerYear(const std::uint64_t* dates, int length)
+		{
+			if (length < 2)
+				return 252.0;
+
+			double seconds = (double)(DateTimeToSeconds(dates[length - 1]) - DateTimeToSeconds(dates[0]));
+			return seconds > 0.0 ? (length - 1) / (seconds / (365.25 * 86400.0)) : 252.0;
+		}
+
+		std::vector<TradeMetricValue> EquityMetricValues(const EquityMetrics& metrics)
+		{
+			return std::vector<TradeMetricValue> {
+				{ "Equity CAGR %", metrics.cagr, 0.0, 0.0, 2 },
+				{ "Equity max. drawdown %", metrics.maxDrawdown, 0.0, 0.0, 2 },
+				{ "Max. drawdown duration (bars)", (double)metrics.maxDrawdownBars, 0.0, 0.0, 0 },
+				{ "Equity Sharpe ratio", metrics.sharpe, 0.0, 0.0, 2 },
+				{ "Equity Sortino ratio", metrics.sortino, 0.0, 0.0, 2 },
+				{ "Equity ulcer index", metrics.ulcerIndex, 0.0, 0.0, 2 },
+				{ "MAR ratio", metrics.mar, 0.0, 0.0, 2 }
+			};
+		}
+	}
+}
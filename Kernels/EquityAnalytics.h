@@ -0,0 +1,92 @@
+// EquityAnalytics.h : bar by bar equity, drawdown and risk-adjusted return metrics
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "TradeAnalytics.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		struct EquitySettings
+		{
+			// bars of the rolling Sharpe, Sortino and ulcer index
+			int window = 252;
+			// annualizes the Sharpe and Sortino ratios and the CAGR (see PeriodsPerYear)
+			double periodsPerYear = 252.0;
+			double initialEquity = 1.0;
+		};
+
+		/// <summary>
+		/// Arrays written by the analytics; nullptr for the ones not needed. The rolling values are Null until the window is full.
+		/// </summary>
+		struct EquityOutputs
+		{
+			float* equity;
+			// percent below the highest equity so far (0 or negative)
+			float* drawdown;
+			// bars since the highest equity so far (0 on a new high)
+			float* drawdownBars;
+			// annualized mean / standard deviation of the bar returns of the window
+			float* sharpe;
+			// annualized mean / downside deviation (root mean square of the negative returns) of the window
+			float* sortino;
+			// root mean square of the drawdown of the window
+			float* ulcer;
+		};
+
+		/// <summary>
+		/// Shortest curve, in years, whose CAGR is reported. Annualizing a shorter one (a few days of minute bars) raises
+		/// its growth to a power so high that the result means nothing and overflows a float.
+		/// </summary>
+		const double MinimumCagrYears = 0.25;
+
+		/// <summary>
+		/// Metrics of the whole curve. Returns are bar returns, the deviations population deviations (as AFL's StDev).
+		/// Every value fits in a float (the type of the custom metrics of the backtest report).
+		/// </summary>
+		struct EquityMetrics
+		{
+			double netProfit;			// percent
+			double cagr;				// percent a year; 0 when the curve spans less than MinimumCagrYears
+			double maxDrawdown;			// percent, positive
+			int maxDrawdownBars;		// the longest time below a high, the drawdown still open at the end included
+			double sharpe;
+			double sortino;
+			double ulcerIndex;
+			// CAGR / max drawdown, 0 without a CAGR or a drawdown
+			double mar;
+		};
+
+		/// <summary>
+		/// Equity of holding position[i] (1 = long, -1 = short, fractions for partial exposure, Null = flat) from the close of bar i
+		/// to the close of bar i + 1, compounded bar by bar: the return of bar i is position[i - 1] * (price[i] / price[i - 1] - 1).
+		/// The curve starts at the first valid price; a bar with a Null price earns nothing.
+		///
+		/// Everything is calculated in a few passes over fixed chunks of bars: the returns (element-wise), the equity
+		/// (a product scan: the chunk products are chained, then each chunk is scaled), the highs and drawdowns (a max scan)
+		/// with the sums of the metrics, and the rolling windows (ParallelForWindowed). Long arrays run on all cores;
+		/// the results do not depend on the number of threads.
+		/// </summary>
+		EquityMetrics PositionEquity(const float* position, const float* price, int length, const EquitySettings& settings, const EquityOutputs& outputs);
+
+		/// <summary>
+		/// The same analytics of an existing equity curve, e.g. the EquityArray of the backtester;
+		/// outputs.equity is not written. Leading Nulls are skipped.
+		/// </summary>
+		EquityMetrics AnalyzeEquity(const float* equity, int length, const EquitySettings& settings, const EquityOutputs& outputs);
+
+		/// <summary>
+		/// Bars per year of ATDateTime::Date time stamps: the bars over the calendar time between the first and the last one.
+		/// 252 if the dates do not span any time.
+		/// </summary>
+		double PeriodsPerYear(const std::uint64_t* dates, int length);
+
+		/// <summary>
+		/// The metrics as custom metrics of the backtest report (all trades only).
+		/// </summary>
+		std::vector<TradeMetricValue> EquityMetricValues(const EquityMetrics& metrics);
+	}
+}
@@ -0,0 +1,136 @@
+// Expression.h : expression templates for fused, Null-aware array arithmetic
+//
+// Writing
+//     Evaluate((Series(ma) - Series(ema)) * 100.0f, diff, length);
+// builds a lazy expression tree at compile time and evaluates it in a single loop into diff.
+// No temporary array is allocated for the intermediate results, unlike the chained ATArray operators.
+
+#pragma once
+
+#include "Null.h"
+
+// The evaluation loops must be native code even when this header is included by the /clr plug-in sources.
+// Templates are compiled managed or unmanaged according to the pragma in effect where they are defined.
+#ifdef _MANAGED
+#pragma managed(push, off)
+#endif
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Base of all expression nodes (CRTP). Every node returns its value at a bar index with operator[].
+		/// </summary>
+		template <class E>
+		struct Expression
+		{
+			const E& Self() const { return static_cast<const E&>(*this); }
+		};
+
+		/// <summary>
+		/// Leaf node reading an array (e.g. the buffer of an ATArray).
+		/// </summary>
+		class SeriesTerm : public Expression<SeriesTerm>
+		{
+		public:
+			explicit SeriesTerm(const float* data) : data(data) {}
+
+			float operator[](int i) const { return data[i]; }
+
+		private:
+			const float* data;
+		};
+
+		/// <summary>
+		/// Leaf node of a scalar operand (e.g. the 100.0f of "diff * 100.0f").
+		/// </summary>
+		class ScalarTerm : public Expression<ScalarTerm>
+		{
+		public:
+			explicit ScalarTerm(float value) : value(value) {}
+
+			float operator[](int) const { return value; }
+
+		private:
+			float value;
+		};
+
+		struct PlusOp { static float Apply(float a, float b) { return a + b; } };
+		struct MinusOp { static float Apply(float a, float b) { return a - b; } };
+		struct MultipliesOp { static float Apply(float a, float b) { return a * b; } };
+		struct DividesOp { static float Apply(float a, float b) { return a / b; } };
+
+		/// <summary>
+		/// Binary operator node. Like the ATArray operators, a Null operand produces Null.
+		/// Children are held by value: nodes are a few pointers/floats and the tree is built on the stack.
+		/// </summary>
+		template <class Op, class L, class R>
+		class BinaryExpression : public Expression<BinaryExpression<Op, L, R>>
+		{
+		public:
+			BinaryExpression(const L& left, const R& right) : left(left), right(right) {}
+
+			float operator[](int i) const
+			{
+				float a = left[i];
+				float b = right[i];
+
+				// branch free so the fused loop vectorizes
+				return NullIf(IsNull(a) | IsNull(b), Op::Apply(a, b));
+			}
+
+		private:
+			L left;
+			R right;
+		};
+
+		/// <summary>
+		/// Wraps an array so it can be used in an expression.
+		/// </summary>
+		inline SeriesTerm Series(const float* data)
+		{
+			return SeriesTerm(data);
+		}
+
+#define KERNELS_EXPRESSION_OPERATOR(op, Op) \
+		template <class L, class R> \
+		BinaryExpression<Op, L, R> operator op(const Expression<L>& left, const Expression<R>& right) \
+		{ \
+			return BinaryExpression<Op, L, R>(left.Self(), right.Self()); \
+		} \
+		template <class L> \
+		BinaryExpression<Op, L, ScalarTerm> operator op(const Expression<L>& left, float right) \
+		{ \
+			return BinaryExpression<Op, L, ScalarTerm>(left.Self(), ScalarTerm(right)); \
+		} \
+		template <class R> \
+		BinaryExpression<Op, ScalarTerm, R> operator op(float left, const Expression<R>& right) \
+		{ \
+			return BinaryExpression<Op, ScalarTerm, R>(ScalarTerm(left), right.Self()); \
+		}
+
+		KERNELS_EXPRESSION_OPERATOR(+, PlusOp)
+		KERNELS_EXPRESSION_OPERATOR(-, MinusOp)
+		KERNELS_EXPRESSION_OPERATOR(*, MultipliesOp)
+		KERNELS_EXPRESSION_OPERATOR(/, DividesOp)
+
+#undef KERNELS_EXPRESSION_OPERATOR
+
+		/// <summary>
+		/// Evaluates the expression for bars [0, length) into dst in one fused loop.
+		/// dst may be one of the arrays of the expression: every bar is read before it is written.
+		/// </summary>
+		template <class E>
+		void Evaluate(const Expression<E>& expression, float* dst, int length)
+		{
+			const E& e = expression.Self();
+			for (int i = 0; i < length; i++)
+				dst[i] = e[i];
+		}
+	}
+}
+
+#ifdef _MANAGED
+#pragma managed(pop)
+#endif
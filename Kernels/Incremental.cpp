@@ -0,0 +1,478 @@
+// Incremental.cpp : append-only indicator state for real-time refreshes
+
+#include "Incremental.h"
+#include "Averages.h"
+#include "Null.h"
+#include "ResultCache.h"
+#include "RollingWindow.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// The states below read the value leaving the window from the source array instead of a ring buffer:
+			// AmiBroker passes the whole history on every refresh. Push(src, i) commits bar i,
+			// Peek(src, i) returns the result of bar i without changing the state. Both match RollingWindow/RollingExtreme.
+
+			template <class Accumulator, class Result>
+			class WindowState
+			{
+			public:
+				explicit WindowState(int period)
+					: period(period < 1 ? 1 : period), first(-1), lastNull(-1)
+				{
+				}
+
+				float Push(const float* src, int i)
+				{
+					if (first < 0)
+					{
+						// skip leading Nulls like AFL does
+						if (IsNull(src[i]))
+							return Null;
+						first = i;
+					}
+
+					if (i - first >= period)
+					{
+						// Nulls inside the window count as 0 (see RollingWindow)
+						float old = IsNull(src[i - period]) ? 0.0f : src[i - period];
+						sum.Remove(old);
+						sumSq.Remove((double)old * old);
+					}
+
+					float value = Value(src, i);
+					sum.Add(value);
+					sumSq.Add((double)value * value);
+
+					return Output(i, sum, sumSq);
+				}
+
+				float Peek(const float* src, int i) const
+				{
+					WindowState copy = *this;
+					return copy.Push(src, i);
+				}
+
+			private:
+				float Value(const float* src, int i)
+				{
+					float value = src[i];
+					if (IsNull(value))
+					{
+						lastNull = i;
+						value = 0.0f;
+					}
+					return value;
+				}
+
+				float Output(int i, const Accumulator& s, const Accumulator& sq) const
+				{
+					bool valid = i - first + 1 >= period && lastNull <= i - period;
+					return valid ? (float)Result()(s.Value(), sq.Value(), period) : Null;
+				}
+
+				int period;
+				int first;
+				int lastNull;
+				Accumulator sum;
+				Accumulator sumSq;
+			};
+
+			struct MeanResult { double operator()(double sum, double, int period) const { return sum / period; } };
+			struct SumResult { double operator()(double sum, double, int) const { return sum; } };
+			struct StDevResult
+			{
+				double operator()(double sum, double sumSq, int period) const
+				{
+					double mean = sum / period;
+					double variance = sumSq / period - mean * mean;
+					return variance > 0.0 ? std::sqrt(variance) : 0.0;
+				}
+			};
+
+			template <class Compare>
+			class ExtremeState
+			{
+			public:
+				explicit ExtremeState(int period)
+					: period(period < 1 ? 1 : period), indices(this->period), front(0), size(0), first(-1), lastNull(-1)
+				{
+				}
+
+				float Push(const float* src, int i)
+				{
+					if (first < 0)
+					{
+						if (IsNull(src[i]))
+							return Null;
+						first = i;
+					}
+
+					// drop the front element if it has left the window
+					if (size > 0 && indices[front] <= i - period)
+					{
+						front = front + 1 == period ? 0 : front + 1;
+						size--;
+					}
+
+					float value = src[i];
+					if (IsNull(value))
+					{
+						lastNull = i;
+					}
+					else
+					{
+						// drop dominated elements from the back
+						while (size > 0 && !compare(src[indices[(front + size - 1) % period]], value))
+							size--;
+
+						indices[(front + size) % period] = i;
+						size++;
+					}
+
+					return IsValid(i) ? src[indices[front]] : Null;
+				}
+
+				// the extreme of bar i is the better of the value and the oldest live element of the committed deque,
+				// so it is found without touching the deque
+				float Peek(const float* src, int i) const
+				{
+					if (first < 0 && IsNull(src[i]))
+						return Null;
+
+					float value = src[i];
+					int start = first < 0 ? i : first;
+					if (IsNull(value) || i - start + 1 < period || lastNull > i - period)
+						return Null;
+
+					int head = front;
+					int live = size;
+					if (live > 0 && indices[head] <= i - period)
+					{
+						head = head + 1 == period ? 0 : head + 1;
+						live--;
+					}
+
+					return live > 0 && compare(src[indices[head]], value) ? src[indices[head]] : value;
+				}
+
+			private:
+				bool IsValid(int i) const
+				{
+					return i - first + 1 >= period && lastNull <= i - period;
+				}
+
+				int period;
+				std::vector<int> indices;
+				int front;
+				int size;
+				int first;
+				int lastNull;
+				Compare compare;
+			};
+
+			class EmaSeriesState
+			{
+			public:
+				explicit EmaSeriesState(int period)
+					: state(period)
+				{
+				}
+
+				float Push(const float* src, int i) { return state.Push(src[i]); }
+
+				float Peek(const float* src, int i) const
+				{
+					EmaState copy = state;
+					return copy.Push(src[i]);
+				}
+
+			private:
+				EmaState state;
+			};
+
+			// cached results and state of one indicator
+			class Series
+			{
+			public:
+				virtual ~Series() {}
+
+				int Update(const float* src, const std::uint64_t* dates, int length, float* dst)
+				{
+					if (!Continues(src, dates, length))
+					{
+						Reset();
+						results.clear();
+						blocks.clear();
+						committed = 0;
+						verified = 0;
+					}
+
+					results.resize(length);
+
+					// all bars but the last one are closed and are committed to the state
+					int start = committed;
+					for (; committed < length - 1; committed++)
+						results[committed] = Push(src, committed);
+
+					// the last bar may change on the next tick
+					if (length > 0)
+						results[length - 1] = Peek(src, length - 1);
+
+					// hash the blocks the new bars completed, each once
+					for (int block = (int)blocks.size(); (block + 1) * BlockLength <= committed; block++)
+						blocks.push_back(BlockHash(src, dates, block));
+					if (committed > 0)
+					{
+						firstDate = dates[0];
+						lastDate = dates[committed - 1];
+						std::memcpy(&lastValue, &src[committed - 1], sizeof(lastValue));
+					}
+
+					if (length > 0)
+						std::memcpy(dst, results.data(), length * sizeof(float));
+
+					return length - start;
+				}
+
+				// memory held by the series, counted by its results and the state of its window
+				std::size_t Bytes() const
+				{
+					return results.capacity() * sizeof(float) + blocks.capacity() * sizeof(std::uint64_t) + StateBytes();
+				}
+
+			protected:
+				virtual void Reset() = 0;
+				virtual float Push(const float* src, int i) = 0;
+				virtual float Peek(const float* src, int i) const = 0;
+				virtual std::size_t StateBytes() const = 0;
+
+			private:
+				// closed bars are hashed in blocks of this many bars
+				static const int BlockLength = 4096;
+
+				// the values and time stamps of one block of committed bars; the dates are hashed as pairs of floats (only the bits matter)
+				static std::uint64_t BlockHash(const float* src, const std::uint64_t* dates, int block)
+				{
+					std::size_t begin = (std::size_t)block * BlockLength;
+					return HashArray(src + begin, BlockLength) ^
+						(HashArray(reinterpret_cast<const float*>(dates + begin), 2 * BlockLength) * 0x9E3779B185EBCA87ull);
+				}
+
+				// true if the bars of the cached state look unchanged in the new history, in time independent of the bar count.
+				// The first date and the last committed bar are compared on every refresh: a backfill, another database and
+				// bars inserted or removed anywhere shift them. One complete block of committed bars is hashed again in turn,
+				// so an edit deeper in the history (quote editor, split adjustment) is found within one refresh per block
+				bool Continues(const float* src, const std::uint64_t* dates, int length)
+				{
+					if (committed == 0)
+						return true;
+					if (length <= committed || dates[0] != firstDate || dates[committed - 1] != lastDate ||
+						std::memcmp(&src[committed - 1], &lastValue, sizeof(lastValue)) != 0)
+						return false;
+
+					if (blocks.empty())
+						return true;
+					int block = verified++ % (int)blocks.size();
+					return BlockHash(src, dates, block) == blocks[block];
+				}
+
+				std::vector<float> results;
+				int committed = 0;
+				// hashes of the complete blocks of committed bars, the next one to verify, and the bars compared on every refresh
+				std::vector<std::uint64_t> blocks;
+				int verified = 0;
+				std::uint64_t firstDate = 0;
+				std::uint64_t lastDate = 0;
+				float lastValue = 0.0f;
+			};
+
+			template <class State>
+			class StateSeries : public Series
+			{
+			public:
+				explicit StateSeries(int period)
+					: period(period), state(period)
+				{
+				}
+
+
+			protected:
+				void Reset() override { state = State(period); }
+				float Push(const float* src, int i) override { return state.Push(src, i); }
+				float Peek(const float* src, int i) const override { return state.Peek(src, i); }
+				// ExtremeState keeps a deque of up to 'period' bar indexes
+				std::size_t StateBytes() const override { return sizeof(State) + (std::size_t)std::max(period, 0) * sizeof(int); }
+
+			private:
+				int period;
+				State state;
+			};
+
+			std::unique_ptr<Series> CreateSeries(IncrementalFunction function, int period)
+			{
+				switch (function)
+				{
+				case IncrementalFunction::Sum:
+					return std::unique_ptr<Series>(new StateSeries<WindowState<RunningSum, SumResult>>(period));
+				case IncrementalFunction::Hhv:
+					return std::unique_ptr<Series>(new StateSeries<ExtremeState<Greater>>(period));
+				case IncrementalFunction::Llv:
+					return std::unique_ptr<Series>(new StateSeries<ExtremeState<Less>>(period));
+				case IncrementalFunction::StDev:
+					return std::unique_ptr<Series>(new StateSeries<WindowState<KahanSum, StDevResult>>(period));
+				case IncrementalFunction::Ema:
+					return std::unique_ptr<Series>(new StateSeries<EmaSeriesState>(period));
+				default:
+					return std::unique_ptr<Series>(new StateSeries<WindowState<RunningSum, MeanResult>>(period));
+				}
+			}
+
+			// each entry has its own lock, so refreshes of different indicators do not wait for each other
+			struct Entry
+			{
+				explicit Entry(const IncrementalKey& key)
+					: key(key)
+				{
+				}
+
+				IncrementalKey key;
+				std::mutex lock;
+				std::unique_ptr<Series> series;
+				// guarded by the lock of the cache
+				std::size_t bytes = 0;
+			};
+
+			// most recently used entries are at the front of the list (the policy of ResultCache). An evicted entry
+			// that is being updated stays alive until its update ends, it is only no longer found
+			struct Cache
+			{
+				std::mutex lock;
+				std::list<std::shared_ptr<Entry>> entries;
+				std::map<IncrementalKey, std::list<std::shared_ptr<Entry>>::iterator> index;
+				std::size_t bytes = 0;
+				std::size_t capacity = DefaultIncrementalCapacity;
+
+				void Erase(std::map<IncrementalKey, std::list<std::shared_ptr<Entry>>::iterator>::iterator found)
+				{
+					bytes -= (*found->second)->bytes;
+					entries.erase(found->second);
+					index.erase(found);
+				}
+
+				void Evict(std::size_t limit)
+				{
+					while (bytes > limit && !entries.empty())
+						Erase(index.find(entries.back()->key));
+				}
+			};
+
+			Cache& SharedCache()
+			{
+				static Cache cache;
+				return cache;
+			}
+		}
+
+		bool IncrementalKey::operator<(const IncrementalKey& other) const
+		{
+			return std::tie(symbol, interval, function, period) < std::tie(other.symbol, other.interval, other.function, other.period);
+		}
+
+		int IncrementalUpdate(const IncrementalKey& key, const float* src, const std::uint64_t* dates, int length, float* dst)
+		{
+			Cache& cache = SharedCache();
+			std::shared_ptr<Entry> entry;
+			{
+				std::lock_guard<std::mutex> guard(cache.lock);
+				auto found = cache.index.find(key);
+				if (found == cache.index.end())
+				{
+					entry = std::make_shared<Entry>(key);
+					entry->series = CreateSeries(key.function, key.period);
+					cache.entries.push_front(entry);
+					cache.index.emplace(key, cache.entries.begin());
+				}
+				else
+				{
+					cache.entries.splice(cache.entries.begin(), cache.entries, found->second);
+					entry = *found->second;
+				}
+			}
+
+			int calculated;
+			std::size_t bytes;
+			{
+				std::lock_guard<std::mutex> guard(entry->lock);
+				calculated = entry->series->Update(src, dates, length, dst);
+				bytes = entry->series->Bytes();
+			}
+
+			// account for the grown results unless the entry was dropped meanwhile; a series larger than the
+			// whole capacity is not kept
+			std::lock_guard<std::mutex> guard(cache.lock);
+			auto found = cache.index.find(key);
+			if (found != cache.index.end() && *found->second == entry)
+			{
+				cache.bytes += bytes - entry->bytes;
+				entry->bytes = bytes;
+				if (bytes > cache.capacity)
+					cache.Erase(found);
+				else
+					cache.Evict(cache.capacity);
+			}
+			return calculated;
+		}
+
+		void IncrementalInvalidate(const std::string& symbol)
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+			for (auto it = cache.index.begin(); it != cache.index.end();)
+			{
+				auto next = std::next(it);
+				if (it->first.symbol == symbol)
+					cache.Erase(it);
+				it = next;
+			}
+		}
+
+		void IncrementalSetCapacity(std::size_t bytes)
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+
+			cache.capacity = bytes;
+			cache.Evict(bytes);
+		}
+
+		std::size_t IncrementalBytes()
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+			return cache.bytes;
+		}
+
+		void IncrementalClear()
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+			cache.entries.clear();
+			cache.index.clear();
+			cache.bytes = 0;
+		}
+	}
+}
@@ -0,0 +1,97 @@
+// Incremental.h : append-only indicator state for real-time refreshes
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Span.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Indicators kept by the incremental cache. The first five values are the ones of WindowFunction.
+		/// </summary>
+		enum class IncrementalFunction
+		{
+			Ma = 0,
+			Sum = 1,
+			Hhv = 2,
+			Llv = 3,
+			StDev = 4,
+			Ema = 5
+		};
+
+		/// <summary>
+		/// Identifies one cached indicator: the same function with the same parameters
+		/// on the same symbol and interval continues from the state of the previous refresh.
+		/// </summary>
+		struct IncrementalKey
+		{
+			std::string symbol;
+			int interval;
+			IncrementalFunction function;
+			int period;
+
+			bool operator<(const IncrementalKey& other) const;
+		};
+
+		/// <summary>
+		/// Calculates the indicator of 'key' for src into dst (both 'length' values long).
+		///
+		/// During real-time trading AmiBroker re-runs formulas on every tick, but only the last bar changes
+		/// and new bars are appended. The cache keeps the running state (rolling sums, deque, EMA seed)
+		/// up to the last closed bar, so a refresh only pushes the new bars and re-evaluates the last (forming) bar.
+		/// The cached results are copied to dst, no other work depends on the number of bars.
+		///
+		/// dates are the bar time stamps (ATDateTime::Date). When the history no longer continues the cached one
+		/// (backfill, inserted or removed bars, another database, the last closed bar edited) the state is rebuilt.
+		/// Those are found by comparing the first date and the last closed bar. An edit deeper in the history is found
+		/// by hashing one block of 4096 closed bars per refresh in turn, i.e. within BarCount / 4096 refreshes;
+		/// call IncrementalInvalidate to rebuild at once. The results are identical to the Rolling* functions and Ema().
+		///
+		/// The cache is bounded by IncrementalSetCapacity (bytes of results); the least recently refreshed
+		/// indicators are dropped first, as in ResultCache.
+		///
+		/// Returns the number of bars calculated, which is length after a rebuild. Thread safe.
+		/// </summary>
+		int IncrementalUpdate(const IncrementalKey& key, const float* src, const std::uint64_t* dates, int length, float* dst);
+
+		/// <summary>
+		/// IncrementalUpdate on spans; src and dates must be at least as long as dst.
+		/// </summary>
+		inline int IncrementalUpdate(const IncrementalKey& key, Span<const float> src, Span<const std::uint64_t> dates, Span<float> dst)
+		{
+			assert(src.Length() >= dst.Length() && dates.Length() >= dst.Length());
+			return IncrementalUpdate(key, src.Data(), dates.Data(), dst.Length(), dst.Data());
+		}
+
+		/// <summary>
+		/// Drops the cached state of every indicator of a symbol, e.g. after its quotes were edited
+		/// or to free its memory when it is no longer charted.
+		/// </summary>
+		void IncrementalInvalidate(const std::string& symbol);
+
+		/// <summary>
+		/// Default memory bound of the cache in bytes.
+		/// </summary>
+		const std::size_t DefaultIncrementalCapacity = 64 * 1024 * 1024;
+
+		/// <summary>
+		/// Sets the memory bound in bytes and drops the least recently refreshed indicators until the cache fits in it.
+		/// </summary>
+		void IncrementalSetCapacity(std::size_t bytes);
+
+		/// <summary>
+		/// Memory held by the cache in bytes.
+		/// </summary>
+		std::size_t IncrementalBytes();
+
+		/// <summary>
+		/// Drops the whole cache (e.g. when the database is changed).
+		/// </summary>
+		void IncrementalClear();
+	}
+}
@@ -0,0 +1,58 @@
+// Null.h : AFL Null handling shared by the native kernels
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// The native equivalent of ATFloat::Null (EMPTY_VAL in the ADK).
+		/// AmiBroker marks missing array elements with this value instead of NaN.
+		/// </summary>
+		const float Null = -1e10f;
+
+		/// <summary>
+		/// Returns true if the value is AmiBroker's Null (see ATFloat::IsNull).
+		/// </summary>
+		inline bool IsNull(float value)
+		{
+			return value == Null;
+		}
+
+		/// <summary>
+		/// Returns Null if isNull is true, otherwise value.
+		/// It is a bit select instead of a branch: compilers do not speculate floating point arithmetic
+		/// into a conditional (trapping math), so "isNull ? Null : a + b" keeps loops from vectorizing.
+		/// </summary>
+		inline float NullIf(bool isNull, float value)
+		{
+			const float null = Null;
+			std::uint32_t bits, nullBits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			std::memcpy(&nullBits, &null, sizeof(nullBits));
+
+			std::uint32_t mask = 0u - (std::uint32_t)isNull;
+			bits = (bits & ~mask) | (nullBits & mask);
+
+			float result;
+			std::memcpy(&result, &bits, sizeof(result));
+			return result;
+		}
+
+		/// <summary>
+		/// Returns the index of the first non-Null element or length if all elements are Null
+		/// (the native equivalent of ATArray::GetFirstValidIndex).
+		/// </summary>
+		inline int FirstValidIndex(const float* src, int length)
+		{
+			int i = 0;
+			while (i < length && IsNull(src[i]))
+				i++;
+			return i;
+		}
+	}
+}
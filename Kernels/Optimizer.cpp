@@ -0,0 +1,367 @@
+// Optimizer.cpp : parallel parameter optimization of the MA/EMA crossover system
+
+#include "Optimizer.h"
+#include "Null.h"
+#include "Parallel.h"
+#include "Positions.h"
+#include "Price.h"
+#include "ScratchArena.h"
+#include "Signals.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			const double MaxProfitFactor = 100.0;
+
+			// trades of one evaluation; reused by the thread so an evaluation allocates nothing once it has run
+			thread_local std::vector<PositionTrade> threadTrades;
+
+			CrossoverResult Measure(int fast, int slow, const std::vector<PositionTrade>& trades, const float* close, int last)
+			{
+				CrossoverResult result = { fast, slow, 0.0, 0.0, 0, 0.0, 0.0, 0.0 };
+				double equity = 1.0, peak = 1.0, drawdown = 0.0;
+				double grossProfit = 0.0, grossLoss = 0.0;
+				int wins = 0;
+
+				for (const PositionTrade& trade : trades)
+				{
+					float exit = trade.isOpen ? close[last] : trade.exitPrice;
+					if (IsNull(trade.entryPrice) || IsNull(exit) || trade.entryPrice <= 0.0f)
+						continue;
+
+					double r = trade.isLong ? exit / (double)trade.entryPrice - 1.0 : 1.0 - exit / (double)trade.entryPrice;
+					equity *= 1.0 + r;
+					peak = std::max(peak, equity);
+					drawdown = std::max(drawdown, 1.0 - equity / peak);
+					if (r > 0.0)
+					{
+						grossProfit += r;
+						wins++;
+					}
+					else
+						grossLoss -= r;
+					result.trades++;
+				}
+
+				result.netProfit = (equity - 1.0) * 100.0;
+				result.score = result.netProfit;
+				result.winRate = result.trades > 0 ? 100.0 * wins / result.trades : 0.0;
+				result.profitFactor = grossLoss > 0.0 ? std::min(grossProfit / grossLoss, MaxProfitFactor) : (grossProfit > 0.0 ? MaxProfitFactor : 0.0);
+				result.maxDrawdown = drawdown * 100.0;
+				return result;
+			}
+
+			// bar by bar equity of the trades of [first, length) into equity[0] .. equity[length - first - 1]; the bars are those of the trades
+			void EquityCurve(const std::vector<PositionTrade>& trades, const float* close, int first, int length, float* equity)
+			{
+				double base = 1.0;
+				int i = first;
+				for (const PositionTrade& trade : trades)
+				{
+					int exitBar = trade.isOpen ? length - 1 : trade.exitBar;
+					float exit = trade.isOpen ? close[length - 1] : trade.exitPrice;
+					if (IsNull(trade.entryPrice) || IsNull(exit) || trade.entryPrice <= 0.0f)
+						continue;
+
+					for (; i < trade.entryBar; i++)
+						equity[i - first] = (float)base;
+
+					// on a reversal bar the entry of this trade overwrites the exit of the previous one
+					double entry = trade.entryPrice;
+					for (int j = trade.entryBar; j < exitBar; j++)
+					{
+						if (IsNull(close[j]))
+							equity[j - first] = j > first ? equity[j - first - 1] : (float)base;
+						else
+							equity[j - first] = (float)(base * (trade.isLong ? close[j] / entry : 2.0 - close[j] / entry));
+					}
+
+					base *= trade.isLong ? exit / entry : 2.0 - exit / entry;
+					equity[exitBar - first] = (float)base;
+					i = exitBar + 1;
+				}
+				for (; i < length; i++)
+					equity[i - first] = (float)base;
+			}
+
+			double Score(const CrossoverResult& result, const OptimizationSettings& settings)
+			{
+				if (result.trades < settings.minTrades)
+					return -std::numeric_limits<double>::infinity();
+
+				switch (settings.objective)
+				{
+				case OptimizationObjective::ProfitFactor:
+					return result.profitFactor;
+				case OptimizationObjective::RecoveryFactor:
+					return result.netProfit / std::max(result.maxDrawdown, 0.01);
+				default:
+					return result.netProfit;
+				}
+			}
+
+			// best first; equal scores in the order of the parameters, so the ranking does not depend on the threads
+			void Rank(std::vector<CrossoverResult>& results)
+			{
+				std::sort(results.begin(), results.end(), [](const CrossoverResult& a, const CrossoverResult& b)
+				{
+					if (a.score != b.score)
+						return a.score > b.score;
+					return a.fast != b.fast ? a.fast < b.fast : a.slow < b.slow;
+				});
+			}
+
+			std::vector<std::pair<int, int>> GridOf(const OptimizationSettings& settings)
+			{
+				std::vector<std::pair<int, int>> grid;
+				int fastStep = std::max(settings.fastStep, 1), slowStep = std::max(settings.slowStep, 1);
+				for (int fast = std::max(settings.fastMin, 1); fast <= settings.fastMax; fast += fastStep)
+				{
+					for (int slow = std::max(settings.slowMin, 1); slow <= settings.slowMax; slow += slowStep)
+					{
+						if (!settings.fastBelowSlow || fast < slow)
+							grid.push_back(std::make_pair(fast, slow));
+					}
+				}
+				return grid;
+			}
+
+			// 'count' distinct combinations of the grid; the whole grid if it is not larger
+			std::vector<std::pair<int, int>> Sample(const std::vector<std::pair<int, int>>& grid, int count, std::uint32_t seed)
+			{
+				if (count >= (int)grid.size())
+					return grid;
+
+				// a partial Fisher-Yates shuffle of the indexes
+				std::mt19937 random(seed);
+				std::vector<int> order(grid.size());
+				for (int k = 0; k < (int)order.size(); k++)
+					order[k] = k;
+				std::vector<std::pair<int, int>> sample;
+				for (int k = 0; k < count; k++)
+				{
+					std::uniform_int_distribution<int> pick(k, (int)order.size() - 1);
+					std::swap(order[k], order[pick(random)]);
+					sample.push_back(grid[order[k]]);
+				}
+				return sample;
+			}
+
+			std::vector<CrossoverResult> Scored(const CrossoverSystem& system, const std::vector<std::pair<int, int>>& periods,
+				int begin, int end, const OptimizationSettings& settings)
+			{
+				std::vector<CrossoverResult> results = system.Evaluate(periods, begin, end);
+				for (CrossoverResult& result : results)
+					result.score = Score(result, settings);
+				Rank(results);
+				return results;
+			}
+		}
+
+		CrossoverSystem::CrossoverSystem(const CrossoverInputs& inputs)
+			: inputs(inputs), typicalPrice(inputs.length)
+		{
+			TypicalPrice(inputs.high, inputs.low, inputs.close, typicalPrice.data(), inputs.length);
+			prefix.reset(new PrefixSums(typicalPrice.data(), inputs.length));
+		}
+
+		void CrossoverSystem::CacheEma(const std::vector<int>& periods)
+		{
+			for (int period : periods)
+			{
+				if (!CachedEma(period))
+					emaCache.push_back(std::make_pair(period, std::vector<float>()));
+			}
+
+			ParallelFor((int)emaCache.size(), 1, [&](int first, int last)
+			{
+				for (int k = first; k < last; k++)
+				{
+					std::vector<float>& ema = emaCache[k].second;
+					if (ema.empty() && inputs.length > 0)
+					{
+						ema.resize(inputs.length);
+						Ema(inputs.close, ema.data(), inputs.length, emaCache[k].first);
+					}
+				}
+			});
+		}
+
+		const float* CrossoverSystem::CachedEma(int period) const
+		{
+			for (const auto& entry : emaCache)
+			{
+				if (entry.first == period && !entry.second.empty())
+					return entry.second.data();
+			}
+			return nullptr;
+		}
+
+		CrossoverResult CrossoverSystem::Evaluate(int fast, int slow, int begin, int end) const
+		{
+			std::pair<int, int> periods(fast, slow);
+			CrossoverResult result;
+			EvaluateGroup(&periods, 1, begin, end, &result, nullptr);
+			return result;
+		}
+
+		CrossoverResult CrossoverSystem::EvaluateEquity(int fast, int slow, int begin, int end, float* equity) const
+		{
+			std::pair<int, int> periods(fast, slow);
+			CrossoverResult result;
+			EvaluateGroup(&periods, 1, begin, end, &result, equity);
+			return result;
+		}
+
+		std::vector<CrossoverResult> CrossoverSystem::Evaluate(const std::vector<std::pair<int, int>>& periods, int begin, int end) const
+		{
+			// the combinations grouped by fast period, each group on one thread with one EMA
+			std::vector<int> order(periods.size());
+			for (int k = 0; k < (int)order.size(); k++)
+				order[k] = k;
+			std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return periods[a].first < periods[b].first; });
+
+			std::vector<std::pair<int, int>> sorted(periods.size());
+			for (int k = 0; k < (int)order.size(); k++)
+				sorted[k] = periods[order[k]];
+
+			std::vector<int> groups;
+			for (int k = 0; k < (int)sorted.size(); k++)
+			{
+				if (k == 0 || sorted[k].first != sorted[k - 1].first)
+					groups.push_back(k);
+			}
+			groups.push_back((int)sorted.size());
+
+			std::vector<CrossoverResult> results(periods.size());
+			std::vector<CrossoverResult> sortedResults(periods.size());
+			ParallelFor((int)groups.size() - 1, 1, [&](int first, int last)
+			{
+				for (int g = first; g < last; g++)
+					EvaluateGroup(&sorted[groups[g]], groups[g + 1] - groups[g], begin, end, &sortedResults[groups[g]], nullptr);
+			});
+
+			for (int k = 0; k < (int)order.size(); k++)
+				results[order[k]] = sortedResults[k];
+			return results;
+		}
+
+		void CrossoverSystem::EvaluateGroup(const std::pair<int, int>* periods, int count, int begin, int end, CrossoverResult* results, float* equity) const
+		{
+			if (end < 0 || end > inputs.length)
+				end = inputs.length;
+			if (begin < 0)
+				begin = 0;
+			if (begin >= end)
+			{
+				for (int k = 0; k < count; k++)
+					results[k] = Measure(periods[k].first, periods[k].second, std::vector<PositionTrade>(), inputs.close, 0);
+				return;
+			}
+
+			// from the bar before the window: the first bar of a Cross is never a cross, so bar 'begin' is one if it should be
+			int start = begin > 0 ? begin - 1 : 0;
+			int length = end - start;
+
+			ScratchScope scratch;
+			const float* ema = CachedEma(periods[0].first);
+			if (!ema)
+			{
+				Span<float> computed = scratch.Allocate<float>(end);
+				Ema(inputs.close, computed.Data(), end, periods[0].first);
+				ema = computed.Data();
+			}
+			ema += start;
+
+			int words = SignalWords(length);
+			Span<float> ma = scratch.Allocate<float>(length);
+			Span<std::uint64_t> up = scratch.Allocate<std::uint64_t>(words);
+			Span<std::uint64_t> down = scratch.Allocate<std::uint64_t>(words);
+
+			PositionSignals signals = { up.Data(), down.Data(), down.Data(), up.Data(),
+				inputs.open + start, inputs.close + start, inputs.open + start, inputs.close + start };
+			PositionOutputs outputs = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, &threadTrades };
+
+			for (int k = 0; k < count; k++)
+			{
+				prefix->Ma(periods[k].second, ma.Data(), start, end);
+				Cross(ema, ma.Data(), up.Data(), length);
+				Cross(ma.Data(), ema, down.Data(), length);
+
+				threadTrades.clear();
+				TrackPositions(signals, length, outputs);
+				results[k] = Measure(periods[k].first, periods[k].second, threadTrades, inputs.close + start, length - 1);
+				if (equity)
+					EquityCurve(threadTrades, inputs.close + start, begin - start, length, equity);
+			}
+		}
+
+		OptimizationReport Optimize(const CrossoverSystem& system, const OptimizationSettings& settings)
+		{
+			OptimizationReport report;
+			report.evaluations = 0;
+
+			int end = settings.end < 0 || settings.end > system.Length() ? system.Length() : settings.end;
+			int begin = std::max(settings.begin, 0);
+
+			std::vector<std::pair<int, int>> candidates = GridOf(settings);
+			if (settings.method != OptimizationMethod::Grid)
+				candidates = Sample(candidates, std::max(settings.samples, 1), settings.seed);
+
+			if (settings.method != OptimizationMethod::SuccessiveHalving)
+			{
+				report.results = Scored(system, candidates, begin, end, settings);
+				report.evaluations = (int)candidates.size();
+				return report;
+			}
+
+			// rungs on 1/27, 1/9, 1/3 of the bars (fewer for few candidates), all of them ending at the last bar;
+			// a rung shorter than a few slow periods says nothing about the system, so it is made longer
+			const int Eta = 3;
+			int rungs = 0;
+			for (int survivors = (int)candidates.size(); survivors > Eta && rungs < 3; survivors = (survivors + Eta - 1) / Eta)
+				rungs++;
+
+			int bars = end - begin;
+			int minimum = std::min(bars, 10 * std::max(settings.slowMax, 1));
+			for (int rung = rungs; rung > 0; rung--)
+			{
+				int length = std::max(bars / (int)std::pow(Eta, rung), minimum);
+				std::vector<CrossoverResult> results = Scored(system, candidates, end - length, end, settings);
+				report.evaluations += (int)candidates.size();
+
+				int keep = ((int)candidates.size() + Eta - 1) / Eta;
+				candidates.clear();
+				for (int k = 0; k < keep; k++)
+					candidates.push_back(std::make_pair(results[k].fast, results[k].slow));
+			}
+
+			report.results = Scored(system, candidates, begin, end, settings);
+			report.evaluations += (int)candidates.size();
+			return report;
+		}
+
+		std::string OptimizationTable(const std::vector<CrossoverResult>& results, int rows)
+		{
+			std::string table = "Rank  Fast  Slow        Score   Net profit %  Trades   Win %  Profit factor  Max DD %\n";
+			char line[160];
+			for (int k = 0; k < (int)results.size() && k < rows; k++)
+			{
+				const CrossoverResult& r = results[k];
+				std::snprintf(line, sizeof(line), "%4d  %4d  %4d  %11.6g  %13.6g  %6d  %6.1f  %13.2f  %8.2f\n",
+					k + 1, r.fast, r.slow, r.score, r.netProfit, r.trades, r.winRate, r.profitFactor, r.maxDrawdown);
+				table += line;
+			}
+			return table;
+		}
+	}
+}
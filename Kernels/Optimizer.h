@@ -0,0 +1,159 @@
+// Optimizer.h : parallel parameter optimization of the MA/EMA crossover system
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Averages.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Quotes of the symbol to optimize on; they must outlive the CrossoverSystem.
+		/// </summary>
+		struct CrossoverInputs
+		{
+			const float* open;
+			const float* high;
+			const float* low;
+			const float* close;
+			int length;
+		};
+
+		/// <summary>
+		/// Performance of one parameter combination. Returns are per trade on the entry price and compounded;
+		/// the drawdown is the largest fall of the closed-trade equity from its peak.
+		/// </summary>
+		struct CrossoverResult
+		{
+			int fast;
+			int slow;
+			double score;
+			double netProfit;			// percent
+			int trades;
+			double winRate;				// percent of the trades
+			double profitFactor;		// gross profit / gross loss, capped at 100
+			double maxDrawdown;			// percent
+		};
+
+		/// <summary>
+		/// The ranking of the results.
+		/// </summary>
+		enum class OptimizationObjective
+		{
+			NetProfit = 0,
+			ProfitFactor = 1,
+			// net profit / max drawdown
+			RecoveryFactor = 2
+		};
+
+		/// <summary>
+		/// The system of BasicSampleVC9 and the offline backtester with the periods as parameters:
+		/// Buy = Cover = Cross(EMA(Close, fast), MA(TypicalPrice, slow)), Short = Sell = Cross(MA, EMA),
+		/// BuyPrice = ShortPrice = Open, SellPrice = CoverPrice = Close. A trade still open at the end is closed at the last close.
+		///
+		/// The inputs every combination shares are prepared once: the typical price and its prefix sums, so the MA of any
+		/// period is a difference of two sums. Evaluating a combination then costs one EMA (or none, see CacheEma),
+		/// one MA from the prefix sums, two packed Cross and the position state machine (Positions.h).
+		/// Evaluate is thread safe; the intermediate arrays come from the scratch arena of the calling thread.
+		/// </summary>
+		class CrossoverSystem
+		{
+		public:
+			explicit CrossoverSystem(const CrossoverInputs& inputs);
+
+			int Length() const { return inputs.length; }
+
+			/// <summary>
+			/// Trades of the bars [begin, end) (end = -1: the last bar); the averages are calculated from the first bar,
+			/// so a window starts with the indicators of the whole history, the way a backtest of a date range does.
+			/// </summary>
+			CrossoverResult Evaluate(int fast, int slow, int begin = 0, int end = -1) const;
+
+			/// <summary>
+			/// Evaluates many combinations: those of the same fast period share one EMA. Results in the order of the input.
+			/// </summary>
+			std::vector<CrossoverResult> Evaluate(const std::vector<std::pair<int, int>>& periods, int begin = 0, int end = -1) const;
+
+			/// <summary>
+			/// Evaluate with the equity of every bar of [begin, end) in equity[0] .. equity[end - begin - 1]: 1 at the start,
+			/// the closed trades compounded and the open trade marked to the close. The last value is 1 + net profit / 100.
+			/// </summary>
+			CrossoverResult EvaluateEquity(int fast, int slow, int begin, int end, float* equity) const;
+
+			/// <summary>
+			/// Calculates the EMA of the periods once for all later evaluations, in parallel (4 bytes per bar and period).
+			/// Pays off when the same fast periods are evaluated on many windows (walk-forward).
+			/// Not thread safe: call it before the evaluations.
+			/// </summary>
+			void CacheEma(const std::vector<int>& periods);
+
+		private:
+			void EvaluateGroup(const std::pair<int, int>* periods, int count, int begin, int end, CrossoverResult* results, float* equity) const;
+			const float* CachedEma(int period) const;
+
+			CrossoverInputs inputs;
+			std::vector<float> typicalPrice;
+			std::unique_ptr<PrefixSums> prefix;
+			std::vector<std::pair<int, std::vector<float>>> emaCache;
+		};
+
+		/// <summary>
+		/// How the parameter space is searched.
+		/// - Grid: every combination.
+		/// - Random: 'samples' distinct combinations of the grid drawn at random.
+		/// - SuccessiveHalving: 'samples' random combinations evaluated on the most recent part of the bars; the best
+		///   third goes on to a part three times longer, until the survivors are evaluated on all bars.
+		///   Most of the candidates are dropped after a fraction of the work.
+		/// </summary>
+		enum class OptimizationMethod
+		{
+			Grid = 0,
+			Random = 1,
+			SuccessiveHalving = 2
+		};
+
+		struct OptimizationSettings
+		{
+			OptimizationMethod method = OptimizationMethod::Grid;
+			OptimizationObjective objective = OptimizationObjective::NetProfit;
+			int fastMin = 2;
+			int fastMax = 40;
+			int fastStep = 1;
+			int slowMin = 5;
+			int slowMax = 200;
+			int slowStep = 5;
+			// combinations with fast >= slow are skipped
+			bool fastBelowSlow = true;
+			// results with fewer trades rank last
+			int minTrades = 1;
+			int samples = 300;
+			std::uint32_t seed = 1;
+			// the bars to optimize on (end = -1: the last bar)
+			int begin = 0;
+			int end = -1;
+		};
+
+		struct OptimizationReport
+		{
+			// best first
+			std::vector<CrossoverResult> results;
+			int evaluations;
+		};
+
+		/// <summary>
+		/// Searches the parameters of the crossover system on all cores (Parallel.h) and ranks the results.
+		/// The results are the same whatever the number of threads.
+		/// </summary>
+		OptimizationReport Optimize(const CrossoverSystem& system, const OptimizationSettings& settings);
+
+		/// <summary>
+		/// The first 'rows' results as a text table, one line per result.
+		/// </summary>
+		std::string OptimizationTable(const std::vector<CrossoverResult>& results, int rows);
+	}
+}
@@ -0,0 +1,268 @@
+// Parallel.cpp : data-parallel loops and reductions of the native kernels
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// chunks per participating thread: enough to balance uneven work by stealing, few enough to keep the overhead low
+			const int ChunksPerThread = 8;
+
+			// nesting depth of parallel loops on this thread; loops inside loops run sequentially
+			thread_local int parallelDepth = 0;
+
+			/// <summary>
+			/// One parallel loop. Participant p owns the chunks [next, end) of slots[p] and claims them from the front;
+			/// participants without work claim chunks of the other slots the same way, so every chunk is run exactly once.
+			/// </summary>
+			class Job
+			{
+			public:
+				Job(int chunks, int participants, const std::function<void(int chunk)>& body)
+					: body(body), slots(new Slot[participants]), participants(participants), joined(1), active(1)
+				{
+					for (int p = 0; p < participants; p++)
+					{
+						slots[p].next.store((int)((long long)chunks * p / participants), std::memory_order_relaxed);
+						slots[p].end = (int)((long long)chunks * (p + 1) / participants);
+					}
+				}
+
+				void Run(int participant)
+				{
+					for (int k = 0; k < participants; k++)
+					{
+						Slot& slot = slots[(participant + k) % participants];
+						for (int chunk = slot.next.fetch_add(1); chunk < slot.end; chunk = slot.next.fetch_add(1))
+						{
+							if (failed.load(std::memory_order_relaxed))
+								return;
+							try
+							{
+								body(chunk);
+							}
+							catch (...)
+							{
+								std::lock_guard<std::mutex> lock(errorMutex);
+								if (!error)
+									error = std::current_exception();
+								failed.store(true);
+							}
+						}
+					}
+				}
+
+				bool CanJoin() const { return joined < participants; }
+
+				const std::function<void(int chunk)>& body;
+				struct alignas(64) Slot
+				{
+					std::atomic<int> next;
+					int end;
+				};
+				std::unique_ptr<Slot[]> slots;
+				int participants;
+				int joined;	// guarded by the pool mutex
+				int active;	// guarded by the pool mutex
+
+				std::atomic<bool> failed{ false };
+				std::mutex errorMutex;
+				std::exception_ptr error;
+			};
+
+			/// <summary>
+			/// The global pool. Its threads are never stopped: the plug-in may be unloaded while the process exits,
+			/// when joining threads from a static destructor can dead-lock.
+			/// </summary>
+			class Pool
+			{
+			public:
+				static Pool& Instance()
+				{
+					static Pool* pool = new Pool();
+					return *pool;
+				}
+
+				int Limit() const { return limit.load(std::memory_order_relaxed); }
+
+				void SetLimit(int threads)
+				{
+					limit.store(std::max(1, threads));
+					wake.notify_all();
+				}
+
+				void Run(int chunks, const std::function<void(int chunk)>& body)
+				{
+					int participants = std::min(chunks, Limit());
+					Job job(chunks, participants, body);
+
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						StartThreads(participants - 1);
+						jobs.push_back(&job);
+						busy++;
+					}
+					wake.notify_all();
+
+					parallelDepth++;
+					job.Run(0);
+					parallelDepth--;
+
+					{
+						// all chunks are claimed: no one may join any more, wait for the helpers still finishing theirs
+						std::unique_lock<std::mutex> lock(mutex);
+						jobs.erase(std::find(jobs.begin(), jobs.end(), &job));
+						busy--;
+						job.active--;
+						done.wait(lock, [&job]() { return job.active == 0; });
+					}
+					wake.notify_all();
+
+					if (job.error)
+						std::rethrow_exception(job.error);
+				}
+
+			private:
+				Pool() : limit(WorkerCount()), busy(0), threads(0) {}
+
+				// called with the mutex held
+				void StartThreads(int count)
+				{
+					for (; threads < count; threads++)
+						std::thread([this]() { Work(); }).detach();
+				}
+
+				// called with the mutex held
+				Job* FindJob()
+				{
+					if (busy >= Limit())
+						return nullptr;
+					for (Job* job : jobs)
+					{
+						if (job->CanJoin())
+							return job;
+					}
+					return nullptr;
+				}
+
+				void Work()
+				{
+					parallelDepth = 1;
+
+					std::unique_lock<std::mutex> lock(mutex);
+					for (;;)
+					{
+						Job* job;
+						wake.wait(lock, [this, &job]() { return (job = FindJob()) != nullptr; });
+
+						int participant = job->joined++;
+						job->active++;
+						busy++;
+						lock.unlock();
+
+						job->Run(participant);
+
+						lock.lock();
+						busy--;
+						if (--job->active == 0)
+							done.notify_all();
+						wake.notify_all();
+					}
+				}
+
+				std::atomic<int> limit;
+				std::mutex mutex;
+				std::condition_variable wake;
+				std::condition_variable done;
+				std::vector<Job*> jobs;
+				int busy;
+				int threads;
+			};
+
+			void RunChunks(int chunks, const std::function<void(int chunk)>& body)
+			{
+				if (chunks <= 0)
+					return;
+
+				if (chunks == 1 || parallelDepth > 0 || Parallelism() < 2)
+				{
+					for (int chunk = 0; chunk < chunks; chunk++)
+						body(chunk);
+					return;
+				}
+
+				Pool::Instance().Run(chunks, body);
+			}
+		}
+
+		int WorkerCount()
+		{
+			static const int workers = []()
+			{
+				unsigned int threads = std::thread::hardware_concurrency();
+				return threads > 0 ? (int)threads : 1;
+			}();
+			return workers;
+		}
+
+		int Parallelism()
+		{
+			return Pool::Instance().Limit();
+		}
+
+		void SetParallelism(int threads)
+		{
+			Pool::Instance().SetLimit(threads);
+		}
+
+		void ParallelFor(int count, int grain, const std::function<void(int begin, int end)>& body)
+		{
+			if (count <= 0)
+				return;
+			if (grain < 1)
+				grain = 1;
+
+			if (count < 2 * grain || parallelDepth > 0 || Parallelism() < 2)
+			{
+				body(0, count);
+				return;
+			}
+
+			// at least 'grain' items per chunk, about ChunksPerThread chunks per thread
+			int chunkSize = std::max(grain, (int)(((long long)count + Parallelism() * ChunksPerThread - 1) / (Parallelism() * ChunksPerThread)));
+			int chunks = (count + chunkSize - 1) / chunkSize;
+
+			RunChunks(chunks, [&](int chunk)
+			{
+				int begin = chunk * chunkSize;
+				body(begin, std::min(count, begin + chunkSize));
+			});
+		}
+
+		void ParallelForWindowed(int count, int chunkSize, int halo, const std::function<void(int begin, int end, int warmup)>& body)
+		{
+			if (count <= 0)
+				return;
+			if (chunkSize < 1)
+				chunkSize = count;
+
+			int chunks = (int)(((long long)count + chunkSize - 1) / chunkSize);
+			RunChunks(chunks, [&](int chunk)
+			{
+				int begin = chunk * chunkSize;
+				body(begin, std::min(count, begin + chunkSize), std::max(0, begin - halo));
+			});
+		}
+	}
+}
@@ -0,0 +1,97 @@
+// Parallel.h : data-parallel loops and reductions of the native kernels
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		// All parallel loops run on one global thread pool that is started at the first parallel loop.
+		// A loop is cut into chunks; each thread taking part starts on its own share of the chunks and,
+		// when it is done, steals the remaining chunks of the others, so uneven chunks and busy cores even out.
+		//
+		// AmiBroker runs formulas of many panes, scans and optimizations on its own threads at the same time.
+		// The threads inside parallel loops (callers included) are counted and the pool threads only join a loop
+		// while fewer than Parallelism() threads are in one, which caps the threads the loops themselves add.
+		// It is not a process-wide CPU budget: formula threads outside parallel loops are not counted, so pool threads
+		// may still compete with them for cores, and a caller always works on its own loop even when the cap is reached.
+		// Lower SetParallelism() to leave cores to such threads.
+		// A parallel loop started inside the body of another one runs on the calling thread.
+
+		/// <summary>
+		/// Returns the number of hardware threads.
+		/// </summary>
+		int WorkerCount();
+
+		/// <summary>
+		/// Maximum number of threads busy with parallel loops at the same time (callers included).
+		/// Defaults to WorkerCount(); 1 makes every loop sequential. Thread safe.
+		/// </summary>
+		int Parallelism();
+		void SetParallelism(int threads);
+
+		/// <summary>
+		/// Arrays shorter than this are processed on the calling thread by the kernels that parallelize internally:
+		/// below it, waking up the pool costs more than the loop.
+		/// </summary>
+		const int ParallelMinimumLength = 1 << 20;
+
+		/// <summary>
+		/// Elements per chunk of the element-wise kernels: the inputs and the output of a chunk stay in the L2 cache.
+		/// </summary>
+		const int ParallelChunkLength = 1 << 15;
+
+		/// <summary>
+		/// Splits [0, count) into ranges of at least 'grain' items and runs body(begin, end) on them in parallel.
+		/// The calling thread takes part in the work. Small loops (count below 2 * grain) run on the calling thread.
+		/// An exception thrown by the body is rethrown on the calling thread after the loop.
+		/// </summary>
+		void ParallelFor(int count, int grain, const std::function<void(int begin, int end)>& body);
+
+		/// <summary>
+		/// Windowed parallel loop: [0, count) is cut into chunks of exactly chunkSize items, and
+		/// body(begin, end, warmup) computes the results of [begin, end) starting from the inputs at
+		/// warmup = max(0, begin - halo). The halo is the overlap the window of the kernel needs
+		/// (period - 1 for a rolling window), so each chunk is computed independently of the others.
+		/// The chunks only depend on count and chunkSize, so the results do not depend on the number of threads.
+		/// </summary>
+		void ParallelForWindowed(int count, int chunkSize, int halo, const std::function<void(int begin, int end, int warmup)>& body);
+
+		/// <summary>
+		/// Parallel reduction: map(begin, end) reduces one range of [0, count) to a T and the partial results
+		/// are folded with combine in range order.
+		/// The ranges depend on count and grain only, so floating point results do not depend on the number of threads.
+		/// </summary>
+		template <class T, class Map, class Combine>
+		T ParallelReduce(int count, int grain, T identity, Map map, Combine combine)
+		{
+			const int MaxChunks = 64;
+
+			if (grain < 1)
+				grain = 1;
+			int chunkSize = (count + MaxChunks - 1) / MaxChunks;
+			if (chunkSize < grain)
+				chunkSize = grain;
+			int chunks = count > 0 ? (count + chunkSize - 1) / chunkSize : 0;
+
+			std::vector<T> partial(chunks, identity);
+			ParallelFor(chunks, 1, [&](int first, int last)
+			{
+				for (int chunk = first; chunk < last; chunk++)
+				{
+					int begin = chunk * chunkSize;
+					int end = begin + chunkSize < count ? begin + chunkSize : count;
+					partial[chunk] = map(begin, end);
+				}
+			});
+
+			T result = identity;
+			for (const T& value : partial)
+				result = combine(result, value);
+			return result;
+		}
+	}
+}
@@ -0,0 +1,197 @@
+// Positions.cpp : position state machine of Buy/Sell/Short/Cover signals
+
+#include "Positions.h"
+#include "Null.h"
+#include "Signals.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			class PositionMachine
+			{
+			public:
+				PositionMachine(const PositionSignals& signals, const PositionOutputs& outputs)
+					: in(signals), out(outputs)
+				{
+				}
+
+				int Run(int length)
+				{
+					int words = SignalWords(length);
+					std::uint64_t* bitOutputs[6] = { out.buy, out.sell, out.shrt, out.cover, out.inLong, out.inShort };
+					for (std::uint64_t* bits : bitOutputs)
+					{
+						if (bits)
+						{
+							for (int w = 0; w < words; w++)
+								bits[w] = 0;
+						}
+					}
+
+					for (int w = 0; w < words; w++)
+					{
+						int start = w * 64;
+						int count = length - start < 64 ? length - start : 64;
+						std::uint64_t events = Word(in.buy, w) | Word(in.sell, w) | Word(in.shrt, w) | Word(in.cover, w);
+
+						// no signal in these 64 bars: the position carries over unchanged
+						if (events == 0)
+						{
+							Hold(w, start, count);
+							continue;
+						}
+
+						for (int lane = 0; lane < count; lane++)
+						{
+							std::uint64_t bar = 1ull << lane;
+							exited = 0;
+							if (events & bar)
+								Step(start + lane, w, bar);
+							Record(start + lane, w, bar);
+						}
+					}
+
+					if (out.trades && position != 0)
+						out.trades->back().exitBar = length - 1;
+					return trades;
+				}
+
+			private:
+				static std::uint64_t Word(const std::uint64_t* bits, int w) { return bits ? bits[w] : 0; }
+				static float Price(const float* prices, int bar) { return prices ? prices[bar] : Null; }
+				static void Mark(std::uint64_t* bits, int w, std::uint64_t bar) { if (bits) bits[w] |= bar; }
+
+				void Step(int index, int w, std::uint64_t bar)
+				{
+					bool buy = (Word(in.buy, w) & bar) != 0;
+					bool sell = (Word(in.sell, w) & bar) != 0;
+					bool shrt = (Word(in.shrt, w) & bar) != 0;
+					bool cover = (Word(in.cover, w) & bar) != 0;
+
+					// exits first, from the bar after the entry on; the opposite entry signal reverses the position
+					bool reverse = false;
+					if (position == 1 && index > entryBar && (sell || shrt))
+					{
+						Exit(index, sell ? Price(in.sellPrice, index) : Price(in.shortPrice, index));
+						Mark(out.sell, w, bar);
+						reverse = shrt;
+					}
+					else if (position == -1 && index > entryBar && (cover || buy))
+					{
+						Exit(index, cover ? Price(in.coverPrice, index) : Price(in.buyPrice, index));
+						Mark(out.cover, w, bar);
+						reverse = buy;
+					}
+
+					if (position != 0 || (exited != 0 && !reverse))
+						return;
+					if (buy && exited != 1)
+					{
+						Enter(index, 1, Price(in.buyPrice, index));
+						Mark(out.buy, w, bar);
+					}
+					else if (shrt && exited != -1)
+					{
+						Enter(index, -1, Price(in.shortPrice, index));
+						Mark(out.shrt, w, bar);
+					}
+				}
+
+				void Enter(int index, int side, float price)
+				{
+					position = side;
+					entryBar = index;
+					entryPrice = price;
+					trades++;
+					if (out.trades)
+					{
+						PositionTrade trade = { index, index, price, Null, side == 1, true };
+						out.trades->push_back(trade);
+					}
+				}
+
+				void Exit(int index, float price)
+				{
+					exited = position;
+					exitedEntryBar = entryBar;
+					exitedEntryPrice = entryPrice;
+					position = 0;
+					if (out.trades)
+					{
+						PositionTrade& trade = out.trades->back();
+						trade.exitBar = index;
+						trade.exitPrice = price;
+						trade.isOpen = false;
+					}
+				}
+
+				// per bar outputs; the exit bar still belongs to the trade it closes
+				void Record(int index, int w, std::uint64_t bar)
+				{
+					if (position == 1 || exited == 1)
+						Mark(out.inLong, w, bar);
+					if (position == -1 || exited == -1)
+						Mark(out.inShort, w, bar);
+
+					if (position != 0)
+					{
+						if (out.entryPrice)
+							out.entryPrice[index] = entryPrice;
+						if (out.barsInTrade)
+							out.barsInTrade[index] = (float)(index - entryBar + 1);
+					}
+					else
+					{
+						if (out.entryPrice)
+							out.entryPrice[index] = exited != 0 ? exitedEntryPrice : Null;
+						if (out.barsInTrade)
+							out.barsInTrade[index] = exited != 0 ? (float)(index - exitedEntryBar + 1) : 0.0f;
+					}
+				}
+
+				void Hold(int w, int start, int count)
+				{
+					std::uint64_t used = count == 64 ? ~0ull : (1ull << count) - 1;
+					if (position == 1 && out.inLong)
+						out.inLong[w] |= used;
+					if (position == -1 && out.inShort)
+						out.inShort[w] |= used;
+
+					if (out.entryPrice)
+					{
+						float value = position != 0 ? entryPrice : Null;
+						for (int i = start; i < start + count; i++)
+							out.entryPrice[i] = value;
+					}
+					if (out.barsInTrade)
+					{
+						for (int i = start; i < start + count; i++)
+							out.barsInTrade[i] = position != 0 ? (float)(i - entryBar + 1) : 0.0f;
+					}
+				}
+
+				const PositionSignals& in;
+				const PositionOutputs& out;
+
+				int position = 0;
+				int entryBar = -1;
+				float entryPrice = Null;
+				int trades = 0;
+
+				// the side closed on the current bar (0 if none) and the entry of that trade
+				int exited = 0;
+				int exitedEntryBar = -1;
+				float exitedEntryPrice = Null;
+			};
+		}
+
+		int TrackPositions(const PositionSignals& signals, int length, const PositionOutputs& outputs)
+		{
+			PositionMachine machine(signals, outputs);
+			return machine.Run(length);
+		}
+	}
+}
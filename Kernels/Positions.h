@@ -0,0 +1,72 @@
+// Positions.h : position state machine of Buy/Sell/Short/Cover signals
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Raw trade signals as packed bit vectors (Signals.h) and their trade prices.
+		/// A null signal never fires; a null price array gives Null prices.
+		/// </summary>
+		struct PositionSignals
+		{
+			const std::uint64_t* buy;
+			const std::uint64_t* sell;
+			const std::uint64_t* shrt;
+			const std::uint64_t* cover;
+			const float* buyPrice;
+			const float* sellPrice;
+			const float* shortPrice;
+			const float* coverPrice;
+		};
+
+		/// <summary>
+		/// One trade found by TrackPositions. exitBar and exitPrice are the last bar and Null for a trade still open.
+		/// </summary>
+		struct PositionTrade
+		{
+			int entryBar;
+			int exitBar;
+			float entryPrice;
+			float exitPrice;
+			bool isLong;
+			bool isOpen;
+		};
+
+		/// <summary>
+		/// Outputs of TrackPositions; every member may be null when it is not needed.
+		/// </summary>
+		struct PositionOutputs
+		{
+			// the signals that were acted on (ExRem of the raw signals); sell and cover also mark the exits by reversal
+			std::uint64_t* buy;
+			std::uint64_t* sell;
+			std::uint64_t* shrt;
+			std::uint64_t* cover;
+			// bars from the entry to the exit, both included
+			std::uint64_t* inLong;
+			std::uint64_t* inShort;
+			// entry price of the trade held on the bar (of the new trade on a reversal bar), Null when flat
+			float* entryPrice;
+			// 1 on the entry bar, counting up to the exit bar, 0 when flat
+			float* barsInTrade;
+			std::vector<PositionTrade>* trades;
+		};
+
+		/// <summary>
+		/// Runs the position of one symbol through all bars in a single pass, the way the backtester acts on the signals:
+		/// - flat: Buy enters long, otherwise Short enters short;
+		/// - long: Sell exits; Short exits and reverses to short. Short: Cover exits; Buy exits and reverses to long;
+		/// - a position is exited from the bar after its entry on (no same bar exit), and redundant signals are ignored.
+		/// The exit price is the price of the signal that closed the trade. Words of 64 bars without any signal are
+		/// filled in one step, so the cost follows the number of signals plus the per-bar outputs asked for.
+		/// Returns the number of trades.
+		/// </summary>
+		int TrackPositions(const PositionSignals& signals, int length, const PositionOutputs& outputs);
+	}
+}
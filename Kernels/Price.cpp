@@ -0,0 +1,67 @@
+// Price.cpp : bar price kernels
+
+#include "Price.h"
+#include "Elementwise.h"
+#include "Null.h"
+#include "Parallel.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// runs kernel(begin, count) on the whole array, or on cache-sized chunks in parallel for long arrays
+			template <class Kernel>
+			void Chunked(int length, Kernel kernel)
+			{
+				if (length < ParallelMinimumLength)
+				{
+					kernel(0, length);
+					return;
+				}
+
+				ParallelFor(length, ParallelChunkLength, [&kernel](int begin, int end) { kernel(begin, end - begin); });
+			}
+		}
+
+		void TypicalPrice(const float* high, const float* low, const float* close, float* dst, int length)
+		{
+			auto kernel = ActiveElementwiseKernels().typicalPrice;
+			Chunked(length, [=](int begin, int count) { kernel(high + begin, low + begin, close + begin, dst + begin, count); });
+		}
+
+		void MedianPrice(const float* high, const float* low, float* dst, int length)
+		{
+			auto kernel = ActiveElementwiseKernels().medianPrice;
+			Chunked(length, [=](int begin, int count) { kernel(high + begin, low + begin, dst + begin, count); });
+		}
+
+		void AvgPrice(const float* high, const float* low, const float* close, float* dst, int length)
+		{
+			auto kernel = ActiveElementwiseKernels().avgPrice;
+			Chunked(length, [=](int begin, int count) { kernel(high + begin, low + begin, close + begin, dst + begin, count); });
+		}
+
+		void PercentBands(const float* src, float* upper, float* lower, int length, float percent)
+		{
+			auto kernel = ActiveElementwiseKernels().percentBands;
+			Chunked(length, [=](int begin, int count) { kernel(src + begin, upper + begin, lower + begin, count, percent); });
+		}
+
+		void TrueRange(const float* high, const float* low, const float* close, float* dst, int length)
+		{
+			if (length <= 0)
+				return;
+
+			dst[0] = NullIf(IsNull(high[0]) | IsNull(low[0]), high[0] - low[0]);
+			for (int i = 1; i < length; i++)
+			{
+				float previous = close[i - 1];
+				float top = high[i] > previous ? high[i] : previous;
+				float bottom = low[i] < previous ? low[i] : previous;
+				dst[i] = NullIf(IsNull(high[i]) | IsNull(low[i]) | IsNull(previous), top - bottom);
+			}
+		}
+	}
+}
@@ -0,0 +1,42 @@
+// Price.h : bar price kernels
+
+#pragma once
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		// The price expressions below are fused: all inputs are read and the result is written in a single
+		// vectorized pass (SSE2, AVX2 or AVX-512, see Simd.h) instead of one pass and one temporary array
+		// per operator. A Null in any of the inputs produces Null, like the chained ATArray operators do.
+		// dst may be the same buffer as one of the inputs.
+		// Arrays of ParallelMinimumLength values or more are processed in cache-sized chunks in parallel (Parallel.h).
+
+		/// <summary>
+		/// Typical price of the samples: (High + Low + 2 * Close) / 4 (also known as weighted close).
+		/// </summary>
+		void TypicalPrice(const float* high, const float* low, const float* close, float* dst, int length);
+
+		/// <summary>
+		/// Median price: (High + Low) / 2.
+		/// </summary>
+		void MedianPrice(const float* high, const float* low, float* dst, int length);
+
+		/// <summary>
+		/// Average price, the same as AFL's Avg: (High + Low + Close) / 3.
+		/// </summary>
+		void AvgPrice(const float* high, const float* low, const float* close, float* dst, int length);
+
+		/// <summary>
+		/// Percentage bands around an array: upper = src * (1 + percent / 100), lower = src * (1 - percent / 100).
+		/// Both bands are written in the same pass.
+		/// </summary>
+		void PercentBands(const float* src, float* upper, float* lower, int length, float percent);
+
+		/// <summary>
+		/// True range (AFL's ATR(1)): Max(High, Ref(Close, -1)) - Min(Low, Ref(Close, -1)), High - Low on the first bar.
+		/// It reads the previous bar, so it is a plain loop and not one of the dispatched kernels.
+		/// </summary>
+		void TrueRange(const float* high, const float* low, const float* close, float* dst, int length);
+	}
+}
@@ -0,0 +1,472 @@
+// Profiler.cpp : call counts, latencies and traces of the plug-in functions
+
+#include "Profiler.h"
+#include "ScratchArena.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// latency histogram: 8 buckets per power of two, exact below 16 ns, up to 2^49 ns
+			const int SubBuckets = 8;
+			const int Buckets = 48 * SubBuckets;
+
+			int Log2(std::uint64_t value)
+			{
+				int result = 0;
+				for (int shift = 32; shift > 0; shift >>= 1)
+				{
+					if (value >> shift)
+					{
+						value >>= shift;
+						result += shift;
+					}
+				}
+				return result;
+			}
+
+			int BucketOf(std::uint64_t ns)
+			{
+				if (ns < SubBuckets)
+					return (int)ns;
+				int exponent = Log2(ns);
+				int index = (exponent - 2) * SubBuckets + (int)((ns >> (exponent - 3)) & (SubBuckets - 1));
+				return index < Buckets ? index : Buckets - 1;
+			}
+
+			// the largest latency that falls in a bucket
+			std::uint64_t BucketLimit(int index)
+			{
+				if (index < SubBuckets)
+					return (std::uint64_t)index;
+				int exponent = index / SubBuckets + 2;
+				std::uint64_t lower = (std::uint64_t)(SubBuckets + index % SubBuckets) << (exponent - 3);
+				return lower + ((std::uint64_t)1 << (exponent - 3)) - 1;
+			}
+
+			std::uint64_t Now()
+			{
+				return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+			typedef std::array<std::uint64_t, Buckets> Histogram;
+
+			// counters of one function on all threads, collected for a report
+			struct Totals
+			{
+				std::uint64_t calls = 0;
+				std::uint64_t totalNs = 0;
+				std::uint64_t minNs = UINT64_MAX;
+				std::uint64_t maxNs = 0;
+				std::uint64_t bars = 0;
+				std::uint64_t bytes = 0;
+				Histogram histogram = {};
+			};
+
+			// counters of one function on one thread: written by that thread only, read by the reports
+			struct Counters
+			{
+				std::atomic<std::uint64_t> calls{ 0 };
+				std::atomic<std::uint64_t> totalNs{ 0 };
+				std::atomic<std::uint64_t> minNs{ UINT64_MAX };
+				std::atomic<std::uint64_t> maxNs{ 0 };
+				std::atomic<std::uint64_t> bars{ 0 };
+				std::atomic<std::uint64_t> bytes{ 0 };
+				std::atomic<std::uint64_t> histogram[Buckets];
+
+				Counters() { Clear(); }
+
+				// single writer: plain loads and stores, no locked instructions
+				static void Add(std::atomic<std::uint64_t>& counter, std::uint64_t value)
+				{
+					counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+				}
+
+				void Record(std::uint64_t ns, std::uint64_t bars, std::uint64_t bytes)
+				{
+					Add(calls, 1);
+					Add(totalNs, ns);
+					if (ns < minNs.load(std::memory_order_relaxed))
+						minNs.store(ns, std::memory_order_relaxed);
+					if (ns > maxNs.load(std::memory_order_relaxed))
+						maxNs.store(ns, std::memory_order_relaxed);
+					Add(this->bars, bars);
+					Add(this->bytes, bytes);
+					Add(histogram[BucketOf(ns)], 1);
+				}
+
+				void Clear()
+				{
+					calls.store(0, std::memory_order_relaxed);
+					totalNs.store(0, std::memory_order_relaxed);
+					minNs.store(UINT64_MAX, std::memory_order_relaxed);
+					maxNs.store(0, std::memory_order_relaxed);
+					bars.store(0, std::memory_order_relaxed);
+					bytes.store(0, std::memory_order_relaxed);
+					for (std::atomic<std::uint64_t>& bucket : histogram)
+						bucket.store(0, std::memory_order_relaxed);
+				}
+
+				void AddTo(Totals& totals) const
+				{
+					totals.calls += calls.load(std::memory_order_relaxed);
+					totals.totalNs += totalNs.load(std::memory_order_relaxed);
+					totals.minNs = std::min(totals.minNs, minNs.load(std::memory_order_relaxed));
+					totals.maxNs = std::max(totals.maxNs, maxNs.load(std::memory_order_relaxed));
+					totals.bars += bars.load(std::memory_order_relaxed);
+					totals.bytes += bytes.load(std::memory_order_relaxed);
+					for (int k = 0; k < Buckets; k++)
+						totals.histogram[k] += histogram[k].load(std::memory_order_relaxed);
+				}
+			};
+
+			struct Method
+			{
+				const std::string* name;
+				Counters counters;
+			};
+
+			struct TraceEvent
+			{
+				const std::string* name;
+				std::uint64_t start;
+				std::uint64_t duration;
+				int bars;
+				int thread;
+			};
+
+			class ThreadProfile;
+
+			struct Registry
+			{
+				std::mutex mutex;
+				std::vector<ThreadProfile*> threads;
+				int nextThread = 1;
+
+				// function names; the set never removes them, so events keep pointing to valid names
+				std::set<std::string> names;
+
+				// counters and events of the threads that have exited
+				std::map<std::string, Totals> retired;
+				std::vector<TraceEvent> retiredEvents;
+			};
+
+			// never destroyed: threads may exit after the static destructors ran
+			Registry& GetRegistry()
+			{
+				static Registry* registry = new Registry();
+				return *registry;
+			}
+
+			// incremented by ProfilerReset; a thread whose counters are from an older epoch clears them on its next call
+			std::atomic<std::uint64_t> resetEpoch{ 0 };
+			std::atomic<bool> tracing{ false };
+
+			class ThreadProfile
+			{
+			public:
+				ThreadProfile()
+				{
+					Registry& registry = GetRegistry();
+					std::lock_guard<std::mutex> lock(registry.mutex);
+					thread = registry.nextThread++;
+					epoch = resetEpoch.load(std::memory_order_acquire);
+					registry.threads.push_back(this);
+				}
+
+				~ThreadProfile()
+				{
+					Registry& registry = GetRegistry();
+					std::lock_guard<std::mutex> registryLock(registry.mutex);
+					std::lock_guard<std::mutex> lock(mutex);
+					registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), this));
+					if (epoch == resetEpoch.load(std::memory_order_acquire))
+					{
+						for (const std::unique_ptr<Method>& method : methods)
+							method->counters.AddTo(registry.retired[*method->name]);
+						registry.retiredEvents.insert(registry.retiredEvents.end(), events.begin(), events.end());
+					}
+				}
+
+				ThreadProfile(const ThreadProfile&) = delete;
+				ThreadProfile& operator=(const ThreadProfile&) = delete;
+
+				void Record(const ProfileSample& sample, std::uint64_t end, std::uint64_t bytes)
+				{
+					std::uint64_t current = resetEpoch.load(std::memory_order_acquire);
+					if (current != epoch)
+						Clear(current);
+
+					Method* method = Find(sample.name);
+					std::uint64_t duration = end - sample.start;
+					method->counters.Record(duration, (std::uint64_t)(sample.bars > 0 ? sample.bars : 0), bytes);
+
+					if (tracing.load(std::memory_order_relaxed))
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						if (events.size() < (std::size_t)MaxTraceEvents)
+							events.push_back(TraceEvent{ method->name, sample.start, duration, sample.bars, thread });
+					}
+				}
+
+				// adds the counters to the totals and the events to a trace, unless they are from before the last reset
+				void Collect(std::map<std::string, Totals>* totals, std::vector<TraceEvent>* trace)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (epoch != resetEpoch.load(std::memory_order_acquire))
+						return;
+					if (totals != nullptr)
+					{
+						for (const std::unique_ptr<Method>& method : methods)
+							method->counters.AddTo((*totals)[*method->name]);
+					}
+					if (trace != nullptr)
+						trace->insert(trace->end(), events.begin(), events.end());
+				}
+
+			private:
+				Method* Find(const char* name)
+				{
+					auto found = byAddress.find(name);
+					if (found != byAddress.end())
+						return found->second;
+
+					// a new address: the same name may have been recorded through another literal
+					Registry& registry = GetRegistry();
+					const std::string* interned;
+					{
+						std::lock_guard<std::mutex> lock(registry.mutex);
+						interned = &*registry.names.insert(name).first;
+					}
+
+					Method* method = nullptr;
+					for (const std::unique_ptr<Method>& existing : methods)
+					{
+						if (existing->name == interned)
+							method = existing.get();
+					}
+					if (method == nullptr)
+					{
+						std::unique_ptr<Method> created(new Method());
+						created->name = interned;
+						method = created.get();
+						std::lock_guard<std::mutex> lock(mutex);
+						methods.push_back(std::move(created));
+					}
+					byAddress[name] = method;
+					return method;
+				}
+
+				void Clear(std::uint64_t current)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					for (const std::unique_ptr<Method>& method : methods)
+						method->counters.Clear();
+					events.clear();
+					epoch = current;
+				}
+
+				std::unordered_map<const char*, Method*> byAddress;
+
+				// guards the structure of methods, the events and epoch against the readers on other threads
+				std::mutex mutex;
+				std::vector<std::unique_ptr<Method>> methods;
+				std::vector<TraceEvent> events;
+				std::uint64_t epoch;
+				int thread;
+			};
+
+			ThreadProfile& CurrentThreadProfile()
+			{
+				thread_local ThreadProfile profile;
+				return profile;
+			}
+
+			// the innermost open scope of the thread, which ProfilerCountArray charges
+			thread_local ProfileSample* currentSample = nullptr;
+
+			std::map<std::string, Totals> CollectTotals()
+			{
+				Registry& registry = GetRegistry();
+				std::lock_guard<std::mutex> lock(registry.mutex);
+				std::map<std::string, Totals> totals = registry.retired;
+				for (ThreadProfile* thread : registry.threads)
+					thread->Collect(&totals, nullptr);
+				return totals;
+			}
+
+			std::uint64_t Percentile(const Histogram& histogram, std::uint64_t calls, double percentile)
+			{
+				std::uint64_t rank = (std::uint64_t)(calls * percentile / 100.0);
+				std::uint64_t seen = 0;
+				for (int k = 0; k < Buckets; k++)
+				{
+					seen += histogram[k];
+					if (seen > rank)
+						return BucketLimit(k);
+				}
+				return BucketLimit(Buckets - 1);
+			}
+
+			void WriteJsonString(std::ofstream& file, const std::string& text)
+			{
+				file << '"';
+				for (char c : text)
+				{
+					if (c == '"' || c == '\\')
+						file << '\\' << c;
+					else if ((unsigned char)c < 0x20)
+						file << ' ';
+					else
+						file << c;
+				}
+				file << '"';
+			}
+		}
+
+		void ProfilerBegin(ProfileSample& sample)
+		{
+			sample.arrayBytes = 0;
+			sample.outer = currentSample;
+			currentSample = &sample;
+			sample.scratchStart = ScratchArenaAllocatedBytes();
+			sample.start = Now();
+		}
+
+		void ProfilerEnd(const ProfileSample& sample)
+		{
+			std::uint64_t end = Now();
+			std::uint64_t bytes = ScratchArenaAllocatedBytes() - sample.scratchStart + sample.arrayBytes;
+			// like the scratch memory, the arrays of a nested scope count in the outer scope as well
+			currentSample = sample.outer;
+			if (currentSample)
+				currentSample->arrayBytes += sample.arrayBytes;
+			CurrentThreadProfile().Record(sample, end, bytes);
+		}
+
+		void ProfilerCountArray(int length)
+		{
+			if (currentSample && length > 0)
+				currentSample->arrayBytes += (std::uint64_t)length * sizeof(float);
+		}
+
+		std::vector<ProfileEntry> ProfilerStatistics()
+		{
+			std::vector<ProfileEntry> entries;
+			for (const auto& item : CollectTotals())
+			{
+				const Totals& totals = item.second;
+				if (totals.calls == 0)
+					continue;
+
+				ProfileEntry entry;
+				entry.name = item.first;
+				entry.calls = totals.calls;
+				entry.totalNs = totals.totalNs;
+				entry.minNs = totals.minNs;
+				entry.maxNs = totals.maxNs;
+				entry.p99Ns = std::min(Percentile(totals.histogram, totals.calls, 99.0), totals.maxNs);
+				entry.bars = totals.bars;
+				entry.bytes = totals.bytes;
+				entries.push_back(entry);
+			}
+
+			std::sort(entries.begin(), entries.end(), [](const ProfileEntry& a, const ProfileEntry& b) { return a.totalNs > b.totalNs; });
+			return entries;
+		}
+
+		std::string ProfilerReport()
+		{
+			std::vector<ProfileEntry> entries = ProfilerStatistics();
+			if (entries.empty())
+				return "No plug-in calls recorded.";
+
+			int width = 8;
+			for (const ProfileEntry& entry : entries)
+				width = std::max(width, (int)entry.name.size());
+
+			char line[512];
+			std::snprintf(line, sizeof(line), "%-*s %10s %11s %10s %10s %10s %10s %11s %10s\n", width, "Function",
+				"Calls", "Total ms", "Avg us", "Min us", "P99 us", "Max us", "Bars/call", "KB/call");
+			std::string report = line;
+
+			for (const ProfileEntry& entry : entries)
+			{
+				double calls = (double)entry.calls;
+				std::snprintf(line, sizeof(line), "%-*s %10llu %11.3f %10.2f %10.2f %10.2f %10.2f %11.0f %10.1f\n", width, entry.name.c_str(),
+					(unsigned long long)entry.calls, entry.totalNs / 1e6, entry.totalNs / calls / 1e3,
+					entry.minNs / 1e3, entry.p99Ns / 1e3, entry.maxNs / 1e3, entry.bars / calls, entry.bytes / calls / 1024.0);
+				report += line;
+			}
+			return report;
+		}
+
+		void ProfilerReset()
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			registry.retired.clear();
+			registry.retiredEvents.clear();
+			resetEpoch.fetch_add(1, std::memory_order_acq_rel);
+		}
+
+		void ProfilerSetTracing(bool enabled)
+		{
+			tracing.store(enabled, std::memory_order_relaxed);
+		}
+
+		bool ProfilerTracing()
+		{
+			return tracing.load(std::memory_order_relaxed);
+		}
+
+		int ProfilerWriteTrace(const std::string& path)
+		{
+			std::vector<TraceEvent> events;
+			{
+				Registry& registry = GetRegistry();
+				std::lock_guard<std::mutex> lock(registry.mutex);
+				events = registry.retiredEvents;
+				for (ThreadProfile* thread : registry.threads)
+					thread->Collect(nullptr, &events);
+			}
+
+			std::ofstream file(path);
+			if (!file)
+				return -1;
+
+			std::sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) { return a.start < b.start; });
+			std::uint64_t origin = events.empty() ? 0 : events.front().start;
+
+			// timestamps and durations are in microseconds
+			char numbers[128];
+			file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+			for (size_t k = 0; k < events.size(); k++)
+			{
+				const TraceEvent& event = events[k];
+				file << (k == 0 ? "\n" : ",\n") << "{\"name\":";
+				WriteJsonString(file, *event.name);
+				std::snprintf(numbers, sizeof(numbers), ",\"cat\":\"ABMethod\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"bars\":%d}}",
+					event.thread, (event.start - origin) / 1e3, event.duration / 1e3, event.bars);
+				file << numbers;
+			}
+			file << "\n]}\n";
+
+			return file ? (int)events.size() : -1;
+		}
+	}
+}
@@ -0,0 +1,110 @@
+// Profiler.h : call counts, latencies and traces of the plug-in functions
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Counters of one function summed over all threads. Times are in nanoseconds.
+		/// Bytes are the scratch memory (ScratchArena.h) and the result arrays (ProfilerCountArray) the calls allocated.
+		/// </summary>
+		struct ProfileEntry
+		{
+			std::string name;
+			std::uint64_t calls;
+			std::uint64_t totalNs;
+			std::uint64_t minNs;
+			std::uint64_t maxNs;
+			// 99th percentile, accurate to 1/8 of its power of two
+			std::uint64_t p99Ns;
+			std::uint64_t bars;
+			std::uint64_t bytes;
+		};
+
+		/// <summary>
+		/// One call being measured. Filled by ProfilerBegin, recorded by ProfilerEnd; use ProfileScope rather than these directly.
+		/// </summary>
+		struct ProfileSample
+		{
+			const char* name;
+			int bars;
+			std::uint64_t start;
+			std::uint64_t scratchStart;
+			std::uint64_t arrayBytes;
+			// the scope this one is nested in on the same thread
+			ProfileSample* outer;
+		};
+
+		void ProfilerBegin(ProfileSample& sample);
+		void ProfilerEnd(const ProfileSample& sample);
+
+		/// <summary>
+		/// Counts an array of 'length' floats allocated for a result (an ATArray) in the innermost ProfileScope of the calling thread.
+		/// Outside any scope it does nothing. Use it where the array is allocated (NewResultArray), so the count cannot drift from the code.
+		/// </summary>
+		void ProfilerCountArray(int length);
+
+		/// <summary>
+		/// Returns the counters of every function that was called since the last reset, the most expensive (total time) first.
+		/// </summary>
+		std::vector<ProfileEntry> ProfilerStatistics();
+
+		/// <summary>
+		/// Returns ProfilerStatistics as a text table, one line per function.
+		/// </summary>
+		std::string ProfilerReport();
+
+		/// <summary>
+		/// Clears the counters and the recorded trace events of all threads.
+		/// </summary>
+		void ProfilerReset();
+
+		/// <summary>
+		/// Starts or stops recording one trace event per call. Each thread keeps at most MaxTraceEvents events.
+		/// </summary>
+		void ProfilerSetTracing(bool enabled);
+		bool ProfilerTracing();
+
+		const int MaxTraceEvents = 1 << 20;
+
+		/// <summary>
+		/// Writes the recorded trace events to a Chrome trace file (JSON, "X" events with the bars as argument)
+		/// that chrome://tracing, Perfetto or speedscope show as a timeline and flame graph per thread.
+		/// Returns the number of events written, or -1 if the file cannot be created.
+		/// </summary>
+		int ProfilerWriteTrace(const std::string& path);
+
+		/// <summary>
+		/// Measures one call of a plug-in function from construction to destruction (also when an exception leaves the scope).
+		///
+		/// The counters are kept per thread and per function, so scans running on many threads never contend.
+		/// A call costs two clock reads and a few additions; the function is found by the address of 'name',
+		/// which must be a string literal (or otherwise outlive the process). 'bars' is the number of bars the call processes;
+		/// the scratch memory it takes is counted by itself, its result arrays by ProfilerCountArray.
+		/// </summary>
+		class ProfileScope
+		{
+		public:
+			ProfileScope(const char* name, int bars)
+			{
+				sample.name = name;
+				sample.bars = bars;
+				ProfilerBegin(sample);
+			}
+
+			~ProfileScope() { ProfilerEnd(sample); }
+
+			ProfileScope(const ProfileScope&) = delete;
+			ProfileScope& operator=(const ProfileScope&) = delete;
+
+		private:
+			ProfileSample sample;
+		};
+	}
+}
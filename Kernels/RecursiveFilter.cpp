@@ -0,0 +1,250 @@
+// RecursiveFilter.cpp : EMA family and first/second order IIR filters computed as a parallel prefix scan
+
+#include "RecursiveFilter.h"
+#include "Averages.h"
+#include "Null.h"
+#include "Parallel.h"
+#include "ScratchArena.h"
+
+#include <cmath>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// 2x2 feedback matrix of the recurrence: (y[n], y[n-1]) = M * (y[n-1], y[n-2]) without the input terms
+			struct Matrix
+			{
+				double m00, m01, m10, m11;
+			};
+
+			Matrix Multiply(const Matrix& a, const Matrix& b)
+			{
+				Matrix result;
+				result.m00 = a.m00 * b.m00 + a.m01 * b.m10;
+				result.m01 = a.m00 * b.m01 + a.m01 * b.m11;
+				result.m10 = a.m10 * b.m00 + a.m11 * b.m10;
+				result.m11 = a.m10 * b.m01 + a.m11 * b.m11;
+				return result;
+			}
+
+			// M^n by squaring: O(log n), so carrying a state across a chunk costs nothing next to filtering it
+			Matrix Power(Matrix base, int n)
+			{
+				Matrix result = { 1.0, 0.0, 0.0, 1.0 };
+				for (; n > 0; n >>= 1)
+				{
+					if (n & 1)
+						result = Multiply(result, base);
+					base = Multiply(base, base);
+				}
+				return result;
+			}
+
+			struct Chunk
+			{
+				Chunk(const IirCoefficients& coefficients, int seed)
+					: start(coefficients, seed), atSteady(coefficients, seed), exit(coefficients, seed)
+				{
+				}
+
+				int begin;
+				int end;
+				// first Null of the chunk (or end): the bars after it do not depend on the previous chunks
+				int prefixEnd;
+				// first bar from which the output is the zero-state response plus the decaying carried state
+				int steady;
+				// state entering the chunk and entering 'steady'
+				IirState start;
+				IirState atSteady;
+				// state after the chunk when it contains a Null
+				IirState exit;
+			};
+
+			void IirScan(const float* src, float* dst, int length, const IirCoefficients& c, int seed)
+			{
+				int count = (length + ParallelChunkLength - 1) / ParallelChunkLength;
+				std::vector<Chunk> chunks(count, Chunk(c, seed));
+
+				// zero-state response of every chunk, kept in double so adding the carried state loses nothing
+				ScratchScope scratch;
+				Span<double> zero = scratch.Allocate<double>(length);
+				double* z = zero.Data();
+
+				// pass 1: every chunk filtered from a zero state, the bars after its first Null filtered exactly
+				ParallelFor(count, 1, [&](int first, int last)
+				{
+					for (int k = first; k < last; k++)
+					{
+						Chunk& chunk = chunks[k];
+						chunk.begin = k * ParallelChunkLength;
+						chunk.end = chunk.begin + ParallelChunkLength < length ? chunk.begin + ParallelChunkLength : length;
+
+						double x1 = 0.0, x2 = 0.0, y1 = 0.0, y2 = 0.0;
+						int i = chunk.begin;
+						for (; i < chunk.end && !IsNull(src[i]); i++)
+						{
+							double x = src[i];
+							double y = c.b0 * x + c.b1 * x1 + c.b2 * x2 - c.a1 * y1 - c.a2 * y2;
+							z[i] = y;
+							x2 = x1;
+							x1 = x;
+							y2 = y1;
+							y1 = y;
+						}
+						chunk.prefixEnd = i;
+
+						IirState state(c, seed);
+						for (; i < chunk.end; i++)
+							dst[i] = state.Push(src[i]);
+						chunk.exit = state;
+					}
+				});
+
+				// pass 2: carry the state from chunk to chunk. The first bars of a chunk (at least two, since the zero-state
+				// response started without input history, and the seeding after a Null) are stepped through IirState;
+				// from there on the difference between the real output and the zero-state response follows the feedback
+				// recurrence alone, so its value at the end of the chunk is a matrix power applied to its first value.
+				Matrix feedback = { -c.a1, -c.a2, 1.0, 0.0 };
+				IirState carry(c, seed);
+				for (Chunk& chunk : chunks)
+				{
+					chunk.start = carry;
+
+					IirState state = carry;
+					int i = chunk.begin;
+					for (; i < chunk.prefixEnd && (i < chunk.begin + 2 || !state.Steady()); i++)
+						state.Push(src[i]);
+					chunk.steady = i;
+					chunk.atSteady = state;
+
+					if (chunk.prefixEnd < chunk.end)
+					{
+						carry = chunk.exit;
+						continue;
+					}
+					if (i >= chunk.end)
+					{
+						carry = state;
+						continue;
+					}
+
+					double d1 = state.Output1() - z[i - 1];
+					double d2 = state.Output2() - z[i - 2];
+					Matrix decay = Power(feedback, chunk.end - i);
+					double last = z[chunk.end - 1] + decay.m00 * d1 + decay.m01 * d2;
+					double previous = z[chunk.end - 2] + decay.m10 * d1 + decay.m11 * d2;
+					carry = state;
+					carry.Resume(last, previous, src[chunk.end - 1], src[chunk.end - 2]);
+				}
+
+				// pass 3: the seeding bars again, then the zero-state response plus the decaying carried state
+				ParallelFor(count, 1, [&](int first, int last)
+				{
+					for (int k = first; k < last; k++)
+					{
+						const Chunk& chunk = chunks[k];
+
+						IirState state = chunk.start;
+						int i = chunk.begin;
+						for (; i < chunk.steady; i++)
+							dst[i] = state.Push(src[i]);
+						if (i >= chunk.prefixEnd)
+							continue;
+
+						double d1 = chunk.atSteady.Output1() - z[i - 1];
+						double d2 = chunk.atSteady.Output2() - z[i - 2];
+						// the carried state decays geometrically; once it is below the double precision of the output it is dropped,
+						// before it becomes denormal (and stays at the smallest denormal, which is very slow to compute with)
+						for (; i < chunk.prefixEnd; i++)
+						{
+							double d = -c.a1 * d1 - c.a2 * d2;
+							dst[i] = (float)(z[i] + d);
+							d2 = d1;
+							d1 = d;
+							if (std::fabs(d1) + std::fabs(d2) <= 1e-18 * std::fabs(z[i]) + 1e-300)
+								break;
+						}
+						for (i++; i < chunk.prefixEnd; i++)
+							dst[i] = (float)z[i];
+					}
+				});
+			}
+
+			// Null where any of the averages is Null, otherwise the weighted sum
+			void Combine(const float* e1, const float* e2, const float* e3, float* dst, int length, float w1, float w2, float w3)
+			{
+				for (int i = 0; i < length; i++)
+				{
+					bool isNull = IsNull(e1[i]) || IsNull(e2[i]) || (e3 && IsNull(e3[i]));
+					float value = w1 * e1[i] + w2 * e2[i] + (e3 ? w3 * e3[i] : 0.0f);
+					dst[i] = NullIf(isNull, value);
+				}
+			}
+		}
+
+		IirCoefficients EmaCoefficients(int period)
+		{
+			double factor = 2.0 / ((period < 1 ? 1 : period) + 1.0);
+			IirCoefficients c = { factor, 0.0, 0.0, factor - 1.0, 0.0 };
+			return c;
+		}
+
+		IirCoefficients WildersCoefficients(int period)
+		{
+			double factor = 1.0 / (period < 1 ? 1 : period);
+			IirCoefficients c = { factor, 0.0, 0.0, factor - 1.0, 0.0 };
+			return c;
+		}
+
+		IirCoefficients SuperSmootherCoefficients(int period)
+		{
+			const double Pi = 3.14159265358979323846;
+			double a = std::exp(-std::sqrt(2.0) * Pi / (period < 2 ? 2 : period));
+			double b = 2.0 * a * std::cos(std::sqrt(2.0) * Pi / (period < 2 ? 2 : period));
+			double c1 = 1.0 - b + a * a;
+			IirCoefficients c = { c1 / 2.0, c1 / 2.0, 0.0, -b, a * a };
+			return c;
+		}
+
+		void Iir(const float* src, float* dst, int length, const IirCoefficients& coefficients, int seed)
+		{
+			if (length < ParallelMinimumLength)
+				IirSequential(src, dst, length, coefficients, seed);
+			else
+				IirScan(src, dst, length, coefficients, seed);
+		}
+
+		void IirSequential(const float* src, float* dst, int length, const IirCoefficients& coefficients, int seed)
+		{
+			IirState state(coefficients, seed);
+			for (int i = 0; i < length; i++)
+				dst[i] = state.Push(src[i]);
+		}
+
+		void Dema(const float* src, float* dst, int length, int period)
+		{
+			ScratchScope scratch;
+			Span<float> e1 = scratch.Allocate<float>(length);
+			Span<float> e2 = scratch.Allocate<float>(length);
+			Ema(src, e1.Data(), length, period);
+			Ema(e1.Data(), e2.Data(), length, period);
+			Combine(e1.Data(), e2.Data(), nullptr, dst, length, 2.0f, -1.0f, 0.0f);
+		}
+
+		void Tema(const float* src, float* dst, int length, int period)
+		{
+			ScratchScope scratch;
+			Span<float> e1 = scratch.Allocate<float>(length);
+			Span<float> e2 = scratch.Allocate<float>(length);
+			Span<float> e3 = scratch.Allocate<float>(length);
+			Ema(src, e1.Data(), length, period);
+			Ema(e1.Data(), e2.Data(), length, period);
+			Ema(e2.Data(), e3.Data(), length, period);
+			Combine(e1.Data(), e2.Data(), e3.Data(), dst, length, 3.0f, -3.0f, 1.0f);
+		}
+	}
+}
@@ -0,0 +1,156 @@
+// RecursiveFilter.h : EMA family and first/second order IIR filters computed as a parallel prefix scan
+
+#pragma once
+
+#include "Null.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Coefficients of y[n] = b0 * x[n] + b1 * x[n-1] + b2 * x[n-2] - a1 * y[n-1] - a2 * y[n-2].
+		/// First order filters leave b2 and a2 at 0. The filter should be stable (the poles inside the unit circle):
+		/// the parallel scan applies powers of the feedback matrix to carry the state across chunks.
+		/// </summary>
+		struct IirCoefficients
+		{
+			double b0;
+			double b1;
+			double b2;
+			double a1;
+			double a2;
+		};
+
+		/// <summary>
+		/// EMA with a smoothing factor of 2 / (period + 1): y = f * x + (1 - f) * y[n-1].
+		/// </summary>
+		IirCoefficients EmaCoefficients(int period);
+
+		/// <summary>
+		/// Wilder's smoothing: the EMA recurrence with a smoothing factor of 1 / period.
+		/// </summary>
+		IirCoefficients WildersCoefficients(int period);
+
+		/// <summary>
+		/// Ehlers' two pole Super Smoother, a second order low pass with its cutoff at 'period' bars.
+		/// </summary>
+		IirCoefficients SuperSmootherCoefficients(int period);
+
+		/// <summary>
+		/// Sequential IIR recurrence with AmiBroker's Null handling, the reference the parallel scan is checked against.
+		///
+		/// Leading Nulls are skipped; the first output is the simple average of the first 'seed' valid values
+		/// (seed = period for EMA and Wilders, 1 for a filter that starts from the first value) and is also the
+		/// output history of the recurrence. Before the seed the input history is the first valid value.
+		/// A Null produces Null and the filter is seeded again after it, like EmaState.
+		/// </summary>
+		class IirState
+		{
+		public:
+			IirState(const IirCoefficients& coefficients, int seed)
+				: c(coefficients), seed(seed < 1 ? 1 : seed), count(0), sum(0.0), x1(0.0), x2(0.0), y1(0.0), y2(0.0)
+			{
+			}
+
+			float Push(float value)
+			{
+				if (IsNull(value))
+				{
+					count = 0;
+					sum = 0.0;
+					return Null;
+				}
+
+				double x = value;
+				if (count == 0)
+					x1 = x2 = x;
+
+				double y;
+				if (count < seed)
+				{
+					sum += x;
+					if (++count < seed)
+					{
+						x2 = x1;
+						x1 = x;
+						return Null;
+					}
+					y = sum / seed;
+					y1 = y2 = y;
+				}
+				else
+				{
+					y = c.b0 * x + c.b1 * x1 + c.b2 * x2 - c.a1 * y1 - c.a2 * y2;
+					y2 = y1;
+					y1 = y;
+					// saturates, only the comparisons with seed and 2 matter
+					if (count < (1 << 30))
+						count++;
+				}
+
+				x2 = x1;
+				x1 = x;
+				return (float)y;
+			}
+
+			/// <summary>
+			/// True when the next value is filtered by the plain recurrence with the real inputs as history,
+			/// i.e. the state is linear in the inputs from here on (what the parallel scan relies on).
+			/// </summary>
+			bool Steady() const { return count >= seed && count >= 2; }
+
+			double Output1() const { return y1; }
+			double Output2() const { return y2; }
+
+			/// <summary>
+			/// Continues a steady run whose last outputs are y1, y2 and last inputs x1, x2 (used by the parallel scan).
+			/// </summary>
+			void Resume(double y1, double y2, double x1, double x2)
+			{
+				if (count < seed || count < 2)
+					count = seed > 2 ? seed : 2;
+				this->y1 = y1;
+				this->y2 = y2;
+				this->x1 = x1;
+				this->x2 = x2;
+			}
+
+		private:
+			IirCoefficients c;
+			int seed;
+			int count;
+			double sum;
+			double x1;
+			double x2;
+			double y1;
+			double y2;
+		};
+
+		/// <summary>
+		/// IIR filter with the Null handling of IirState.
+		///
+		/// Arrays of at least ParallelMinimumLength bars are filtered as a blocked prefix scan of the linear recurrence:
+		/// every chunk is filtered from a zero state in parallel, the chunk boundary states are carried from chunk to chunk
+		/// with a power of the 2x2 feedback matrix, and a second parallel pass adds the decaying response of the carried state.
+		/// Seeding and Nulls are handled exactly by running those few bars through IirState. The chunks do not depend on the
+		/// number of threads, so neither do the results, which match IirSequential within double rounding.
+		/// </summary>
+		void Iir(const float* src, float* dst, int length, const IirCoefficients& coefficients, int seed);
+
+		/// <summary>
+		/// Iir() computed bar by bar with IirState on the calling thread.
+		/// </summary>
+		void IirSequential(const float* src, float* dst, int length, const IirCoefficients& coefficients, int seed);
+
+		/// <summary>
+		/// Double EMA (AFL's DEMA): 2 * EMA - EMA(EMA). Null until the second average is seeded.
+		/// </summary>
+		void Dema(const float* src, float* dst, int length, int period);
+
+		/// <summary>
+		/// Triple EMA (AFL's TEMA): 3 * EMA - 3 * EMA(EMA) + EMA(EMA(EMA)). Null until the third average is seeded.
+		/// </summary>
+		void Tema(const float* src, float* dst, int length, int period);
+	}
+}
@@ -0,0 +1,203 @@
+// ResultCache.cpp : memoizing LRU cache of indicator results shared by all plug-in functions
+
+#include "ResultCache.h"
+
+#include <cstring>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			const std::uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+			const std::uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+
+			inline std::uint64_t Rotate(std::uint64_t value, int bits)
+			{
+				return (value << bits) | (value >> (64 - bits));
+			}
+
+			// one round of a multiply-rotate hash (as in xxHash64)
+			inline std::uint64_t Round(std::uint64_t lane, std::uint64_t input)
+			{
+				lane += input * Prime2;
+				return Rotate(lane, 31) * Prime1;
+			}
+
+			inline std::uint64_t Mix(std::uint64_t hash, std::uint64_t value)
+			{
+				return (hash ^ Round(0, value)) * Prime1 + Prime2;
+			}
+
+			struct KeyHash
+			{
+				std::size_t operator()(const ResultKey& key) const { return key.Hash(); }
+			};
+
+			struct Entry
+			{
+				ResultKey key;
+				std::vector<float> values;
+			};
+
+			// most recently used entries are at the front of the list
+			struct Cache
+			{
+				std::mutex lock;
+				std::list<Entry> entries;
+				std::unordered_map<ResultKey, std::list<Entry>::iterator, KeyHash> index;
+				std::size_t bytes = 0;
+				std::size_t capacity = DefaultResultCacheCapacity;
+				std::uint64_t hits = 0;
+				std::uint64_t misses = 0;
+				std::uint64_t evictions = 0;
+
+				void Evict(std::size_t limit)
+				{
+					while (bytes > limit && !entries.empty())
+					{
+						Entry& last = entries.back();
+						bytes -= last.values.size() * sizeof(float);
+						index.erase(last.key);
+						entries.pop_back();
+						evictions++;
+					}
+				}
+			};
+
+			Cache& SharedCache()
+			{
+				static Cache cache;
+				return cache;
+			}
+		}
+
+		std::uint64_t HashArray(const float* src, int length)
+		{
+			std::uint64_t lanes[4] = { Prime1 + Prime2, Prime2, 0, 0 - Prime1 };
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(src);
+			std::size_t size = length > 0 ? (std::size_t)length * sizeof(float) : 0;
+			std::size_t i = 0;
+
+			for (; i + 32 <= size; i += 32)
+			{
+				std::uint64_t words[4];
+				std::memcpy(words, bytes + i, sizeof(words));
+				for (int k = 0; k < 4; k++)
+					lanes[k] = Round(lanes[k], words[k]);
+			}
+
+			std::uint64_t hash = Rotate(lanes[0], 1) + Rotate(lanes[1], 7) + Rotate(lanes[2], 12) + Rotate(lanes[3], 18);
+			for (; i + 4 <= size; i += 4)
+			{
+				std::uint32_t word;
+				std::memcpy(&word, bytes + i, sizeof(word));
+				hash = Mix(hash, word);
+			}
+
+			return Mix(hash, (std::uint64_t)size);
+		}
+
+		std::size_t ResultKey::Hash() const
+		{
+			std::uint64_t hash = std::hash<std::string>()(function);
+			hash = Mix(hash, (std::uint64_t)length);
+			for (std::uint64_t input : inputs)
+				hash = Mix(hash, input);
+			for (float parameter : parameters)
+			{
+				std::uint32_t bits;
+				std::memcpy(&bits, &parameter, sizeof(bits));
+				hash = Mix(hash, bits);
+			}
+			return (std::size_t)hash;
+		}
+
+		bool ResultCacheGet(const ResultKey& key, float* dst, int length)
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+
+			auto found = cache.index.find(key);
+			if (found == cache.index.end() || (int)found->second->values.size() != length)
+			{
+				cache.misses++;
+				return false;
+			}
+
+			// move to the front of the LRU list
+			cache.entries.splice(cache.entries.begin(), cache.entries, found->second);
+			if (length > 0)
+				std::memcpy(dst, found->second->values.data(), length * sizeof(float));
+			cache.hits++;
+			return true;
+		}
+
+		void ResultCachePut(const ResultKey& key, const float* src, int length)
+		{
+			std::size_t size = length > 0 ? (std::size_t)length * sizeof(float) : 0;
+
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+
+			if (size > cache.capacity)
+				return;
+
+			auto found = cache.index.find(key);
+			if (found != cache.index.end())
+			{
+				cache.bytes -= found->second->values.size() * sizeof(float);
+				cache.entries.erase(found->second);
+				cache.index.erase(found);
+			}
+
+			cache.Evict(cache.capacity - size);
+
+			cache.entries.push_front(Entry{ key, std::vector<float>(src, src + length) });
+			cache.index.emplace(key, cache.entries.begin());
+			cache.bytes += size;
+		}
+
+		ResultCacheStats ResultCacheStatistics()
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+
+			ResultCacheStats stats;
+			stats.hits = cache.hits;
+			stats.misses = cache.misses;
+			stats.evictions = cache.evictions;
+			stats.entries = cache.entries.size();
+			stats.bytes = cache.bytes;
+			stats.capacity = cache.capacity;
+			return stats;
+		}
+
+		void ResultCacheSetCapacity(std::size_t bytes)
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+
+			cache.capacity = bytes;
+			cache.Evict(bytes);
+		}
+
+		void ResultCacheClear()
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+
+			cache.entries.clear();
+			cache.index.clear();
+			cache.bytes = 0;
+			cache.hits = 0;
+			cache.misses = 0;
+			cache.evictions = 0;
+		}
+	}
+}
@@ -0,0 +1,95 @@
+// ResultCache.h : memoizing LRU cache of indicator results shared by all plug-in functions
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Returns a 64 bit hash of the contents of an array.
+		/// It runs four independent lanes, so hashing is several times faster than the indicators it guards.
+		/// </summary>
+		std::uint64_t HashArray(const float* src, int length);
+
+		/// <summary>
+		/// Identifies a cached result: the function, the content hashes of the input arrays and the parameters.
+		/// Two calls with the same key get the same result whichever plug-in function made them.
+		/// </summary>
+		class ResultKey
+		{
+		public:
+			explicit ResultKey(const std::string& function)
+				: function(function), length(0)
+			{
+			}
+
+			void AddInput(const float* src, int length)
+			{
+				inputs.push_back(HashArray(src, length));
+				this->length = length;
+			}
+
+			void AddParameter(float value) { parameters.push_back(value); }
+
+			int Length() const { return length; }
+
+			std::size_t Hash() const;
+
+			bool operator==(const ResultKey& other) const
+			{
+				return function == other.function && length == other.length && inputs == other.inputs && parameters == other.parameters;
+			}
+
+		private:
+			std::string function;
+			std::vector<std::uint64_t> inputs;
+			std::vector<float> parameters;
+			int length;
+		};
+
+		struct ResultCacheStats
+		{
+			std::uint64_t hits;
+			std::uint64_t misses;
+			std::uint64_t evictions;
+			std::size_t entries;
+			std::size_t bytes;
+			std::size_t capacity;
+		};
+
+		/// <summary>
+		/// Default memory bound of the cache in bytes.
+		/// </summary>
+		const std::size_t DefaultResultCacheCapacity = 64 * 1024 * 1024;
+
+		/// <summary>
+		/// Copies the cached result of key to dst ('length' values) and returns true,
+		/// or returns false (a miss) if the key is not in the cache or its length differs.
+		/// </summary>
+		bool ResultCacheGet(const ResultKey& key, float* dst, int length);
+
+		/// <summary>
+		/// Stores a result. The least recently used results are evicted while the cache is over its capacity.
+		/// Results larger than the whole capacity are not stored.
+		/// </summary>
+		void ResultCachePut(const ResultKey& key, const float* src, int length);
+
+		ResultCacheStats ResultCacheStatistics();
+
+		/// <summary>
+		/// Sets the memory bound in bytes and evicts results until the cache fits in it.
+		/// </summary>
+		void ResultCacheSetCapacity(std::size_t bytes);
+
+		/// <summary>
+		/// Drops all results and resets the counters.
+		/// </summary>
+		void ResultCacheClear();
+	}
+}
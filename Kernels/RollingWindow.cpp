@@ -0,0 +1,106 @@
+// RollingWindow.cpp : array interface of the rolling-window engine
+
+#include "RollingWindow.h"
+#include "Parallel.h"
+
+#include <algorithm>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// chunks of the parallel loop; the halo of period - 1 values is recalculated, so chunks are kept
+			// several periods long to bound that overhead
+			const int WindowChunkLength = 1 << 16;
+			const int HalosPerChunk = 4;
+
+			template <class Window, class Result>
+			void Run(Window& window, const float* src, float* dst, int length, Result result)
+			{
+				if (length < ParallelMinimumLength)
+				{
+					for (int i = 0; i < length; i++)
+						dst[i] = window.Push(src[i]) ? (float)result(window) : Null;
+					return;
+				}
+
+				// the window starts at the first valid value, everything before it is Null
+				int period = window.Period();
+				int first = 0;
+				while (first < length && IsNull(src[first]))
+					dst[first++] = Null;
+
+				int chunkSize = std::max(WindowChunkLength, HalosPerChunk * period);
+				ParallelForWindowed(length - first, chunkSize, period - 1, [&](int begin, int end, int warmup)
+				{
+					// each chunk has its own window, warmed up on the halo before its first result
+					Window chunkWindow(period);
+					if (warmup > 0)
+						chunkWindow.ResetMidSeries();
+
+					const float* chunkSrc = src + first;
+					float* chunkDst = dst + first;
+					for (int i = warmup; i < begin; i++)
+						chunkWindow.Push(chunkSrc[i]);
+					for (int i = begin; i < end; i++)
+						chunkDst[i] = chunkWindow.Push(chunkSrc[i]) ? (float)result(chunkWindow) : Null;
+				});
+			}
+		}
+
+		void RollingMa(const float* src, float* dst, int length, int period)
+		{
+			RollingWindow<RunningSum> window(period);
+			Run(window, src, dst, length, [](const RollingWindow<RunningSum>& w) { return w.Mean(); });
+		}
+
+		void RollingSum(const float* src, float* dst, int length, int period)
+		{
+			RollingWindow<RunningSum> window(period);
+			Run(window, src, dst, length, [](const RollingWindow<RunningSum>& w) { return w.Sum(); });
+		}
+
+		void RollingHhv(const float* src, float* dst, int length, int period)
+		{
+			RollingExtreme<Greater> window(period);
+			Run(window, src, dst, length, [](const RollingExtreme<Greater>& w) { return w.Value(); });
+		}
+
+		void RollingLlv(const float* src, float* dst, int length, int period)
+		{
+			RollingExtreme<Less> window(period);
+			Run(window, src, dst, length, [](const RollingExtreme<Less>& w) { return w.Value(); });
+		}
+
+		void RollingStDev(const float* src, float* dst, int length, int period)
+		{
+			// sum of squares cancels badly over long series, so StDev uses the compensated accumulator
+			RollingWindow<KahanSum> window(period);
+			Run(window, src, dst, length, [](const RollingWindow<KahanSum>& w) { return w.StDev(); });
+		}
+
+		void Rolling(WindowFunction function, const float* src, float* dst, int length, int period)
+		{
+			switch (function)
+			{
+			case WindowFunction::Sum:
+				RollingSum(src, dst, length, period);
+				break;
+			case WindowFunction::Hhv:
+				RollingHhv(src, dst, length, period);
+				break;
+			case WindowFunction::Llv:
+				RollingLlv(src, dst, length, period);
+				break;
+			case WindowFunction::StDev:
+				RollingStDev(src, dst, length, period);
+				break;
+			default:
+				RollingMa(src, dst, length, period);
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,285 @@
+// RollingWindow.h : O(n) rolling-window engine for MA, Sum, HHV, LLV and StDev
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include "Null.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Plain running sum accumulator. Values leaving the window are subtracted from the sum,
+		/// so each bar costs one add and one subtract whatever the period.
+		/// </summary>
+		struct RunningSum
+		{
+			double sum = 0.0;
+
+			void Add(double value) { sum += value; }
+			void Remove(double value) { sum -= value; }
+			double Value() const { return sum; }
+			void Reset() { sum = 0.0; }
+		};
+
+		/// <summary>
+		/// Kahan-compensated running sum accumulator.
+		/// Use it when the sum is long-lived (e.g. sum of squares for StDev over hundreds of thousands of bars)
+		/// and the add/subtract rounding error of RunningSum would accumulate.
+		/// </summary>
+		struct KahanSum
+		{
+			double sum = 0.0;
+			double compensation = 0.0;
+
+			void Add(double value)
+			{
+				double y = value - compensation;
+				double t = sum + y;
+				compensation = (t - sum) - y;
+				sum = t;
+			}
+			void Remove(double value) { Add(-value); }
+			double Value() const { return sum; }
+			void Reset() { sum = 0.0; compensation = 0.0; }
+		};
+
+		/// <summary>
+		/// Streaming fixed-size window that keeps a running sum and sum of squares of the last 'period' values.
+		///
+		/// Null handling follows AFL:
+		/// - leading Nulls are skipped (the window starts at the first valid value),
+		/// - the result is Null until the window is full,
+		/// - any Null inside the window makes the result Null until it leaves the window.
+		/// </summary>
+		template <class Accumulator = RunningSum>
+		class RollingWindow
+		{
+		public:
+			explicit RollingWindow(int period)
+				: period(period < 1 ? 1 : period), ring(this->period, 0.0f)
+			{
+				Reset();
+			}
+
+			void Reset()
+			{
+				head = 0;
+				count = 0;
+				lastNull = -1;
+				midSeries = false;
+				sum.Reset();
+				sumSq.Reset();
+			}
+
+			/// <summary>
+			/// Resets the window to continue a series after its first valid value, e.g. from the halo of a chunk:
+			/// Nulls pushed first are inside the series, not leading Nulls, so they are not skipped.
+			/// </summary>
+			void ResetMidSeries()
+			{
+				Reset();
+				midSeries = true;
+			}
+
+			/// <summary>
+			/// Pushes the next bar value into the window and evicts the oldest one.
+			/// Returns true if the window holds 'period' valid values.
+			/// </summary>
+			bool Push(float value)
+			{
+				// skip leading Nulls like AFL does
+				if (count == 0 && !midSeries && IsNull(value))
+					return false;
+
+				if (count >= period)
+				{
+					float old = ring[head];
+					sum.Remove(old);
+					sumSq.Remove((double)old * old);
+				}
+
+				if (IsNull(value))
+				{
+					lastNull = count;
+					value = 0.0f;
+				}
+
+				ring[head] = value;
+				sum.Add(value);
+				sumSq.Add((double)value * value);
+
+				if (++head == period)
+					head = 0;
+				count++;
+
+				return IsValid();
+			}
+
+			bool IsValid() const
+			{
+				return count >= period && lastNull < count - period;
+			}
+
+			int Period() const { return period; }
+
+			double Sum() const { return sum.Value(); }
+
+			double Mean() const { return sum.Value() / period; }
+
+			/// <summary>
+			/// Population standard deviation of the window (same as AFL's StDev).
+			/// </summary>
+			double StDev() const
+			{
+				double mean = Mean();
+				double variance = sumSq.Value() / period - mean * mean;
+				return variance > 0.0 ? std::sqrt(variance) : 0.0;
+			}
+
+			/// <summary>
+			/// The mean the window would have after Push(value), without pushing it: the average of a bar
+			/// that is still forming. Returns Null if the window would not be valid.
+			/// </summary>
+			float PeekMean(float value) const
+			{
+				if (IsNull(value) || count + 1 < period || lastNull >= count + 1 - period)
+					return Null;
+
+				double next = sum.Value() + value - (count >= period ? ring[head] : 0.0f);
+				return (float)(next / period);
+			}
+
+		private:
+			int period;
+			std::vector<float> ring;
+			int head;
+			int count;
+			int lastNull;
+			bool midSeries;
+			Accumulator sum;
+			Accumulator sumSq;
+		};
+
+		struct Greater { bool operator()(float a, float b) const { return a > b; } };
+		struct Less { bool operator()(float a, float b) const { return a < b; } };
+
+		/// <summary>
+		/// Streaming rolling extreme (HHV with Greater, LLV with Less) using a monotonic deque.
+		/// Each value enters and leaves the deque at most once, so the amortized cost is O(1) per bar.
+		/// Null handling is the same as in RollingWindow.
+		/// </summary>
+		template <class Compare>
+		class RollingExtreme
+		{
+		public:
+			explicit RollingExtreme(int period)
+				: period(period < 1 ? 1 : period), indices(this->period), values(this->period)
+			{
+				Reset();
+			}
+
+			void Reset()
+			{
+				front = 0;
+				size = 0;
+				count = 0;
+				lastNull = -1;
+				midSeries = false;
+			}
+
+			/// <summary>
+			/// See RollingWindow::ResetMidSeries.
+			/// </summary>
+			void ResetMidSeries()
+			{
+				Reset();
+				midSeries = true;
+			}
+
+			bool Push(float value)
+			{
+				if (count == 0 && !midSeries && IsNull(value))
+					return false;
+
+				// drop the front element if it has left the window
+				if (size > 0 && indices[front] <= count - period)
+				{
+					front = Next(front);
+					size--;
+				}
+
+				if (IsNull(value))
+				{
+					lastNull = count;
+				}
+				else
+				{
+					// drop dominated elements from the back
+					while (size > 0 && !compare(values[Back()], value))
+						size--;
+
+					int back = (front + size) % period;
+					indices[back] = count;
+					values[back] = value;
+					size++;
+				}
+
+				count++;
+
+				return IsValid();
+			}
+
+			bool IsValid() const
+			{
+				return count >= period && lastNull < count - period;
+			}
+
+			float Value() const { return values[front]; }
+
+			int Period() const { return period; }
+
+		private:
+			int Next(int i) const { return i + 1 == period ? 0 : i + 1; }
+			int Back() const { return (front + size - 1) % period; }
+
+			int period;
+			std::vector<int> indices;
+			std::vector<float> values;
+			int front;
+			int size;
+			int count;
+			int lastNull;
+			bool midSeries;
+			Compare compare;
+		};
+
+		/// <summary>
+		/// Functions supported by the array interface of the rolling-window engine.
+		/// The numeric values are the ones AFL scripts pass to RollingVC().
+		/// </summary>
+		enum class WindowFunction
+		{
+			Ma = 0,
+			Sum = 1,
+			Hhv = 2,
+			Llv = 3,
+			StDev = 4
+		};
+
+		/// <summary>
+		/// Array interface of the rolling-window engine. All functions read 'length' values from src
+		/// and write 'length' values to dst (src and dst may not overlap) at O(length) cost regardless of the period.
+		/// Arrays of ParallelMinimumLength values or more are cut into chunks calculated in parallel (Parallel.h);
+		/// each chunk restarts the window period - 1 values before its first result.
+		/// </summary>
+		void RollingMa(const float* src, float* dst, int length, int period);
+		void RollingSum(const float* src, float* dst, int length, int period);
+		void RollingHhv(const float* src, float* dst, int length, int period);
+		void RollingLlv(const float* src, float* dst, int length, int period);
+		void RollingStDev(const float* src, float* dst, int length, int period);
+		void Rolling(WindowFunction function, const float* src, float* dst, int length, int period);
+	}
+}
@@ -0,0 +1,248 @@
+// ScratchArena.cpp : per-thread bump allocator for the temporary arrays of a plug-in call
+
+#include "ScratchArena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// cache line alignment, also enough for every SIMD level of Simd.h
+			const std::size_t Alignment = 64;
+
+			// the first block of a thread; larger calls get larger blocks
+			const std::size_t MinimumBlockSize = 1 << 20;
+
+			class Arena;
+
+			// all live arenas, so the statistics can be collected from any thread
+			struct Registry
+			{
+				std::mutex mutex;
+				std::vector<Arena*> arenas;
+
+				// counters of the arenas of threads that have exited
+				std::size_t retiredHighWater = 0;
+				std::uint64_t retiredCalls = 0;
+				std::uint64_t retiredBlockAllocations = 0;
+			};
+
+			// never destroyed: threads may exit (and destroy their arenas) after the static destructors ran
+			Registry& GetRegistry()
+			{
+				static Registry* registry = new Registry();
+				return *registry;
+			}
+
+			class Arena
+			{
+			public:
+				Arena()
+				{
+					Registry& registry = GetRegistry();
+					std::lock_guard<std::mutex> lock(registry.mutex);
+					registry.arenas.push_back(this);
+				}
+
+				~Arena()
+				{
+					Registry& registry = GetRegistry();
+					{
+						std::lock_guard<std::mutex> lock(registry.mutex);
+						registry.arenas.erase(std::find(registry.arenas.begin(), registry.arenas.end(), this));
+						registry.retiredHighWater = std::max(registry.retiredHighWater, highWater.load(std::memory_order_relaxed));
+						registry.retiredCalls += calls.load(std::memory_order_relaxed);
+						registry.retiredBlockAllocations += blockAllocations.load(std::memory_order_relaxed);
+					}
+					for (Block& block : blocks)
+						FreeBlock(block);
+				}
+
+				Arena(const Arena&) = delete;
+				Arena& operator=(const Arena&) = delete;
+
+				void* Allocate(std::size_t bytes)
+				{
+					bytes = (bytes + Alignment - 1) & ~(Alignment - 1);
+
+					// the rest of the current block, then the blocks after it
+					for (; current < blocks.size(); current++, offset = 0)
+					{
+						if (offset + bytes <= blocks[current].size)
+							return Take(bytes);
+					}
+
+					// the arena at least doubles, so a thread allocates O(log(largest call)) blocks in its lifetime
+					std::size_t reserved = this->reserved.load(std::memory_order_relaxed);
+					blocks.push_back(NewBlock(std::max(std::max(bytes, reserved), MinimumBlockSize)));
+					current = blocks.size() - 1;
+					offset = 0;
+					return Take(bytes);
+				}
+
+				ScratchMark Enter()
+				{
+					depth++;
+					ScratchMark mark;
+					mark.block = (int)current;
+					mark.offset = offset;
+					mark.used = used;
+					return mark;
+				}
+
+				void Leave(const ScratchMark& mark)
+				{
+					current = (std::size_t)mark.block;
+					offset = mark.offset;
+					used = mark.used;
+					if (--depth > 0)
+						return;
+
+					// end of the outermost scope: one plug-in call
+					lastCall = peak;
+					if (peak > highWater.load(std::memory_order_relaxed))
+						highWater.store(peak, std::memory_order_relaxed);
+					calls.fetch_add(1, std::memory_order_relaxed);
+					peak = 0;
+
+					// a call that spilled over several blocks gets one block as large as its peak for the next call
+					if (blocks.size() > 1)
+					{
+						for (Block& block : blocks)
+							FreeBlock(block);
+						blocks.clear();
+						blocks.push_back(NewBlock((lastCall + MinimumBlockSize - 1) / MinimumBlockSize * MinimumBlockSize));
+					}
+					current = 0;
+					offset = 0;
+				}
+
+				std::size_t LastCall() const { return lastCall; }
+				std::uint64_t Allocated() const { return allocated; }
+
+				void Collect(ScratchArenaStats& stats) const
+				{
+					stats.reserved += reserved.load(std::memory_order_relaxed);
+					stats.highWater = std::max(stats.highWater, highWater.load(std::memory_order_relaxed));
+					stats.calls += calls.load(std::memory_order_relaxed);
+					stats.blockAllocations += blockAllocations.load(std::memory_order_relaxed);
+				}
+
+				void ResetStatistics()
+				{
+					highWater.store(0, std::memory_order_relaxed);
+					calls.store(0, std::memory_order_relaxed);
+					blockAllocations.store(0, std::memory_order_relaxed);
+				}
+
+			private:
+				struct Block
+				{
+					char* data;
+					std::size_t size;
+				};
+
+				Block NewBlock(std::size_t size)
+				{
+					Block block;
+					block.data = static_cast<char*>(::operator new(size, std::align_val_t(Alignment)));
+					block.size = size;
+					reserved.fetch_add(size, std::memory_order_relaxed);
+					blockAllocations.fetch_add(1, std::memory_order_relaxed);
+					return block;
+				}
+
+				void FreeBlock(Block& block)
+				{
+					::operator delete(block.data, std::align_val_t(Alignment));
+					reserved.fetch_sub(block.size, std::memory_order_relaxed);
+				}
+
+				void* Take(std::size_t bytes)
+				{
+					void* result = blocks[current].data + offset;
+					offset += bytes;
+					used += bytes;
+					allocated += bytes;
+					peak = std::max(peak, used);
+					return result;
+				}
+
+				std::vector<Block> blocks;
+				std::size_t current = 0;
+				std::size_t offset = 0;
+				std::size_t used = 0;
+				std::size_t peak = 0;
+				std::size_t lastCall = 0;
+				std::uint64_t allocated = 0;
+				int depth = 0;
+
+				// read by ScratchArenaStatistics on other threads
+				std::atomic<std::size_t> reserved{ 0 };
+				std::atomic<std::size_t> highWater{ 0 };
+				std::atomic<std::uint64_t> calls{ 0 };
+				std::atomic<std::uint64_t> blockAllocations{ 0 };
+			};
+
+			Arena& ThreadArena()
+			{
+				thread_local Arena arena;
+				return arena;
+			}
+		}
+
+		void* ScratchArenaAllocate(std::size_t bytes)
+		{
+			return ThreadArena().Allocate(bytes);
+		}
+
+		ScratchMark ScratchArenaEnter()
+		{
+			return ThreadArena().Enter();
+		}
+
+		void ScratchArenaLeave(const ScratchMark& mark)
+		{
+			ThreadArena().Leave(mark);
+		}
+
+		ScratchArenaStats ScratchArenaStatistics()
+		{
+			ScratchArenaStats stats = {};
+			stats.lastCall = ThreadArena().LastCall();
+
+			Registry& registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			stats.threads = registry.arenas.size();
+			stats.highWater = registry.retiredHighWater;
+			stats.calls = registry.retiredCalls;
+			stats.blockAllocations = registry.retiredBlockAllocations;
+			for (const Arena* arena : registry.arenas)
+				arena->Collect(stats);
+			return stats;
+		}
+
+		std::uint64_t ScratchArenaAllocatedBytes()
+		{
+			return ThreadArena().Allocated();
+		}
+
+		void ScratchArenaResetStatistics()
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			registry.retiredHighWater = 0;
+			registry.retiredCalls = 0;
+			registry.retiredBlockAllocations = 0;
+			for (Arena* arena : registry.arenas)
+				arena->ResetStatistics();
+		}
+	}
+}
@@ -0,0 +1,97 @@
+// ScratchArena.h : per-thread bump allocator for the temporary arrays of a plug-in call
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "Span.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Position of a thread's scratch arena when a scope was entered (see ScratchArenaEnter).
+		/// </summary>
+		struct ScratchMark
+		{
+			int block;
+			std::size_t offset;
+			std::size_t used;
+		};
+
+		struct ScratchArenaStats
+		{
+			// threads owning an arena
+			std::size_t threads;
+			// bytes held by the arenas of all threads
+			std::size_t reserved;
+			// most scratch bytes used by one call on any thread
+			std::size_t highWater;
+			// scratch bytes used by the last finished call on the calling thread
+			std::size_t lastCall;
+			// outermost scopes closed, i.e. plug-in calls that used scratch
+			std::uint64_t calls;
+			// blocks allocated from the heap; flat once every thread has seen its largest call
+			std::uint64_t blockAllocations;
+		};
+
+		/// <summary>
+		/// Returns 'bytes' of uninitialized memory aligned to 64 bytes from the calling thread's arena.
+		/// The memory is valid until the arena is rewound past it; it is never freed one by one.
+		/// </summary>
+		void* ScratchArenaAllocate(std::size_t bytes);
+
+		/// <summary>
+		/// Opens a scope on the calling thread's arena and returns its position. Use ScratchScope rather than calling it directly.
+		/// </summary>
+		ScratchMark ScratchArenaEnter();
+
+		/// <summary>
+		/// Closes the scope opened by ScratchArenaEnter: everything allocated since 'mark' is released.
+		/// Closing the outermost scope ends a call: its peak is recorded and, if the call needed more than one block,
+		/// the blocks are replaced by one block as large as its peak, so the next call of the same size allocates nothing.
+		/// </summary>
+		void ScratchArenaLeave(const ScratchMark& mark);
+
+		ScratchArenaStats ScratchArenaStatistics();
+
+		/// <summary>
+		/// Returns the bytes allocated from the calling thread's arena since the thread started; the profiler reads it before and after a call.
+		/// </summary>
+		std::uint64_t ScratchArenaAllocatedBytes();
+
+		/// <summary>
+		/// Resets the high-water mark and the counters; the reserved memory is kept.
+		/// </summary>
+		void ScratchArenaResetStatistics();
+
+		/// <summary>
+		/// Scratch memory of one [ABMethod] call or of one kernel.
+		///
+		/// Intermediate arrays of a plug-in method (e.g. the typical price before its average is taken) do not have to be
+		/// ATArray objects allocated by AmiBroker for every call; they are taken from the arena of the calling thread instead.
+		/// Only the final results are written to ATArray buffers. The destructor gives back everything allocated since the scope
+		/// was opened, the outermost scope of a thread resets the arena. Scopes nest: kernels open their own for internal buffers.
+		/// A scope must be destroyed on the thread that created it, in reverse order of creation (a local variable does that).
+		/// </summary>
+		class ScratchScope
+		{
+		public:
+			ScratchScope() : mark(ScratchArenaEnter()) {}
+			~ScratchScope() { ScratchArenaLeave(mark); }
+
+			ScratchScope(const ScratchScope&) = delete;
+			ScratchScope& operator=(const ScratchScope&) = delete;
+
+			template <class T>
+			Span<T> Allocate(int count)
+			{
+				return Span<T>(static_cast<T*>(ScratchArenaAllocate(sizeof(T) * (std::size_t)count)), count);
+			}
+
+		private:
+			ScratchMark mark;
+		};
+	}
+}
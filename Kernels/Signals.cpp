@@ -0,0 +1,128 @@
+// Signals.cpp : trading signals and conditions as packed bit vectors
+
+#include "Signals.h"
+#include "Elementwise.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// bits of the last word that are bars
+			std::uint64_t LastWordMask(int length)
+			{
+				int used = length % 64;
+				return used == 0 ? ~0ull : (1ull << used) - 1;
+			}
+
+			int PopCount(std::uint64_t x)
+			{
+				x = x - ((x >> 1) & 0x5555555555555555ull);
+				x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+				x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+				return (int)((x * 0x0101010101010101ull) >> 56);
+			}
+		}
+
+		void Compare(const float* a, const float* b, Comparison op, std::uint64_t* bits, int length)
+		{
+			ActiveElementwiseKernels().compare(a, b, op, bits, length);
+		}
+
+		void Compare(const float* a, float b, Comparison op, std::uint64_t* bits, int length)
+		{
+			ActiveElementwiseKernels().compareScalar(a, b, op, bits, length);
+		}
+
+		void Cross(const float* a, const float* b, std::uint64_t* bits, int length)
+		{
+			ActiveElementwiseKernels().cross(a, b, bits, length);
+		}
+
+		void PackSignal(const float* src, std::uint64_t* bits, int length)
+		{
+			ActiveElementwiseKernels().packSignal(src, bits, length);
+		}
+
+		void SignalAnd(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* dst, int length)
+		{
+			int words = SignalWords(length);
+			for (int w = 0; w < words; w++)
+				dst[w] = a[w] & b[w];
+		}
+
+		void SignalOr(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* dst, int length)
+		{
+			int words = SignalWords(length);
+			for (int w = 0; w < words; w++)
+				dst[w] = a[w] | b[w];
+		}
+
+		void SignalAndNot(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* dst, int length)
+		{
+			int words = SignalWords(length);
+			for (int w = 0; w < words; w++)
+				dst[w] = a[w] & ~b[w];
+		}
+
+		void SignalNot(const std::uint64_t* src, std::uint64_t* dst, int length)
+		{
+			int words = SignalWords(length);
+			for (int w = 0; w < words; w++)
+				dst[w] = ~src[w];
+			if (words > 0)
+				dst[words - 1] &= LastWordMask(length);
+		}
+
+		void ExRem(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* dst, int length)
+		{
+			bool on = false;
+			int words = SignalWords(length);
+			for (int w = 0; w < words; w++)
+			{
+				std::uint64_t first = a[w];
+				std::uint64_t second = b[w];
+				std::uint64_t kept = 0;
+
+				// walk the set bars of the word in order, lowest bit first (x & -x isolates it)
+				std::uint64_t events = on ? second : first;
+				while (events != 0)
+				{
+					std::uint64_t bar = events & (0 - events);
+					if (!on)
+					{
+						kept |= bar;
+						on = true;
+					}
+					if (on && (second & bar))
+						on = false;
+
+					// the bars after this one that matter for the new state
+					std::uint64_t after = ~((bar << 1) - 1);
+					events = (on ? second : first) & after;
+				}
+				dst[w] = kept;
+			}
+		}
+
+		int CountSignals(const std::uint64_t* bits, int length)
+		{
+			int count = 0;
+			int words = SignalWords(length);
+			for (int w = 0; w < words; w++)
+				count += PopCount(bits[w]);
+			return count;
+		}
+
+		void ExpandSignal(const std::uint64_t* bits, float* dst, int length, float ifTrue, float ifFalse)
+		{
+			ActiveElementwiseKernels().expandSignal(bits, dst, length, ifTrue, ifFalse);
+		}
+
+		void SelectSignal(const std::uint64_t* bits, const float* ifTrue, const float* ifFalse, float* dst, int length)
+		{
+			ActiveElementwiseKernels().selectSignal(bits, ifTrue, ifFalse, dst, length);
+		}
+	}
+}
@@ -0,0 +1,85 @@
+// Signals.h : trading signals and conditions as packed bit vectors
+
+#pragma once
+
+#include <cstdint>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Comparison operators of AFL (&lt;, &lt;=, &gt;, &gt;=, ==, !=).
+		/// </summary>
+		enum class Comparison
+		{
+			Less = 0,
+			LessEqual = 1,
+			Greater = 2,
+			GreaterEqual = 3,
+			Equal = 4,
+			NotEqual = 5
+		};
+
+		/// <summary>
+		/// Number of 64-bit words of a signal of 'length' bars. Bar i is bit (i % 64) of word i / 64;
+		/// the bits after the last bar are always 0.
+		/// </summary>
+		inline int SignalWords(int length)
+		{
+			return (length + 63) / 64;
+		}
+
+		/// <summary>
+		/// Sets the bars where 'a op b' holds. A Null on either side is false, so a condition on an
+		/// average is never true before the average has a value.
+		/// The compare instructions of the active instruction set produce one lane mask per vector (movemask),
+		/// 64 bars are packed into each word: a condition costs 1/32 of the memory of a float array.
+		/// </summary>
+		void Compare(const float* a, const float* b, Comparison op, std::uint64_t* bits, int length);
+		void Compare(const float* a, float b, Comparison op, std::uint64_t* bits, int length);
+
+		/// <summary>
+		/// AFL's Cross(a, b): a crosses above b on this bar (a &gt; b now, a &lt;= b on the previous bar).
+		/// A Null on either bar is no cross; the first bar is never a cross.
+		/// </summary>
+		void Cross(const float* a, const float* b, std::uint64_t* bits, int length);
+
+		/// <summary>
+		/// Packs an AFL condition array: bars that are neither 0 nor Null are set.
+		/// </summary>
+		void PackSignal(const float* src, std::uint64_t* bits, int length);
+
+		/// <summary>
+		/// AFL's AND, OR and NOT of conditions, and a AND NOT b. 64 bars per operation; dst may be one of the operands.
+		/// </summary>
+		void SignalAnd(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* dst, int length);
+		void SignalOr(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* dst, int length);
+		void SignalAndNot(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* dst, int length);
+		void SignalNot(const std::uint64_t* src, std::uint64_t* dst, int length);
+
+		/// <summary>
+		/// AFL's ExRem(a, b): keeps the first bar of a, then removes the bars of a until b is set.
+		/// b is checked from the bar that was kept on, so a and b on the same bar keep that bar and end it.
+		/// Words without a set bar in the part that matters (a while off, b while on) are passed in one step,
+		/// so the cost follows the number of signals, not the number of bars.
+		/// </summary>
+		void ExRem(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* dst, int length);
+
+		/// <summary>
+		/// Returns the number of bars set.
+		/// </summary>
+		int CountSignals(const std::uint64_t* bits, int length);
+
+		/// <summary>
+		/// Expands a signal to an AFL array at the boundary: Iif(bits, ifTrue, ifFalse).
+		/// With the default values it is the 1/0 array AFL uses for conditions; with a shape it is the array of PlotShapes.
+		/// </summary>
+		void ExpandSignal(const std::uint64_t* bits, float* dst, int length, float ifTrue = 1.0f, float ifFalse = 0.0f);
+
+		/// <summary>
+		/// Iif(bits, ifTrue, ifFalse) with arrays: the bars of ifTrue where the signal is set, of ifFalse elsewhere.
+		/// </summary>
+		void SelectSignal(const std::uint64_t* bits, const float* ifTrue, const float* ifFalse, float* dst, int length);
+	}
+}
@@ -0,0 +1,122 @@
+// Simd.cpp : instruction set detection and selection for the vectorized kernels
+
+#include "Simd.h"
+
+#if KERNELS_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+#if KERNELS_X86
+			void CpuId(int leaf, int subLeaf, unsigned int regs[4])
+			{
+#if defined(_MSC_VER)
+				int info[4];
+				__cpuidex(info, leaf, subLeaf);
+				for (int i = 0; i < 4; i++)
+					regs[i] = (unsigned int)info[i];
+#else
+				__cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+			}
+
+			// register state enabled by the OS (XCR0)
+			unsigned long long XGetBv()
+			{
+#if defined(_MSC_VER)
+				return _xgetbv(0);
+#else
+				unsigned int eax, edx;
+				__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+				return ((unsigned long long)edx << 32) | eax;
+#endif
+			}
+#endif
+
+			SimdLevel Detect()
+			{
+#if KERNELS_X86
+				unsigned int regs[4];
+
+				CpuId(0, 0, regs);
+				unsigned int maxLeaf = regs[0];
+				if (maxLeaf < 1)
+					return SimdLevel::Scalar;
+
+				CpuId(1, 0, regs);
+				bool sse2 = (regs[3] & (1u << 26)) != 0;
+				bool osxsave = (regs[2] & (1u << 27)) != 0;
+				bool avx = (regs[2] & (1u << 28)) != 0;
+
+				if (!sse2)
+					return SimdLevel::Scalar;
+				if (!osxsave || !avx || maxLeaf < 7)
+					return SimdLevel::Sse2;
+
+				unsigned long long xcr0 = XGetBv();
+				if ((xcr0 & 0x6) != 0x6)
+					return SimdLevel::Sse2;
+
+				CpuId(7, 0, regs);
+				bool avx2 = (regs[1] & (1u << 5)) != 0;
+				bool avx512f = (regs[1] & (1u << 16)) != 0;
+
+				if (avx512f && (xcr0 & 0xE6) == 0xE6)
+					return SimdLevel::Avx512;
+				if (avx2)
+					return SimdLevel::Avx2;
+				return SimdLevel::Sse2;
+#else
+				return SimdLevel::Scalar;
+#endif
+			}
+
+			// function-local static, so kernels called during static initialization see the detected level
+			SimdLevel& Active()
+			{
+				static SimdLevel level = DetectSimdLevel();
+				return level;
+			}
+		}
+
+		SimdLevel DetectSimdLevel()
+		{
+			static const SimdLevel level = Detect();
+			return level;
+		}
+
+		SimdLevel ActiveSimdLevel()
+		{
+			return Active();
+		}
+
+		void SetSimdLevel(SimdLevel level)
+		{
+			Active() = level > DetectSimdLevel() ? DetectSimdLevel() : level;
+		}
+
+		const char* SimdLevelName(SimdLevel level)
+		{
+			switch (level)
+			{
+			case SimdLevel::Sse2:
+				return "SSE2";
+			case SimdLevel::Avx2:
+				return "AVX2";
+			case SimdLevel::Avx512:
+				return "AVX-512";
+			default:
+				return "Scalar";
+			}
+		}
+	}
+}
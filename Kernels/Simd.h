@@ -0,0 +1,49 @@
+// Simd.h : instruction set detection and selection for the vectorized kernels
+
+#pragma once
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define KERNELS_X86 1
+#else
+#define KERNELS_X86 0
+#endif
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Instruction sets the vectorized kernels are compiled for, in increasing order.
+		/// </summary>
+		enum class SimdLevel
+		{
+			Scalar = 0,
+			Sse2 = 1,
+			Avx2 = 2,
+			Avx512 = 3
+		};
+
+		/// <summary>
+		/// Returns the best instruction set supported by both the CPU and the OS (CPUID and XGETBV).
+		/// </summary>
+		SimdLevel DetectSimdLevel();
+
+		/// <summary>
+		/// Returns the instruction set the kernels dispatch to.
+		/// It is set to DetectSimdLevel() when the library is loaded.
+		/// </summary>
+		SimdLevel ActiveSimdLevel();
+
+		/// <summary>
+		/// Limits the instruction set the kernels dispatch to (e.g. to compare variants in benchmarks
+		/// or to get scalar results). Levels above DetectSimdLevel() are clamped.
+		/// Not thread safe: call it before kernels run on other threads.
+		/// </summary>
+		void SetSimdLevel(SimdLevel level);
+
+		/// <summary>
+		/// Returns the name of an instruction set level ("Scalar", "SSE2", "AVX2", "AVX-512").
+		/// </summary>
+		const char* SimdLevelName(SimdLevel level);
+	}
+}
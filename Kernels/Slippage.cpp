@@ -0,0 +1,173 @@
+// Slippage.cpp : slippage and commission models of the custom backtester
+
+#include "Slippage.h"
+#include "Averages.h"
+#include "Null.h"
+#include "Price.h"
+
+#include <cmath>
+#include <map>
+#include <mutex>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		struct SlippageInputs::Symbols
+		{
+			struct Inputs
+			{
+				std::vector<std::uint64_t> dates;
+				std::vector<float> atr;
+				std::vector<float> tradedValue;
+			};
+
+			std::mutex lock;
+			std::map<std::string, Inputs> bySymbol;
+		};
+
+		namespace
+		{
+			struct NamedStores
+			{
+				std::mutex lock;
+				std::map<std::string, std::shared_ptr<SlippageInputs>> stores;
+			};
+
+			NamedStores& SharedStores()
+			{
+				static NamedStores named;
+				return named;
+			}
+
+			// resamples the values of a symbol to the portfolio bars: each bar takes the last value at or before its date
+			std::vector<float> Align(const std::vector<std::uint64_t>& sourceDates, const std::vector<float>& values, const std::uint64_t* dates, int length)
+			{
+				std::vector<float> result(length, Null);
+				int source = 0;
+				int count = (int)sourceDates.size();
+				for (int bar = 0; bar < length; bar++)
+				{
+					while (source < count && sourceDates[source] <= dates[bar])
+						source++;
+					if (source > 0)
+						result[bar] = values[source - 1];
+				}
+				return result;
+			}
+		}
+
+		SlippageInputs::SlippageInputs()
+			: symbols(new Symbols())
+		{
+		}
+
+		SlippageInputs::~SlippageInputs()
+		{
+		}
+
+		void SlippageInputs::Store(const std::string& symbol, const std::uint64_t* dates, const float* high, const float* low,
+			const float* close, const float* volume, int length, int period)
+		{
+			Symbols::Inputs inputs;
+			inputs.dates.assign(dates, dates + length);
+			inputs.atr.resize(length);
+			inputs.tradedValue.resize(length);
+
+			// ATR = Wilders(TrueRange, period)
+			std::vector<float> range(length);
+			TrueRange(high, low, close, range.data(), length);
+			Wilders(range.data(), inputs.atr.data(), length, period);
+
+			// average traded value = MA(Close * Volume, period)
+			std::vector<float> value(length);
+			for (int i = 0; i < length; i++)
+				value[i] = NullIf(IsNull(close[i]) | IsNull(volume[i]), close[i] * volume[i]);
+			Ma(value.data(), inputs.tradedValue.data(), length, period);
+
+			std::lock_guard<std::mutex> guard(symbols->lock);
+			symbols->bySymbol[symbol] = std::move(inputs);
+		}
+
+		std::shared_ptr<SlippageInputs> NamedSlippageInputs(const std::string& backtest)
+		{
+			NamedStores& named = SharedStores();
+			std::lock_guard<std::mutex> guard(named.lock);
+			std::shared_ptr<SlippageInputs>& store = named.stores[backtest];
+			if (!store)
+				store = std::make_shared<SlippageInputs>();
+			return store;
+		}
+
+		void ReleaseSlippageInputs(const std::string& backtest)
+		{
+			NamedStores& named = SharedStores();
+			std::lock_guard<std::mutex> guard(named.lock);
+			named.stores.erase(backtest);
+		}
+
+		SlippageEngine::SlippageEngine(const SlippageSettings& settings, const SlippageInputs& inputs, const std::uint64_t* dates, int length)
+			: settings(settings), length(length)
+		{
+			bool needsInputs = settings.model == SlippageModel::Atr || settings.model == SlippageModel::VolumeParticipation;
+			if (!needsInputs)
+				return;
+
+			std::lock_guard<std::mutex> guard(inputs.symbols->lock);
+			for (const auto& symbol : inputs.symbols->bySymbol)
+			{
+				symbols[symbol.first] = (int)atr.size();
+				atr.push_back(Align(symbol.second.dates, symbol.second.atr, dates, length));
+				tradedValue.push_back(Align(symbol.second.dates, symbol.second.tradedValue, dates, length));
+			}
+		}
+
+		int SlippageEngine::SymbolIndex(const std::string& symbol) const
+		{
+			auto found = symbols.find(symbol);
+			return found != symbols.end() ? found->second : -1;
+		}
+
+		float SlippageEngine::Slippage(int symbol, int bar, float price, float amount, double orderValue) const
+		{
+			bool hasInputs = symbol >= 0 && bar >= 0 && bar < length;
+
+			switch (settings.model)
+			{
+			case SlippageModel::Percent:
+				return price * amount / 100.0f;
+
+			case SlippageModel::Atr:
+			{
+				float range = hasInputs ? atr[symbol][bar] : Null;
+				return IsNull(range) ? 0.0f : amount * range;
+			}
+
+			case SlippageModel::VolumeParticipation:
+			{
+				// square root market impact: the cost grows with the square root of the share of the traded value
+				float traded = hasInputs ? tradedValue[symbol][bar] : Null;
+				if (IsNull(traded) || traded <= 0.0f || orderValue <= 0.0)
+					return 0.0f;
+				double participation = orderValue / traded;
+				if (participation > 1.0)
+					participation = 1.0;
+				return (float)(price * amount / 100.0 * std::sqrt(participation));
+			}
+
+			default:
+				return amount * settings.tickSize;
+			}
+		}
+
+		float SlippageEngine::Adjust(int symbol, int bar, float price, bool isLong, bool isEntry, double orderValue) const
+		{
+			float amount = isLong ? settings.longAmount : settings.shortAmount;
+			float cost = Slippage(symbol, bar, price, amount, orderValue) + settings.commissionPerShare;
+
+			// long entries and short exits buy
+			bool buy = isLong == isEntry;
+			return buy ? price + cost : price - cost;
+		}
+	}
+}
@@ -0,0 +1,112 @@
+// Slippage.h : slippage and commission models of the custom backtester
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// How the slippage of a signal is calculated. The numeric values are the ones AFL scripts use.
+		/// The amount is chosen by the direction of the trade (SlippageSettings::longAmount / shortAmount).
+		/// </summary>
+		enum class SlippageModel
+		{
+			FixedTick = 0,				// amount * tick size
+			Percent = 1,				// amount % of the price
+			Atr = 2,					// amount * ATR(period) of the symbol
+			VolumeParticipation = 3		// amount % of the price * sqrt(order value / average traded value over period)
+		};
+
+		struct SlippageSettings
+		{
+			SlippageModel model = SlippageModel::FixedTick;
+			float longAmount = 0.0f;
+			float shortAmount = 0.0f;
+			float tickSize = 0.0f;
+			int period = 14;
+			float commissionPerShare = 0.0f;	// added to the slippage of every signal
+		};
+
+		/// <summary>
+		/// The per-bar inputs of the ATR and volume models of the symbols of one backtest. Each backtest has its own store,
+		/// so backtests running at the same time do not see or drop each other's inputs.
+		/// </summary>
+		class SlippageInputs
+		{
+		public:
+			SlippageInputs();
+			~SlippageInputs();
+
+			/// <summary>
+			/// Calculates the inputs of a symbol (ATR and the average traded value Close * Volume, both over 'period' bars)
+			/// and keeps them until the custom backtest phase. Call it in the first (per-symbol) phase of the backtest,
+			/// when the symbol's own quotes are available. dates are the bar time stamps (ATDateTime::Date) used to align
+			/// the symbol to the portfolio bars. Thread safe.
+			/// </summary>
+			void Store(const std::string& symbol, const std::uint64_t* dates, const float* high, const float* low,
+				const float* close, const float* volume, int length, int period);
+
+		private:
+			friend class SlippageEngine;
+
+			// the lock and the symbols live in the .cpp file (<mutex> is not available to managed code)
+			struct Symbols;
+			std::unique_ptr<Symbols> symbols;
+		};
+
+		/// <summary>
+		/// The store of the backtest named 'backtest', created on first use. The phases of a backtest in AmiBroker run in
+		/// separate formula executions, so they find their store by a name; backtests that run at the same time must use
+		/// different names. Thread safe.
+		/// </summary>
+		std::shared_ptr<SlippageInputs> NamedSlippageInputs(const std::string& backtest);
+
+		/// <summary>
+		/// Drops the store of a backtest at its end. The store stays alive while an engine is being built from it.
+		/// </summary>
+		void ReleaseSlippageInputs(const std::string& backtest);
+
+		/// <summary>
+		/// Adjusts signal prices by slippage and commission in the custom backtest phase.
+		///
+		/// The constructor aligns the stored inputs of every symbol to the portfolio bars once (before PreProcess),
+		/// so adjusting a signal is an array lookup: no host calls and no per-signal calculation over bars.
+		/// The price always moves against the trade: buys (long entries, short exits) pay more, sells receive less.
+		/// </summary>
+		class SlippageEngine
+		{
+		public:
+			SlippageEngine(const SlippageSettings& settings, const SlippageInputs& inputs, const std::uint64_t* dates, int length);
+
+			/// <summary>
+			/// Returns the index of a symbol for Adjust or -1 if it has no stored inputs
+			/// (only the fixed tick and percent models work for such symbols).
+			/// </summary>
+			int SymbolIndex(const std::string& symbol) const;
+
+			/// <summary>
+			/// Returns the adjusted price of a signal. orderValue is the value of the order in account currency
+			/// and is used by the volume participation model only.
+			/// </summary>
+			float Adjust(int symbol, int bar, float price, bool isLong, bool isEntry, double orderValue) const;
+
+			const SlippageSettings& Settings() const { return settings; }
+
+		private:
+			float Slippage(int symbol, int bar, float price, float amount, double orderValue) const;
+
+			SlippageSettings settings;
+			int length;
+			std::unordered_map<std::string, int> symbols;
+			std::vector<std::vector<float>> atr;
+			std::vector<std::vector<float>> tradedValue;
+		};
+	}
+}
@@ -0,0 +1,55 @@
+// Span.h : bounds-checked view of a native buffer
+
+#pragma once
+
+#include <cassert>
+#include <type_traits>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Non-owning view of 'length' elements at 'data' (std::span is C++20, the kernels are C++17).
+		/// The indexer checks the index in debug builds only (assert); in release builds it compiles
+		/// to a plain pointer access, so loops over a Span vectorize like loops over raw pointers.
+		/// Span of T converts to Span of const T.
+		/// </summary>
+		template <class T>
+		class Span
+		{
+		public:
+			Span() : data(nullptr), length(0) {}
+			Span(T* data, int length) : data(data), length(length) { assert(length >= 0 && (data != nullptr || length == 0)); }
+
+			template <class U, class = typename std::enable_if<std::is_convertible<U(*)[], T(*)[]>::value>::type>
+			Span(const Span<U>& other) : data(other.Data()), length(other.Length()) {}
+
+			T& operator[](int index) const
+			{
+				assert(index >= 0 && index < length);
+				return data[index];
+			}
+
+			T* Data() const { return data; }
+			int Length() const { return length; }
+			bool Empty() const { return length == 0; }
+
+			T* begin() const { return data; }
+			T* end() const { return data + length; }
+
+			/// <summary>
+			/// The 'count' elements from 'offset'.
+			/// </summary>
+			Span Subspan(int offset, int count) const
+			{
+				assert(offset >= 0 && count >= 0 && offset + count <= length);
+				return Span(data + offset, count);
+			}
+
+		private:
+			T* data;
+			int length;
+		};
+	}
+}
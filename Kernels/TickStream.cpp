@@ -0,0 +1,233 @@
+// TickStream.cpp : streaming aggregation of ticks to bars for real-time feeds
+
+#include "TickStream.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			const std::int64_t MicrosecondsPerSecond = 1000000;
+			const std::int64_t SecondsPerDay = 86400;
+
+			std::int64_t FloorDivide(std::int64_t a, std::int64_t b)
+			{
+				std::int64_t q = a / b;
+				return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+			}
+		}
+
+		// the indexes count ticks from the start and are masked on access, so full and empty are told apart without a spare slot;
+		// each one is on its own cache line, with the copy of the other index its side keeps
+		struct TickRing::State
+		{
+			explicit State(int size)
+				: buffer(size), mask((std::uint64_t)size - 1)
+			{
+			}
+
+			std::vector<Tick> buffer;
+			std::uint64_t mask;
+
+			alignas(64) std::atomic<std::uint64_t> head{ 0 };
+			std::uint64_t cachedTail = 0;
+
+			alignas(64) std::atomic<std::uint64_t> tail{ 0 };
+			std::uint64_t cachedHead = 0;
+			int highWater = 0;
+
+			alignas(64) std::atomic<bool> closed{ false };
+		};
+
+		TickRing::TickRing(int capacity)
+		{
+			int size = 64;
+			while (size < capacity && size < (1 << 30))
+				size <<= 1;
+			state.reset(new State(size));
+		}
+
+		TickRing::~TickRing()
+		{
+		}
+
+		int TickRing::Push(const Tick* ticks, int count)
+		{
+			State& s = *state;
+			std::uint64_t head = s.head.load(std::memory_order_relaxed);
+			std::uint64_t size = s.mask + 1;
+			if (head - s.cachedTail + count > size)
+				s.cachedTail = s.tail.load(std::memory_order_acquire);
+
+			std::uint64_t free = size - (head - s.cachedTail);
+			int n = count < (std::int64_t)free ? count : (int)free;
+			if (n == 0)
+				return 0;
+
+			// at most two copies: up to the end of the buffer and from its start
+			std::uint64_t start = head & s.mask;
+			std::uint64_t first = size - start < (std::uint64_t)n ? size - start : (std::uint64_t)n;
+			std::memcpy(&s.buffer[start], ticks, first * sizeof(Tick));
+			std::memcpy(&s.buffer[0], ticks + first, (n - first) * sizeof(Tick));
+			s.head.store(head + n, std::memory_order_release);
+			return n;
+		}
+
+		int TickRing::Pop(Tick* ticks, int count)
+		{
+			State& s = *state;
+			std::uint64_t tail = s.tail.load(std::memory_order_relaxed);
+			if (s.cachedHead - tail < (std::uint64_t)count)
+			{
+				s.cachedHead = s.head.load(std::memory_order_acquire);
+				if ((int)(s.cachedHead - tail) > s.highWater)
+					s.highWater = (int)(s.cachedHead - tail);
+			}
+
+			std::uint64_t available = s.cachedHead - tail;
+			int n = count < (std::int64_t)available ? count : (int)available;
+			if (n == 0)
+				return 0;
+
+			std::uint64_t size = s.mask + 1;
+			std::uint64_t start = tail & s.mask;
+			std::uint64_t first = size - start < (std::uint64_t)n ? size - start : (std::uint64_t)n;
+			std::memcpy(ticks, &s.buffer[start], first * sizeof(Tick));
+			std::memcpy(ticks + first, &s.buffer[0], (n - first) * sizeof(Tick));
+			s.tail.store(tail + n, std::memory_order_release);
+			return n;
+		}
+
+		void TickRing::Close()
+		{
+			state->closed.store(true, std::memory_order_release);
+		}
+
+		bool TickRing::IsDrained() const
+		{
+			// closed is read first: once it is set, head no longer changes
+			if (!state->closed.load(std::memory_order_acquire))
+				return false;
+			return state->head.load(std::memory_order_acquire) == state->tail.load(std::memory_order_relaxed);
+		}
+
+		int TickRing::Capacity() const
+		{
+			return (int)(state->mask + 1);
+		}
+
+		int TickRing::HighWater() const
+		{
+			return state->highWater;
+		}
+
+		TickAggregator::TickAggregator(int interval, int period)
+			: interval((interval < 1 ? 1 : interval) * MicrosecondsPerSecond), window(period)
+		{
+		}
+
+		std::int64_t TickAggregator::PeriodOf(std::int64_t time, std::int64_t& start) const
+		{
+			// bars of an interval that divides a day start at midnight whatever the day
+			const std::int64_t day = SecondsPerDay * MicrosecondsPerSecond;
+			if (day % interval == 0)
+			{
+				std::int64_t p = FloorDivide(time, interval);
+				start = p * interval;
+				return p;
+			}
+
+			std::int64_t perDay = (day + interval - 1) / interval;
+			std::int64_t days = FloorDivide(time, day);
+			std::int64_t slot = (time - days * day) / interval;
+			start = days * day + slot * interval;
+			return days * perDay + slot;
+		}
+
+		void TickAggregator::Push(const Tick* batch, int count, BarSink& sink)
+		{
+			for (int k = 0; k < count; k++)
+			{
+				const Tick& tick = batch[k];
+				std::int64_t start;
+				std::int64_t p = PeriodOf(tick.time, start);
+				if (forming && p != period)
+				{
+					if (p < period)
+					{
+						lateTicks++;
+						continue;
+					}
+					Complete(sink);
+				}
+
+				if (!forming)
+				{
+					forming = true;
+					period = p;
+					bar.time = start;
+					bar.open = bar.high = bar.low = tick.price;
+					bar.volume = 0.0;
+					bar.ticks = 0;
+				}
+
+				if (tick.price > bar.high)
+					bar.high = tick.price;
+				if (tick.price < bar.low)
+					bar.low = tick.price;
+				bar.close = tick.price;
+				bar.volume += tick.size;
+				bar.ticks++;
+				ticks++;
+			}
+
+			if (forming && count > 0)
+			{
+				bar.ma = window.PeekMean(bar.close);
+				sink.OnUpdate(bar);
+			}
+		}
+
+		void TickAggregator::Flush(BarSink& sink)
+		{
+			if (forming)
+				Complete(sink);
+		}
+
+		void TickAggregator::Complete(BarSink& sink)
+		{
+			bar.ma = window.Push(bar.close) ? (float)window.Mean() : Null;
+			sink.OnBar(bar);
+			bars++;
+			forming = false;
+		}
+
+		std::int64_t RunTickStage(TickRing& ring, TickAggregator& aggregator, BarSink& sink, int batch)
+		{
+			std::vector<Tick> buffer(batch < 1 ? 1 : batch);
+			std::int64_t consumed = 0;
+			for (;;)
+			{
+				int n = ring.Pop(buffer.data(), (int)buffer.size());
+				if (n > 0)
+				{
+					aggregator.Push(buffer.data(), n, sink);
+					consumed += n;
+				}
+				else if (ring.IsDrained())
+					break;
+				else
+					std::this_thread::yield();
+			}
+
+			aggregator.Flush(sink);
+			return consumed;
+		}
+	}
+}
@@ -0,0 +1,161 @@
+// TickStream.h : streaming aggregation of ticks to bars for real-time feeds
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include "RollingWindow.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// One trade of a feed: time in microseconds since 1970-01-01, price and size.
+		/// </summary>
+		struct Tick
+		{
+			std::int64_t time;
+			float price;
+			float size;
+		};
+
+		/// <summary>
+		/// Lock-free ring buffer of ticks between one producer thread (the feed) and one consumer thread (the bar stage).
+		///
+		/// Each side owns one index and only reads the other one, so no locks or compare-and-swap are needed; each side also
+		/// keeps a copy of the other index and reloads it only when the ring looks full (or empty), so the cache line of the
+		/// other side is touched once per batch, not once per tick. Ticks are passed in batches for the same reason.
+		/// The atomics live in the .cpp file: the header can be included by /clr code.
+		/// </summary>
+		class TickRing
+		{
+		public:
+			/// <summary>
+			/// Creates a ring of at least 'capacity' ticks (rounded up to a power of two). The memory is allocated once.
+			/// </summary>
+			explicit TickRing(int capacity);
+			~TickRing();
+
+			TickRing(const TickRing&) = delete;
+			TickRing& operator=(const TickRing&) = delete;
+
+			/// <summary>
+			/// Producer side: copies as many of the ticks as fit and returns their number (0 when the ring is full).
+			/// </summary>
+			int Push(const Tick* ticks, int count);
+
+			/// <summary>
+			/// Consumer side: moves up to 'count' ticks to 'ticks' and returns their number (0 when the ring is empty).
+			/// </summary>
+			int Pop(Tick* ticks, int count);
+
+			/// <summary>
+			/// Producer side: no more ticks will be pushed. The consumer still gets the ticks in the ring.
+			/// </summary>
+			void Close();
+
+			/// <summary>
+			/// True when the producer closed the ring and every tick was popped.
+			/// </summary>
+			bool IsDrained() const;
+
+			int Capacity() const;
+
+			/// <summary>
+			/// The most ticks the consumer found in the ring. Close to Capacity() means the consumer falls behind the feed.
+			/// </summary>
+			int HighWater() const;
+
+		private:
+			struct State;
+			std::unique_ptr<State> state;
+		};
+
+		/// <summary>
+		/// A time bar built from ticks, with the moving average of the bar closes.
+		/// time is the start of the bar (microseconds since 1970-01-01); ma is Null until 'period' bars are complete.
+		/// </summary>
+		struct StreamBar
+		{
+			std::int64_t time;
+			float open;
+			float high;
+			float low;
+			float close;
+			double volume;
+			int ticks;
+			float ma;
+		};
+
+		/// <summary>
+		/// Receives the output of a TickAggregator on the consumer thread.
+		/// </summary>
+		class BarSink
+		{
+		public:
+			virtual ~BarSink() {}
+
+			/// <summary>
+			/// A bar is complete: the first tick of a later bar arrived, or the stream ended (Flush).
+			/// </summary>
+			virtual void OnBar(const StreamBar& bar) = 0;
+
+			/// <summary>
+			/// The forming bar changed; its ma is the average with the current close as the last value,
+			/// the value MA(Close, period) has on the last bar of a chart during real-time refreshes.
+			/// </summary>
+			virtual void OnUpdate(const StreamBar& forming) { (void)forming; }
+		};
+
+		/// <summary>
+		/// Builds bars of 'interval' seconds from a stream of ticks in time order, with the MA of the bar closes
+		/// of BasicSampleVC5 updated incrementally: a tick costs O(1) and the memory is the forming bar
+		/// plus the 'period' closes of the average, whatever the length of the stream.
+		///
+		/// Bars start at multiples of the interval from midnight when the interval divides a day (1, 5, 15, 60 minutes...),
+		/// from 1970-01-01 otherwise. Periods without ticks have no bar. A tick older than the forming bar is late:
+		/// it is counted and dropped, the bars already sent are not changed.
+		/// </summary>
+		class TickAggregator
+		{
+		public:
+			TickAggregator(int interval, int period);
+
+			/// <summary>
+			/// Adds the ticks; completed bars go to sink.OnBar, then sink.OnUpdate is called once for the forming bar
+			/// (once per batch, not per tick: a consumer behind the feed does not repaint for every tick).
+			/// </summary>
+			void Push(const Tick* ticks, int count, BarSink& sink);
+
+			/// <summary>
+			/// Completes the forming bar, e.g. at the end of a replay.
+			/// </summary>
+			void Flush(BarSink& sink);
+
+			std::int64_t Ticks() const { return ticks; }
+			std::int64_t Bars() const { return bars; }
+			std::int64_t LateTicks() const { return lateTicks; }
+
+		private:
+			std::int64_t PeriodOf(std::int64_t time, std::int64_t& start) const;
+			void Complete(BarSink& sink);
+
+			std::int64_t interval;
+			RollingWindow<> window;
+			bool forming = false;
+			std::int64_t period = 0;
+			StreamBar bar = StreamBar();
+			std::int64_t ticks = 0;
+			std::int64_t bars = 0;
+			std::int64_t lateTicks = 0;
+		};
+
+		/// <summary>
+		/// Consumer loop of the bar stage: pops ticks in batches of up to 'batch' and feeds the aggregator until the
+		/// producer closed the ring and it is empty, then completes the forming bar. Yields the CPU while the ring is empty.
+		/// Returns the number of ticks consumed.
+		/// </summary>
+		std::int64_t RunTickStage(TickRing& ring, TickAggregator& aggregator, BarSink& sink, int batch = 4096);
+	}
+}
@@ -0,0 +1,540 @@
+// TimeFrame.cpp : one-pass compression of bars to several time frames and expansion back to the base bars
+
+#include "TimeFrame.h"
+#include "Null.h"
+#include "ResultCache.h"
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			const int SecondsPerDay = 86400;
+
+			std::int64_t FloorDivide(std::int64_t a, std::int64_t b)
+			{
+				std::int64_t q = a / b;
+				return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+			}
+
+			// days since 1970-01-01 of a date of the proleptic Gregorian calendar
+			std::int64_t DaysFromCivil(int year, int month, int day)
+			{
+				year -= month <= 2;
+				std::int64_t era = FloorDivide(year, 400);
+				int yearOfEra = (int)(year - era * 400);
+				int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+				int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+				return era * 146097 + dayOfEra - 719468;
+			}
+
+			// the fields of a time stamp the periods are made of
+			struct Stamp
+			{
+				int year;
+				int month;
+				std::int64_t day;
+				int second;
+			};
+
+			void DecodeDate(std::uint64_t date, Stamp& stamp)
+			{
+				stamp.year = (int)(date >> 52);
+				stamp.month = (int)((date >> 48) & 15);
+				stamp.day = DaysFromCivil(stamp.year, stamp.month, (int)((date >> 43) & 31));
+			}
+
+			void DecodeTime(std::uint64_t date, Stamp& stamp)
+			{
+				int hour = (int)((date >> 38) & 31);
+				int minute = (int)((date >> 32) & 63);
+				int second = (int)((date >> 26) & 63);
+				stamp.second = hour > 23 ? SecondsPerDay - 1 : hour * 3600 + minute * 60 + second;
+			}
+
+			// number of the period of an interval a bar belongs to; consecutive bars with the same number form one compressed bar
+			std::int64_t PeriodOf(const Stamp& stamp, int interval)
+			{
+				switch (interval)
+				{
+				case IntervalDaily:
+					return stamp.day;
+				case IntervalWeekly:
+					// 1970-01-01 was a Thursday, weeks start on Monday
+					return FloorDivide(stamp.day + 3, 7);
+				case IntervalMonthly:
+					return stamp.year * 12 + stamp.month - 1;
+				case IntervalQuarterly:
+					return stamp.year * 4 + (stamp.month - 1) / 3;
+				case IntervalYearly:
+					return stamp.year;
+				default:
+					break;
+				}
+
+				if (interval < SecondsPerDay)
+				{
+					// intraday periods start at midnight, the last one of the day may be shorter
+					std::int64_t perDay = (SecondsPerDay + interval - 1) / interval;
+					return stamp.day * perDay + stamp.second / interval;
+				}
+				return FloorDivide(stamp.day * SecondsPerDay + stamp.second, interval);
+			}
+
+			// true if the period can change within a day; the others are worked out once per day, not once per bar
+			bool IsIntraday(int interval)
+			{
+				switch (interval)
+				{
+				case IntervalWeekly:
+				case IntervalMonthly:
+				case IntervalQuarterly:
+				case IntervalYearly:
+					return false;
+				default:
+					return interval % SecondsPerDay != 0;
+				}
+			}
+
+			// true if every period boundary of 'coarse' is one of 'fine' as well, so the coarse bars can be built from the fine ones
+			bool Nests(int fine, int coarse)
+			{
+				bool fineDays = !IsIntraday(fine) && fine % SecondsPerDay == 0;
+				bool coarseDays = !IsIntraday(coarse) && coarse % SecondsPerDay == 0;
+				if (fine < SecondsPerDay)
+					return coarse < SecondsPerDay ? coarse % fine == 0 : !IsIntraday(coarse);
+				if (fineDays)
+					return fine == IntervalDaily ? !IsIntraday(coarse) : coarseDays && coarse % fine == 0;
+				if (fine == IntervalMonthly)
+					return coarse == IntervalQuarterly || coarse == IntervalYearly;
+				if (fine == IntervalQuarterly)
+					return coarse == IntervalYearly;
+				return false;
+			}
+
+			// the forming bar of one interval; the volume is summed in double, a daily volume of minute bars
+			// is beyond the 24 bit mantissa of a float
+			struct Forming
+			{
+				std::int64_t period;
+				float open;
+				float high;
+				float low;
+				float close;
+				double volume;
+				bool hasVolume;
+
+				void Start(std::int64_t p)
+				{
+					period = p;
+					open = high = low = close = Null;
+					volume = 0.0;
+					hasVolume = false;
+				}
+
+				void Add(float o, float h, float l, float c, float v)
+				{
+					if (!IsNull(o) && IsNull(open))
+						open = o;
+					if (!IsNull(h) && (IsNull(high) || h > high))
+						high = h;
+					if (!IsNull(l) && (IsNull(low) || l < low))
+						low = l;
+					if (!IsNull(c))
+						close = c;
+					if (!IsNull(v))
+					{
+						volume += v;
+						hasVolume = true;
+					}
+				}
+
+				void Close(CompressedBars& bars, int last) const
+				{
+					bars.open.push_back(open);
+					bars.high.push_back(high);
+					bars.low.push_back(low);
+					bars.close.push_back(close);
+					bars.volume.push_back(hasVolume ? (float)volume : Null);
+					bars.lastBar.push_back(last);
+				}
+			};
+
+			float Field(const float* values, int i)
+			{
+				return values ? values[i] : Null;
+			}
+
+			// the intervals without a finer interval to build on, in one scan of the base bars
+			void CompressBase(const TimeFrameInput& input, const std::vector<int>& intervals, const std::vector<int>& levels,
+				CompressedBars* outputs)
+			{
+				int count = (int)levels.size();
+				std::vector<Forming> forming(count);
+				std::vector<std::int64_t> periods(count);
+
+				Stamp stamp;
+				std::uint64_t day = ~0ull;
+				for (int i = 0; i < input.length; i++)
+				{
+					// the time stamp is decoded once for all intervals, the date part only when the day changes
+					std::uint64_t date = input.dates[i];
+					bool newDay = (date >> 43) != day;
+					if (newDay)
+					{
+						DecodeDate(date, stamp);
+						day = date >> 43;
+					}
+					DecodeTime(date, stamp);
+
+					float o = Field(input.open, i), h = Field(input.high, i), l = Field(input.low, i);
+					float c = Field(input.close, i), v = Field(input.volume, i);
+					for (int k = 0; k < count; k++)
+					{
+						int interval = intervals[levels[k]];
+						if (newDay || IsIntraday(interval))
+							periods[k] = PeriodOf(stamp, interval);
+
+						if (i == 0)
+							forming[k].Start(periods[k]);
+						else if (periods[k] != forming[k].period)
+						{
+							forming[k].Close(outputs[levels[k]], i - 1);
+							forming[k].Start(periods[k]);
+						}
+						forming[k].Add(o, h, l, c, v);
+					}
+				}
+
+				if (input.length > 0)
+				{
+					for (int k = 0; k < count; k++)
+						forming[k].Close(outputs[levels[k]], input.length - 1);
+				}
+			}
+
+			// a coarse interval from the bars of a finer one that nests in it: the cost follows the number of fine bars
+			void CompressBars(const TimeFrameInput& input, const CompressedBars& fine, int interval, CompressedBars& output)
+			{
+				Forming forming;
+				Stamp stamp;
+				for (int p = 0; p < fine.Length(); p++)
+				{
+					std::uint64_t date = input.dates[fine.lastBar[p]];
+					DecodeDate(date, stamp);
+					DecodeTime(date, stamp);
+					std::int64_t period = PeriodOf(stamp, interval);
+
+					if (p == 0)
+						forming.Start(period);
+					else if (period != forming.period)
+					{
+						forming.Close(output, fine.lastBar[p - 1]);
+						forming.Start(period);
+					}
+					forming.Add(fine.open[p], fine.high[p], fine.low[p], fine.close[p], fine.volume[p]);
+				}
+
+				if (fine.Length() > 0)
+					forming.Close(output, fine.lastBar[fine.Length() - 1]);
+			}
+
+			// what the cached bars were compressed from: every bar of every column, so an edit of any price, volume
+			// or time stamp (quote editor, backfill, split adjustment) compresses the symbol again
+			struct Fingerprint
+			{
+				int length;
+				std::uint64_t dates;
+				std::uint64_t open;
+				std::uint64_t high;
+				std::uint64_t low;
+				std::uint64_t close;
+				std::uint64_t volume;
+
+				bool operator==(const Fingerprint& other) const
+				{
+					return std::tie(length, dates, open, high, low, close, volume) ==
+						std::tie(other.length, other.dates, other.open, other.high, other.low, other.close, other.volume);
+				}
+			};
+
+			// an absent column hashes to 0
+			std::uint64_t HashColumn(const float* column, int length)
+			{
+				return column ? HashArray(column, length) : 0;
+			}
+
+			Fingerprint FingerprintOf(const TimeFrameInput& input)
+			{
+				Fingerprint fingerprint;
+				fingerprint.length = input.length;
+				// the dates are hashed as pairs of floats (only the bits matter)
+				fingerprint.dates = HashColumn(reinterpret_cast<const float*>(input.dates), 2 * input.length);
+				fingerprint.open = HashColumn(input.open, input.length);
+				fingerprint.high = HashColumn(input.high, input.length);
+				fingerprint.low = HashColumn(input.low, input.length);
+				fingerprint.close = HashColumn(input.close, input.length);
+				fingerprint.volume = HashColumn(input.volume, input.length);
+				return fingerprint;
+			}
+
+			std::size_t BytesOf(const CompressedBars& bars)
+			{
+				return sizeof(CompressedBars) + (std::size_t)bars.Length() * (5 * sizeof(float) + sizeof(int));
+			}
+
+			typedef std::pair<std::string, int> EntryKey;
+
+			// each symbol has its own lock, so panes of different symbols do not wait for each other
+			struct Entry
+			{
+				explicit Entry(const EntryKey& key)
+					: key(key)
+				{
+				}
+
+				EntryKey key;
+				std::mutex lock;
+				bool valid = false;
+				Fingerprint fingerprint;
+				std::map<int, std::shared_ptr<const CompressedBars>> bars;
+				// guarded by the lock of the cache
+				std::size_t bytes = 0;
+			};
+
+			// most recently used symbols are at the front of the list (the policy of ResultCache). The bars of an evicted
+			// symbol stay alive while they are returned or read, they are only no longer found
+			struct Cache
+			{
+				std::mutex lock;
+				std::list<std::shared_ptr<Entry>> entries;
+				std::map<EntryKey, std::list<std::shared_ptr<Entry>>::iterator> index;
+				std::size_t bytes = 0;
+				std::size_t capacity = DefaultTimeFrameCapacity;
+
+				void Erase(std::map<EntryKey, std::list<std::shared_ptr<Entry>>::iterator>::iterator found)
+				{
+					bytes -= (*found->second)->bytes;
+					entries.erase(found->second);
+					index.erase(found);
+				}
+
+				void Evict(std::size_t limit)
+				{
+					while (bytes > limit && !entries.empty())
+						Erase(index.find(entries.back()->key));
+				}
+			};
+
+			Cache& SharedCache()
+			{
+				static Cache cache;
+				return cache;
+			}
+		}
+
+		std::int64_t DateTimeToSeconds(std::uint64_t date)
+		{
+			Stamp stamp;
+			DecodeDate(date, stamp);
+			DecodeTime(date, stamp);
+			return stamp.day * SecondsPerDay + stamp.second;
+		}
+
+		void CompressTimeFrames(const TimeFrameInput& input, const int* intervals, int count, CompressedBars* outputs)
+		{
+			std::vector<int> checked(count);
+			for (int k = 0; k < count; k++)
+			{
+				checked[k] = intervals[k] < 1 ? 1 : intervals[k];
+				CompressedBars& bars = outputs[k];
+				bars = CompressedBars();
+				bars.interval = intervals[k];
+			}
+
+			// each interval is built on the coarsest other interval that nests in it (5 minutes on 1 minute, daily on hourly,
+			// quarterly on monthly), the others on the base bars; a repeated interval is built on its first occurrence
+			std::vector<int> finer(count, -1);
+			for (int k = 0; k < count; k++)
+			{
+				for (int j = 0; j < count; j++)
+				{
+					bool candidate = checked[j] == checked[k] ? j < k : Nests(checked[j], checked[k]);
+					if (j != k && candidate && (finer[k] < 0 || Nests(checked[finer[k]], checked[j])))
+						finer[k] = j;
+				}
+			}
+
+			std::vector<int> roots;
+			for (int k = 0; k < count; k++)
+			{
+				if (finer[k] < 0)
+					roots.push_back(k);
+			}
+			CompressBase(input, checked, roots, outputs);
+
+			// the nesting is a partial order, so every round builds at least one more interval
+			std::vector<bool> done(count, false);
+			for (int k : roots)
+				done[k] = true;
+			for (bool progress = true; progress;)
+			{
+				progress = false;
+				for (int k = 0; k < count; k++)
+				{
+					if (!done[k] && done[finer[k]])
+					{
+						CompressBars(input, outputs[finer[k]], checked[k], outputs[k]);
+						done[k] = true;
+						progress = true;
+					}
+				}
+			}
+		}
+
+		void ExpandTimeFrame(const float* src, const CompressedBars& bars, float* dst, int length, ExpandMode mode)
+		{
+			int first = 0;
+			for (int k = 0; k < bars.Length() && first < length; k++)
+			{
+				int last = bars.lastBar[k] < length - 1 ? bars.lastBar[k] : length - 1;
+				float previous = k > 0 ? src[k - 1] : Null;
+				float before = mode == ExpandMode::Last ? previous : mode == ExpandMode::First ? src[k] : Null;
+
+				for (int i = first; i < last; i++)
+					dst[i] = before;
+				// the last base bar of the period is only complete if the compressed bar ends there
+				dst[last] = last == bars.lastBar[k] ? src[k] : before;
+				first = last + 1;
+			}
+
+			for (int i = first; i < length; i++)
+				dst[i] = Null;
+		}
+
+		std::vector<std::shared_ptr<const CompressedBars>> TimeFrameCompress(const std::string& symbol, int baseInterval,
+			const TimeFrameInput& input, const int* intervals, int count)
+		{
+			EntryKey key(symbol, baseInterval);
+			Cache& cache = SharedCache();
+			std::shared_ptr<Entry> entry;
+			{
+				std::lock_guard<std::mutex> guard(cache.lock);
+				auto found = cache.index.find(key);
+				if (found == cache.index.end())
+				{
+					entry = std::make_shared<Entry>(key);
+					cache.entries.push_front(entry);
+					cache.index.emplace(key, cache.entries.begin());
+				}
+				else
+				{
+					cache.entries.splice(cache.entries.begin(), cache.entries, found->second);
+					entry = *found->second;
+				}
+			}
+
+			std::vector<std::shared_ptr<const CompressedBars>> result;
+			std::size_t bytes = 0;
+			{
+				std::lock_guard<std::mutex> guard(entry->lock);
+
+				Fingerprint fingerprint = FingerprintOf(input);
+				if (!entry->valid || !(entry->fingerprint == fingerprint))
+				{
+					entry->bars.clear();
+					entry->fingerprint = fingerprint;
+					entry->valid = true;
+				}
+
+				// the intervals not cached yet, each once, compressed together
+				std::vector<int> missing;
+				for (int k = 0; k < count; k++)
+				{
+					if (entry->bars.find(intervals[k]) == entry->bars.end())
+					{
+						bool listed = false;
+						for (int interval : missing)
+							listed = listed || interval == intervals[k];
+						if (!listed)
+							missing.push_back(intervals[k]);
+					}
+				}
+
+				if (!missing.empty())
+				{
+					std::vector<CompressedBars> compressed(missing.size());
+					CompressTimeFrames(input, missing.data(), (int)missing.size(), compressed.data());
+					for (CompressedBars& bars : compressed)
+					{
+						int interval = bars.interval;
+						entry->bars[interval] = std::make_shared<const CompressedBars>(std::move(bars));
+					}
+				}
+
+				for (int k = 0; k < count; k++)
+					result.push_back(entry->bars[intervals[k]]);
+				for (const auto& bars : entry->bars)
+					bytes += BytesOf(*bars.second);
+			}
+
+			// account for the bars unless the symbol was dropped meanwhile; a symbol larger than the whole capacity is not kept
+			std::lock_guard<std::mutex> guard(cache.lock);
+			auto found = cache.index.find(key);
+			if (found != cache.index.end() && *found->second == entry)
+			{
+				cache.bytes += bytes - entry->bytes;
+				entry->bytes = bytes;
+				if (bytes > cache.capacity)
+					cache.Erase(found);
+				else
+					cache.Evict(cache.capacity);
+			}
+			return result;
+		}
+
+		void TimeFrameInvalidate(const std::string& symbol)
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+			for (auto it = cache.index.begin(); it != cache.index.end();)
+			{
+				auto next = std::next(it);
+				if (it->first.first == symbol)
+					cache.Erase(it);
+				it = next;
+			}
+		}
+
+		void TimeFrameSetCapacity(std::size_t bytes)
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+
+			cache.capacity = bytes;
+			cache.Evict(bytes);
+		}
+
+		std::size_t TimeFrameBytes()
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+			return cache.bytes;
+		}
+
+		void TimeFrameClear()
+		{
+			Cache& cache = SharedCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+			cache.entries.clear();
+			cache.index.clear();
+			cache.bytes = 0;
+		}
+	}
+}
@@ -0,0 +1,143 @@
+// TimeFrame.h : one-pass compression of bars to several time frames and expansion back to the base bars
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Time frames longer than a day, in the units of AFTimeFrame::Interval() (TFInterval).
+		/// Any other interval is a number of seconds; bars are grouped from midnight (e.g. 300 = 5 minutes, 3600 = hourly).
+		/// </summary>
+		const int IntervalDaily = 86400;
+		const int IntervalWeekly = 432001;
+		const int IntervalMonthly = 2160001;
+		const int IntervalQuarterly = 6480001;
+		const int IntervalYearly = 25920001;
+
+		/// <summary>
+		/// Packs a time stamp the way ATDateTime::Date stores it (year 12 bits, month 4, day 5, hour 5, minute 6, second 6,
+		/// then milliseconds, microseconds and flags in the low 26 bits).
+		/// </summary>
+		inline std::uint64_t MakeDateTime(int year, int month, int day, int hour = 0, int minute = 0, int second = 0)
+		{
+			return ((std::uint64_t)year << 52) | ((std::uint64_t)month << 48) | ((std::uint64_t)day << 43) |
+				((std::uint64_t)hour << 38) | ((std::uint64_t)minute << 32) | ((std::uint64_t)second << 26);
+		}
+
+		/// <summary>
+		/// Seconds since 1970-01-01 of an ATDateTime::Date time stamp. End of day bars (hour 31, the EOD marker
+		/// of AmiBroker) are the last second of their day.
+		/// </summary>
+		std::int64_t DateTimeToSeconds(std::uint64_t date);
+
+		/// <summary>
+		/// The base bars to compress: dates are ATDateTime::Date time stamps in ascending order,
+		/// any price array may be null (its compressed array is then all Null).
+		/// </summary>
+		struct TimeFrameInput
+		{
+			const std::uint64_t* dates;
+			const float* open;
+			const float* high;
+			const float* low;
+			const float* close;
+			const float* volume;
+			int length;
+		};
+
+		/// <summary>
+		/// Bars of one time frame: open is the first, high the highest, low the lowest and close the last value
+		/// of the base bars in the period that are not Null; volume is their sum. A period without values is Null.
+		/// lastBar is the last base bar of each compressed bar, the map between the two time frames.
+		/// </summary>
+		struct CompressedBars
+		{
+			int interval;
+			std::vector<float> open;
+			std::vector<float> high;
+			std::vector<float> low;
+			std::vector<float> close;
+			std::vector<float> volume;
+			std::vector<int> lastBar;
+
+			int Length() const { return (int)lastBar.size(); }
+		};
+
+		/// <summary>
+		/// Compresses the base bars to all 'count' intervals in a single scan of the base bars, so checking 5 minutes, hourly,
+		/// daily and weekly bars costs one pass instead of one TimeFrameSet per interval. Every time stamp is decoded once;
+		/// only the intervals that no other listed interval nests in are built from the base bars, the coarser ones are built
+		/// from the bars of the finer interval (hourly from 5 minutes, weekly from daily), with the same result.
+		/// </summary>
+		void CompressTimeFrames(const TimeFrameInput& input, const int* intervals, int count, CompressedBars* outputs);
+
+		/// <summary>
+		/// How a compressed array is mapped to the base bars (the modes of TimeFrameExpand).
+		/// - Last: a compressed bar is known from its last base bar on; the earlier bars of its period show the previous bar,
+		///   so nothing from the future leaks into a base bar. This is the one for signals.
+		/// - First: a compressed bar shows on all bars of its period, from the first one on (looks ahead, for display only).
+		/// - Point: a compressed bar shows on its last base bar only, Null elsewhere.
+		/// </summary>
+		enum class ExpandMode
+		{
+			Last = 0,
+			First = 1,
+			Point = 2
+		};
+
+		/// <summary>
+		/// Expands a compressed array (one value per bar of 'bars') to the 'length' base bars in O(length).
+		/// src may be any array calculated on the compressed bars, e.g. an average of bars.close.
+		/// </summary>
+		void ExpandTimeFrame(const float* src, const CompressedBars& bars, float* dst, int length, ExpandMode mode = ExpandMode::Last);
+
+		/// <summary>
+		/// CompressTimeFrames with a per symbol cache: the compressed bars of a symbol are kept with the base interval
+		/// and a fingerprint of the base bars (length and a hash of the dates and of each price and volume column), so the
+		/// panes, scans and explorations that follow reuse them. Only the intervals that are not cached yet are
+		/// compressed, all of them in one pass. When the base bars changed (new tick, new bar, another database)
+		/// the symbol is compressed again.
+		///
+		/// The cache is bounded by TimeFrameSetCapacity (bytes of compressed bars); the symbols used least recently
+		/// are dropped first, and bars larger than the whole capacity are returned without being kept.
+		///
+		/// Returns the bars in the order of 'intervals'; they are never modified, so they can be read while
+		/// another thread replaces them. Thread safe.
+		/// </summary>
+		std::vector<std::shared_ptr<const CompressedBars>> TimeFrameCompress(const std::string& symbol, int baseInterval,
+			const TimeFrameInput& input, const int* intervals, int count);
+
+		/// <summary>
+		/// Default memory bound of the cache in bytes.
+		/// </summary>
+		const std::size_t DefaultTimeFrameCapacity = 64 * 1024 * 1024;
+
+		/// <summary>
+		/// Sets the memory bound in bytes and drops the least recently used symbols until the cache fits in it.
+		/// </summary>
+		void TimeFrameSetCapacity(std::size_t bytes);
+
+		/// <summary>
+		/// Memory held by the cache in bytes.
+		/// </summary>
+		std::size_t TimeFrameBytes();
+
+		/// <summary>
+		/// Drops the cached bars of a symbol, e.g. after its quotes were edited.
+		/// </summary>
+		void TimeFrameInvalidate(const std::string& symbol);
+
+		/// <summary>
+		/// Drops the whole cache (e.g. when the database is changed).
+		/// </summary>
+		void TimeFrameClear();
+	}
+}
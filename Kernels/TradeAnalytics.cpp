@@ -0,0 +1,280 @@
+// TradeAnalytics.cpp : columnar trade list and portfolio trade metrics
+
+#include "TradeAnalytics.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			// trades per range of the parallel reductions
+			const int TradeGrain = 8192;
+
+			enum Side { AllTrades = 0, LongTrades = 1, ShortTrades = 2 };
+
+			struct Summary
+			{
+				int count = 0;
+				int winners = 0;
+				double sumPercent = 0.0;
+				double sumSqPercent = 0.0;
+				double grossProfit = 0.0;
+				double grossLoss = 0.0;
+				double sumBars = 0.0;
+				double sumMae = 0.0;
+				double sumMfe = 0.0;
+
+				void Add(const Summary& other)
+				{
+					count += other.count;
+					winners += other.winners;
+					sumPercent += other.sumPercent;
+					sumSqPercent += other.sumSqPercent;
+					grossProfit += other.grossProfit;
+					grossLoss += other.grossLoss;
+					sumBars += other.sumBars;
+					sumMae += other.sumMae;
+					sumMfe += other.sumMfe;
+				}
+			};
+
+			typedef std::array<Summary, 3> Summaries;
+
+			Summaries Summarize(const TradeColumns& trades, int begin, int end)
+			{
+				Summaries result;
+				for (int i = begin; i < end; i++)
+				{
+					double percent = trades.profitPercent[i];
+					double profit = trades.profit[i];
+
+					Summary& side = result[trades.isLong[i] ? LongTrades : ShortTrades];
+					side.count++;
+					side.winners += profit > 0.0 ? 1 : 0;
+					side.sumPercent += percent;
+					side.sumSqPercent += percent * percent;
+					side.grossProfit += profit > 0.0 ? profit : 0.0;
+					side.grossLoss += profit < 0.0 ? profit : 0.0;
+					side.sumBars += trades.barsInTrade[i];
+					side.sumMae += trades.mae[i];
+					side.sumMfe += trades.mfe[i];
+				}
+
+				result[AllTrades].Add(result[LongTrades]);
+				result[AllTrades].Add(result[ShortTrades]);
+				return result;
+			}
+
+			double Average(double sum, int count)
+			{
+				return count > 0 ? sum / count : 0.0;
+			}
+
+			double Sqn(const Summary& s)
+			{
+				if (s.count < 2)
+					return 0.0;
+
+				double mean = s.sumPercent / s.count;
+				double variance = (s.sumSqPercent - s.count * mean * mean) / (s.count - 1);
+				return variance > 0.0 ? std::sqrt((double)s.count) * mean / std::sqrt(variance) : 0.0;
+			}
+
+			// ulcer index of the equity compounded by the trades in list order;
+			// it is a running maximum, so it is one sequential pass
+			std::array<double, 3> UlcerIndex(const TradeColumns& trades)
+			{
+				double equity[3] = { 1.0, 1.0, 1.0 };
+				double peak[3] = { 1.0, 1.0, 1.0 };
+				double sumSq[3] = { 0.0, 0.0, 0.0 };
+				int count[3] = { 0, 0, 0 };
+
+				for (int i = 0; i < trades.Count(); i++)
+				{
+					double growth = 1.0 + trades.profitPercent[i] / 100.0;
+					int sides[2] = { AllTrades, trades.isLong[i] ? LongTrades : ShortTrades };
+					for (int side : sides)
+					{
+						equity[side] *= growth;
+						peak[side] = std::max(peak[side], equity[side]);
+						double drawdown = 100.0 * (equity[side] - peak[side]) / peak[side];
+						sumSq[side] += drawdown * drawdown;
+						count[side]++;
+					}
+				}
+
+				std::array<double, 3> result;
+				for (int side = 0; side < 3; side++)
+					result[side] = std::sqrt(Average(sumSq[side], count[side]));
+				return result;
+			}
+
+			// percentiles with linear interpolation between the closest ranks; values is reordered.
+			// Each rank is selected with nth_element in the range above the previous one instead of sorting all values.
+			std::vector<double> Percentiles(std::vector<double>& values, const std::vector<double>& percentiles)
+			{
+				std::vector<double> result(percentiles.size(), 0.0);
+				if (values.empty())
+					return result;
+
+				std::vector<size_t> order(percentiles.size());
+				for (size_t k = 0; k < order.size(); k++)
+					order[k] = k;
+				std::sort(order.begin(), order.end(), [&percentiles](size_t a, size_t b) { return percentiles[a] < percentiles[b]; });
+
+				size_t done = 0;
+				for (size_t k : order)
+				{
+					double rank = std::min(std::max(percentiles[k], 0.0), 100.0) / 100.0 * (values.size() - 1);
+					size_t below = (size_t)rank;
+
+					std::nth_element(values.begin() + std::min(done, below), values.begin() + below, values.end());
+					done = below + 1;
+
+					double low = values[below];
+					double high = below + 1 < values.size() ? *std::min_element(values.begin() + below + 1, values.end()) : low;
+					result[k] = low + (rank - below) * (high - low);
+				}
+				return result;
+			}
+
+			TradeMetricValue Metric(const std::string& name, double all, double longOnly, double shortOnly, int decimals)
+			{
+				TradeMetricValue value;
+				value.name = name;
+				value.all = all;
+				value.longOnly = longOnly;
+				value.shortOnly = shortOnly;
+				value.decimals = decimals;
+				return value;
+			}
+		}
+
+		void TradeColumns::Reserve(int count)
+		{
+			profit.reserve(count);
+			profitPercent.reserve(count);
+			barsInTrade.reserve(count);
+			entryPrice.reserve(count);
+			exitPrice.reserve(count);
+			mae.reserve(count);
+			mfe.reserve(count);
+			isLong.reserve(count);
+			isOpen.reserve(count);
+		}
+
+		void TradeColumns::Add(double profit, double profitPercent, int barsInTrade, float entryPrice, float exitPrice, float mae, float mfe, bool isLong, bool isOpen)
+		{
+			this->profit.push_back(profit);
+			this->profitPercent.push_back(profitPercent);
+			this->barsInTrade.push_back(barsInTrade);
+			this->entryPrice.push_back(entryPrice);
+			this->exitPrice.push_back(exitPrice);
+			this->mae.push_back(mae);
+			this->mfe.push_back(mfe);
+			this->isLong.push_back(isLong ? 1 : 0);
+			this->isOpen.push_back(isOpen ? 1 : 0);
+		}
+
+		void TradeColumns::Clear()
+		{
+			profit.clear();
+			profitPercent.clear();
+			barsInTrade.clear();
+			entryPrice.clear();
+			exitPrice.clear();
+			mae.clear();
+			mfe.clear();
+			isLong.clear();
+			isOpen.clear();
+		}
+
+		std::vector<double> DefaultTradePercentiles()
+		{
+			return std::vector<double>{ 5.0, 25.0, 50.0, 75.0, 95.0 };
+		}
+
+		std::vector<TradeMetricValue> CalculateTradeMetrics(const TradeColumns& trades, TradeMetrics metrics, const std::vector<double>& percentiles)
+		{
+			Summaries s = ParallelReduce(trades.Count(), TradeGrain, Summaries(),
+				[&trades](int begin, int end) { return Summarize(trades, begin, end); },
+				[](Summaries a, const Summaries& b)
+				{
+					for (int side = 0; side < 3; side++)
+						a[side].Add(b[side]);
+					return a;
+				});
+
+			const Summary& all = s[AllTrades];
+			const Summary& lng = s[LongTrades];
+			const Summary& shrt = s[ShortTrades];
+
+			std::vector<TradeMetricValue> result;
+
+			if (HasMetric(metrics, TradeMetrics::Expectancy))
+			{
+				result.push_back(Metric("Expectancy %", Average(all.sumPercent, all.count), Average(lng.sumPercent, lng.count), Average(shrt.sumPercent, shrt.count), 4));
+				result.push_back(Metric("Winners %", 100.0 * Average(all.winners, all.count), 100.0 * Average(lng.winners, lng.count), 100.0 * Average(shrt.winners, shrt.count), 2));
+			}
+
+			if (HasMetric(metrics, TradeMetrics::ProfitFactor))
+			{
+				auto factor = [](const Summary& side) { return side.grossLoss < 0.0 ? side.grossProfit / -side.grossLoss : 0.0; };
+				result.push_back(Metric("Profit factor", factor(all), factor(lng), factor(shrt), 2));
+			}
+
+			if (HasMetric(metrics, TradeMetrics::Sqn))
+				result.push_back(Metric("SQN", Sqn(all), Sqn(lng), Sqn(shrt), 2));
+
+			if (HasMetric(metrics, TradeMetrics::UlcerIndex))
+			{
+				std::array<double, 3> ulcer = UlcerIndex(trades);
+				result.push_back(Metric("Trade ulcer index", ulcer[AllTrades], ulcer[LongTrades], ulcer[ShortTrades], 2));
+			}
+
+			if (HasMetric(metrics, TradeMetrics::Percentiles))
+			{
+				std::vector<double> returns[3];
+				for (int side = 0; side < 3; side++)
+					returns[side].reserve(s[side].count);
+				for (int i = 0; i < trades.Count(); i++)
+				{
+					returns[AllTrades].push_back(trades.profitPercent[i]);
+					returns[trades.isLong[i] ? LongTrades : ShortTrades].push_back(trades.profitPercent[i]);
+				}
+
+				std::vector<double> values[3];
+				ParallelFor(3, 1, [&returns, &values, &percentiles](int begin, int end)
+				{
+					for (int side = begin; side < end; side++)
+						values[side] = Percentiles(returns[side], percentiles);
+				});
+
+				for (size_t k = 0; k < percentiles.size(); k++)
+				{
+					char name[32];
+					std::snprintf(name, sizeof(name), "P%g profit %%", percentiles[k]);
+					result.push_back(Metric(name, values[AllTrades][k], values[LongTrades][k], values[ShortTrades][k], 2));
+				}
+			}
+
+			if (HasMetric(metrics, TradeMetrics::Excursions))
+			{
+				result.push_back(Metric("Avg. MAE %", Average(all.sumMae, all.count), Average(lng.sumMae, lng.count), Average(shrt.sumMae, shrt.count), 2));
+				result.push_back(Metric("Avg. MFE %", Average(all.sumMfe, all.count), Average(lng.sumMfe, lng.count), Average(shrt.sumMfe, shrt.count), 2));
+			}
+
+			if (HasMetric(metrics, TradeMetrics::BarsHeld))
+				result.push_back(Metric("Avg. bars held", Average(all.sumBars, all.count), Average(lng.sumBars, lng.count), Average(shrt.sumBars, shrt.count), 1));
+
+			return result;
+		}
+	}
+}
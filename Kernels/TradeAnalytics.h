@@ -0,0 +1,84 @@
+// TradeAnalytics.h : columnar trade list and portfolio trade metrics
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Closed and open trades of a backtest copied once into columns.
+		/// The metrics read only the columns they need, and each column is contiguous, which keeps the reductions vectorizable.
+		/// </summary>
+		struct TradeColumns
+		{
+			std::vector<double> profit;
+			std::vector<double> profitPercent;
+			std::vector<int> barsInTrade;
+			std::vector<float> entryPrice;
+			std::vector<float> exitPrice;
+			std::vector<float> mae;
+			std::vector<float> mfe;
+			std::vector<unsigned char> isLong;
+			std::vector<unsigned char> isOpen;
+
+			void Reserve(int count);
+			void Add(double profit, double profitPercent, int barsInTrade, float entryPrice, float exitPrice, float mae, float mfe, bool isLong, bool isOpen);
+			void Clear();
+			int Count() const { return (int)profit.size(); }
+		};
+
+		/// <summary>
+		/// Metrics calculated by CalculateTradeMetrics. Combine them with |.
+		/// </summary>
+		enum class TradeMetrics : unsigned
+		{
+			None = 0,
+			Expectancy = 1 << 0,		// average profit % and winners %
+			ProfitFactor = 1 << 1,		// gross profit / gross loss
+			Sqn = 1 << 2,				// system quality number: sqrt(N) * average / standard deviation of profit %
+			UlcerIndex = 1 << 3,		// ulcer index of the equity compounded trade by trade
+			Percentiles = 1 << 4,		// percentiles of profit %
+			Excursions = 1 << 5,		// average MAE % and MFE %
+			BarsHeld = 1 << 6,			// average bars in trade
+			All = (1 << 7) - 1
+		};
+
+		inline TradeMetrics operator|(TradeMetrics a, TradeMetrics b)
+		{
+			return (TradeMetrics)((unsigned)a | (unsigned)b);
+		}
+
+		inline bool HasMetric(TradeMetrics set, TradeMetrics metric)
+		{
+			return ((unsigned)set & (unsigned)metric) != 0;
+		}
+
+		/// <summary>
+		/// One metric for all trades, long trades only and short trades only (the arguments of Backtester::AddCustomMetric).
+		/// </summary>
+		struct TradeMetricValue
+		{
+			std::string name;
+			double all;
+			double longOnly;
+			double shortOnly;
+			int decimals;
+		};
+
+		/// <summary>
+		/// Calculates the selected metrics of the trades in the order of the TradeMetrics flags.
+		/// The sums are parallel reductions over the columns (see ParallelReduce), the percentiles select from a copy of profit %.
+		/// Metrics that are undefined for the trades (e.g. profit factor without losers) are 0.
+		/// </summary>
+		std::vector<TradeMetricValue> CalculateTradeMetrics(const TradeColumns& trades, TradeMetrics metrics, const std::vector<double>& percentiles);
+
+		/// <summary>
+		/// Percentiles reported when the caller does not choose: 5, 25, 50, 75 and 95.
+		/// </summary>
+		std::vector<double> DefaultTradePercentiles();
+	}
+}
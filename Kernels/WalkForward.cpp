@@ -0,0 +1,137 @@
+// WalkForward.cpp : walk-forward test of the MA/EMA crossover system
+
+#include "WalkForward.h"
+#include "Null.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		namespace
+		{
+			const long long EmaCacheBytes = 256ll << 20;
+
+			std::vector<WalkForwardWindow> Windows(int length, const WalkForwardSettings& settings)
+			{
+				std::vector<WalkForwardWindow> windows;
+				if (settings.inSample < 1 || settings.outOfSample < 1)
+					return windows;
+
+				int step = settings.step > 0 ? settings.step : settings.outOfSample;
+				for (int isEnd = settings.inSample; isEnd < length; isEnd += step)
+				{
+					WalkForwardWindow window = {};
+					window.inSampleBegin = settings.anchored ? 0 : isEnd - settings.inSample;
+					window.inSampleEnd = isEnd;
+					window.outOfSampleBegin = isEnd;
+					window.outOfSampleEnd = std::min(isEnd + settings.outOfSample, length);
+					windows.push_back(window);
+				}
+				return windows;
+			}
+		}
+
+		WalkForwardReport WalkForward(CrossoverSystem& system, const WalkForwardSettings& settings)
+		{
+			WalkForwardReport report = {};
+			int length = system.Length();
+			report.windows = Windows(length, settings);
+			if (report.windows.empty())
+				return report;
+
+			// every window starts its indicators at bar 0, so one EMA per fast period serves all of them
+			const OptimizationSettings& grid = settings.optimization;
+			std::vector<int> fastPeriods;
+			for (int fast = std::max(grid.fastMin, 1); fast <= grid.fastMax; fast += std::max(grid.fastStep, 1))
+			{
+				if ((long long)(fastPeriods.size() + 1) * length * sizeof(float) > EmaCacheBytes)
+					break;
+				fastPeriods.push_back(fast);
+			}
+			system.CacheEma(fastPeriods);
+
+			int count = (int)report.windows.size();
+			std::vector<int> evaluations(count);
+			std::vector<std::vector<float>> curves(count);
+			auto run = [&](int first, int last)
+			{
+				for (int w = first; w < last; w++)
+				{
+					WalkForwardWindow& window = report.windows[w];
+					OptimizationSettings optimization = grid;
+					optimization.begin = window.inSampleBegin;
+					optimization.end = window.inSampleEnd;
+
+					OptimizationReport optimized = Optimize(system, optimization);
+					evaluations[w] = optimized.evaluations;
+					curves[w].assign(window.outOfSampleEnd - window.outOfSampleBegin, 1.0f);
+					if (optimized.results.empty())
+						continue;
+
+					window.inSample = optimized.results[0];
+					window.outOfSample = system.EvaluateEquity(window.inSample.fast, window.inSample.slow,
+						window.outOfSampleBegin, window.outOfSampleEnd, curves[w].data());
+				}
+			};
+			if (count >= Parallelism())
+				ParallelFor(count, 1, run);
+			else
+				run(0, count);
+
+			// each window chained to the previous one until the next one starts; flat in the gaps between them
+			report.equity.assign(length, Null);
+			double carry = 1.0, peak = 1.0, drawdown = 0.0, wins = 0.0;
+			int i = report.windows[0].outOfSampleBegin;
+			for (int w = 0; w < count; w++)
+			{
+				const WalkForwardWindow& window = report.windows[w];
+				int end = w + 1 < count ? std::min(window.outOfSampleEnd, report.windows[w + 1].outOfSampleBegin) : window.outOfSampleEnd;
+				for (; i < window.outOfSampleBegin; i++)
+					report.equity[i] = (float)carry;
+
+				double value = carry;
+				for (; i < end; i++)
+				{
+					value = carry * curves[w][i - window.outOfSampleBegin];
+					report.equity[i] = (float)value;
+					peak = std::max(peak, value);
+					drawdown = std::max(drawdown, 1.0 - value / peak);
+				}
+				carry = value;
+
+				report.trades += window.outOfSample.trades;
+				wins += window.outOfSample.winRate * window.outOfSample.trades / 100.0;
+				report.evaluations += evaluations[w];
+			}
+
+			report.netProfit = (carry - 1.0) * 100.0;
+			report.winRate = report.trades > 0 ? 100.0 * wins / report.trades : 0.0;
+			report.maxDrawdown = drawdown * 100.0;
+			return report;
+		}
+
+		std::string WalkForwardTable(const WalkForwardReport& report)
+		{
+			std::string table = "Window     In sample  Out of sample  Fast  Slow     IS score     IS net %    OOS net %  Trades   Win %  Max DD %\n";
+			char line[200];
+			for (int k = 0; k < (int)report.windows.size(); k++)
+			{
+				const WalkForwardWindow& w = report.windows[k];
+				std::snprintf(line, sizeof(line), "%6d  %12s  %13s  %4d  %4d  %11.6g  %11.6g  %11.6g  %6d  %6.1f  %8.2f\n", k + 1,
+					(std::to_string(w.inSampleBegin) + "-" + std::to_string(w.inSampleEnd - 1)).c_str(),
+					(std::to_string(w.outOfSampleBegin) + "-" + std::to_string(w.outOfSampleEnd - 1)).c_str(),
+					w.inSample.fast, w.inSample.slow, w.inSample.score, w.inSample.netProfit,
+					w.outOfSample.netProfit, w.outOfSample.trades, w.outOfSample.winRate, w.outOfSample.maxDrawdown);
+				table += line;
+			}
+			std::snprintf(line, sizeof(line), "Out of sample: net profit %.6g %%, %d trades, win %.1f %%, max drawdown %.2f %% (bar by bar)\n",
+				report.netProfit, report.trades, report.winRate, report.maxDrawdown);
+			table += line;
+			return table;
+		}
+	}
+}
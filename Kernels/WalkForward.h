@@ -0,0 +1,72 @@
+// WalkForward.h : walk-forward test of the MA/EMA crossover system
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Optimizer.h"
+
+namespace AmiBroker
+{
+	namespace Kernels
+	{
+		/// <summary>
+		/// Window layout and optimization of a walk-forward test.
+		/// The first in-sample window starts at bar 0; each out-of-sample window follows its in-sample window and the windows
+		/// move forward by 'step' bars (0: the out-of-sample length, so the out-of-sample windows follow each other).
+		/// Anchored windows all start at bar 0 and grow by 'step'. The last out-of-sample window may be shorter.
+		/// optimization.begin and optimization.end are set per window.
+		/// </summary>
+		struct WalkForwardSettings
+		{
+			OptimizationSettings optimization;
+			int inSample = 0;
+			int outOfSample = 0;
+			int step = 0;
+			bool anchored = false;
+		};
+
+		/// <summary>
+		/// One step of the walk: the best combination of the in-sample bars and its trades on the out-of-sample bars.
+		/// Trades still open at the end of a window are closed at its last close.
+		/// </summary>
+		struct WalkForwardWindow
+		{
+			int inSampleBegin;
+			int inSampleEnd;
+			int outOfSampleBegin;
+			int outOfSampleEnd;
+			// the best result of the in-sample optimization; its periods are traded out of sample
+			CrossoverResult inSample;
+			CrossoverResult outOfSample;
+		};
+
+		struct WalkForwardReport
+		{
+			std::vector<WalkForwardWindow> windows;
+			// the out-of-sample equity of every bar, the windows chained: 1 at the start of the first out-of-sample window,
+			// Null before it. Overlapping out-of-sample windows (step < outOfSample) are followed until the next one starts.
+			std::vector<float> equity;
+			// the totals of the out-of-sample windows; the profit and the drawdown are those of the stitched equity
+			double netProfit;
+			int trades;
+			double winRate;
+			double maxDrawdown;
+			int evaluations;
+		};
+
+		/// <summary>
+		/// Optimizes the system on each in-sample window and trades the best periods on the following out-of-sample window.
+		/// The windows share the prefix sums of the system, and the EMA of every fast period of the grid is calculated once
+		/// for the whole history (CacheEma, within 256 MB) instead of once per window. The windows are optimized in parallel
+		/// when there are at least as many as threads; otherwise one after the other, each on all threads.
+		/// Returns no windows if the sizes are not positive or the history is shorter than one in-sample window.
+		/// </summary>
+		WalkForwardReport WalkForward(CrossoverSystem& system, const WalkForwardSettings& settings);
+
+		/// <summary>
+		/// The windows of the report as a text table, one line per window, and the totals.
+		/// </summary>
+		std::string WalkForwardTable(const WalkForwardReport& report);
+	}
+}
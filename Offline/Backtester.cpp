@@ -0,0 +1,448 @@
+// Backtester.cpp : offline stand-in of AmiBroker's portfolio backtester objects
+
+#include "Backtester.h"
+#include "Kernels/Null.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace AmiBroker
+{
+	namespace Offline
+	{
+		using Kernels::IsNull;
+
+		const char* const Stats::InitialCapital = "InitialCapital";
+		const char* const Stats::EndingCapital = "EndingCapital";
+		const char* const Stats::NetProfit = "NetProfit";
+		const char* const Stats::NetProfitPercent = "NetProfitPercent";
+		const char* const Stats::AllQty = "AllQty";
+		const char* const Stats::AllAvgProfitLoss = "AllAvgProfitLoss";
+		const char* const Stats::AllAvgProfitLossPercent = "AllAvgProfitLossPercent";
+		const char* const Stats::AllAvgBarsHeld = "AllAvgBarsHeld";
+		const char* const Stats::WinnersQty = "WinnersQty";
+		const char* const Stats::WinnersPercent = "WinnersPercent";
+		const char* const Stats::WinnersTotalProfit = "WinnersTotalProfit";
+		const char* const Stats::WinnersAvgProfit = "WinnersAvgProfit";
+		const char* const Stats::WinnersAvgProfitPercent = "WinnersAvgProfitPercent";
+		const char* const Stats::LosersQty = "LosersQty";
+		const char* const Stats::LosersPercent = "LosersPercent";
+		const char* const Stats::LosersTotalLoss = "LosersTotalLoss";
+		const char* const Stats::LosersAvgLoss = "LosersAvgLoss";
+		const char* const Stats::LosersAvgLossPercent = "LosersAvgLossPercent";
+		const char* const Stats::MaxSystemDrawdown = "MaxSystemDrawdown";
+		const char* const Stats::MaxSystemDrawdownPercent = "MaxSystemDrawdownPercent";
+		const char* const Stats::ProfitFactor = "ProfitFactor";
+
+		double Trade::GetProfit() const
+		{
+			double move = IsLong ? ExitPrice - EntryPrice : EntryPrice - ExitPrice;
+			return move * Shares;
+		}
+
+		double Trade::GetPercentProfit() const
+		{
+			return EntryPrice != 0.0f ? 100.0 * GetProfit() / GetEntryValue() : 0.0;
+		}
+
+		float Trade::GetMAE() const
+		{
+			float worst = IsLong ? lowest - EntryPrice : EntryPrice - highest;
+			return 100.0f * worst / EntryPrice;
+		}
+
+		float Trade::GetMFE() const
+		{
+			float best = IsLong ? highest - EntryPrice : EntryPrice - lowest;
+			return 100.0f * best / EntryPrice;
+		}
+
+		float Stats::GetValue(const std::string& name) const
+		{
+			for (const auto& value : values)
+			{
+				if (value.first == name)
+					return value.second;
+			}
+			return 0.0f;
+		}
+
+		Backtester::Backtester(const std::vector<SymbolData>& symbols, std::vector<SymbolSignals> signals,
+			const BacktestSettings& settings, int referenceSymbol)
+			: Cash(settings.initialEquity), Equity(settings.initialEquity), InitialEquity(settings.initialEquity),
+			symbols(symbols), signals(std::move(signals)), settings(settings), signalCursor(0), tradeCursor(0), openCursor(0)
+		{
+			if (!symbols.empty())
+			{
+				const SymbolData& reference = symbols[referenceSymbol];
+				dates.assign(reference.dates, reference.dates + reference.length);
+			}
+
+			// map each symbol to the portfolio bars: the last bar at or before the portfolio date, -1 before the first bar
+			barMaps.resize(symbols.size());
+			for (size_t s = 0; s < symbols.size(); s++)
+			{
+				const SymbolData& symbol = symbols[s];
+				if (symbol.length == BarCount() && std::equal(dates.begin(), dates.end(), symbol.dates))
+					continue;
+
+				std::vector<int>& map = barMaps[s];
+				map.resize(dates.size());
+				int source = 0;
+				for (int bar = 0; bar < BarCount(); bar++)
+				{
+					while (source < symbol.length && symbol.dates[source] <= dates[bar])
+						source++;
+					map[bar] = source - 1;
+				}
+			}
+		}
+
+		float Backtester::Quote(const float* column, int symbol, int bar) const
+		{
+			const std::vector<int>& map = barMaps[symbol];
+			int index = map.empty() ? bar : map[bar];
+			return index >= 0 ? column[index] : Kernels::Null;
+		}
+
+		template <class Visit>
+		void Backtester::ForEachSignal(Visit visit) const
+		{
+			for (size_t s = 0; s < symbols.size(); s++)
+			{
+				const SymbolSignals& symbol = signals[s];
+				const std::vector<int>& map = barMaps[s];
+
+				struct Column { const std::vector<unsigned char>* flags; SignalType type; };
+				Column columns[4] = {
+					{ &symbol.sell, SignalType::Sell },
+					{ &symbol.cover, SignalType::Cover },
+					{ &symbol.buy, SignalType::Buy },
+					{ &symbol.shrt, SignalType::Short } };
+
+				for (const Column& column : columns)
+				{
+					const unsigned char* flags = column.flags->data();
+					int length = (int)column.flags->size();
+
+					// same dates: signals are sparse, so skip 8 flags at a time while they are all zero
+					if (map.empty())
+					{
+						int count = std::min(length, BarCount());
+						for (int bar = 0; bar < count; bar++)
+						{
+							std::uint64_t word;
+							if (bar + 8 <= count && (std::memcpy(&word, flags + bar, 8), word == 0))
+							{
+								bar += 7;
+								continue;
+							}
+							if (flags[bar])
+								visit((int)s, bar, bar, column.type);
+						}
+						continue;
+					}
+
+					for (int bar = 0; bar < BarCount(); bar++)
+					{
+						int index = map[bar];
+						// a symbol bar maps to the first portfolio bar at its date only
+						if (index < 0 || index >= length || !flags[index] || (bar > 0 && map[bar - 1] == index))
+							continue;
+						visit((int)s, bar, index, column.type);
+					}
+				}
+			}
+		}
+
+		void Backtester::PreProcess()
+		{
+			Cash = Equity = InitialEquity;
+			EquityArray.assign(dates.size(), (float)InitialEquity);
+			closed.clear();
+			open.clear();
+			openBySymbol.assign(symbols.size(), -1);
+			customMetrics.clear();
+
+			// group the signals of all symbols by bar: count them, then fill the bars in place
+			barOffsets.assign(dates.size() + 1, 0);
+			ForEachSignal([&](int, int bar, int, SignalType) { barOffsets[bar + 1]++; });
+			for (size_t bar = 0; bar < dates.size(); bar++)
+				barOffsets[bar + 1] += barOffsets[bar];
+
+			barSignals.resize(barOffsets.back());
+			std::vector<int> next(barOffsets.begin(), barOffsets.end() - 1);
+			ForEachSignal([&](int s, int bar, int index, SignalType type)
+			{
+				const SymbolSignals& symbol = signals[s];
+				const std::vector<float>& prices = type == SignalType::Buy ? symbol.buyPrice :
+					type == SignalType::Sell ? symbol.sellPrice : type == SignalType::Short ? symbol.shortPrice : symbol.coverPrice;
+
+				Signal& signal = barSignals[next[bar]++];
+				signal.Price = prices[index];
+				signal.PosSize = symbol.positionSize;
+				signal.PosScore = symbol.positionScore;
+				signal.Type = type;
+				signal.Symbol = symbols[s].symbol;
+				signal.symbolIndex = s;
+			});
+
+			// exits first, then entries by decreasing score; bars have few signals, so an insertion sort
+			auto before = [](const Signal& a, const Signal& b)
+			{
+				if (a.IsEntry() != b.IsEntry())
+					return !a.IsEntry();
+				return a.PosScore > b.PosScore;
+			};
+			for (size_t bar = 0; bar < dates.size(); bar++)
+			{
+				for (int i = barOffsets[bar] + 1; i < barOffsets[bar + 1]; i++)
+				{
+					for (int j = i; j > barOffsets[bar] && before(barSignals[j], barSignals[j - 1]); j--)
+						std::swap(barSignals[j], barSignals[j - 1]);
+				}
+			}
+		}
+
+		Signal* Backtester::GetFirstSignal(int bar)
+		{
+			signalCursor = barOffsets[bar];
+			return signalCursor < barOffsets[bar + 1] ? &barSignals[signalCursor] : nullptr;
+		}
+
+		Signal* Backtester::GetNextSignal(int bar)
+		{
+			signalCursor++;
+			return signalCursor < barOffsets[bar + 1] ? &barSignals[signalCursor] : nullptr;
+		}
+
+		void Backtester::Exit(Signal& signal, int bar)
+		{
+			int position = openBySymbol[signal.symbolIndex];
+			if (position < 0 || open[position].IsLong != signal.IsLong() || IsNull(signal.Price))
+				return;
+
+			Trade trade = open[position];
+			trade.IsOpen = false;
+			trade.ExitPrice = signal.Price;
+			trade.BarsInTrade = bar - trade.entryBar + 1;
+			trade.lowest = std::min(trade.lowest, signal.Price);
+			trade.highest = std::max(trade.highest, signal.Price);
+			Cash += trade.GetPositionValue();
+			closed.push_back(trade);
+
+			// remove from the open positions by moving the last one into its place
+			openBySymbol[signal.symbolIndex] = -1;
+			if (position != (int)open.size() - 1)
+			{
+				open[position] = open.back();
+				openBySymbol[open[position].symbolIndex] = position;
+			}
+			open.pop_back();
+		}
+
+		void Backtester::Enter(Signal& signal, int bar)
+		{
+			if (openBySymbol[signal.symbolIndex] >= 0 || (int)open.size() >= settings.maxOpenPositions || IsNull(signal.Price) || signal.Price <= 0.0f)
+				return;
+
+			double value = signal.PosSize > 0.0f ? signal.PosSize : (signal.PosSize >= -100.0f ? -signal.PosSize / 100.0 * Equity : 0.0);
+			value = std::min(value, Cash);
+			float shares = (float)std::floor(value / signal.Price);
+			if (shares < 1.0f)
+				return;
+
+			Trade trade;
+			trade.Symbol = signal.Symbol;
+			trade.IsLong = signal.IsLong();
+			trade.IsOpen = true;
+			trade.EntryPrice = signal.Price;
+			trade.ExitPrice = signal.Price;
+			trade.BarsInTrade = 1;
+			trade.Shares = shares;
+			trade.symbolIndex = signal.symbolIndex;
+			trade.entryBar = bar;
+			trade.lowest = signal.Price;
+			trade.highest = signal.Price;
+
+			Cash -= trade.GetEntryValue();
+			openBySymbol[signal.symbolIndex] = (int)open.size();
+			open.push_back(trade);
+		}
+
+		void Backtester::MarkToMarket(int bar)
+		{
+			double equity = Cash;
+			for (Trade& trade : open)
+			{
+				const SymbolData& symbol = symbols[trade.symbolIndex];
+				float close = Quote(symbol.close, trade.symbolIndex, bar);
+				float high = Quote(symbol.high, trade.symbolIndex, bar);
+				float low = Quote(symbol.low, trade.symbolIndex, bar);
+
+				if (!IsNull(close))
+					trade.ExitPrice = close;
+				if (!IsNull(high))
+					trade.highest = std::max(trade.highest, high);
+				if (!IsNull(low))
+					trade.lowest = std::min(trade.lowest, low);
+				trade.BarsInTrade = bar - trade.entryBar + 1;
+
+				equity += trade.GetPositionValue();
+			}
+
+			Equity = equity;
+			EquityArray[bar] = (float)equity;
+		}
+
+		bool Backtester::ProcessTradeSignals(int bar)
+		{
+			for (int i = barOffsets[bar]; i < barOffsets[bar + 1]; i++)
+			{
+				Signal& signal = barSignals[i];
+				if (signal.IsExit())
+					Exit(signal, bar);
+				else
+					Enter(signal, bar);
+			}
+
+			MarkToMarket(bar);
+			return true;
+		}
+
+		void Backtester::PostProcess()
+		{
+			for (int type = 0; type < 3; type++)
+			{
+				double totalProfit = 0.0, totalPercent = 0.0, totalBars = 0.0;
+				double winProfit = 0.0, winPercent = 0.0, lossProfit = 0.0, lossPercent = 0.0;
+				int count = 0, winners = 0, losers = 0;
+
+				auto add = [&](const Trade& trade)
+				{
+					if ((type == (int)StatType::LongsOnly && !trade.IsLong) || (type == (int)StatType::ShortOnly && trade.IsLong))
+						return;
+
+					double profit = trade.GetProfit();
+					double percent = trade.GetPercentProfit();
+					count++;
+					totalProfit += profit;
+					totalPercent += percent;
+					totalBars += trade.BarsInTrade;
+					if (profit > 0.0)
+					{
+						winners++;
+						winProfit += profit;
+						winPercent += percent;
+					}
+					else
+					{
+						losers++;
+						lossProfit += profit;
+						lossPercent += percent;
+					}
+				};
+				for (const Trade& trade : closed)
+					add(trade);
+				for (const Trade& trade : open)
+					add(trade);
+
+				double peak = InitialEquity, maxDrawdown = 0.0, maxDrawdownPercent = 0.0;
+				for (float equity : EquityArray)
+				{
+					peak = std::max(peak, (double)equity);
+					maxDrawdown = std::min(maxDrawdown, equity - peak);
+					maxDrawdownPercent = std::min(maxDrawdownPercent, 100.0 * (equity - peak) / peak);
+				}
+
+				auto average = [](double sum, int n) { return n > 0 ? sum / n : 0.0; };
+
+				std::vector<std::pair<std::string, float>>& values = stats[type].values;
+				values.clear();
+				values.emplace_back(Stats::InitialCapital, (float)InitialEquity);
+				values.emplace_back(Stats::EndingCapital, (float)Equity);
+				values.emplace_back(Stats::NetProfit, (float)(Equity - InitialEquity));
+				values.emplace_back(Stats::NetProfitPercent, (float)(100.0 * (Equity - InitialEquity) / InitialEquity));
+				values.emplace_back(Stats::AllQty, (float)count);
+				values.emplace_back(Stats::AllAvgProfitLoss, (float)average(totalProfit, count));
+				values.emplace_back(Stats::AllAvgProfitLossPercent, (float)average(totalPercent, count));
+				values.emplace_back(Stats::AllAvgBarsHeld, (float)average(totalBars, count));
+				values.emplace_back(Stats::WinnersQty, (float)winners);
+				values.emplace_back(Stats::WinnersPercent, (float)(100.0 * average(winners, count)));
+				values.emplace_back(Stats::WinnersTotalProfit, (float)winProfit);
+				values.emplace_back(Stats::WinnersAvgProfit, (float)average(winProfit, winners));
+				values.emplace_back(Stats::WinnersAvgProfitPercent, (float)average(winPercent, winners));
+				values.emplace_back(Stats::LosersQty, (float)losers);
+				values.emplace_back(Stats::LosersPercent, (float)(100.0 * average(losers, count)));
+				values.emplace_back(Stats::LosersTotalLoss, (float)lossProfit);
+				values.emplace_back(Stats::LosersAvgLoss, (float)average(lossProfit, losers));
+				values.emplace_back(Stats::LosersAvgLossPercent, (float)average(lossPercent, losers));
+				values.emplace_back(Stats::MaxSystemDrawdown, (float)maxDrawdown);
+				values.emplace_back(Stats::MaxSystemDrawdownPercent, (float)maxDrawdownPercent);
+				values.emplace_back(Stats::ProfitFactor, (float)(lossProfit < 0.0 ? winProfit / -lossProfit : 0.0));
+			}
+		}
+
+		bool Backtester::Backtest()
+		{
+			PreProcess();
+			for (int bar = 0; bar < BarCount(); bar++)
+				ProcessTradeSignals(bar);
+			PostProcess();
+			return true;
+		}
+
+		Trade* Backtester::GetFirstTrade()
+		{
+			tradeCursor = 0;
+			return tradeCursor < closed.size() ? &closed[tradeCursor] : nullptr;
+		}
+
+		Trade* Backtester::GetNextTrade()
+		{
+			tradeCursor++;
+			return tradeCursor < closed.size() ? &closed[tradeCursor] : nullptr;
+		}
+
+		Trade* Backtester::GetFirstOpenPos()
+		{
+			openCursor = 0;
+			return openCursor < open.size() ? &open[openCursor] : nullptr;
+		}
+
+		Trade* Backtester::GetNextOpenPos()
+		{
+			openCursor++;
+			return openCursor < open.size() ? &open[openCursor] : nullptr;
+		}
+
+		Trade* Backtester::FindOpenPos(std::string_view symbol)
+		{
+			for (Trade& trade : open)
+			{
+				if (trade.Symbol == symbol)
+					return &trade;
+			}
+			return nullptr;
+		}
+
+		Stats* Backtester::GetPerformanceStats(StatType type)
+		{
+			return &stats[(int)type];
+		}
+
+		bool Backtester::AddCustomMetric(const std::string& name, float value, float longOnly, float shortOnly, float decimals)
+		{
+			CustomMetric metric;
+			metric.name = name;
+			metric.value = value;
+			metric.longOnly = longOnly;
+			metric.shortOnly = shortOnly;
+			metric.decimals = (int)decimals;
+			customMetrics.push_back(metric);
+			return true;
+		}
+	}
+}
@@ -0,0 +1,227 @@
+// Backtester.h : offline stand-in of AmiBroker's portfolio backtester objects
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Quotes.h"
+
+namespace AmiBroker
+{
+	namespace Offline
+	{
+		// The classes below mirror the members of AmiBroker's Backtester, Signal, Trade and Stats objects
+		// that the custom backtest samples use, with the same names, so a custom backtest procedure
+		// can be compiled natively against them, run on any OS and profiled without AmiBroker.
+		// Properties of the .NET objects are public fields here: sig->Price = ... compiles in both.
+
+		enum class SignalType
+		{
+			Buy,
+			Sell,
+			Short,
+			Cover
+		};
+
+		enum class StatType
+		{
+			All,
+			LongsOnly,
+			ShortOnly
+		};
+
+		/// <summary>
+		/// Trade signals of one symbol: the Buy, Sell, Short and Cover arrays and their prices
+		/// (the result of the per-symbol phase of a backtest).
+		/// </summary>
+		struct SymbolSignals
+		{
+			std::vector<unsigned char> buy;
+			std::vector<unsigned char> sell;
+			std::vector<unsigned char> shrt;
+			std::vector<unsigned char> cover;
+			std::vector<float> buyPrice;
+			std::vector<float> sellPrice;
+			std::vector<float> shortPrice;
+			std::vector<float> coverPrice;
+
+			// SetPositionSize: positive values are amounts of money, -100..0 percents of the equity
+			float positionSize = -10.0f;
+			float positionScore = 1.0f;
+		};
+
+		class Signal
+		{
+		public:
+			float Price;
+			float PosSize;
+			float PosScore;
+			SignalType Type;
+			std::string_view Symbol;	// points into the symbol names of the backtester
+
+			bool IsEntry() const { return Type == SignalType::Buy || Type == SignalType::Short; }
+			bool IsExit() const { return !IsEntry(); }
+			bool IsLong() const { return Type == SignalType::Buy || Type == SignalType::Sell; }
+			bool IsScale() const { return false; }
+
+			int symbolIndex;
+		};
+
+		class Trade
+		{
+		public:
+			std::string_view Symbol;
+			bool IsLong;
+			bool IsOpen;
+			float EntryPrice;
+			float ExitPrice;
+			int BarsInTrade;
+			float Shares;
+
+			double GetProfit() const;
+			double GetPercentProfit() const;
+			double GetEntryValue() const { return (double)Shares * EntryPrice; }
+			double GetPositionValue() const { return GetEntryValue() + GetProfit(); }
+
+			// maximum adverse and favorable excursion in percent of the entry price
+			float GetMAE() const;
+			float GetMFE() const;
+
+			int symbolIndex;
+			int entryBar;
+			float lowest;
+			float highest;
+		};
+
+		/// <summary>
+		/// Backtest statistics. The names are the ones of AmiBroker's Stats object.
+		/// </summary>
+		class Stats
+		{
+		public:
+			static const char* const InitialCapital;
+			static const char* const EndingCapital;
+			static const char* const NetProfit;
+			static const char* const NetProfitPercent;
+			static const char* const AllQty;
+			static const char* const AllAvgProfitLoss;
+			static const char* const AllAvgProfitLossPercent;
+			static const char* const AllAvgBarsHeld;
+			static const char* const WinnersQty;
+			static const char* const WinnersPercent;
+			static const char* const WinnersTotalProfit;
+			static const char* const WinnersAvgProfit;
+			static const char* const WinnersAvgProfitPercent;
+			static const char* const LosersQty;
+			static const char* const LosersPercent;
+			static const char* const LosersTotalLoss;
+			static const char* const LosersAvgLoss;
+			static const char* const LosersAvgLossPercent;
+			static const char* const MaxSystemDrawdown;
+			static const char* const MaxSystemDrawdownPercent;
+			static const char* const ProfitFactor;
+
+			/// <summary>
+			/// Returns the value of a statistic or 0 for unknown names.
+			/// </summary>
+			float GetValue(const std::string& name) const;
+
+			std::vector<std::pair<std::string, float>> values;
+		};
+
+		struct CustomMetric
+		{
+			std::string name;
+			float value;
+			float longOnly;
+			float shortOnly;
+			int decimals;
+		};
+
+		struct BacktestSettings
+		{
+			double initialEquity = 100000.0;
+			int maxOpenPositions = 10;
+		};
+
+		/// <summary>
+		/// Offline portfolio backtester. The bars of the portfolio are the dates of the reference symbol
+		/// (AmiBroker's pad and align); the other symbols are mapped to them by date.
+		/// Exits are processed before entries on each bar, entries in decreasing position score order;
+		/// each symbol has at most one open position.
+		///
+		/// Signals are stored per bar in one flat array, so a bar costs O(signals + open positions)
+		/// whatever the number of symbols.
+		/// </summary>
+		class Backtester
+		{
+		public:
+			/// <summary>
+			/// The backtester keeps its own copy of the symbols and the signals; move the signals in when they are not needed afterwards.
+			/// </summary>
+			Backtester(const std::vector<SymbolData>& symbols, std::vector<SymbolSignals> signals,
+				const BacktestSettings& settings = BacktestSettings(), int referenceSymbol = 0);
+
+			int BarCount() const { return (int)dates.size(); }
+			const std::vector<std::uint64_t>& DateTime() const { return dates; }
+
+			void PreProcess();
+			bool ProcessTradeSignals(int bar);
+			void PostProcess();
+
+			/// <summary>
+			/// Runs PreProcess, ProcessTradeSignals for all bars and PostProcess.
+			/// </summary>
+			bool Backtest();
+
+			Signal* GetFirstSignal(int bar);
+			Signal* GetNextSignal(int bar);
+
+			Trade* GetFirstTrade();
+			Trade* GetNextTrade();
+			Trade* GetFirstOpenPos();
+			Trade* GetNextOpenPos();
+			Trade* FindOpenPos(std::string_view symbol);
+			int GetOpenPosQty() const { return (int)open.size(); }
+
+			Stats* GetPerformanceStats(StatType type);
+
+			bool AddCustomMetric(const std::string& name, float value, float longOnly = 0.0f, float shortOnly = 0.0f, float decimals = 2.0f);
+			const std::vector<CustomMetric>& CustomMetrics() const { return customMetrics; }
+
+			double Cash;
+			double Equity;
+			double InitialEquity;
+			std::vector<float> EquityArray;
+
+		private:
+			float Quote(const float* column, int symbol, int bar) const;
+			template <class Visit>
+			void ForEachSignal(Visit visit) const;
+			void Enter(Signal& signal, int bar);
+			void Exit(Signal& signal, int bar);
+			void MarkToMarket(int bar);
+
+			std::vector<SymbolData> symbols;
+			std::vector<SymbolSignals> signals;
+			BacktestSettings settings;
+			std::vector<std::uint64_t> dates;
+			std::vector<std::vector<int>> barMaps;	// portfolio bar -> symbol bar, empty if the dates are the same
+
+			std::vector<Signal> barSignals;
+			std::vector<int> barOffsets;
+			int signalCursor;
+
+			std::vector<Trade> closed;
+			std::vector<Trade> open;
+			std::vector<int> openBySymbol;
+			size_t tradeCursor;
+			size_t openCursor;
+
+			Stats stats[3];
+			std::vector<CustomMetric> customMetrics;
+		};
+	}
+}
@@ -0,0 +1,251 @@
+// ColumnStore.cpp : memory mapped column-per-field OHLCV store of many symbols
+
+#include "ColumnStore.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace AmiBroker
+{
+	namespace Offline
+	{
+		namespace
+		{
+			const char StoreMagic[8] = { 'A', 'B', 'C', 'O', 'L', 'S', 'T', 'R' };
+			const std::uint32_t StoreVersion = 1;
+			const std::uint64_t SectionAlignment = 64;
+
+			std::uint64_t Align(std::uint64_t offset)
+			{
+				return (offset + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+			}
+
+			void Pad(std::ofstream& file, std::uint64_t& offset)
+			{
+				static const char zeros[SectionAlignment] = {};
+				std::uint64_t aligned = Align(offset);
+				file.write(zeros, (std::streamsize)(aligned - offset));
+				offset = aligned;
+			}
+
+			template <class T>
+			void Write(std::ofstream& file, std::uint64_t& offset, const T* values, std::uint64_t count)
+			{
+				file.write(reinterpret_cast<const char*>(values), (std::streamsize)(count * sizeof(T)));
+				offset += count * sizeof(T);
+			}
+
+			const float* SymbolData::* const FieldMembers[5] = { &SymbolData::open, &SymbolData::high, &SymbolData::low, &SymbolData::close, &SymbolData::volume };
+		}
+
+		ColumnStore::ColumnStore(const std::string& path)
+			: data(nullptr), size(0), header(nullptr), index(nullptr), names(nullptr), file(nullptr), mapping(nullptr)
+		{
+			Map(path);
+
+			header = reinterpret_cast<const ColumnStoreHeader*>(data);
+			if (size < sizeof(ColumnStoreHeader) || std::memcmp(header->magic, StoreMagic, 8) != 0 || header->version != StoreVersion)
+			{
+				Unmap();
+				throw std::runtime_error(path + " is not a column store file.");
+			}
+
+			// every section must be inside the file before any pointer into it is handed out
+			std::uint64_t indexEnd = header->indexOffset + (std::uint64_t)header->symbolCount * sizeof(ColumnStoreEntry);
+			bool valid = indexEnd <= size && header->namesOffset <= size &&
+				header->dateOffset + header->barCount * sizeof(std::uint64_t) <= size;
+			for (std::uint64_t offset : header->fieldOffsets)
+				valid = valid && offset + header->barCount * sizeof(float) <= size;
+
+			index = reinterpret_cast<const ColumnStoreEntry*>(data + header->indexOffset);
+			names = reinterpret_cast<const char*>(data + header->namesOffset);
+			for (std::uint32_t s = 0; valid && s < header->symbolCount; s++)
+			{
+				valid = index[s].first + index[s].length <= header->barCount &&
+					header->namesOffset + index[s].nameOffset < size &&
+					std::memchr(names + index[s].nameOffset, 0, (size_t)(size - header->namesOffset - index[s].nameOffset)) != nullptr;
+			}
+
+			if (!valid)
+			{
+				Unmap();
+				throw std::runtime_error(path + " is truncated or corrupt.");
+			}
+		}
+
+		ColumnStore::~ColumnStore()
+		{
+			Unmap();
+		}
+
+#ifdef _WIN32
+		void ColumnStore::Map(const std::string& path)
+		{
+			HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (handle == INVALID_HANDLE_VALUE)
+				throw std::runtime_error("Cannot open " + path);
+
+			LARGE_INTEGER length;
+			HANDLE view = nullptr;
+			if (GetFileSizeEx(handle, &length) && length.QuadPart > 0)
+				view = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			const void* address = view != nullptr ? MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0) : nullptr;
+			if (address == nullptr)
+			{
+				if (view != nullptr)
+					CloseHandle(view);
+				CloseHandle(handle);
+				throw std::runtime_error("Cannot map " + path);
+			}
+
+			file = handle;
+			mapping = view;
+			data = static_cast<const unsigned char*>(address);
+			size = (std::uint64_t)length.QuadPart;
+		}
+
+		void ColumnStore::Unmap()
+		{
+			if (data != nullptr)
+				UnmapViewOfFile(data);
+			if (mapping != nullptr)
+				CloseHandle(mapping);
+			if (file != nullptr)
+				CloseHandle(file);
+			data = nullptr;
+			mapping = file = nullptr;
+		}
+#else
+		void ColumnStore::Map(const std::string& path)
+		{
+			int descriptor = open(path.c_str(), O_RDONLY);
+			if (descriptor < 0)
+				throw std::runtime_error("Cannot open " + path);
+
+			struct stat status;
+			void* address = MAP_FAILED;
+			if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+				address = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+			close(descriptor);	// the mapping keeps the file open
+			if (address == MAP_FAILED)
+				throw std::runtime_error("Cannot map " + path);
+
+			data = static_cast<const unsigned char*>(address);
+			size = (std::uint64_t)status.st_size;
+		}
+
+		void ColumnStore::Unmap()
+		{
+			if (data != nullptr)
+				munmap(const_cast<unsigned char*>(data), (size_t)size);
+			data = nullptr;
+		}
+#endif
+
+		int ColumnStore::Find(std::string_view symbol) const
+		{
+			for (int s = 0; s < SymbolCount(); s++)
+			{
+				if (SymbolName(s) == symbol)
+					return s;
+			}
+			return -1;
+		}
+
+		std::string_view ColumnStore::SymbolName(int symbol) const
+		{
+			return std::string_view(names + index[symbol].nameOffset);
+		}
+
+		const std::uint64_t* ColumnStore::DateTime(int symbol) const
+		{
+			return reinterpret_cast<const std::uint64_t*>(data + header->dateOffset) + index[symbol].first;
+		}
+
+		const float* ColumnStore::GetStockArray(int symbol, StockField field) const
+		{
+			return reinterpret_cast<const float*>(data + header->fieldOffsets[(int)field]) + index[symbol].first;
+		}
+
+		SymbolData ColumnStore::View(int symbol) const
+		{
+			SymbolData view;
+			view.symbol = std::string(SymbolName(symbol));
+			view.dates = DateTime(symbol);
+			view.open = GetStockArray(symbol, StockField::Open);
+			view.high = GetStockArray(symbol, StockField::High);
+			view.low = GetStockArray(symbol, StockField::Low);
+			view.close = GetStockArray(symbol, StockField::Close);
+			view.volume = GetStockArray(symbol, StockField::Volume);
+			view.length = Length(symbol);
+			return view;
+		}
+
+		void WriteColumnStore(const std::string& path, const std::vector<SymbolData>& symbols)
+		{
+			std::ofstream file(path, std::ios::binary);
+			if (!file)
+				throw std::runtime_error("Cannot create " + path);
+
+			ColumnStoreHeader header = {};
+			std::memcpy(header.magic, StoreMagic, 8);
+			header.version = StoreVersion;
+			header.symbolCount = (std::uint32_t)symbols.size();
+
+			std::vector<ColumnStoreEntry> index(symbols.size());
+			std::uint32_t namesSize = 0;
+			for (size_t s = 0; s < symbols.size(); s++)
+			{
+				index[s].first = header.barCount;
+				index[s].length = (std::uint32_t)symbols[s].length;
+				index[s].nameOffset = namesSize;
+				header.barCount += (std::uint64_t)symbols[s].length;
+				namesSize += (std::uint32_t)symbols[s].symbol.size() + 1;
+			}
+
+			// the offsets only depend on the sizes, so the header is written first
+			header.indexOffset = Align(sizeof(ColumnStoreHeader));
+			header.namesOffset = Align(header.indexOffset + index.size() * sizeof(ColumnStoreEntry));
+			header.dateOffset = Align(header.namesOffset + namesSize);
+			std::uint64_t next = Align(header.dateOffset + header.barCount * sizeof(std::uint64_t));
+			for (std::uint64_t& offset : header.fieldOffsets)
+			{
+				offset = next;
+				next = Align(offset + header.barCount * sizeof(float));
+			}
+
+			std::uint64_t offset = 0;
+			Write(file, offset, &header, 1);
+			Pad(file, offset);
+			Write(file, offset, index.data(), index.size());
+			Pad(file, offset);
+			for (const SymbolData& symbol : symbols)
+				Write(file, offset, symbol.symbol.c_str(), symbol.symbol.size() + 1);
+			Pad(file, offset);
+			for (const SymbolData& symbol : symbols)
+				Write(file, offset, symbol.dates, (std::uint64_t)symbol.length);
+			for (const float* SymbolData::* field : FieldMembers)
+			{
+				Pad(file, offset);
+				for (const SymbolData& symbol : symbols)
+					Write(file, offset, symbol.*field, (std::uint64_t)symbol.length);
+			}
+			Pad(file, offset);
+
+			if (!file)
+				throw std::runtime_error("Cannot write " + path);
+		}
+	}
+}
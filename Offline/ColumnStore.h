@@ -0,0 +1,108 @@
+// ColumnStore.h : memory mapped column-per-field OHLCV store of many symbols
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Quotes.h"
+
+namespace AmiBroker
+{
+	namespace Offline
+	{
+		// File layout (little endian, every section 64 byte aligned):
+		//   ColumnStoreHeader
+		//   index: one ColumnStoreEntry per symbol, in the order they were written
+		//   names: the symbol names, each followed by a zero byte
+		//   columns: dates (uint64), open, high, low, close, volume (float32)
+		// Each column holds the bars of all symbols back to back; a symbol is the range
+		// [first, first + length) of every column, so a field of a symbol is one contiguous array.
+
+		/// <summary>
+		/// Price fields of a symbol, as ABHost::GetStockArray names them.
+		/// </summary>
+		enum class StockField
+		{
+			Open,
+			High,
+			Low,
+			Close,
+			Volume
+		};
+
+		struct ColumnStoreHeader
+		{
+			char magic[8];
+			std::uint32_t version;
+			std::uint32_t symbolCount;
+			std::uint64_t barCount;
+			std::uint64_t indexOffset;
+			std::uint64_t namesOffset;
+			std::uint64_t dateOffset;
+			std::uint64_t fieldOffsets[5];	// by StockField
+		};
+
+		struct ColumnStoreEntry
+		{
+			std::uint64_t first;
+			std::uint32_t length;
+			std::uint32_t nameOffset;	// from namesOffset
+		};
+
+		/// <summary>
+		/// Read-only view of a column store file. The file is memory mapped: opening it costs no parsing or copying
+		/// whatever its size, and the arrays returned point into the mapping, so they are valid while the store is open.
+		/// Pages are read on first access and are shared by all processes mapping the same file.
+		/// </summary>
+		class ColumnStore
+		{
+		public:
+			/// <summary>
+			/// Maps the file. Throws std::runtime_error if it cannot be opened or is not a valid column store.
+			/// </summary>
+			explicit ColumnStore(const std::string& path);
+			~ColumnStore();
+
+			ColumnStore(const ColumnStore&) = delete;
+			ColumnStore& operator=(const ColumnStore&) = delete;
+
+			int SymbolCount() const { return (int)header->symbolCount; }
+			std::uint64_t BarCount() const { return header->barCount; }
+
+			/// <summary>
+			/// Returns the index of a symbol or -1 if it is not in the store.
+			/// </summary>
+			int Find(std::string_view symbol) const;
+			std::string_view SymbolName(int symbol) const;
+			int Length(int symbol) const { return (int)index[symbol].length; }
+
+			const std::uint64_t* DateTime(int symbol) const;
+			const float* GetStockArray(int symbol, StockField field) const;
+
+			/// <summary>
+			/// All columns of a symbol without copying them.
+			/// </summary>
+			SymbolData View(int symbol) const;
+
+		private:
+			void Map(const std::string& path);
+			void Unmap();
+
+			const unsigned char* data;
+			std::uint64_t size;
+			const ColumnStoreHeader* header;
+			const ColumnStoreEntry* index;
+			const char* names;
+			void* file;
+			void* mapping;
+		};
+
+		/// <summary>
+		/// Writes the quotes of the symbols to a column store file, one column at a time.
+		/// Throws std::runtime_error if the file cannot be written.
+		/// </summary>
+		void WriteColumnStore(const std::string& path, const std::vector<SymbolData>& symbols);
+	}
+}
@@ -0,0 +1,294 @@
+// OfflineBacktest.cpp : runs the sample custom backtest procedures on quotes from files, without AmiBroker
+//
+// Usage: OfflineBacktest [options] <quotes.csv | quotes.bin | quotes.abcol>...
+//   --procedure metrics|slippage|expectancy   custom backtest to run (default metrics: BasicSampleVC7)
+//   --slippage <model> <amount>               slippage model (0..3, see Kernels\Slippage.h) and amount of the slippage procedure
+//   --max-positions <count>                   maximum number of open positions (default 10)
+//   --synthetic <symbols> <bars>              generates random walk quotes instead of loading files
+//   --save <quotes.bin | quotes.abcol>        saves the quotes in the binary format or as a column store, which load much faster than CSV
+//   --optimize grid|random|halving            optimizes the periods of the crossover system per symbol instead of the backtest
+//                                             (fast 2..40, slow 5..200 step 5; see Kernels\Optimizer.h) and prints the best ten
+//   --walk-forward <in-sample> <out-of-sample> walk-forward test of the same optimization per symbol instead of the backtest
+//                                             (see Kernels\WalkForward.h); --optimize selects the method (default grid)
+// The name of a CSV file without its extension is the symbol. Column stores (see OfflineConvert) are memory mapped
+// and used in place; the other formats are loaded into memory.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Backtester.h"
+#include "ColumnStore.h"
+#include "Quotes.h"
+#include "SampleProcedures.h"
+#include "Benchmarks/SyntheticBars.h"
+#include "Kernels/Optimizer.h"
+#include "Kernels/WalkForward.h"
+
+using namespace AmiBroker;
+using namespace AmiBroker::Offline;
+
+namespace
+{
+	class Stopwatch
+	{
+	public:
+		Stopwatch() : start(std::chrono::steady_clock::now()) {}
+
+		double Milliseconds() const
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+	private:
+		std::chrono::steady_clock::time_point start;
+	};
+
+	// one-minute bars from 2000-01-01, with 28 day months so the packing stays simple
+	std::vector<SymbolQuotes> MakeSyntheticQuotes(int symbolCount, int barCount)
+	{
+		std::vector<std::uint64_t> dates(barCount);
+		for (int i = 0; i < barCount; i++)
+		{
+			int day = i / 1440;
+			dates[i] = PackDateTime(2000 + day / 336, 1 + day / 28 % 12, 1 + day % 28, i / 60 % 24, i % 60);
+		}
+
+		std::vector<SymbolQuotes> quotes(symbolCount);
+		for (int s = 0; s < symbolCount; s++)
+		{
+			Benchmarks::Bars bars = Benchmarks::MakeBars(barCount, 20100101u + s);
+			SymbolQuotes& symbol = quotes[s];
+			symbol.symbol = "SYM" + std::to_string(s);
+			symbol.dates = dates;
+			symbol.open = std::move(bars.open);
+			symbol.high = std::move(bars.high);
+			symbol.low = std::move(bars.low);
+			symbol.close = std::move(bars.close);
+			symbol.volume = std::move(bars.volume);
+		}
+		return quotes;
+	}
+
+	std::string SymbolName(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+		size_t dot = name.find_last_of('.');
+		return dot == std::string::npos ? name : name.substr(0, dot);
+	}
+
+	bool EndsWith(const std::string& text, const char* suffix)
+	{
+		size_t length = std::strlen(suffix);
+		return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+	}
+
+	int Usage()
+	{
+		std::fprintf(stderr, "Usage: OfflineBacktest [--procedure metrics|slippage|expectancy] [--slippage <model> <amount>]\n"
+			"                       [--max-positions <count>] [--synthetic <symbols> <bars>] [--save <quotes.bin>]\n"
+			"                       [--optimize grid|random|halving] [--walk-forward <in-sample> <out-of-sample>]\n"
+			"                       <quotes.csv|quotes.bin|quotes.abcol>...\n");
+		return 2;
+	}
+
+	bool ParseMethod(const std::string& name, Kernels::OptimizationMethod& method)
+	{
+		if (name == "grid")
+			method = Kernels::OptimizationMethod::Grid;
+		else if (name == "random")
+			method = Kernels::OptimizationMethod::Random;
+		else if (name == "halving")
+			method = Kernels::OptimizationMethod::SuccessiveHalving;
+		else
+			return false;
+		return true;
+	}
+
+	// the symbols one after the other, each optimized on all cores
+	void Optimize(const std::vector<SymbolData>& symbols, const Kernels::OptimizationSettings& settings)
+	{
+		for (const SymbolData& symbol : symbols)
+		{
+			Stopwatch optimizing;
+			Kernels::CrossoverInputs inputs = { symbol.open, symbol.high, symbol.low, symbol.close, symbol.length };
+			Kernels::CrossoverSystem system(inputs);
+			Kernels::OptimizationReport report = Kernels::Optimize(system, settings);
+
+			std::printf("\n%s: %d combinations on %d bars in %.1f ms\n%s", symbol.symbol.c_str(), report.evaluations, symbol.length,
+				optimizing.Milliseconds(), Kernels::OptimizationTable(report.results, 10).c_str());
+		}
+	}
+
+	void WalkForward(const std::vector<SymbolData>& symbols, const Kernels::WalkForwardSettings& settings)
+	{
+		for (const SymbolData& symbol : symbols)
+		{
+			Stopwatch walking;
+			Kernels::CrossoverInputs inputs = { symbol.open, symbol.high, symbol.low, symbol.close, symbol.length };
+			Kernels::CrossoverSystem system(inputs);
+			Kernels::WalkForwardReport report = Kernels::WalkForward(system, settings);
+
+			std::printf("\n%s: %d windows, %d combinations on %d bars in %.1f ms\n%s", symbol.symbol.c_str(), (int)report.windows.size(),
+				report.evaluations, symbol.length, walking.Milliseconds(), Kernels::WalkForwardTable(report).c_str());
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::string procedure = "metrics";
+	std::string savePath;
+	bool optimize = false;
+	Kernels::OptimizationSettings optimization;
+	Kernels::WalkForwardSettings walkForward;
+	int syntheticSymbols = 0, syntheticBars = 0;
+	BacktestSettings settings;
+	Kernels::SlippageSettings slippage;
+	slippage.model = Kernels::SlippageModel::Percent;
+	slippage.longAmount = slippage.shortAmount = 0.05f;
+	std::vector<std::string> paths;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--procedure" && i + 1 < argc)
+			procedure = argv[++i];
+		else if (arg == "--slippage" && i + 2 < argc)
+		{
+			slippage.model = (Kernels::SlippageModel)std::atoi(argv[++i]);
+			slippage.longAmount = slippage.shortAmount = (float)std::atof(argv[++i]);
+		}
+		else if (arg == "--max-positions" && i + 1 < argc)
+			settings.maxOpenPositions = std::atoi(argv[++i]);
+		else if (arg == "--synthetic" && i + 2 < argc)
+		{
+			syntheticSymbols = std::atoi(argv[++i]);
+			syntheticBars = std::atoi(argv[++i]);
+		}
+		else if (arg == "--save" && i + 1 < argc)
+			savePath = argv[++i];
+		else if (arg == "--optimize" && i + 1 < argc)
+		{
+			if (!ParseMethod(argv[++i], optimization.method))
+				return Usage();
+			optimize = true;
+		}
+		else if (arg == "--walk-forward" && i + 2 < argc)
+		{
+			walkForward.inSample = std::atoi(argv[++i]);
+			walkForward.outOfSample = std::atoi(argv[++i]);
+			if (walkForward.inSample < 1 || walkForward.outOfSample < 1)
+				return Usage();
+		}
+		else if (arg.compare(0, 2, "--") == 0)
+			return Usage();
+		else
+			paths.push_back(arg);
+	}
+
+	if (paths.empty() && syntheticSymbols <= 0)
+		return Usage();
+	if (slippage.model == Kernels::SlippageModel::FixedTick)
+		slippage.tickSize = 0.01f;
+
+	try
+	{
+		Stopwatch loading;
+		std::vector<SymbolQuotes> quotes = MakeSyntheticQuotes(syntheticSymbols, syntheticBars);
+		std::vector<std::unique_ptr<ColumnStore>> stores;
+		for (const std::string& path : paths)
+		{
+			if (EndsWith(path, ".abcol"))
+				stores.push_back(std::make_unique<ColumnStore>(path));
+			else if (EndsWith(path, ".bin"))
+			{
+				std::vector<SymbolQuotes> loaded = LoadBinary(path);
+				for (SymbolQuotes& symbol : loaded)
+					quotes.push_back(std::move(symbol));
+			}
+			else
+				quotes.push_back(LoadCsv(path, SymbolName(path)));
+		}
+
+		long long totalBars = 0;
+		std::vector<SymbolData> symbols;
+		for (const SymbolQuotes& symbol : quotes)
+		{
+			symbols.push_back(symbol.View());
+			totalBars += symbol.Length();
+		}
+		for (const std::unique_ptr<ColumnStore>& store : stores)
+		{
+			for (int s = 0; s < store->SymbolCount(); s++)
+				symbols.push_back(store->View(s));
+			totalBars += (long long)store->BarCount();
+		}
+		std::printf("Loaded %d symbols, %lld bars in %.1f ms\n", (int)symbols.size(), totalBars, loading.Milliseconds());
+
+		if (!savePath.empty())
+		{
+			if (EndsWith(savePath, ".abcol"))
+				WriteColumnStore(savePath, symbols);
+			else
+				SaveBinary(savePath, quotes);
+		}
+
+		if (walkForward.inSample > 0)
+		{
+			walkForward.optimization = optimization;
+			WalkForward(symbols, walkForward);
+			return 0;
+		}
+		if (optimize)
+		{
+			Optimize(symbols, optimization);
+			return 0;
+		}
+
+		Stopwatch signalling;
+		std::vector<SymbolSignals> signals = CrossoverSignals(symbols);
+		std::printf("Signals calculated in %.1f ms\n", signalling.Milliseconds());
+
+		Stopwatch backtesting;
+		Backtester bo(symbols, std::move(signals), settings);
+		if (procedure == "metrics")
+			TradeMetricsProcedure(bo);
+		else if (procedure == "slippage")
+			SlippageProcedure(bo, symbols, slippage);
+		else if (procedure == "expectancy")
+			ExpectancyProcedure(bo);
+		else
+			return Usage();
+		double elapsed = backtesting.Milliseconds();
+		std::printf("Backtest of %d bars in %.1f ms (%.1f ns/symbol bar)\n\n", bo.BarCount(), elapsed,
+			totalBars > 0 ? elapsed * 1e6 / totalBars : 0.0);
+
+		Stats* st = bo.GetPerformanceStats(StatType::All);
+		for (const auto& value : st->values)
+			std::printf("%-28s %14.2f\n", value.first.c_str(), value.second);
+
+		if (!bo.CustomMetrics().empty())
+		{
+			std::printf("\n%-28s %14s %14s %14s\n", "Custom metric", "All", "Long", "Short");
+			for (const CustomMetric& metric : bo.CustomMetrics())
+			{
+				std::printf("%-28s %14.*f %14.*f %14.*f\n", metric.name.c_str(), metric.decimals, metric.value,
+					metric.decimals, metric.longOnly, metric.decimals, metric.shortOnly);
+			}
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, "Error while running the offline backtest: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,81 @@
+// OfflineConvert.cpp : converts CSV, AmiBroker ASCII export and binary quotes into a memory mapped column store
+//
+// Usage: OfflineConvert <output.abcol> [--amibroker <export.txt>] <quotes.csv | quotes.bin>...
+//   --amibroker <file>   AmiBroker ASCII export of many symbols: Ticker,Date[,Time],Open,High,Low,Close[,Volume]
+// The name of a CSV file without its extension is the symbol.
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <vector>
+#include "ColumnStore.h"
+#include "Quotes.h"
+
+using namespace AmiBroker::Offline;
+
+namespace
+{
+	std::string SymbolName(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+		size_t dot = name.find_last_of('.');
+		return dot == std::string::npos ? name : name.substr(0, dot);
+	}
+
+	bool EndsWith(const std::string& text, const std::string& suffix)
+	{
+		return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		std::fprintf(stderr, "Usage: OfflineConvert <output.abcol> [--amibroker <export.txt>] <quotes.csv|quotes.bin>...\n");
+		return 2;
+	}
+
+	try
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		std::vector<SymbolQuotes> quotes;
+		for (int i = 2; i < argc; i++)
+		{
+			std::string path = argv[i];
+			std::vector<SymbolQuotes> loaded;
+			if (path == "--amibroker" && i + 1 < argc)
+				loaded = LoadAmiBrokerAscii(argv[++i]);
+			else if (EndsWith(path, ".bin"))
+				loaded = LoadBinary(path);
+			else
+				loaded.push_back(LoadCsv(path, SymbolName(path)));
+
+			for (SymbolQuotes& symbol : loaded)
+				quotes.push_back(std::move(symbol));
+		}
+
+		std::vector<SymbolData> symbols;
+		long long bars = 0;
+		for (const SymbolQuotes& symbol : quotes)
+		{
+			symbols.push_back(symbol.View());
+			bars += symbol.Length();
+		}
+
+		WriteColumnStore(argv[1], symbols);
+
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::printf("Wrote %d symbols, %lld bars to %s in %.1f ms\n", (int)symbols.size(), bars, argv[1], elapsed);
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, "Error while converting quotes: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,168 @@
+// OfflineReplay.cpp : load test of the streaming bar stage with a recorded or synthetic tick feed, without AmiBroker
+//
+// Usage: OfflineReplay [options] <ticks.csv | ticks.bin>
+//   --interval <seconds>    bar interval (default 60)
+//   --ma <period>           period of the MA of the bar closes (default 20)
+//   --ring <ticks>          capacity of the ring between the feed and the bar stage (default 65536)
+//   --speed <factor>        0 = as fast as possible (default), 1 = real time, 10 = ten times faster
+//   --synthetic <ticks>     replays random walk ticks instead of a file
+//   --save <ticks.bin>      writes the ticks to a binary tick file, which replays much faster than CSV, and exits
+//   --print                 prints every completed bar
+// The feed runs on its own thread and pushes the ticks into a lock-free ring; the bar stage runs on the main thread.
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include "TickReplay.h"
+#include "Kernels/Null.h"
+#include "Kernels/TickStream.h"
+
+using namespace AmiBroker;
+using namespace AmiBroker::Offline;
+
+namespace
+{
+	class Stopwatch
+	{
+	public:
+		Stopwatch() : start(std::chrono::steady_clock::now()) {}
+
+		double Milliseconds() const
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+	private:
+		std::chrono::steady_clock::time_point start;
+	};
+
+	// counts the bars and prints them if asked; updates of the forming bar are only counted
+	class ReportSink : public Kernels::BarSink
+	{
+	public:
+		explicit ReportSink(bool print) : print(print) {}
+
+		void OnBar(const Kernels::StreamBar& bar) override
+		{
+			if (print)
+			{
+				std::time_t seconds = (std::time_t)(bar.time / 1000000);
+				char text[32];
+				std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", std::gmtime(&seconds));
+				std::printf("%s %10.4f %10.4f %10.4f %10.4f %12.0f %6d", text, bar.open, bar.high, bar.low, bar.close, bar.volume, bar.ticks);
+				if (Kernels::IsNull(bar.ma))
+					std::printf("\n");
+				else
+					std::printf(" %10.4f\n", bar.ma);
+			}
+		}
+
+		void OnUpdate(const Kernels::StreamBar&) override
+		{
+			updates++;
+		}
+
+		std::int64_t updates = 0;
+
+	private:
+		bool print;
+	};
+
+	int Usage()
+	{
+		std::fprintf(stderr, "Usage: OfflineReplay [--interval <seconds>] [--ma <period>] [--ring <ticks>] [--speed <factor>]\n"
+			"                     [--synthetic <ticks>] [--save <ticks.bin>] [--print] <ticks.csv|ticks.bin>\n");
+		return 2;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int interval = 60, period = 20, capacity = 65536;
+	double speed = 0.0;
+	long long synthetic = 0;
+	bool print = false;
+	std::string path, savePath;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--interval" && i + 1 < argc)
+			interval = std::atoi(argv[++i]);
+		else if (arg == "--ma" && i + 1 < argc)
+			period = std::atoi(argv[++i]);
+		else if (arg == "--ring" && i + 1 < argc)
+			capacity = std::atoi(argv[++i]);
+		else if (arg == "--speed" && i + 1 < argc)
+			speed = std::atof(argv[++i]);
+		else if (arg == "--synthetic" && i + 1 < argc)
+			synthetic = std::atoll(argv[++i]);
+		else if (arg == "--save" && i + 1 < argc)
+			savePath = argv[++i];
+		else if (arg == "--print")
+			print = true;
+		else if (arg.compare(0, 2, "--") == 0 || !path.empty())
+			return Usage();
+		else
+			path = arg;
+	}
+
+	if (path.empty() == (synthetic <= 0) || interval < 1 || period < 1)
+		return Usage();
+
+	try
+	{
+		std::unique_ptr<TickSource> source = synthetic > 0 ? MakeSyntheticTicks(synthetic) : OpenTicks(path);
+
+		if (!savePath.empty())
+		{
+			Stopwatch saving;
+			std::int64_t saved = SaveTicks(savePath, *source);
+			std::printf("Wrote %" PRId64 " ticks to %s in %.1f ms\n", saved, savePath.c_str(), saving.Milliseconds());
+			return 0;
+		}
+
+		Kernels::TickRing ring(capacity);
+		Kernels::TickAggregator aggregator(interval, period);
+		ReportSink sink(print);
+
+		Stopwatch replaying;
+		ReplayStats stats = { 0, 0 };
+		std::exception_ptr failure;
+		std::thread feed([&]
+		{
+			try
+			{
+				stats = ReplayTicks(*source, ring, speed);
+			}
+			catch (...)
+			{
+				failure = std::current_exception();
+				ring.Close();
+			}
+		});
+		std::int64_t consumed = Kernels::RunTickStage(ring, aggregator, sink);
+		feed.join();
+		if (failure)
+			std::rethrow_exception(failure);
+		double elapsed = replaying.Milliseconds();
+
+		std::printf("Replayed %" PRId64 " ticks into %" PRId64 " bars of %d s in %.1f ms (%.2f million ticks/s)\n", consumed,
+			aggregator.Bars(), interval, elapsed, elapsed > 0.0 ? consumed / (elapsed * 1000.0) : 0.0);
+		std::printf("Late ticks %" PRId64 ", forming bar updates %" PRId64 ", ring %d ticks, high-water %d, producer stalls %" PRId64 "\n",
+			aggregator.LateTicks(), sink.updates, ring.Capacity(), ring.HighWater(), stats.stalls);
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, "Error while replaying ticks: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
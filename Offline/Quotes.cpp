@@ -0,0 +1,292 @@
+// Quotes.cpp : OHLCV quotes of the offline backtester loaded from CSV or binary files
+
+#include "Quotes.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace AmiBroker
+{
+	namespace Offline
+	{
+		namespace
+		{
+			const char BinaryMagic[8] = { 'A', 'B', 'O', 'H', 'L', 'C', 'V', '1' };
+
+			std::vector<std::string> SplitFields(const std::string& line)
+			{
+				std::vector<std::string> fields;
+				size_t start = 0;
+				while (start <= line.size())
+				{
+					size_t end = line.find_first_of(",;\t", start);
+					if (end == std::string::npos)
+						end = line.size();
+					fields.push_back(line.substr(start, end - start));
+					start = end + 1;
+				}
+				return fields;
+			}
+
+			// parses Date[ Time][,Time],Open,High,Low,Close[,Volume[,OpenInt]] starting at fields[first]
+			bool ParseBar(const std::vector<std::string>& fields, size_t first, std::uint64_t& date, float* values)
+			{
+				if (fields.size() < first + 5)
+					return false;
+
+				int year, month, day;
+				if (!ParseDate(fields[first].c_str(), year, month, day))
+					return false;	// header or malformed line
+
+				// the time is either in the date field after a space or in its own field
+				int hour = 0, minute = 0, second = 0;
+				size_t space = fields[first].find(' ');
+				if (space != std::string::npos)
+					ParseTime(fields[first].c_str() + space + 1, hour, minute, second);
+
+				size_t count = fields.size() - first;
+				const std::string& next = fields[first + 1];
+				bool hasTime = next.find(':') != std::string::npos || (count >= 7 && next.find('.') == std::string::npos);
+				if (space == std::string::npos && hasTime && ParseTime(next.c_str(), hour, minute, second))
+					first++;
+				first++;
+
+				for (size_t k = 0; k < 5; k++)
+					values[k] = first + k < fields.size() ? std::strtof(fields[first + k].c_str(), nullptr) : 0.0f;
+
+				date = PackDateTime(year, month, day, hour, minute, second);
+				return true;
+			}
+
+			template <class T>
+			void Read(std::ifstream& file, T* values, size_t count)
+			{
+				file.read(reinterpret_cast<char*>(values), count * sizeof(T));
+				if (!file)
+					throw std::runtime_error("Unexpected end of binary quotes file.");
+			}
+
+			template <class T>
+			void Write(std::ofstream& file, const T* values, size_t count)
+			{
+				file.write(reinterpret_cast<const char*>(values), count * sizeof(T));
+			}
+		}
+
+		bool ParseDate(const char* text, int& year, int& month, int& day)
+		{
+			if (std::sscanf(text, "%d-%d-%d", &year, &month, &day) == 3)
+				return true;
+			if (std::sscanf(text, "%d/%d/%d", &year, &month, &day) == 3)
+			{
+				if (year <= 31)
+				{
+					int first = year, second = month;
+					year = day;
+					month = first;
+					day = second;
+				}
+				return true;
+			}
+
+			long packed = std::strtol(text, nullptr, 10);
+			if (packed < 10000101)
+				return false;
+			year = (int)(packed / 10000);
+			month = (int)(packed / 100 % 100);
+			day = (int)(packed % 100);
+			return true;
+		}
+
+		bool ParseTime(const char* text, int& hour, int& minute, int& second)
+		{
+			second = 0;
+			if (std::sscanf(text, "%d:%d:%d", &hour, &minute, &second) >= 2)
+				return true;
+
+			char* end;
+			long packed = std::strtol(text, &end, 10);
+			if (end == text)
+				return false;
+			hour = (int)(packed / 10000);
+			minute = (int)(packed / 100 % 100);
+			second = (int)(packed % 100);
+			return true;
+		}
+
+		std::uint64_t PackDateTime(int year, int month, int day, int hour, int minute, int second)
+		{
+			return ((std::uint64_t)year << 40) | ((std::uint64_t)month << 36) | ((std::uint64_t)day << 31) |
+				((std::uint64_t)hour << 26) | ((std::uint64_t)minute << 20) | ((std::uint64_t)second << 14);
+		}
+
+		void SymbolQuotes::Reserve(int count)
+		{
+			dates.reserve(count);
+			open.reserve(count);
+			high.reserve(count);
+			low.reserve(count);
+			close.reserve(count);
+			volume.reserve(count);
+		}
+
+		void SymbolQuotes::Add(std::uint64_t date, float o, float h, float l, float c, float v)
+		{
+			dates.push_back(date);
+			open.push_back(o);
+			high.push_back(h);
+			low.push_back(l);
+			close.push_back(c);
+			volume.push_back(v);
+		}
+
+		SymbolData SymbolQuotes::View() const
+		{
+			SymbolData data;
+			data.symbol = symbol;
+			data.dates = dates.data();
+			data.open = open.data();
+			data.high = high.data();
+			data.low = low.data();
+			data.close = close.data();
+			data.volume = volume.data();
+			data.length = Length();
+			return data;
+		}
+
+		SymbolQuotes LoadCsv(const std::string& path, const std::string& symbol)
+		{
+			std::ifstream file(path);
+			if (!file)
+				throw std::runtime_error("Cannot open " + path);
+
+			SymbolQuotes quotes;
+			quotes.symbol = symbol;
+
+			std::string line;
+			while (std::getline(file, line))
+			{
+				if (!line.empty() && line.back() == '\r')
+					line.pop_back();
+				if (line.empty())
+					continue;
+
+				std::uint64_t date;
+				float values[5];
+				if (ParseBar(SplitFields(line), 0, date, values))
+					quotes.Add(date, values[0], values[1], values[2], values[3], values[4]);
+			}
+
+			return quotes;
+		}
+
+		std::vector<SymbolQuotes> LoadAmiBrokerAscii(const std::string& path)
+		{
+			std::ifstream file(path);
+			if (!file)
+				throw std::runtime_error("Cannot open " + path);
+
+			std::vector<SymbolQuotes> result;
+			std::unordered_map<std::string, size_t> symbols;
+
+			std::string line;
+			while (std::getline(file, line))
+			{
+				if (!line.empty() && line.back() == '\r')
+					line.pop_back();
+				if (line.empty() || line[0] == '$')
+					continue;	// import format directives
+
+				std::vector<std::string> fields = SplitFields(line);
+				std::uint64_t date;
+				float values[5];
+				if (!ParseBar(fields, 1, date, values))
+					continue;
+
+				auto found = symbols.find(fields[0]);
+				if (found == symbols.end())
+				{
+					found = symbols.emplace(fields[0], result.size()).first;
+					result.emplace_back();
+					result.back().symbol = fields[0];
+				}
+				result[found->second].Add(date, values[0], values[1], values[2], values[3], values[4]);
+			}
+
+			return result;
+		}
+
+		std::vector<SymbolQuotes> LoadBinary(const std::string& path)
+		{
+			std::ifstream file(path, std::ios::binary);
+			if (!file)
+				throw std::runtime_error("Cannot open " + path);
+
+			char magic[8];
+			Read(file, magic, 8);
+			if (std::memcmp(magic, BinaryMagic, 8) != 0)
+				throw std::runtime_error(path + " is not a binary quotes file.");
+
+			std::int32_t count;
+			Read(file, &count, 1);
+
+			std::vector<SymbolQuotes> result(count);
+			for (SymbolQuotes& quotes : result)
+			{
+				std::int32_t nameLength, length;
+				Read(file, &nameLength, 1);
+				quotes.symbol.resize(nameLength);
+				Read(file, &quotes.symbol[0], nameLength);
+				Read(file, &length, 1);
+
+				quotes.dates.resize(length);
+				quotes.open.resize(length);
+				quotes.high.resize(length);
+				quotes.low.resize(length);
+				quotes.close.resize(length);
+				quotes.volume.resize(length);
+				Read(file, quotes.dates.data(), length);
+				Read(file, quotes.open.data(), length);
+				Read(file, quotes.high.data(), length);
+				Read(file, quotes.low.data(), length);
+				Read(file, quotes.close.data(), length);
+				Read(file, quotes.volume.data(), length);
+			}
+
+			return result;
+		}
+
+		void SaveBinary(const std::string& path, const std::vector<SymbolQuotes>& quotes)
+		{
+			std::ofstream file(path, std::ios::binary);
+			if (!file)
+				throw std::runtime_error("Cannot create " + path);
+
+			file.write(BinaryMagic, 8);
+			std::int32_t count = (std::int32_t)quotes.size();
+			Write(file, &count, 1);
+
+			for (const SymbolQuotes& symbol : quotes)
+			{
+				std::int32_t nameLength = (std::int32_t)symbol.symbol.size();
+				std::int32_t length = symbol.Length();
+				Write(file, &nameLength, 1);
+				Write(file, symbol.symbol.data(), nameLength);
+				Write(file, &length, 1);
+				Write(file, symbol.dates.data(), length);
+				Write(file, symbol.open.data(), length);
+				Write(file, symbol.high.data(), length);
+				Write(file, symbol.low.data(), length);
+				Write(file, symbol.close.data(), length);
+				Write(file, symbol.volume.data(), length);
+			}
+
+			if (!file)
+				throw std::runtime_error("Cannot write " + path);
+		}
+	}
+}
@@ -0,0 +1,88 @@
+// Quotes.h : OHLCV quotes of the offline backtester loaded from CSV or binary files
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Offline
+	{
+		/// <summary>
+		/// Packs a date and time into a 64 bit time stamp. Time stamps order like ATDateTime::Date
+		/// (year, month, day, hour, minute, second from the most significant bits), but the bit layout is not AmiBroker's.
+		/// </summary>
+		std::uint64_t PackDateTime(int year, int month, int day, int hour = 0, int minute = 0, int second = 0);
+
+		/// <summary>
+		/// Parses a date of the quote files: YYYY-MM-DD, YYYY/MM/DD, MM/DD/YYYY (AmiBroker's ASCII export) or YYYYMMDD.
+		/// Returns false for anything else, e.g. a header line.
+		/// </summary>
+		bool ParseDate(const char* text, int& year, int& month, int& day);
+
+		/// <summary>
+		/// Parses a time of the quote files: HH:MM[:SS] or HHMMSS. A fraction of the second is ignored.
+		/// </summary>
+		bool ParseTime(const char* text, int& hour, int& minute, int& second);
+
+		/// <summary>
+		/// Non-owning view of the quotes of one symbol, the arrays AmiBroker hands to a formula.
+		/// The storage behind it (SymbolQuotes, a memory mapped file) must outlive the view.
+		/// </summary>
+		struct SymbolData
+		{
+			std::string symbol;
+			const std::uint64_t* dates;
+			const float* open;
+			const float* high;
+			const float* low;
+			const float* close;
+			const float* volume;
+			int length;
+		};
+
+		/// <summary>
+		/// Quotes of one symbol held in memory, column by column.
+		/// </summary>
+		struct SymbolQuotes
+		{
+			std::string symbol;
+			std::vector<std::uint64_t> dates;
+			std::vector<float> open;
+			std::vector<float> high;
+			std::vector<float> low;
+			std::vector<float> close;
+			std::vector<float> volume;
+
+			int Length() const { return (int)dates.size(); }
+			void Reserve(int count);
+			void Add(std::uint64_t date, float o, float h, float l, float c, float v);
+			SymbolData View() const;
+		};
+
+		/// <summary>
+		/// Loads a CSV file of one symbol. Each line is Date[,Time],Open,High,Low,Close[,Volume];
+		/// dates are YYYY-MM-DD, YYYY/MM/DD, MM/DD/YYYY or YYYYMMDD, times HH:MM[:SS] or HHMMSS,
+		/// either in their own field or after the date separated by a space. A header line is skipped.
+		/// Lines must be in ascending date order. Throws std::runtime_error if the file cannot be read.
+		/// </summary>
+		SymbolQuotes LoadCsv(const std::string& path, const std::string& symbol);
+
+		/// <summary>
+		/// Loads an AmiBroker ASCII export of many symbols: Ticker,Date[,Time],Open,High,Low,Close[,Volume[,OpenInt]]
+		/// in the formats of LoadCsv. $FORMAT and other $ directive lines are skipped.
+		/// Symbols are returned in the order of their first line.
+		/// </summary>
+		std::vector<SymbolQuotes> LoadAmiBrokerAscii(const std::string& path);
+
+		/// <summary>
+		/// Binary file of many symbols: "ABOHLCV1", the symbol count (int32), then for each symbol
+		/// the name length (int32), the name, the bar count (int32) and the columns: dates (uint64), open, high, low, close, volume (float32).
+		/// Little endian. Throws std::runtime_error if the file cannot be read or written.
+		/// </summary>
+		std::vector<SymbolQuotes> LoadBinary(const std::string& path);
+		void SaveBinary(const std::string& path, const std::vector<SymbolQuotes>& quotes);
+	}
+}
@@ -0,0 +1,163 @@
+// SampleProcedures.cpp : the sample trading system and custom backtest procedures compiled against the offline backtester
+
+#include "SampleProcedures.h"
+#include "Kernels/Averages.h"
+#include "Kernels/EquityAnalytics.h"
+#include "Kernels/Null.h"
+#include "Kernels/Parallel.h"
+#include "Kernels/Price.h"
+#include "Kernels/TradeAnalytics.h"
+
+namespace AmiBroker
+{
+	namespace Offline
+	{
+		namespace
+		{
+			// AFL Cross(a, b): a crosses above b on this bar; Null on either bar is no cross
+			void Cross(const float* a, const float* b, unsigned char* dst, int length)
+			{
+				if (length > 0)
+					dst[0] = 0;
+				for (int i = 1; i < length; i++)
+				{
+					bool valid = !Kernels::IsNull(a[i]) && !Kernels::IsNull(b[i]) && !Kernels::IsNull(a[i - 1]) && !Kernels::IsNull(b[i - 1]);
+					dst[i] = (unsigned char)(valid && a[i] > b[i] && a[i - 1] <= b[i - 1]);
+				}
+			}
+		}
+
+		SymbolSignals CrossoverSignals(const SymbolData& data)
+		{
+			int length = data.length;
+			std::vector<float> typicalPrice(length), ma(length), ema(length);
+			Kernels::TypicalPrice(data.high, data.low, data.close, typicalPrice.data(), length);
+			Kernels::Ma(typicalPrice.data(), ma.data(), length, 20);
+			Kernels::Ema(data.close, ema.data(), length, 5);
+
+			SymbolSignals signals;
+			signals.buy.resize(length);
+			signals.shrt.resize(length);
+			Cross(ema.data(), ma.data(), signals.buy.data(), length);
+			Cross(ma.data(), ema.data(), signals.shrt.data(), length);
+			signals.cover = signals.buy;
+			signals.sell = signals.shrt;
+
+			signals.buyPrice.assign(data.open, data.open + length);
+			signals.shortPrice = signals.buyPrice;
+			signals.sellPrice.assign(data.close, data.close + length);
+			signals.coverPrice = signals.sellPrice;
+			return signals;
+		}
+
+		std::vector<SymbolSignals> CrossoverSignals(const std::vector<SymbolData>& symbols)
+		{
+			std::vector<SymbolSignals> signals(symbols.size());
+			Kernels::ParallelFor((int)symbols.size(), 1, [&](int begin, int end)
+			{
+				for (int s = begin; s < end; s++)
+					signals[s] = CrossoverSignals(symbols[s]);
+			});
+			return signals;
+		}
+
+		void TradeMetricsProcedure(Backtester& bo)
+		{
+			bo.Backtest();
+
+			Kernels::TradeColumns trades;
+
+			for (Trade* trade = bo.GetFirstTrade(); trade != nullptr; trade = bo.GetNextTrade())
+			{
+				trades.Add(trade->GetProfit(), trade->GetPercentProfit(), trade->BarsInTrade, trade->EntryPrice, trade->ExitPrice,
+					trade->GetMAE(), trade->GetMFE(), trade->IsLong, false);
+			}
+
+			for (Trade* trade = bo.GetFirstOpenPos(); trade != nullptr; trade = bo.GetNextOpenPos())
+			{
+				trades.Add(trade->GetProfit(), trade->GetPercentProfit(), trade->BarsInTrade, trade->EntryPrice, trade->ExitPrice,
+					trade->GetMAE(), trade->GetMFE(), trade->IsLong, true);
+			}
+
+			std::vector<Kernels::TradeMetricValue> values = Kernels::CalculateTradeMetrics(trades, Kernels::TradeMetrics::All, Kernels::DefaultTradePercentiles());
+
+			for (const Kernels::TradeMetricValue& value : values)
+				bo.AddCustomMetric(value.name, (float)value.all, (float)value.longOnly, (float)value.shortOnly, (float)value.decimals);
+		}
+
+		void SlippageProcedure(Backtester& bo, const std::vector<SymbolData>& symbols, const Kernels::SlippageSettings& settings)
+		{
+			bool usesInputs = settings.model == Kernels::SlippageModel::Atr || settings.model == Kernels::SlippageModel::VolumeParticipation;
+
+			// first phase: store the model inputs of each symbol in the store of this backtest
+			Kernels::SlippageInputs inputs;
+			if (usesInputs)
+			{
+				for (const SymbolData& symbol : symbols)
+					inputs.Store(symbol.symbol, symbol.dates, symbol.high, symbol.low, symbol.close, symbol.volume, symbol.length, settings.period);
+			}
+
+			Kernels::SlippageEngine engine(settings, inputs, bo.DateTime().data(), bo.BarCount());
+
+			bo.PreProcess();
+
+			for (int bar = 0; bar < bo.BarCount(); bar++)
+			{
+				for (Signal* sig = bo.GetFirstSignal(bar); sig != nullptr; sig = bo.GetNextSignal(bar))
+				{
+					if (sig->IsScale())
+						continue;
+
+					int symbol = -1;
+					double orderValue = 0;
+
+					if (usesInputs)
+						symbol = engine.SymbolIndex(std::string(sig->Symbol));
+
+					if (settings.model == Kernels::SlippageModel::VolumeParticipation)
+					{
+						if (sig->IsEntry())
+						{
+							float posSize = sig->PosSize;
+							orderValue = posSize > 0 ? posSize : (posSize >= -100 ? -posSize / 100 * bo.Equity : 0);
+						}
+						else
+						{
+							Trade* position = bo.FindOpenPos(sig->Symbol);
+							orderValue = position != nullptr ? position->GetPositionValue() : 0;
+						}
+					}
+
+					sig->Price = engine.Adjust(symbol, bar, sig->Price, sig->IsLong(), sig->IsEntry(), orderValue);
+				}
+				bo.ProcessTradeSignals(bar);
+			}
+
+			bo.PostProcess();
+		}
+
+		void ExpectancyProcedure(Backtester& bo)
+		{
+			bo.Backtest();
+
+			Stats* st = bo.GetPerformanceStats(StatType::All);
+
+			float expectancy = (st->GetValue(Stats::WinnersPercent) * st->GetValue("WinnersAvgProfit") +
+				st->GetValue(Stats::LosersAvgLoss) * st->GetValue(Stats::LosersPercent)) / 100;
+
+			bo.AddCustomMetric("Expectancy", expectancy, 0, 0, 2);
+
+			// the dates are packed 12 bits lower than ATDateTime (see PackDateTime); shifted, PeriodsPerYear reads them
+			std::vector<std::uint64_t> dates(bo.DateTime().size());
+			for (size_t i = 0; i < dates.size(); i++)
+				dates[i] = bo.DateTime()[i] << 12;
+
+			Kernels::EquitySettings settings;
+			settings.periodsPerYear = Kernels::PeriodsPerYear(dates.data(), (int)dates.size());
+			Kernels::EquityOutputs none = {};
+			Kernels::EquityMetrics metrics = Kernels::AnalyzeEquity(bo.EquityArray.data(), (int)bo.EquityArray.size(), settings, none);
+			for (const Kernels::TradeMetricValue& value : Kernels::EquityMetricValues(metrics))
+				bo.AddCustomMetric(value.name, (float)value.all, (float)value.longOnly, (float)value.shortOnly, (float)value.decimals);
+		}
+	}
+}
@@ -0,0 +1,42 @@
+// SampleProcedures.h : the sample trading system and custom backtest procedures compiled against the offline backtester
+
+#pragma once
+
+#include <vector>
+#include "Backtester.h"
+#include "Kernels/Slippage.h"
+
+namespace AmiBroker
+{
+	namespace Offline
+	{
+		/// <summary>
+		/// The trading system of the Basic Samples (Sample7 BacktestVC.afl):
+		/// Buy = Cover = Cross(EMA(Close, 5), MA(TypicalPrice, 20)), Short = Sell = Cross(MA, EMA);
+		/// BuyPrice = ShortPrice = Open, SellPrice = CoverPrice = Close.
+		/// </summary>
+		SymbolSignals CrossoverSignals(const SymbolData& data);
+
+		/// <summary>
+		/// Runs CrossoverSignals for all symbols in parallel, the first (per-symbol) phase of a portfolio backtest.
+		/// </summary>
+		std::vector<SymbolSignals> CrossoverSignals(const std::vector<SymbolData>& symbols);
+
+		/// <summary>
+		/// Custom backtest of BasicSampleVC7: copies the trades into columns and adds the trade metrics as custom metrics.
+		/// </summary>
+		void TradeMetricsProcedure(Backtester& bo);
+
+		/// <summary>
+		/// Custom backtest of BasicSampleVC8: adjusts the signal prices by the slippage model in the signal loop.
+		/// The model inputs of every symbol are stored first, as the per-symbol phase does in AmiBroker.
+		/// </summary>
+		void SlippageProcedure(Backtester& bo, const std::vector<SymbolData>& symbols, const Kernels::SlippageSettings& settings);
+
+		/// <summary>
+		/// Custom backtest of BasicSampleVC9: adds the expectancy calculated from the Stats object
+		/// and the equity curve metrics of Kernels\EquityAnalytics.h.
+		/// </summary>
+		void ExpectancyProcedure(Backtester& bo);
+	}
+}
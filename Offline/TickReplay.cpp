@@ -0,0 +1,266 @@
+// TickReplay.cpp : tick files and the replay of a recorded feed into the streaming bar stage
+
+#include "TickReplay.h"
+#include "Quotes.h"
+#include "Kernels/TimeFrame.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace AmiBroker
+{
+	namespace Offline
+	{
+		namespace
+		{
+			const char TickMagic[8] = { 'A', 'B', 'T', 'I', 'C', 'K', 'S', '1' };
+			const std::int64_t MicrosecondsPerSecond = 1000000;
+
+			// microseconds of the ".ffffff" after a time, 0 if there is none
+			std::int64_t ParseFraction(const char* text)
+			{
+				const char* dot = std::strchr(text, '.');
+				if (!dot)
+					return 0;
+
+				std::int64_t microseconds = 0;
+				int digits = 0;
+				for (const char* c = dot + 1; *c >= '0' && *c <= '9' && digits < 6; c++, digits++)
+					microseconds = microseconds * 10 + (*c - '0');
+				for (; digits < 6; digits++)
+					microseconds *= 10;
+				return microseconds;
+			}
+
+			class CsvTickSource : public TickSource
+			{
+			public:
+				explicit CsvTickSource(const std::string& path)
+					: file(path)
+				{
+					if (!file)
+						throw std::runtime_error("Cannot open tick file " + path + ".");
+				}
+
+				int Read(Kernels::Tick* ticks, int count) override
+				{
+					int n = 0;
+					std::string line;
+					while (n < count && std::getline(file, line))
+					{
+						if (Parse(line, ticks[n]))
+							n++;
+					}
+					return n;
+				}
+
+			private:
+				// Date Time,Price[,Size] or Date,Time,Price[,Size]
+				static bool Parse(const std::string& line, Kernels::Tick& tick)
+				{
+					std::vector<std::string> fields;
+					size_t start = 0;
+					while (start <= line.size())
+					{
+						size_t end = line.find_first_of(",;\t", start);
+						if (end == std::string::npos)
+							end = line.size();
+						fields.push_back(line.substr(start, end - start));
+						start = end + 1;
+					}
+
+					int year, month, day;
+					if (fields.size() < 2 || !ParseDate(fields[0].c_str(), year, month, day))
+						return false;	// header or malformed line
+
+					int hour = 0, minute = 0, second = 0;
+					size_t first = 1;
+					const char* time = nullptr;
+					size_t space = fields[0].find(' ');
+					if (space != std::string::npos)
+						time = fields[0].c_str() + space + 1;
+					else if (fields.size() >= 3)
+						time = fields[first++].c_str();
+					if (!time || !ParseTime(time, hour, minute, second))
+						return false;
+
+					std::int64_t seconds = Kernels::DateTimeToSeconds(Kernels::MakeDateTime(year, month, day, hour, minute, second));
+					tick.time = seconds * MicrosecondsPerSecond + ParseFraction(time);
+					tick.price = std::strtof(fields[first].c_str(), nullptr);
+					tick.size = first + 1 < fields.size() ? std::strtof(fields[first + 1].c_str(), nullptr) : 0.0f;
+					return true;
+				}
+
+				std::ifstream file;
+			};
+
+			class BinaryTickSource : public TickSource
+			{
+			public:
+				explicit BinaryTickSource(const std::string& path)
+					: file(path, std::ios::binary)
+				{
+					char magic[8];
+					if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, TickMagic, sizeof(magic)) != 0)
+						throw std::runtime_error("Not a binary tick file: " + path + ".");
+					if (!file.read(reinterpret_cast<char*>(&remaining), sizeof(remaining)))
+						throw std::runtime_error("Unexpected end of binary tick file.");
+				}
+
+				int Read(Kernels::Tick* ticks, int count) override
+				{
+					int n = remaining < count ? (int)remaining : count;
+					for (int k = 0; k < n; k++)
+					{
+						file.read(reinterpret_cast<char*>(&ticks[k].time), sizeof(ticks[k].time));
+						file.read(reinterpret_cast<char*>(&ticks[k].price), sizeof(ticks[k].price));
+						file.read(reinterpret_cast<char*>(&ticks[k].size), sizeof(ticks[k].size));
+					}
+					if (!file)
+						throw std::runtime_error("Unexpected end of binary tick file.");
+					remaining -= n;
+					return n;
+				}
+
+			private:
+				std::ifstream file;
+				std::int64_t remaining = 0;
+			};
+
+			class SyntheticTickSource : public TickSource
+			{
+			public:
+				SyntheticTickSource(std::int64_t count, int perSecond, std::uint32_t seed)
+					: remaining(count), random(seed), gap(perSecond < 1 ? 1.0 : (double)perSecond),
+					change(0.0f, 0.0005f), size(1.0f, 500.0f)
+				{
+					time = Kernels::DateTimeToSeconds(Kernels::MakeDateTime(2000, 1, 3, 9, 30)) * MicrosecondsPerSecond;
+				}
+
+				int Read(Kernels::Tick* ticks, int count) override
+				{
+					int n = remaining < count ? (int)remaining : count;
+					for (int k = 0; k < n; k++)
+					{
+						time += 1 + (std::int64_t)(gap(random) * MicrosecondsPerSecond);
+						price = price * (1.0f + change(random));
+						ticks[k].time = time;
+						ticks[k].price = price;
+						ticks[k].size = (float)(int)size(random);
+					}
+					remaining -= n;
+					return n;
+				}
+
+			private:
+				std::int64_t remaining;
+				std::int64_t time;
+				float price = 100.0f;
+				std::mt19937 random;
+				std::exponential_distribution<double> gap;
+				std::normal_distribution<float> change;
+				std::uniform_real_distribution<float> size;
+			};
+
+			bool EndsWith(const std::string& text, const char* suffix)
+			{
+				size_t length = std::strlen(suffix);
+				return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+			}
+		}
+
+		std::unique_ptr<TickSource> OpenTicks(const std::string& path)
+		{
+			if (EndsWith(path, ".bin"))
+				return std::unique_ptr<TickSource>(new BinaryTickSource(path));
+			return std::unique_ptr<TickSource>(new CsvTickSource(path));
+		}
+
+		std::unique_ptr<TickSource> MakeSyntheticTicks(std::int64_t count, int perSecond, std::uint32_t seed)
+		{
+			return std::unique_ptr<TickSource>(new SyntheticTickSource(count, perSecond, seed));
+		}
+
+		std::int64_t SaveTicks(const std::string& path, TickSource& source)
+		{
+			std::ofstream file(path, std::ios::binary);
+			if (!file)
+				throw std::runtime_error("Cannot create tick file " + path + ".");
+
+			// the count is written again at the end, when it is known
+			std::int64_t count = 0;
+			file.write(TickMagic, sizeof(TickMagic));
+			file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+			std::vector<Kernels::Tick> block(4096);
+			for (int n; (n = source.Read(block.data(), (int)block.size())) > 0; count += n)
+			{
+				for (int k = 0; k < n; k++)
+				{
+					file.write(reinterpret_cast<const char*>(&block[k].time), sizeof(block[k].time));
+					file.write(reinterpret_cast<const char*>(&block[k].price), sizeof(block[k].price));
+					file.write(reinterpret_cast<const char*>(&block[k].size), sizeof(block[k].size));
+				}
+			}
+
+			file.seekp(sizeof(TickMagic));
+			file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+			if (!file)
+				throw std::runtime_error("Cannot write tick file " + path + ".");
+			return count;
+		}
+
+		ReplayStats ReplayTicks(TickSource& source, Kernels::TickRing& ring, double speed, int block)
+		{
+			ReplayStats stats = { 0, 0 };
+			std::vector<Kernels::Tick> buffer(block < 1 ? 1 : block);
+
+			auto start = std::chrono::steady_clock::now();
+			std::int64_t firstTime = 0;
+
+			for (int n; (n = source.Read(buffer.data(), (int)buffer.size())) > 0;)
+			{
+				if (stats.ticks == 0)
+					firstTime = buffer[0].time;
+
+				for (int sent = 0; sent < n;)
+				{
+					int count = n - sent;
+					if (speed > 0.0)
+					{
+						// the ticks that are due; wait for the next one if none is
+						auto now = std::chrono::steady_clock::now();
+						double elapsed = std::chrono::duration<double, std::micro>(now - start).count() * speed;
+						count = 0;
+						while (sent + count < n && buffer[sent + count].time - firstTime <= elapsed)
+							count++;
+						if (count == 0)
+						{
+							double wait = (buffer[sent].time - firstTime - elapsed) / speed;
+							std::this_thread::sleep_for(std::chrono::microseconds((std::int64_t)wait + 1));
+							continue;
+						}
+					}
+
+					int pushed = ring.Push(buffer.data() + sent, count);
+					if (pushed == 0)
+					{
+						stats.stalls++;
+						std::this_thread::yield();
+					}
+					sent += pushed;
+				}
+				stats.ticks += n;
+			}
+
+			ring.Close();
+			return stats;
+		}
+	}
+}
@@ -0,0 +1,36 @@
+/*Result Array.h*/
+#pragma once
+
+#include "Kernels/Profiler.h"
+
+using namespace System;
+using namespace AmiBroker;
+
+namespace AmiBroker
+{
+	namespace Samples
+	{
+		/// <summary>
+		/// Allocates a new ATArray for a result and counts its BarCount floats in the innermost ProfileScope (Kernels\Profiler.h).
+		///
+		/// Every result array of the samples is allocated here rather than with gcnew ATArray directly,
+		/// so the bytes the profiler reports per call follow the code.
+		/// </summary>
+		inline ATArray^ NewResultArray()
+		{
+			ATArray^ result = gcnew ATArray();
+			Kernels::ProfilerCountArray(result->Length);
+			return result;
+		}
+
+		/// <summary>
+		/// A new result array initialized with a copy of 'source' (e.g. BuyPrice = NewResultArray(Open)).
+		/// </summary>
+		inline ATArray^ NewResultArray(ATArray^ source)
+		{
+			ATArray^ result = gcnew ATArray(source);
+			Kernels::ProfilerCountArray(result->Length);
+			return result;
+		}
+	}
+}
@@ -0,0 +1,38 @@
+/*Result Cache.cpp*/
+#include "stdafx.h"
+#include "Result Cache.h"
+
+namespace AmiBroker
+{
+	namespace Samples
+	{
+		bool ResultCache::IsEnabled(MethodBase^ caller)
+		{
+			IntPtr handle = caller->MethodHandle.Value;
+
+			bool result;
+			if (!enabled->TryGetValue(handle, result))
+			{
+				// reflection is slow, so the attribute is only looked up at the first call of each method
+				result = caller->IsDefined(CachedResultAttribute::typeid, false);
+				enabled->TryAdd(handle, result);
+			}
+
+			return result;
+		}
+
+		bool ResultCache::Get(MethodBase^ caller, const Kernels::ResultKey& key, ATArray^ result)
+		{
+			if (!IsEnabled(caller))
+				return false;
+
+			return Kernels::ResultCacheGet(key, result->Array, result->Length);
+		}
+
+		void ResultCache::Put(MethodBase^ caller, const Kernels::ResultKey& key, ATArray^ result)
+		{
+			if (IsEnabled(caller))
+				Kernels::ResultCachePut(key, result->Array, result->Length);
+		}
+	}
+}
@@ -0,0 +1,52 @@
+/*Result Cache.h*/
+#pragma once
+
+#include "Kernels/ResultCache.h"
+
+using namespace System;
+using namespace System::Reflection;
+using namespace AmiBroker;
+
+namespace AmiBroker
+{
+	namespace Samples
+	{
+		/// <summary>
+		/// Opts a plug-in method in the result cache. Put it next to the [ABMethod] attribute.
+		/// ResultCache::Get and ResultCache::Put do nothing for methods without this attribute,
+		/// so caching can be switched off for a method by removing the attribute only.
+		/// </summary>
+		[AttributeUsage(AttributeTargets::Method, AllowMultiple = false)]
+		public ref class CachedResultAttribute : Attribute
+		{
+		};
+
+		/// <summary>
+		/// Managed side of the native result cache (Kernels\ResultCache.h).
+		/// The same indicator is often calculated by several panes, scans and backtests.
+		/// The cache stores results by the function name, the content hash of the input arrays and the parameters,
+		/// so a result calculated by one plug-in method is reused by any other method asking for the same key.
+		/// </summary>
+		ref class ResultCache abstract sealed
+		{
+		public:
+			/// <summary>
+			/// Copies the cached result to 'result' and returns true if the calling method opted in and the key is cached.
+			/// </summary>
+			static bool Get(MethodBase^ caller, const Kernels::ResultKey& key, ATArray^ result);
+
+			/// <summary>
+			/// Stores 'result' under key if the calling method opted in.
+			/// </summary>
+			static void Put(MethodBase^ caller, const Kernels::ResultKey& key, ATArray^ result);
+
+			/// <summary>
+			/// Returns true if the method has the [CachedResult] attribute. The answer is remembered per method.
+			/// </summary>
+			static bool IsEnabled(MethodBase^ caller);
+
+		private:
+			static Collections::Concurrent::ConcurrentDictionary<IntPtr, bool>^ enabled = gcnew Collections::Concurrent::ConcurrentDictionary<IntPtr, bool>();
+		};
+	}
+}
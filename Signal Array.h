@@ -0,0 +1,44 @@
+/*Signal Array.h*/
+#pragma once
+
+#include <cstdint>
+#include "Result Array.h"
+#include "Kernels/Signals.h"
+
+using namespace System;
+using namespace AmiBroker;
+
+namespace AmiBroker
+{
+	namespace Samples
+	{
+		/// <summary>
+		/// Expands a packed signal (Kernels\Signals.h) into a new ATArray: Iif(signal, ifTrue, ifFalse).
+		///
+		/// Conditions and signals are kept as bit vectors while they are combined (one bit per bar instead of a float array
+		/// per step); only the arrays AmiBroker reads (Buy, Sell, plot colors, shapes) are expanded, each into its own ATArray.
+		/// </summary>
+		inline ATArray^ SignalArray(const std::uint64_t* bits, float ifTrue, float ifFalse)
+		{
+			ATArray^ result = NewResultArray();
+			Kernels::ExpandSignal(bits, result->Array, result->Length, ifTrue, ifFalse);
+			return result;
+		}
+
+		/// <summary>
+		/// The 1/0 array of a signal, for Buy, Sell, Short and Cover.
+		/// </summary>
+		inline ATArray^ SignalArray(const std::uint64_t* bits)
+		{
+			return SignalArray(bits, 1.0f, 0.0f);
+		}
+
+		/// <summary>
+		/// The PlotShapes array of a signal: the shape on the signal bars, no shape elsewhere.
+		/// </summary>
+		inline ATArray^ SignalArray(const std::uint64_t* bits, Shape shape)
+		{
+			return SignalArray(bits, (float)shape, (float)Shape::None);
+		}
+	}
+}
@@ -0,0 +1,92 @@
+// EquityAnalyticsTest.cpp : checks the annualized metrics of short and long equity curves
+//
+// A few weeks of minute bars with strong growth must not be annualized (CAGR and MAR 0) and every metric must fit
+// in a float, the type of the custom metrics of the backtest report. Two years of daily bars with a known growth
+// must give the CAGR of that growth. Exits with 1 on any failure.
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Kernels/EquityAnalytics.h"
+#include "Kernels/TimeFrame.h"
+
+using namespace AmiBroker::Kernels;
+
+namespace
+{
+	int failures = 0;
+
+	void Check(const std::string& name, bool ok, double value)
+	{
+		std::printf("%s  %-36s %.6g\n", ok ? "ok  " : "FAIL", name.c_str(), value);
+		if (!ok)
+			failures++;
+	}
+
+	bool FitsFloat(double value)
+	{
+		return std::isfinite(value) && std::fabs(value) <= FLT_MAX;
+	}
+
+	void CheckFinite(const std::string& curve, const EquityMetrics& metrics)
+	{
+		for (const TradeMetricValue& value : EquityMetricValues(metrics))
+			Check(curve + " " + value.name, FitsFloat(value.all) && std::isfinite((float)value.all), value.all);
+	}
+
+	// minute bars of a trading session of 390 bars a day, five days a week
+	std::vector<std::uint64_t> MinuteDates(int length)
+	{
+		std::vector<std::uint64_t> dates(length);
+		for (int i = 0; i < length; i++)
+		{
+			int day = i / 390, minute = 570 + i % 390;
+			int calendarDay = day / 5 * 7 + day % 5;
+			dates[i] = MakeDateTime(2024, 1 + calendarDay / 28, 1 + calendarDay % 28, minute / 60, minute % 60);
+		}
+		return dates;
+	}
+}
+
+int main()
+{
+	// 5000 minute bars (about 13 sessions) doubling the equity every 500 bars
+	{
+		const int Length = 5000;
+		std::vector<std::uint64_t> dates = MinuteDates(Length);
+		std::vector<float> equity(Length);
+		for (int i = 0; i < Length; i++)
+			equity[i] = (float)(10000.0 * std::pow(2.0, i / 500.0) * (1.0 + 0.05 * std::sin(i * 0.1)));
+
+		EquitySettings settings;
+		settings.periodsPerYear = PeriodsPerYear(dates.data(), Length);
+		EquityOutputs none = {};
+		EquityMetrics metrics = AnalyzeEquity(equity.data(), Length, settings, none);
+
+		CheckFinite("minute bars:", metrics);
+		Check("minute bars: CAGR not annualized", metrics.cagr == 0.0, metrics.cagr);
+		Check("minute bars: MAR without CAGR", metrics.mar == 0.0, metrics.mar);
+		Check("minute bars: drawdown", metrics.maxDrawdown > 0.0, metrics.maxDrawdown);
+	}
+
+	// two years of daily bars growing 10% a year
+	{
+		const int Length = 2 * 252 + 1;
+		std::vector<float> equity(Length);
+		for (int i = 0; i < Length; i++)
+			equity[i] = (float)(10000.0 * std::pow(1.1, i / 252.0));
+
+		EquitySettings settings;
+		EquityOutputs none = {};
+		EquityMetrics metrics = AnalyzeEquity(equity.data(), Length, settings, none);
+
+		CheckFinite("daily bars:", metrics);
+		Check("daily bars: CAGR of 10% a year", std::fabs(metrics.cagr - 10.0) < 1e-3, metrics.cagr);
+		Check("daily bars: no drawdown, no MAR", metrics.maxDrawdown == 0.0 && metrics.mar == 0.0, metrics.mar);
+	}
+
+	return failures == 0 ? 0 : 1;
+}
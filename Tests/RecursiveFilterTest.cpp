@@ -0,0 +1,164 @@
+// RecursiveFilterTest.cpp : checks the parallel prefix scan of the IIR filters against the sequential recurrence
+//
+// Every filter that switches to the scan at ParallelMinimumLength bars (Iir, Ema, Wilders, Dema, Tema, the Super Smoother)
+// is run on a series longer than that, with Nulls placed on both sides of chunk boundaries, runs of Nulls that cross them,
+// a whole chunk of Nulls and a Null inside the seed of the restarted average. The results are compared with IirSequential
+// bar by bar: the Nulls must be identical and the values equal within float rounding. Exits with 1 on any mismatch.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "Kernels/Null.h"
+#include "Kernels/Averages.h"
+#include "Kernels/Parallel.h"
+#include "Kernels/RecursiveFilter.h"
+
+using namespace AmiBroker::Kernels;
+
+namespace
+{
+	// random walk around 100 with the Nulls of the test cases
+	std::vector<float> MakeSeries(int length)
+	{
+		std::vector<float> series(length);
+		std::mt19937 random(20240607);
+		std::normal_distribution<float> step(0.0f, 0.5f);
+		float price = 100.0f;
+		for (float& value : series)
+		{
+			price += step(random);
+			value = price;
+		}
+
+		const int Chunk = ParallelChunkLength;
+
+		// leading Nulls
+		std::fill(series.begin(), series.begin() + 25, Null);
+
+		// single Nulls on the last and the first bar of a chunk
+		series[1 * Chunk - 1] = Null;
+		series[3 * Chunk] = Null;
+
+		// a run of Nulls crossing a boundary, and a Null inside the seed of the restarted average
+		std::fill(series.begin() + 5 * Chunk - 3, series.begin() + 5 * Chunk + 4, Null);
+		series[5 * Chunk + 10] = Null;
+
+		// a whole chunk of Nulls
+		std::fill(series.begin() + 8 * Chunk, series.begin() + 9 * Chunk, Null);
+
+		// Nulls one bar before and after a boundary, so the chunk starts with a single valid bar
+		series[12 * Chunk - 1] = Null;
+		series[12 * Chunk + 1] = Null;
+
+		// Nulls at boundaries in the later part of the series
+		for (int boundary = 20 * Chunk; boundary < length; boundary += 7 * Chunk)
+			series[boundary] = Null;
+
+		// trailing Null
+		series[length - 1] = Null;
+		return series;
+	}
+
+	// Null where any of the averages is Null, otherwise the weighted sum (as Dema and Tema combine them)
+	std::vector<float> Combine(const std::vector<float>& e1, const std::vector<float>& e2, const std::vector<float>* e3, float w1, float w2, float w3)
+	{
+		std::vector<float> result(e1.size());
+		for (std::size_t i = 0; i < e1.size(); i++)
+		{
+			bool isNull = IsNull(e1[i]) || IsNull(e2[i]) || (e3 && IsNull((*e3)[i]));
+			float value = w1 * e1[i] + w2 * e2[i] + (e3 ? w3 * (*e3)[i] : 0.0f);
+			result[i] = NullIf(isNull, value);
+		}
+		return result;
+	}
+
+	std::vector<float> Sequential(const std::vector<float>& src, const IirCoefficients& coefficients, int seed)
+	{
+		std::vector<float> result(src.size());
+		IirSequential(src.data(), result.data(), (int)src.size(), coefficients, seed);
+		return result;
+	}
+
+	int failures = 0;
+
+	void Compare(const std::string& name, const std::vector<float>& actual, const std::vector<float>& expected, double tolerance)
+	{
+		int mismatches = 0;
+		int first = -1;
+		double maxError = 0.0;
+		for (std::size_t i = 0; i < expected.size(); i++)
+		{
+			bool ok;
+			if (IsNull(expected[i]) || IsNull(actual[i]))
+				ok = IsNull(expected[i]) && IsNull(actual[i]);
+			else
+			{
+				double error = std::fabs((double)actual[i] - expected[i]) / std::max(1.0, std::fabs((double)expected[i]));
+				maxError = std::max(maxError, error);
+				ok = error <= tolerance;
+			}
+
+			if (!ok && mismatches++ == 0)
+				first = (int)i;
+		}
+
+		if (mismatches == 0)
+			std::printf("ok    %-24s max relative error %.3g\n", name.c_str(), maxError);
+		else
+		{
+			std::printf("FAIL  %-24s %d mismatches, first at bar %d: %.9g instead of %.9g\n", name.c_str(), mismatches, first,
+				actual[first], expected[first]);
+			failures++;
+		}
+	}
+}
+
+int main()
+{
+	// the scan must give the same results whatever the number of threads, so run it on several even on one core
+	SetParallelism(4);
+
+	const int Length = 3 * ParallelMinimumLength + 12345;
+	// a float result of the double recurrence differs by a rounding of the output at most
+	const double Tolerance = 1e-6;
+
+	std::vector<float> series = MakeSeries(Length);
+	std::vector<float> result(Length);
+
+	for (int period : { 2, 14, 200 })
+	{
+		std::string suffix = "(" + std::to_string(period) + ")";
+
+		std::vector<float> ema = Sequential(series, EmaCoefficients(period), period);
+		std::vector<float> wilders = Sequential(series, WildersCoefficients(period), period);
+		std::vector<float> smoother = Sequential(series, SuperSmootherCoefficients(period), 1);
+
+		Iir(series.data(), result.data(), Length, EmaCoefficients(period), period);
+		Compare("Iir EMA" + suffix, result, ema, Tolerance);
+
+		Iir(series.data(), result.data(), Length, SuperSmootherCoefficients(period), 1);
+		Compare("SuperSmoother" + suffix, result, smoother, Tolerance);
+
+		Ema(series.data(), result.data(), Length, period);
+		Compare("Ema" + suffix, result, ema, Tolerance);
+
+		Wilders(series.data(), result.data(), Length, period);
+		Compare("Wilders" + suffix, result, wilders, Tolerance);
+
+		// the nested averages are filtered from the float results of the previous one, as Dema and Tema do
+		std::vector<float> ema2 = Sequential(ema, EmaCoefficients(period), period);
+		std::vector<float> ema3 = Sequential(ema2, EmaCoefficients(period), period);
+
+		// the combination magnifies the rounding of the averages
+		Dema(series.data(), result.data(), Length, period);
+		Compare("Dema" + suffix, result, Combine(ema, ema2, nullptr, 2.0f, -1.0f, 0.0f), 10 * Tolerance);
+
+		Tema(series.data(), result.data(), Length, period);
+		Compare("Tema" + suffix, result, Combine(ema, ema2, &ema3, 3.0f, -3.0f, 1.0f), 10 * Tolerance);
+	}
+
+	return failures == 0 ? 0 : 1;
+}